@@ -46,7 +46,7 @@ if(Llvm_CONFIG_EXECUTABLE)
         set(Llvm_REQUEST_STRING "")
         if(Llvm_FIND_COMPONENTS)
             foreach(component ${Llvm_FIND_COMPONENTS})
-                set(Llvm_REQUEST_STRING "${LLVM_REQUEST_STRING} ${component}")
+                set(Llvm_REQUEST_STRING "${Llvm_REQUEST_STRING} ${component}")
             endforeach()
         endif()
         exec_program(${Llvm_CONFIG_EXECUTABLE} ARGS "--ldflags" OUTPUT_VARIABLE Llvm_LD_FLAGS_1)
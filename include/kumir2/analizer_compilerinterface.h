@@ -4,6 +4,7 @@
 #include <kumir2-libs/dataformats/ast.h>
 #include <QString>
 #include <QList>
+#include <QStringList>
 
 #include <string>
 
@@ -17,6 +18,9 @@ enum RunTarget {
 class ASTCompilerInterface {
 public:
     virtual const AST::DataPtr abstractSyntaxTree() const = 0;
+
+    /** Absolute names of files included into source text */
+    inline virtual QStringList includedFiles() const { return QStringList(); }
 };
 
 class ExternalExecutableCompilerInterface
@@ -1,12 +1,16 @@
 #pragma once
 
-#include "../VK/vk.h"
+#include <atomic>
+#include <string>
 
-typedef void (*NewUserEventsCallback)(VkApi*, Json::Value);
-typedef void (*NewBotEventsCallback)(VkApi*, Json::Value);
+#include "../api.h"
 
+typedef void (*NewUserEventsCallback)(Api*, Json::Value);
+typedef void (*NewBotEventsCallback)(Api*, Json::Value);
+
+// Long poll session of user or community. All state of the session is
+// kept by the object, so several sessions can run in different threads
 class LongPoll {
-	VkApi* api;
 public:
 
 	static const int getAttachmets = (1 << 1);
@@ -27,11 +31,32 @@ public:
 		NewBotEventsCallback botCallback;
 	};
 
-	LongPoll(VkApi* api) {
-		this->api = api;
-	}
+	explicit LongPoll(Api api) noexcept;
+
+	// Requests long poll server, key and initial position of events
+	bool Connect(const LongPollSettings& settings) noexcept;
+
+	// Waits for next events at most settings.time seconds. Returns false
+	// when stopped or on error, which is described by LastError
+	bool Poll(Json::Value& updates) noexcept;
 
+	const std::string& LastError() const noexcept { return error; }
+
+	// Runs Connect and Poll loop calling callback of settings on each
+	// portion of events, until stopLongPolling is called
 	void startLongPolling(LongPollSettings& settings) noexcept;
+
+	// Can be called from any thread, pending request is aborted
 	void stopLongPolling() noexcept;
 
-};
\ No newline at end of file
+private:
+	std::string MakeRequestUrl() const;
+
+	Api api;
+	LongPollSettings settings;
+	std::string server;
+	std::string key;
+	std::string ts;
+	std::string error;
+	std::atomic<bool> stopped;
+};
@@ -1,21 +1,72 @@
 #include "api.h"
+#include "connectionpool.h"
 
 #include <curl/curl.h>
+#include <stdio.h>
 
-std::string apiBaseAddress;
-std::string apiRequestAddress;
-Request apiBaseRequest;
+static const long RequestTimeout = 30;
+static const long ConnectTimeout = 10;
 
-//Api::Api() noexcept
-//{
-//
-//}
+struct Api::State {
+	std::string baseAddress;
+	std::string requestAddress;
+	Request baseRequest;
+	// Base request is the same for all calls, so it is encoded once
+	std::string encodedBaseRequest;
+	ConnectionPool pool;
+};
 
-void Api::Init(std::string baseAddress, std::string requestAddress, Request baseRequest) noexcept
+static void appendEscaped(std::string& out, const std::string& value)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	for (unsigned char c : value) {
+		if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+			c == '-' || c == '.' || c == '_' || c == '~') {
+			out.push_back(char(c));
+		}
+		else {
+			out.push_back('%');
+			out.push_back(hex[c >> 4]);
+			out.push_back(hex[c & 0x0F]);
+		}
+	}
+}
+
+static size_t escapedSize(const Request& request)
+{
+	size_t result = 0;
+	for (const Parameter& param : request)
+		result += param.first.size() + 3 * param.second.size() + 2;
+	return result;
+}
+
+static void appendRequest(std::string& out, const Request& request)
 {
-	apiBaseAddress = baseAddress;
-	apiRequestAddress = requestAddress;
-	apiBaseRequest = baseRequest;
+	for (const Parameter& param : request) {
+		if (!out.empty())
+			out.push_back('&');
+		out.append(param.first);
+		out.push_back('=');
+		appendEscaped(out, param.second);
+	}
+}
+
+static Json::Value errorValue(const std::string& text)
+{
+	Json::Value result;
+	result["error"] = text;
+	return result;
+}
+
+static Json::Value parse(const std::string& text)
+{
+	Json::CharReaderBuilder builder;
+	std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+	Json::Value result;
+	std::string errors;
+	if (!reader->parse(text.data(), text.data() + text.size(), &result, &errors))
+		return errorValue("invalid response: " + errors);
+	return result;
 }
 
 static size_t writer(char* data, size_t size, size_t nmemb, std::string* buffer) {
@@ -26,71 +77,111 @@ static size_t writer(char* data, size_t size, size_t nmemb, std::string* buffer)
 	return 0;
 }
 
-Json::Value Api::SendRequest(std::string method, Request requestBody) noexcept
+static int progress(void* cancel, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
 {
-	CURL* curl = curl_easy_init();
-	std::stringstream stream;
-	std::string request;
-	for (int i = 0; i < apiBaseRequest.size(); i++) {
-		Parameter param = apiBaseRequest[i];
-		request.append(param.first);
-		request.append("=");
-		request.append(param.second);
-		request.append(i != apiBaseRequest.size() - 1 ? "&" : "");
+	return static_cast<const std::atomic<bool>*>(cancel)->load() ? 1 : 0;
+}
+
+static Json::Value perform(ConnectionPool& pool, const std::string& url, const std::string* body,
+	long timeout, const std::atomic<bool>* cancel) noexcept
+{
+	PooledConnection connection(pool);
+	CURL* curl = connection.get();
+	if (!curl)
+		return errorValue("curl error");
+
+	std::string response;
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, "CPP API LIB/1.0");
+	curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeout);
+	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, ConnectTimeout);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writer);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
+	if (body) {
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, body->c_str());
+		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, long(body->size()));
 	}
-	for (int i = 0; i < requestBody.size(); i++) {
-		Parameter param = requestBody[i];
-		char* encoded = curl_easy_escape(curl, param.second.c_str(), 0);
-		if (encoded) {
-			request.append("&");
-			request.append(param.first);
-			request.append("=");
-			request.append(encoded);
-			curl_free(encoded);
-		}
+	if (cancel) {
+		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, progress);
+		curl_easy_setopt(curl, CURLOPT_XFERINFODATA, const_cast<std::atomic<bool>*>(cancel));
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
 	}
+
+	const CURLcode res = curl_easy_perform(curl);
+	if (res != CURLE_OK) {
+		if (res != CURLE_ABORTED_BY_CALLBACK)
+			fprintf(stderr, "url: %s\ncurl failed: %s\n", url.c_str(), curl_easy_strerror(res));
+		return errorValue(curl_easy_strerror(res));
+	}
+	return parse(response);
+}
+
+Api::Api() noexcept
+	: state(std::make_shared<State>())
+{
+}
+
+void Api::Init(std::string baseAddress, std::string requestAddress, Request baseRequest) noexcept
+{
+	state->baseAddress = baseAddress;
+	state->requestAddress = requestAddress;
+	state->baseRequest = baseRequest;
+	state->encodedBaseRequest.clear();
+	appendRequest(state->encodedBaseRequest, baseRequest);
+}
+
+Json::Value Api::SendRequest(std::string method, Request requestBody) noexcept
+{
+	// Parameters are sent as form body, so long texts are not
+	// limited by maximum length of URL
 	std::string url;
-	url.append(apiBaseAddress);
-	url.append(apiRequestAddress);
+	url.reserve(state->baseAddress.size() + state->requestAddress.size() + method.size());
+	url.append(state->baseAddress);
+	url.append(state->requestAddress);
 	url.append(method);
-	url.append("?");
-	url.append(request);
-
-
-	if (curl) {
-		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-		curl_easy_setopt(curl, CURLOPT_USERAGENT, "CPP API LIB/1.0");
-
-		std::string response;
-		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writer);
-		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response);
-
-		auto res = curl_easy_perform(curl);
-		if (res != CURLE_OK)
-			fprintf(stderr, "base address: %s\nmethod: %s\nrequest:%s\nurl: %s\ncurl failed: %s\n",
-				apiBaseAddress.c_str(),
-				method.c_str(),
-				request.c_str(),
-				url.c_str(),
-				curl_easy_strerror(res));
-		curl_easy_cleanup(curl);
-		curl = NULL;
-
-		Json::Value responseJson;
-		stream << response.c_str();
-		stream >> responseJson;
-
-		return responseJson;
+
+	std::string body;
+	body.reserve(state->encodedBaseRequest.size() + escapedSize(requestBody));
+	body.append(state->encodedBaseRequest);
+	appendRequest(body, requestBody);
+
+	return perform(state->pool, url, &body, RequestTimeout, nullptr);
+}
+
+Json::Value Api::SendBatch(const std::vector<Call>& calls) noexcept
+{
+	// VKScript: return [API.method1({...}), API.method2({...}), ...];
+	std::string code = "return [";
+	for (size_t i = 0; i < calls.size(); i++) {
+		if (i > 0)
+			code.append(",");
+		code.append("API.");
+		code.append(calls[i].first);
+		code.append("({");
+		const Request& request = calls[i].second;
+		for (size_t j = 0; j < request.size(); j++) {
+			if (j > 0)
+				code.append(",");
+			code.append(Json::valueToQuotedString(request[j].first.c_str()));
+			code.append(":");
+			code.append(Json::valueToQuotedString(request[j].second.c_str()));
+		}
+		code.append("})");
 	}
-	std::string error{ "{\"error\":\"curl error\"}" };
-	Json::Value errorResp;
-	stream << error;
-	stream >> errorResp;
-	return errorResp;
+	code.append("];");
+	return SendRequest("execute", { { "code", code } });
+}
+
+Json::Value Api::Get(const std::string& url, long timeout, const std::atomic<bool>* cancel) noexcept
+{
+	return perform(state->pool, url, nullptr, timeout, cancel);
 }
 
 Api Api::copy() noexcept {
-	Api copied{};
-	copied.Init(apiBaseAddress, apiRequestAddress, apiBaseRequest);
+	Api copied;
+	copied.state = state;
 	return copied;
 }
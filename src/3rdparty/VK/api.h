@@ -1,7 +1,8 @@
 #pragma once
 
-#include <Windows.h>
 #include <stddef.h>
+#include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -9,11 +10,30 @@
 
 typedef std::pair<std::string, std::string> Parameter;
 typedef std::vector<Parameter> Request;
+typedef std::pair<std::string, Request> Call;
 
+// Copies of Api share address, base parameters and connections,
+// so Init of one copy affects all of them
 class Api {
 public:
-	//Api() noexcept;	
+	Api() noexcept;
 	void Init(std::string, std::string, Request) noexcept;
 	Json::Value SendRequest(std::string, Request) noexcept;
+
+	// Performs several calls by one "execute" request. Result has the same
+	// form as of SendRequest, its "response" is an array of call results,
+	// failed calls give false and are described by "execute_errors"
+	Json::Value SendBatch(const std::vector<Call>& calls) noexcept;
+
+	// GET request to absolute url, used by long polling. The transfer
+	// is aborted within a second after cancel becomes true
+	Json::Value Get(const std::string& url, long timeout, const std::atomic<bool>* cancel = nullptr) noexcept;
+
 	Api copy() noexcept;
-};
\ No newline at end of file
+
+	static const size_t MaxBatchSize = 25;
+
+private:
+	struct State;
+	std::shared_ptr<State> state;
+};
@@ -0,0 +1,45 @@
+#include "connectionpool.h"
+
+static std::once_flag curlInitialized;
+
+ConnectionPool::ConnectionPool(size_t maxIdle) noexcept
+	: maxIdle(maxIdle)
+{
+	// curl_global_init is not thread-safe, so it is called before
+	// any handle is created by any thread
+	std::call_once(curlInitialized, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+}
+
+ConnectionPool::~ConnectionPool() noexcept
+{
+	for (CURL* handle : idle)
+		curl_easy_cleanup(handle);
+}
+
+CURL* ConnectionPool::Acquire() noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!idle.empty()) {
+			CURL* handle = idle.back();
+			idle.pop_back();
+			return handle;
+		}
+	}
+	return curl_easy_init();
+}
+
+void ConnectionPool::Release(CURL* handle) noexcept
+{
+	// Reset drops options of the previous request, but keeps
+	// live connections, DNS and TLS session caches of the handle
+	curl_easy_reset(handle);
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (idle.size() < maxIdle) {
+			idle.push_back(handle);
+			return;
+		}
+	}
+	curl_easy_cleanup(handle);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <mutex>
+#include <vector>
+
+#include <curl/curl.h>
+
+// Keeps idle curl handles between requests. Each handle keeps its own cache
+// of open connections, so a request taking a pooled handle reuses a
+// keep-alive connection to the same host instead of making a new TCP and
+// TLS handshake. Handles are thread-safe to acquire and release, a single
+// handle is used by one request at a time.
+class ConnectionPool {
+public:
+	explicit ConnectionPool(size_t maxIdle = 4) noexcept;
+	~ConnectionPool() noexcept;
+
+	CURL* Acquire() noexcept;
+	void Release(CURL* handle) noexcept;
+
+private:
+	ConnectionPool(const ConnectionPool&) = delete;
+	ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+	std::mutex mutex;
+	std::vector<CURL*> idle;
+	size_t maxIdle;
+};
+
+// Returns the handle to the pool when goes out of scope
+class PooledConnection {
+public:
+	explicit PooledConnection(ConnectionPool& pool) noexcept
+		: pool(pool), handle(pool.Acquire()) {}
+	~PooledConnection() noexcept {
+		if (handle)
+			pool.Release(handle);
+	}
+	CURL* get() const noexcept { return handle; }
+
+private:
+	PooledConnection(const PooledConnection&) = delete;
+	PooledConnection& operator=(const PooledConnection&) = delete;
+
+	ConnectionPool& pool;
+	CURL* handle;
+};
@@ -0,0 +1,218 @@
+#include "longpollthread.h"
+
+namespace ActorVK {
+
+// Server holds long poll request up to this number of seconds
+static const int LONG_POLL_WAIT = 25;
+
+// Limit of messages.getById
+static const int MESSAGES_BY_ID_LIMIT = 100;
+
+// Codes and flags of user long poll events, see EventType.h and Message.h
+static const int EVENT_NEW_MESSAGE = 4;
+static const int FLAG_OUTBOX = 1 << 1;
+
+static const Json::Value NullValue;
+
+const Json::Value & jsonMember(const Json::Value & value, const char * name)
+{
+    return value.isObject() && value.isMember(name) ? value[name] : NullValue;
+}
+
+const Json::Value & jsonElement(const Json::Value & value, Json::ArrayIndex index)
+{
+    return value.isArray() && index < value.size() ? value[index] : NullValue;
+}
+
+qint64 jsonInt(const Json::Value & value)
+{
+    return value.isInt64() ? value.asInt64() : 0;
+}
+
+static QString fromUtf8(const Json::Value & value)
+{
+    return value.isString() ? QString::fromUtf8(value.asString().c_str()) : QString();
+}
+
+Message messageFromJson(const Json::Value & value)
+{
+    Message result = Message();
+    result.id = int(jsonInt(jsonMember(value, "id")));
+    result.date = int(jsonInt(jsonMember(value, "date")));
+    result.peerId = int(jsonInt(jsonMember(value, "peer_id")));
+    result.fromId = int(jsonInt(jsonMember(value, "from_id")));
+    result.text = fromUtf8(jsonMember(value, "text"));
+    result.randomId = int(jsonInt(jsonMember(value, "random_id")));
+    result.ref = fromUtf8(jsonMember(value, "ref"));
+    result.refSource = fromUtf8(jsonMember(value, "ref_source"));
+    const Json::Value & important = jsonMember(value, "important");
+    result.important = important.isBool() ? important.asBool() : jsonInt(important) != 0;
+    result.payload = fromUtf8(jsonMember(value, "payload"));
+    result.updateTime = int(jsonInt(jsonMember(value, "update_time")));
+    const Json::Value & attachments = jsonMember(value, "attachments");
+    for (Json::ArrayIndex i=0; attachments.isArray() && i<attachments.size(); i++) {
+        const Json::Value & type = jsonMember(attachments[i], "type");
+        if (!type.isString())
+            continue;
+        const Json::Value & media = jsonMember(attachments[i], type.asCString());
+        Attachment attachment = Attachment();
+        attachment.ownerId = int(jsonInt(jsonMember(media, "owner_id")));
+        attachment.id = int(jsonInt(jsonMember(media, "id")));
+        attachment.accessKey = fromUtf8(jsonMember(media, "access_key"));
+        result.attachments.push_back(attachment);
+    }
+    return result;
+}
+
+// User long poll event: [4, id, flags, peer_id, timestamp, text, extra, ...]
+static Message messageFromUpdate(const Json::Value & update)
+{
+    Message result = Message();
+    result.id = int(jsonInt(jsonElement(update, 1)));
+    result.peerId = int(jsonInt(jsonElement(update, 3)));
+    result.fromId = result.peerId;
+    result.date = int(jsonInt(jsonElement(update, 4)));
+    result.text = fromUtf8(jsonElement(update, 5));
+    const Json::Value & from = jsonMember(jsonElement(update, 6), "from");
+    if (from.isString())
+        result.fromId = fromUtf8(from).toInt();
+    return result;
+}
+
+QString errorTextFromJson(const Json::Value & value)
+{
+    const Json::Value & error = jsonMember(value, "error");
+    if (error.isObject())
+        return fromUtf8(jsonMember(error, "error_msg"));
+    if (error.isString())
+        return fromUtf8(error);
+    return QString::fromUtf8("неверный ответ сервера");
+}
+
+LongPollThread::LongPollThread(QObject * parent)
+    : QThread(parent)
+    , settings_()
+{
+}
+
+LongPollThread::~LongPollThread()
+{
+    stopPolling();
+}
+
+void LongPollThread::startPolling(const Api & api, bool isGroup, qint64 groupId)
+{
+    if (isRunning())
+        return;
+    api_ = api;
+    longPoll_.reset(new LongPoll(api));
+    settings_ = LongPoll::LongPollSettings();
+    settings_.time = LONG_POLL_WAIT;
+    settings_.isGroup = isGroup;
+    settings_.groupId = long(groupId);
+    settings_.mode = LongPoll::getAttachmets;
+    settings_.work = true;
+    setErrorText(QString());
+    start();
+}
+
+void LongPollThread::stopPolling()
+{
+    if (longPoll_)
+        longPoll_->stopLongPolling();
+    wait();
+}
+
+QString LongPollThread::errorText() const
+{
+    QMutexLocker locker(&errorMutex_);
+    return error_;
+}
+
+void LongPollThread::setErrorText(const QString &text)
+{
+    QMutexLocker locker(&errorMutex_);
+    error_ = text;
+}
+
+void LongPollThread::run()
+{
+    if (!longPoll_->Connect(settings_)) {
+        setErrorText(QString::fromUtf8(longPoll_->LastError().c_str()));
+        return;
+    }
+    Json::Value updates;
+    while (longPoll_->Poll(updates)) {
+        if (settings_.isGroup)
+            enqueueGroupMessages(updates);
+        else
+            enqueueUserMessages(updates);
+    }
+    setErrorText(QString::fromUtf8(longPoll_->LastError().c_str()));
+}
+
+void LongPollThread::enqueueGroupMessages(const Json::Value & updates)
+{
+    for (Json::ArrayIndex i=0; i<updates.size(); i++) {
+        const Json::Value & type = jsonMember(updates[i], "type");
+        if (!type.isString() || type.asString() != "message_new")
+            continue;
+        // Since API 5.103 the message is wrapped together with client info
+        const Json::Value & object = jsonMember(updates[i], "object");
+        const Json::Value & message = jsonMember(object, "message");
+        messages_.enqueue(messageFromJson(message.isObject() ? message : object));
+    }
+}
+
+void LongPollThread::enqueueUserMessages(const Json::Value & updates)
+{
+    // User long poll gives only short form of messages, complete ones
+    // are requested for all new messages of the portion at once
+    QList<Message> received;
+    std::vector<Call> calls;
+    std::string ids;
+    for (Json::ArrayIndex i=0; i<updates.size(); i++) {
+        const Json::Value & update = updates[i];
+        if (jsonInt(jsonElement(update, 0)) != EVENT_NEW_MESSAGE
+                || (jsonInt(jsonElement(update, 2)) & FLAG_OUTBOX))
+            continue;
+        received.push_back(messageFromUpdate(update));
+        if (!ids.empty())
+            ids.push_back(',');
+        ids.append(std::to_string(received.last().id));
+        if (received.size() % MESSAGES_BY_ID_LIMIT == 0) {
+            calls.push_back(Call("messages.getById", { { "message_ids", ids } }));
+            ids.clear();
+        }
+    }
+    if (!ids.empty())
+        calls.push_back(Call("messages.getById", { { "message_ids", ids } }));
+
+    QHash<int, Message> complete;
+    for (size_t first=0; first<calls.size(); first+=Api::MaxBatchSize) {
+        const size_t last = qMin(first + Api::MaxBatchSize, calls.size());
+        const std::vector<Call> batch(calls.begin() + first, calls.begin() + last);
+        const Json::Value result = batch.size() == 1
+                ? api_.SendRequest(batch[0].first, batch[0].second)
+                : api_.SendBatch(batch);
+        Json::Value responses = jsonMember(result, "response");
+        if (batch.size() == 1) {
+            responses = Json::Value(Json::arrayValue);
+            responses.append(jsonMember(result, "response"));
+        }
+        // Failed calls of a batch come back as false instead of object
+        for (Json::ArrayIndex r=0; responses.isArray() && r<responses.size(); r++) {
+            const Json::Value & items = jsonMember(responses[r], "items");
+            for (Json::ArrayIndex j=0; items.isArray() && j<items.size(); j++) {
+                const Message message = messageFromJson(items[j]);
+                complete[message.id] = message;
+            }
+        }
+    }
+    // Short forms are used for messages which could not be requested
+    foreach (const Message & message, received) {
+        messages_.enqueue(complete.value(message.id, message));
+    }
+}
+
+} // namespace ActorVK
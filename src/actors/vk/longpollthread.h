@@ -0,0 +1,68 @@
+#ifndef LONGPOLLTHREAD_H
+#define LONGPOLLTHREAD_H
+
+// Base class include for Message type
+#include "vkmodulebase.h"
+
+// VK library includes
+#include <3rdparty/VK/api.h>
+#include <3rdparty/VK/LongPoll/LongPoll.h>
+
+// Qt includes
+#include <QtCore>
+
+// Kumir includes
+#include <kumir2-libs/utils/lockedqueue.hpp>
+
+#include <memory>
+
+namespace ActorVK {
+
+/* Receives incoming messages by long polling in its own thread.
+
+   Messages are converted to Kumir values by this thread and put into
+   queue, so the actor methods only check and drain the queue and never
+   wait for network. Long poll request is aborted on stop, so stopping
+   does not wait for the server timeout */
+class LongPollThread
+    : public QThread
+{
+    Q_OBJECT
+public:
+    explicit LongPollThread(QObject * parent = 0);
+    ~LongPollThread();
+
+    void startPolling(const Api & api, bool isGroup, qint64 groupId);
+    void stopPolling();
+
+    inline kumir2::LockedQueue<Message> & messages() { return messages_; }
+    QString errorText() const;
+
+protected:
+    void run();
+
+private:
+    void enqueueGroupMessages(const Json::Value & updates);
+    void enqueueUserMessages(const Json::Value & updates);
+    void setErrorText(const QString & text);
+
+    Api api_;
+    std::unique_ptr<LongPoll> longPoll_;
+    LongPoll::LongPollSettings settings_;
+    kumir2::LockedQueue<Message> messages_;
+    mutable QMutex errorMutex_;
+    QString error_;
+};
+
+// Conversions used by both the thread and the actor. Server replies are
+// read only through these: jsoncpp throws on subscripts and conversions
+// of values having other type, and missing or mistyped parts are null
+const Json::Value & jsonMember(const Json::Value & value, const char * name);
+const Json::Value & jsonElement(const Json::Value & value, Json::ArrayIndex index);
+qint64 jsonInt(const Json::Value & value);
+Message messageFromJson(const Json::Value & value);
+QString errorTextFromJson(const Json::Value & value);
+
+} // namespace ActorVK
+
+#endif // LONGPOLLTHREAD_H
@@ -20,19 +20,50 @@ You should change it corresponding to functionality.
 #   include <QtGui>
 #endif
 
+// STL includes
+#include <random>
+
 namespace ActorVK {
 
+static const char * DEFAULT_API_ADDRESS = "https://api.vk.com";
+static const char * API_VERSION = "5.103";
+
 VKModule::VKModule(ExtensionSystem::KPlugin * parent)
     : VKModuleBase(parent)
+    , apiAddress_(QString::fromLatin1(DEFAULT_API_ADDRESS))
+    , authorized_(false)
+    , isGroup_(false)
+    , ownerId_(0)
+    , longPoll_(new LongPollThread(this))
 {
-    // Module constructor, called once on plugin load
-    // TODO implement me
+}
+
+VKModule::~VKModule()
+{
+    longPoll_->stopPolling();
 }
 
 /* public static */ QList<ExtensionSystem::CommandLineParameter> VKModule::acceptableCommandLineParameters()
 {
     // See "src/shared/extensionsystem/commandlineparameter.h" for constructor details
-    return QList<ExtensionSystem::CommandLineParameter>();
+    QList<ExtensionSystem::CommandLineParameter> params;
+    params.append(
+        ExtensionSystem::CommandLineParameter(
+            false, 'A', "vkapi", tr("VK API server address, for testing with local server"),
+            QVariant::String, false
+        )
+    );
+    return params;
+}
+
+QString VKModule::initialize(const QStringList & configurationParameters,
+                             const ExtensionSystem::CommandLine & runtimeParameters)
+{
+    Q_UNUSED(configurationParameters);
+    if (runtimeParameters.value("vkapi").isValid()) {
+        apiAddress_ = runtimeParameters.value("vkapi").toString();
+    }
+    return "";
 }
 
 /* public slot */ void VKModule::changeGlobalState(ExtensionSystem::GlobalState old, ExtensionSystem::GlobalState current)
@@ -79,7 +110,13 @@ VKModule::VKModule(ExtensionSystem::KPlugin * parent)
 /* public slot */ void VKModule::reset()
 {
     // Resets module to initial state before program execution
-    // TODO implement me
+    longPoll_->stopPolling();
+    while (!longPoll_->messages().empty()) {
+        longPoll_->messages().dequeue();
+    }
+    authorized_ = false;
+    isGroup_ = false;
+    ownerId_ = 0;
 }
 
 
@@ -88,52 +125,126 @@ VKModule::VKModule(ExtensionSystem::KPlugin * parent)
 {
     // Called on program interrupt to ask long-running module's methods
     // to stop working
-    // TODO implement me
+    longPoll_->stopPolling();
+}
+
+bool VKModule::checkAuthorized()
+{
+    if (!authorized_) {
+        setError(QString::fromUtf8("Не выполнена авторизация"));
+    }
+    return authorized_;
+}
+
+bool VKModule::checkLongPollError()
+{
+    const QString error = longPoll_->errorText();
+    if (!error.isEmpty()) {
+        setError(QString::fromUtf8("Ошибка получения сообщений: %1").arg(error));
+    }
+    return error.isEmpty();
 }
 
 /* public slot */ void VKModule::runAuthorize(const QString& token)
 {
     /* алг авторизация(лит token) */
-    // TODO implement me
-    Q_UNUSED(token)  // Remove this line on implementation;
-    
+    longPoll_->stopPolling();
+    authorized_ = false;
+    api_.Init(apiAddress_.toUtf8().constData(), "/method/", {
+                  { "v", API_VERSION },
+                  { "access_token", token.toUtf8().constData() }
+              });
+    // Both community and user tokens are accepted. Kind of the token is
+    // found by one request: groups.getById succeeds for community only
+    const Json::Value result = api_.SendBatch({
+        Call("groups.getById", Request()),
+        Call("users.get", Request())
+    });
+    const Json::Value & response = jsonMember(result, "response");
+    if (!response.isArray()) {
+        setError(QString::fromUtf8("Ошибка авторизации: %1").arg(errorTextFromJson(result)));
+        return;
+    }
+    const Json::Value & group = jsonElement(jsonElement(response, 0), 0);
+    const Json::Value & user = jsonElement(jsonElement(response, 1), 0);
+    if (group.isObject()) {
+        isGroup_ = true;
+        ownerId_ = jsonInt(jsonMember(group, "id"));
+    }
+    else if (user.isObject()) {
+        isGroup_ = false;
+        ownerId_ = jsonInt(jsonMember(user, "id"));
+    }
+    else {
+        setError(QString::fromUtf8("Ошибка авторизации: неверный ключ доступа"));
+        return;
+    }
+    authorized_ = true;
 }
 
 /* public slot */ void VKModule::runSendMessage(const Message& message)
 {
     /* алг Отправить сообщение(сообщение message) */
-    // TODO implement me
-    Q_UNUSED(message)  // Remove this line on implementation;
-    
+    if (!checkAuthorized())
+        return;
+    // Server drops messages with the same random_id, so it must be
+    // unique for each message sent by the program. Ids made of time
+    // wrap within 31 bits and may repeat, so they are random
+    static QMutex randomMutex;
+    static std::mt19937 random((std::random_device())());
+    qint64 randomId = message.randomId;
+    if (randomId == 0) {
+        QMutexLocker locker(&randomMutex);
+        randomId = std::uniform_int_distribution<qint64>(1, 0x7FFFFFFF)(random);
+    }
+    Request request;
+    request.push_back(Parameter("peer_id", QByteArray::number(message.peerId).constData()));
+    request.push_back(Parameter("random_id", QByteArray::number(randomId).constData()));
+    request.push_back(Parameter("message", message.text.toUtf8().constData()));
+    if (!message.payload.isEmpty()) {
+        request.push_back(Parameter("payload", message.payload.toUtf8().constData()));
+    }
+    const Json::Value result = api_.SendRequest("messages.send", request);
+    if (jsonMember(result, "response").isNull()) {
+        setError(QString::fromUtf8("Сообщение не отправлено: %1").arg(errorTextFromJson(result)));
+    }
 }
 
 /* public slot */ void VKModule::runStartLongPolling()
 {
     /* алг Запустить прослушивание */
-    // TODO implement me
-    
+    if (!checkAuthorized())
+        return;
+    longPoll_->startPolling(api_, isGroup_, ownerId_);
 }
 
 /* public slot */ void VKModule::runStopLongPolling()
 {
     /* алг Остановить прослушивание */
-    // TODO implement me
-    
+    longPoll_->stopPolling();
 }
 
 /* public slot */ bool VKModule::runMessagesAvailable()
 {
     /* алг лог Есть сообщения */
-    // TODO implement me
+    if (!longPoll_->messages().empty())
+        return true;
+    checkLongPollError();
     return false;
-    
 }
 
-/* public slot */ void VKModule::runGetNewMessages(QVector< Messages >& messagesList)
+/* public slot */ void VKModule::runGetNewMessages(QVector< Message >& messagesList)
 {
-    /* алг Получить сообщения(рез messagesтаб messagesList[0:0]) */
-    
-    
+    /* алг Получить сообщения(рез сообщениетаб messagesList[0:0]) */
+    // Only this thread takes messages from the queue, so
+    // dequeue never blocks after queue is found not empty
+    messagesList.clear();
+    while (!longPoll_->messages().empty()) {
+        messagesList.push_back(longPoll_->messages().dequeue());
+    }
+    if (messagesList.isEmpty()) {
+        checkLongPollError();
+    }
 }
 
 
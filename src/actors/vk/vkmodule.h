@@ -11,6 +11,10 @@ You should change it corresponding to functionality.
 
 // Base class include
 #include "vkmodulebase.h"
+#include "longpollthread.h"
+
+// VK library includes
+#include <3rdparty/VK/api.h>
 
 // Kumir includes
 #include <kumir2-libs/extensionsystem/kplugin.h>
@@ -32,7 +36,10 @@ class VKModule
     Q_OBJECT
 public /* methods */:
     VKModule(ExtensionSystem::KPlugin * parent);
+    ~VKModule();
     static QList<ExtensionSystem::CommandLineParameter> acceptableCommandLineParameters();
+    QString initialize(const QStringList & configurationParameters,
+                       const ExtensionSystem::CommandLine & runtimeParameters);
 public Q_SLOTS:
     void changeGlobalState(ExtensionSystem::GlobalState old, ExtensionSystem::GlobalState current);
     void loadActorData(QIODevice * source);
@@ -44,14 +51,21 @@ public Q_SLOTS:
     void runStartLongPolling();
     void runStopLongPolling();
     bool runMessagesAvailable();
-    void runGetNewMessages(QVector< messages >& messagesList);
+    void runGetNewMessages(QVector< Message >& messagesList);
 
 
 
     /* ========= CLASS PRIVATE ========= */
-
-
-
+private:
+    bool checkAuthorized();
+    bool checkLongPollError();
+
+    QString apiAddress_;
+    Api api_;
+    bool authorized_;
+    bool isGroup_;
+    qint64 ownerId_;
+    LongPollThread * longPoll_;
 
 
 
@@ -0,0 +1,627 @@
+#include <QtCore> // include it before STL to avoid MSVC-specific errors
+#include <kumir2-libs/stdlib/kumirstdlib.hpp>
+
+#include "ast_optimizer.h"
+
+namespace AST {
+
+Optimizer::Optimizer(int passes)
+    : passes_(passes)
+    , hiddenVariablesCount_(0)
+{
+}
+
+DataPtr Optimizer::optimize(const DataPtr source, int passes)
+{
+    Optimizer optimizer(passes);
+    return optimizer.run(source);
+}
+
+bool Optimizer::isExternal(const ModulePtr &module)
+{
+    return module->header.type==ModTypeExternal ||
+            module->header.type==ModTypeCached;
+}
+
+DataPtr Optimizer::run(const DataPtr source)
+{
+    DataPtr result(new Data);
+    result->lastModified = source->lastModified;
+    QList<ModulePtr> userModules;
+
+    // Algorithms and variables are copied before any statement,
+    // so references between modules are resolved to copies too
+    Q_FOREACH(const ModulePtr & module, source->modules) {
+        if (isExternal(module)) {
+            if (module->builtInID == 0xF0) {
+                Q_FOREACH(const AlgorithmPtr & algorithm, module->header.algorhitms) {
+                    if (algorithm->header.name == QString::fromUtf8("длин"))
+                        stringLength_ = algorithm;
+                }
+            }
+            result->modules << module;
+            continue;
+        }
+        ModulePtr copy(new Module(*module));
+        for (int i=0; i<copy->impl.algorhitms.size(); i++) {
+            const AlgorithmPtr algorithm = copy->impl.algorhitms[i];
+            const AlgorithmPtr algorithmCopy(new Algorithm(*algorithm));
+            algorithms_.insert(algorithm.data(), algorithmCopy);
+            copy->impl.algorhitms[i] = algorithmCopy;
+        }
+        result->modules << copy;
+        userModules << copy;
+    }
+
+    Q_FOREACH(const ModulePtr & module, userModules) {
+        QList<AlgorithmPtr> * headerLists[2] = { &module->header.algorhitms, &module->header.operators };
+        for (int l=0; l<2; l++) {
+            for (int i=0; i<headerLists[l]->size(); i++) {
+                const AlgorithmPtr algorithm = headerLists[l]->at(i);
+                (*headerLists[l])[i] = algorithms_.value(algorithm.data(), algorithm);
+            }
+        }
+        for (int i=0; i<module->impl.globals.size(); i++) {
+            module->impl.globals[i] = copyVariable(module->impl.globals[i]);
+        }
+        Q_FOREACH(const AlgorithmPtr & algorithm, module->impl.algorhitms) {
+            QList<VariablePtr> & locals = algorithm->impl.locals;
+            for (int i=0; i<locals.size(); i++) {
+                locals[i] = copyVariable(locals[i]);
+            }
+            QList<VariablePtr> & arguments = algorithm->header.arguments;
+            for (int i=0; i<arguments.size(); i++) {
+                arguments[i] = variables_.value(arguments[i].data(), arguments[i]);
+            }
+        }
+    }
+
+    Q_FOREACH(const ModulePtr & module, userModules) {
+        Q_FOREACH(const VariablePtr & variable, module->impl.globals) {
+            copyBounds(variable);
+        }
+        module->impl.initializerBody = copyStatements(module->impl.initializerBody);
+        Q_FOREACH(const AlgorithmPtr & algorithm, module->impl.algorhitms) {
+            Q_FOREACH(const VariablePtr & variable, algorithm->impl.locals) {
+                copyBounds(variable);
+            }
+            algorithm->impl.pre = copyStatements(algorithm->impl.pre);
+            algorithm->impl.body = copyStatements(algorithm->impl.body);
+            algorithm->impl.post = copyStatements(algorithm->impl.post);
+        }
+    }
+    updateCacheReferences();
+
+    Q_FOREACH(const ModulePtr & module, userModules) {
+        currentAlgorithm_.clear();
+        optimizeStatements(module->impl.initializerBody);
+        Q_FOREACH(const AlgorithmPtr & algorithm, module->impl.algorhitms) {
+            currentAlgorithm_ = algorithm;
+            optimizeStatements(algorithm->impl.pre);
+            optimizeStatements(algorithm->impl.body);
+            optimizeStatements(algorithm->impl.post);
+        }
+    }
+    return result;
+}
+
+VariablePtr Optimizer::copyVariable(const VariablePtr &source)
+{
+    const VariablePtr copy(new Variable(*source));
+    variables_.insert(source.data(), copy);
+    return copy;
+}
+
+void Optimizer::copyBounds(const VariablePtr &variable)
+{
+    for (int i=0; i<variable->bounds.size(); i++) {
+        variable->bounds[i].first = copyExpression(variable->bounds[i].first);
+        variable->bounds[i].second = copyExpression(variable->bounds[i].second);
+    }
+}
+
+ExpressionPtr Optimizer::copyExpression(const ExpressionPtr &source)
+{
+    if (!source)
+        return source;
+    // Subexpression might be shared by analizer, so it is shared in copy
+    const QHash<const Expression*, ExpressionPtr>::const_iterator it =
+            expressions_.constFind(source.data());
+    if (it!=expressions_.constEnd())
+        return it.value();
+    const ExpressionPtr copy(new Expression(*source));
+    expressions_.insert(source.data(), copy);
+    if (copy->variable)
+        copy->variable = variables_.value(copy->variable.data(), copy->variable);
+    if (copy->function)
+        copy->function = algorithms_.value(copy->function.data(), copy->function);
+    for (int i=0; i<copy->operands.size(); i++) {
+        copy->operands[i] = copyExpression(copy->operands[i]);
+    }
+    if (!copy->cacheReference.isNull())
+        cachedExpressionUsers_ << copy;
+    return copy;
+}
+
+StatementPtr Optimizer::copyStatement(const StatementPtr &source)
+{
+    const StatementPtr copy(new Statement(*source));
+    for (int i=0; i<copy->expressions.size(); i++) {
+        copy->expressions[i] = copyExpression(copy->expressions[i]);
+    }
+    for (int i=0; i<copy->variables.size(); i++) {
+        copy->variables[i] = variables_.value(copy->variables[i].data(), copy->variables[i]);
+    }
+    LoopSpec & loop = copy->loop;
+    if (loop.forVariable)
+        loop.forVariable = variables_.value(loop.forVariable.data(), loop.forVariable);
+    loop.fromValue = copyExpression(loop.fromValue);
+    loop.toValue = copyExpression(loop.toValue);
+    loop.stepValue = copyExpression(loop.stepValue);
+    loop.whileCondition = copyExpression(loop.whileCondition);
+    loop.timesValue = copyExpression(loop.timesValue);
+    loop.endCondition = copyExpression(loop.endCondition);
+    loop.body = copyStatements(loop.body);
+    for (int i=0; i<copy->conditionals.size(); i++) {
+        ConditionSpec & conditional = copy->conditionals[i];
+        conditional.condition = copyExpression(conditional.condition);
+        conditional.body = copyStatements(conditional.body);
+    }
+    return copy;
+}
+
+QList<StatementPtr> Optimizer::copyStatements(const QList<StatementPtr> &source)
+{
+    QList<StatementPtr> result;
+    result.reserve(source.size());
+    for (int i=0; i<source.size(); i++) {
+        result << copyStatement(source[i]);
+    }
+    return result;
+}
+
+void Optimizer::updateCacheReferences()
+{
+    Q_FOREACH(const ExpressionPtr & expression, cachedExpressionUsers_) {
+        const ExpressionPtr target = expressions_.value(expression->cacheReference.data());
+        if (target)
+            expression->cacheReference = target;
+    }
+}
+
+void Optimizer::optimizeStatements(QList<StatementPtr> &statements)
+{
+    for (int i=0; i<statements.size(); i++) {
+        optimizeStatement(statements[i]);
+        if (passes_ & HoistLoopInvariants) {
+            i += hoistLoopInvariants(statements, i);
+        }
+        if ((passes_ & RemoveDeadCode) && isTerminal(statements[i])) {
+            // Nothing after 'exit' or 'stop' is executed
+            while (statements.size() > i+1) {
+                statements.removeLast();
+            }
+            break;
+        }
+    }
+}
+
+void Optimizer::optimizeStatement(const StatementPtr &statement)
+{
+    if (passes_ & FoldConstants) {
+        Q_FOREACH(const ExpressionPtr & expression, statement->expressions) {
+            foldConstants(expression);
+        }
+        const LoopSpec & loop = statement->loop;
+        const ExpressionPtr loopExpressions[] = {
+            loop.fromValue, loop.toValue, loop.stepValue,
+            loop.whileCondition, loop.timesValue, loop.endCondition
+        };
+        for (size_t i=0; i<sizeof(loopExpressions)/sizeof(ExpressionPtr); i++) {
+            if (loopExpressions[i])
+                foldConstants(loopExpressions[i]);
+        }
+        for (int i=0; i<statement->conditionals.size(); i++) {
+            if (statement->conditionals[i].condition)
+                foldConstants(statement->conditionals[i].condition);
+        }
+    }
+
+    if ((passes_ & RemoveDeadCode) && !hasErrors(statement)) {
+        // Constant conditions are still calculated and shown on margin,
+        // only bodies which are never executed are removed
+        QList<ConditionSpec> & conditionals = statement->conditionals;
+        bool value = false;
+        if (statement->type==StIfThenElse && conditionals.size()>0 &&
+                isConstantCondition(conditionals[0].condition, value))
+        {
+            if (value && conditionals.size()>1)
+                conditionals.removeAt(1);
+            else if (!value)
+                conditionals[0].body.clear();
+        }
+        else if (statement->type==StSwitchCaseElse) {
+            for (int i=0; i<conditionals.size(); i++) {
+                if (!isConstantCondition(conditionals[i].condition, value))
+                    continue;
+                if (value) {
+                    while (conditionals.size() > i+1) {
+                        conditionals.removeLast();
+                    }
+                    break;
+                }
+                conditionals[i].body.clear();
+            }
+        }
+        else if (statement->type==StLoop && statement->loop.type==LoopWhile &&
+                 isConstantCondition(statement->loop.whileCondition, value) && !value)
+        {
+            statement->loop.body.clear();
+        }
+    }
+
+    optimizeStatements(statement->loop.body);
+    for (int i=0; i<statement->conditionals.size(); i++) {
+        optimizeStatements(statement->conditionals[i].body);
+    }
+}
+
+bool Optimizer::hasCacheFlags(const ExpressionPtr &expression)
+{
+    return expression->keepInCache || expression->useFromCache ||
+            expression->clearCacheOnFailure;
+}
+
+bool Optimizer::isConstant(const ExpressionPtr &expression)
+{
+    return expression->kind==ExprConst && expression->dimension==0 &&
+            expression->baseType.kind!=TypeUser && !hasCacheFlags(expression);
+}
+
+void Optimizer::foldConstants(const ExpressionPtr &expression)
+{
+    for (int i=0; i<expression->operands.size(); i++) {
+        foldConstants(expression->operands[i]);
+    }
+    // Cached values are used by compare chains, so such nodes are kept
+    if (expression->kind!=ExprSubexpression || hasCacheFlags(expression))
+        return;
+
+    const QList<ExpressionPtr> & operands = expression->operands;
+    const ExpressionOperator op = expression->operatorr;
+    if (operands.size()==2 && (op==OpAnd || op==OpOr) &&
+            isConstant(operands[0]) && operands[0]->baseType.kind==TypeBoolean &&
+            !hasCacheFlags(operands[1]))
+    {
+        // Right operand is not calculated if left one decides result
+        if (operands[0]->constant.toBool() == (op==OpOr)) {
+            const QVariant value = operands[0]->constant;
+            expression->kind = ExprConst;
+            expression->constant = value;
+            expression->operatorr = OpNone;
+            expression->operands.clear();
+        }
+        else {
+            const ExpressionPtr right = operands[1];
+            *expression = *right;
+        }
+        return;
+    }
+
+    for (int i=0; i<operands.size(); i++) {
+        if (!isConstant(operands[i]))
+            return;
+    }
+    QVariant value;
+    if (evaluate(expression, value)) {
+        expression->kind = ExprConst;
+        expression->constant = value;
+        expression->operatorr = OpNone;
+        expression->operands.clear();
+    }
+}
+
+bool Optimizer::evaluate(const ExpressionPtr &expression, QVariant &result)
+{
+    // Semantics are the same as of KumirVM operations; in case of
+    // integer or real overflow and division by zero expression is
+    // not folded, so error is raised at runtime as before
+    const QList<ExpressionPtr> & operands = expression->operands;
+    const ExpressionOperator op = expression->operatorr;
+    const VariableBaseType type = expression->baseType.kind;
+    if (expression->dimension>0 || operands.isEmpty() || operands.size()>2)
+        return false;
+
+    const VariableBaseType a = operands.first()->baseType.kind;
+    const QVariant & x = operands.first()->constant;
+    if (operands.size()==1) {
+        if (op==OpNot && a==TypeBoolean && type==TypeBoolean) {
+            result = QVariant(!x.toBool());
+            return true;
+        }
+        if (op==OpSubstract && a==TypeInteger && type==TypeInteger) {
+            int32_t value = 0;
+            if (!Kumir::Math::checkedDiff(0, x.toInt(), value))
+                return false;
+            result = QVariant(int(value));
+            return true;
+        }
+        if (op==OpSubstract && a==TypeReal && type==TypeReal) {
+            result = QVariant(0.0 - x.toDouble());
+            return true;
+        }
+        return false;
+    }
+
+    const VariableBaseType b = operands.last()->baseType.kind;
+    const QVariant & y = operands.last()->constant;
+    const bool integers = a==TypeInteger && b==TypeInteger;
+    const bool numbers = (a==TypeInteger || a==TypeReal) && (b==TypeInteger || b==TypeReal);
+    const bool texts = (a==TypeString || a==TypeCharect) && (b==TypeString || b==TypeCharect);
+    const bool comparison = op==OpEqual || op==OpNotEqual || op==OpLess ||
+            op==OpGreater || op==OpLessOrEqual || op==OpGreaterOrEqual;
+
+    if (numbers && comparison && type==TypeBoolean) {
+        const double l = integers ? double(x.toInt()) : x.toDouble();
+        const double r = integers ? double(y.toInt()) : y.toDouble();
+        bool value = false;
+        switch (op) {
+        case OpEqual:           value = l == r; break;
+        case OpNotEqual:        value = l != r; break;
+        case OpLess:            value = l <  r; break;
+        case OpGreater:         value = l >  r; break;
+        case OpLessOrEqual:     value = l <= r; break;
+        case OpGreaterOrEqual:  value = l >= r; break;
+        default: break;
+        }
+        result = QVariant(value);
+        return true;
+    }
+
+    if (integers && type==TypeInteger) {
+        int32_t value = 0;
+        bool correct = false;
+        switch (op) {
+        case OpSumm:        correct = Kumir::Math::checkedSumm(x.toInt(), y.toInt(), value); break;
+        case OpSubstract:   correct = Kumir::Math::checkedDiff(x.toInt(), y.toInt(), value); break;
+        case OpMultiply:    correct = Kumir::Math::checkedProd(x.toInt(), y.toInt(), value); break;
+        default: break;
+        }
+        if (correct)
+            result = QVariant(int(value));
+        return correct;
+    }
+
+    if (numbers && type==TypeReal) {
+        const double l = x.toDouble();
+        const double r = y.toDouble();
+        double value = 0.0;
+        switch (op) {
+        case OpSumm:        value = l + r; break;
+        case OpSubstract:   value = l - r; break;
+        case OpMultiply:    value = l * r; break;
+        case OpDivision:
+            if (r == 0.0)
+                return false;
+            value = l / r;
+            break;
+        default:
+            return false;
+        }
+        if (!Kumir::Math::isCorrectReal(value))
+            return false;
+        result = QVariant(value);
+        return true;
+    }
+
+    if (texts && op==OpSumm && type==TypeString) {
+        result = QVariant(x.toString() + y.toString());
+        return true;
+    }
+
+    if (a==b && (a==TypeBoolean || a==TypeCharect || a==TypeString) &&
+            (op==OpEqual || op==OpNotEqual) && type==TypeBoolean)
+    {
+        const bool equal = a==TypeBoolean
+                ? x.toBool() == y.toBool()
+                : x.toString() == y.toString();
+        result = QVariant(equal == (op==OpEqual));
+        return true;
+    }
+
+    return false;
+}
+
+bool Optimizer::isConstantCondition(const ExpressionPtr &condition, bool &value)
+{
+    if (!condition || !isConstant(condition) || condition->baseType.kind!=TypeBoolean)
+        return false;
+    value = condition->constant.toBool();
+    return true;
+}
+
+bool Optimizer::hasErrors(const StatementPtr &statement)
+{
+    if (!statement->error.isEmpty() || !statement->headerError.isEmpty() ||
+            !statement->beginBlockError.isEmpty() || !statement->endBlockError.isEmpty())
+        return true;
+    for (int i=0; i<statement->conditionals.size(); i++) {
+        if (!statement->conditionals[i].conditionError.isEmpty())
+            return true;
+    }
+    return false;
+}
+
+bool Optimizer::isTerminal(const StatementPtr &statement)
+{
+    return (statement->type==StBreak || statement->type==StHalt) &&
+            statement->error.isEmpty();
+}
+
+int Optimizer::hoistLoopInvariants(QList<StatementPtr> &statements, int loopIndex)
+{
+    const StatementPtr loop = statements[loopIndex];
+    if (!currentAlgorithm_ || !stringLength_ || loop->type!=StLoop ||
+            loop->loop.type!=LoopWhile || !loop->loop.whileCondition || hasErrors(loop))
+        return 0;
+    const ExpressionPtr condition = loop->loop.whileCondition;
+
+    // Calculation of length is moved before other parts of condition,
+    // so they must have no side effects
+    if (callsOtherFunctions(condition, stringLength_))
+        return 0;
+
+    QList<ExpressionPtr> calls;
+    findStringLengthCalls(condition, calls);
+    QHash<const Variable*, VariablePtr> lengths;
+    int inserted = 0;
+    Q_FOREACH(const ExpressionPtr & call, calls) {
+        if (!isHoistable(call))
+            continue;
+        const VariablePtr string = call->operands.first()->variable;
+        if (modifies(loop, string))
+            continue;
+        VariablePtr length = lengths.value(string.data());
+        if (!length) {
+            length = VariablePtr(new Variable);
+            length->name = QString::fromUtf8("@длин%1").arg(++hiddenVariablesCount_);
+            length->baseType.kind = TypeInteger;
+            currentAlgorithm_->impl.locals << length;
+            lengths.insert(string.data(), length);
+
+            const ExpressionPtr target(new Expression);
+            target->kind = ExprVariable;
+            target->baseType.kind = TypeInteger;
+            target->variable = length;
+            const StatementPtr assignment(new Statement);
+            assignment->type = StAssign;
+            assignment->parent = loop->parent;
+            // Length was calculated at loop header line before
+            assignment->lexems = loop->lexems;
+            assignment->expressions << ExpressionPtr(new Expression(*call)) << target;
+            statements.insert(loopIndex + inserted, assignment);
+            inserted ++;
+        }
+        call->kind = ExprVariable;
+        call->variable = length;
+        call->function.clear();
+        call->operands.clear();
+    }
+    return inserted;
+}
+
+void Optimizer::findStringLengthCalls(const ExpressionPtr &expression,
+                                      QList<ExpressionPtr> &calls) const
+{
+    if (expression->kind==ExprFunctionCall && expression->function==stringLength_) {
+        calls << expression;
+        return;
+    }
+    // Right operand of 'and' or 'or' might be never calculated
+    const bool shortCircuit = expression->kind==ExprSubexpression &&
+            (expression->operatorr==OpAnd || expression->operatorr==OpOr);
+    const int count = shortCircuit ? qMin(1, expression->operands.size())
+                                   : expression->operands.size();
+    for (int i=0; i<count; i++) {
+        findStringLengthCalls(expression->operands[i], calls);
+    }
+}
+
+bool Optimizer::isHoistable(const ExpressionPtr &call) const
+{
+    if (call->operands.size()!=1 || hasCacheFlags(call))
+        return false;
+    const ExpressionPtr & argument = call->operands.first();
+    const VariablePtr & variable = argument->variable;
+    // Regular locals only, so called algorithms can not change string
+    return argument->kind==ExprVariable && !hasCacheFlags(argument) &&
+            variable && variable->dimension==0 &&
+            variable->baseType.kind==TypeString &&
+            variable->accessType==AccessRegular &&
+            currentAlgorithm_->impl.locals.contains(variable);
+}
+
+bool Optimizer::callsOtherFunctions(const ExpressionPtr &expression,
+                                    const AlgorithmPtr &allowed)
+{
+    if (expression->kind==ExprFunctionCall && expression->function!=allowed)
+        return true;
+    for (int i=0; i<expression->operands.size(); i++) {
+        if (callsOtherFunctions(expression->operands[i], allowed))
+            return true;
+    }
+    return false;
+}
+
+bool Optimizer::modifies(const QList<StatementPtr> &statements,
+                         const VariablePtr &variable)
+{
+    for (int i=0; i<statements.size(); i++) {
+        if (modifies(statements[i], variable))
+            return true;
+    }
+    return false;
+}
+
+bool Optimizer::modifies(const StatementPtr &statement,
+                         const VariablePtr &variable)
+{
+    if (statement->type==StAssign && statement->expressions.size()>1 &&
+            statement->expressions[1]->variable==variable)
+        return true;
+    if (statement->type==StInput || statement->type==StVarInitialize) {
+        Q_FOREACH(const ExpressionPtr & expression, statement->expressions) {
+            if (expression->variable==variable)
+                return true;
+        }
+        if (statement->variables.contains(variable))
+            return true;
+    }
+    const LoopSpec & loop = statement->loop;
+    if (loop.forVariable==variable)
+        return true;
+    const ExpressionPtr loopExpressions[] = {
+        loop.fromValue, loop.toValue, loop.stepValue,
+        loop.whileCondition, loop.timesValue, loop.endCondition
+    };
+    for (size_t i=0; i<sizeof(loopExpressions)/sizeof(ExpressionPtr); i++) {
+        if (modifies(loopExpressions[i], variable))
+            return true;
+    }
+    Q_FOREACH(const ExpressionPtr & expression, statement->expressions) {
+        if (modifies(expression, variable))
+            return true;
+    }
+    if (modifies(loop.body, variable))
+        return true;
+    for (int i=0; i<statement->conditionals.size(); i++) {
+        if (modifies(statement->conditionals[i].condition, variable) ||
+                modifies(statement->conditionals[i].body, variable))
+            return true;
+    }
+    return false;
+}
+
+bool Optimizer::modifies(const ExpressionPtr &expression,
+                         const VariablePtr &variable)
+{
+    if (!expression)
+        return false;
+    if (expression->kind==ExprFunctionCall && expression->function) {
+        // Passed as 'res' or 'argres' argument
+        const QList<VariablePtr> & arguments = expression->function->header.arguments;
+        for (int i=0; i<expression->operands.size() && i<arguments.size(); i++) {
+            const VariableAccessType access = arguments[i]->accessType;
+            if ((access==AccessArgumentOut || access==AccessArgumentInOut) &&
+                    expression->operands[i]->variable==variable)
+                return true;
+        }
+    }
+    for (int i=0; i<expression->operands.size(); i++) {
+        if (modifies(expression->operands[i], variable))
+            return true;
+    }
+    return false;
+}
+
+}
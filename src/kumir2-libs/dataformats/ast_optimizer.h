@@ -0,0 +1,104 @@
+#ifndef AST_OPTIMIZER_H
+#define AST_OPTIMIZER_H
+
+#include "ast.h"
+#include "ast_module.h"
+#include "ast_algorhitm.h"
+#include "ast_statement.h"
+#include "ast_expression.h"
+#include "ast_variable.h"
+
+#include <QHash>
+#include <QList>
+#include <QVariant>
+
+#undef ABSTRACTSYNTAXTREE_EXPORT
+#ifdef DATAFORMATS_LIBRARY
+#define ABSTRACTSYNTAXTREE_EXPORT Q_DECL_EXPORT
+#else
+#define ABSTRACTSYNTAXTREE_EXPORT Q_DECL_IMPORT
+#endif
+
+namespace AST {
+
+/* Optimization of program tree made before code generation,
+   shared by all generators.
+
+   Analizer keeps its tree between analysis runs, so optimizer works
+   on a copy of user modules; external and cached modules are shared
+   with source tree. Transformations do not change observable
+   behaviour of program, including runtime errors: operations which
+   overflow or divide by zero are left to runtime. Statements keep
+   their lexems, so generated line information is the same for all
+   statements which might be executed */
+class ABSTRACTSYNTAXTREE_EXPORT Optimizer
+{
+public:
+    enum Pass {
+        /** Evaluate operations on constants */
+        FoldConstants       = 0x01,
+
+        /** Remove branches on constant conditions and
+          * statements following 'exit' or 'stop' */
+        RemoveDeadCode      = 0x02,
+
+        /** Calculate length of string, which is not modified by loop,
+          * once before 'while' loop instead of each condition check.
+          * Value is kept in hidden local variable, so this pass is
+          * not for programs run under debugger */
+        HoistLoopInvariants = 0x04,
+
+        AllPasses           = 0x07
+    };
+
+    /** Returns optimized copy of tree; source tree is not modified */
+    static DataPtr optimize(const DataPtr source, int passes = AllPasses);
+
+private:
+    explicit Optimizer(int passes);
+    DataPtr run(const DataPtr source);
+
+    static bool isExternal(const ModulePtr & module);
+    VariablePtr copyVariable(const VariablePtr & source);
+    void copyBounds(const VariablePtr & variable);
+    ExpressionPtr copyExpression(const ExpressionPtr & source);
+    StatementPtr copyStatement(const StatementPtr & source);
+    QList<StatementPtr> copyStatements(const QList<StatementPtr> & source);
+    void updateCacheReferences();
+
+    void optimizeStatements(QList<StatementPtr> & statements);
+    void optimizeStatement(const StatementPtr & statement);
+    void foldConstants(const ExpressionPtr & expression);
+    static bool isConstant(const ExpressionPtr & expression);
+    static bool hasCacheFlags(const ExpressionPtr & expression);
+    static bool evaluate(const ExpressionPtr & expression, QVariant & result);
+    static bool isConstantCondition(const ExpressionPtr & condition, bool & value);
+    static bool hasErrors(const StatementPtr & statement);
+    static bool isTerminal(const StatementPtr & statement);
+
+    int hoistLoopInvariants(QList<StatementPtr> & statements, int loopIndex);
+    void findStringLengthCalls(const ExpressionPtr & expression,
+                               QList<ExpressionPtr> & calls) const;
+    bool isHoistable(const ExpressionPtr & call) const;
+    static bool callsOtherFunctions(const ExpressionPtr & expression,
+                                    const AlgorithmPtr & allowed);
+    static bool modifies(const QList<StatementPtr> & statements,
+                         const VariablePtr & variable);
+    static bool modifies(const StatementPtr & statement,
+                         const VariablePtr & variable);
+    static bool modifies(const ExpressionPtr & expression,
+                         const VariablePtr & variable);
+
+    int passes_;
+    AlgorithmPtr stringLength_;
+    AlgorithmPtr currentAlgorithm_;
+    int hiddenVariablesCount_;
+    QHash<const Algorithm*, AlgorithmPtr> algorithms_;
+    QHash<const Variable*, VariablePtr> variables_;
+    QHash<const Expression*, ExpressionPtr> expressions_;
+    QList<ExpressionPtr> cachedExpressionUsers_;
+};
+
+}
+
+#endif // AST_OPTIMIZER_H
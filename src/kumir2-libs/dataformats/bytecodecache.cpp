@@ -0,0 +1,276 @@
+#include "bytecodecache.h"
+
+#if QT_VERSION >= 0x050000
+# include <QStandardPaths>
+#endif
+
+static const quint32 CacheMagic = 0x4b424343u; // 'KBCC'
+static const quint32 CacheFormatVersion = 1u;
+static const int StatisticsLockAttempts = 100;
+static const int StatisticsLockDelay = 20; // msec
+static const int StatisticsLockStaleAge = 30; // sec
+
+BytecodeCache::BytecodeCache()
+{
+    counted_.hits = counted_.misses = counted_.stores = 0u;
+    const QByteArray customDirectory = qgetenv("KUMIR2_BYTECODE_CACHE_DIR");
+    if (!customDirectory.isNull()) {
+        directory_ = QString::fromLocal8Bit(customDirectory);
+    }
+    else {
+#if QT_VERSION >= 0x050000
+        const QString location =
+                QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+#else
+        const QString location = QDir::homePath() + "/.cache";
+#endif
+        if (!location.isEmpty()) {
+            directory_ = location + "/kumir2/bytecode";
+        }
+    }
+}
+
+BytecodeCache::~BytecodeCache()
+{
+    saveStatistics();
+}
+
+QByteArray BytecodeCache::buildId()
+{
+    // Development builds of the same branch differ by timestamp only
+    return qApp->applicationVersion().toUtf8() + "@" +
+            qApp->property("gitTimeStamp").toDateTime().toString(Qt::ISODate).toLatin1();
+}
+
+QByteArray BytecodeCache::sourceKey(const QString &sourceText,
+                                    const QString &location,
+                                    const QByteArray &options)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(CacheFormatVersion));
+    hash.addData(buildId());
+    hash.addData(options);
+    hash.addData(QFileInfo(location).absoluteFilePath().toUtf8());
+    hash.addData(sourceText.toUtf8());
+    return hash.result();
+}
+
+QString BytecodeCache::entryFileName(const QByteArray &key) const
+{
+    return directory_ + "/" + QString::fromLatin1(key.toHex()) + ".kodcache";
+}
+
+QByteArray BytecodeCache::fileHash(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        // Missing file is a dependency too: it might be created later
+        return QByteArray();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(file.readAll());
+    return hash.result();
+}
+
+static void writeRecordSpecification(QDataStream & stream,
+                                     const Shared::ActorInterface::RecordSpecification & spec)
+{
+    stream << spec.asciiName << quint32(spec.localizedNames.size());
+    Q_FOREACH(const QLocale::Language language, spec.localizedNames.keys()) {
+        stream << quint32(language) << spec.localizedNames[language];
+    }
+    stream << quint32(spec.record.size());
+    for (int i=0; i<spec.record.size(); i++) {
+        stream << spec.record[i].first << quint8(spec.record[i].second);
+    }
+}
+
+QByteArray BytecodeCache::actorSignature(const Shared::ActorInterface *actor)
+{
+    // Everything analizer and generator take from actor
+    typedef Shared::ActorInterface Actor;
+    QByteArray buffer;
+    QDataStream stream(&buffer, QIODevice::WriteOnly);
+    stream << actor->asciiModuleName() << actor->templateParameters();
+    const Actor::TypeList types = actor->typeList();
+    stream << quint32(types.size());
+    for (int i=0; i<types.size(); i++) {
+        writeRecordSpecification(stream, types[i]);
+    }
+    const Actor::FunctionList functions = actor->functionList();
+    stream << quint32(functions.size());
+    for (int i=0; i<functions.size(); i++) {
+        const Actor::Function & f = functions[i];
+        stream << f.id << quint8(f.accessType) << quint8(f.returnType) << f.asciiName;
+        writeRecordSpecification(stream, f.returnTypeSpecification);
+        stream << quint32(f.localizedNames.size());
+        Q_FOREACH(const QLocale::Language language, f.localizedNames.keys()) {
+            stream << quint32(language) << f.localizedNames[language];
+        }
+        stream << quint32(f.arguments.size());
+        for (int j=0; j<f.arguments.size(); j++) {
+            const Actor::Argument & a = f.arguments[j];
+            stream << quint8(a.accessType) << quint8(a.type) << a.asciiName << a.dimension;
+            writeRecordSpecification(stream, a.typeSpecification);
+        }
+    }
+    return QCryptographicHash::hash(buffer, QCryptographicHash::Sha1);
+}
+
+bool BytecodeCache::lockStatistics() const
+{
+    // Directory creation is atomic, so it is a lock file shared by
+    // concurrent processes; the lock left by crashed process is removed
+    // when it becomes old enough
+    QDir dir(directory_);
+    QMutex mutex;
+    QWaitCondition delay;
+    QMutexLocker locker(&mutex);
+    for (int attempt=0; attempt<StatisticsLockAttempts; ++attempt) {
+        if (dir.mkdir("statistics.lock")) {
+            return true;
+        }
+        const QFileInfo lockInfo(dir.filePath("statistics.lock"));
+        if (lockInfo.exists() &&
+                lockInfo.lastModified().secsTo(QDateTime::currentDateTime()) > StatisticsLockStaleAge)
+        {
+            dir.rmdir("statistics.lock");
+        }
+        else {
+            delay.wait(&mutex, StatisticsLockDelay);
+        }
+    }
+    return false;
+}
+
+void BytecodeCache::saveStatistics() const
+{
+    if (!isEnabled() || 0u == counted_.hits + counted_.misses + counted_.stores) {
+        return;
+    }
+    QDir().mkpath(directory_);
+    if (!lockStatistics()) {
+        return;
+    }
+    {
+        QSettings counters(directory_ + "/statistics.ini", QSettings::IniFormat);
+        counters.setValue("hits", counters.value("hits", 0).toULongLong() + counted_.hits);
+        counters.setValue("misses", counters.value("misses", 0).toULongLong() + counted_.misses);
+        counters.setValue("stores", counters.value("stores", 0).toULongLong() + counted_.stores);
+        counters.sync();
+    }
+    QDir(directory_).rmdir("statistics.lock");
+    counted_.hits = counted_.misses = counted_.stores = 0u;
+}
+
+BytecodeCache::Statistics BytecodeCache::statistics() const
+{
+    Statistics result = counted_;
+    if (isEnabled()) {
+        QSettings counters(directory_ + "/statistics.ini", QSettings::IniFormat);
+        result.hits += counters.value("hits", 0).toULongLong();
+        result.misses += counters.value("misses", 0).toULongLong();
+        result.stores += counters.value("stores", 0).toULongLong();
+    }
+    return result;
+}
+
+bool BytecodeCache::find(const QByteArray &key,
+                         const QList<Shared::ActorInterface *> &actors,
+                         QByteArray &executable) const
+{
+    if (!isEnabled()) {
+        return false;
+    }
+    bool valid = false;
+    QFile file(entryFileName(key));
+    if (file.open(QIODevice::ReadOnly)) {
+        QDataStream stream(&file);
+        quint32 magic = 0, version = 0;
+        stream >> magic >> version;
+        valid = CacheMagic == magic && CacheFormatVersion == version;
+
+        quint32 filesCount = 0;
+        stream >> filesCount;
+        for (quint32 i=0; valid && i<filesCount; ++i) {
+            QString fileName;
+            QByteArray hash;
+            stream >> fileName >> hash;
+            valid = stream.status() == QDataStream::Ok && fileHash(fileName) == hash;
+        }
+
+        quint32 actorsCount = 0;
+        stream >> actorsCount;
+        for (quint32 i=0; valid && i<actorsCount; ++i) {
+            QByteArray name, signature;
+            stream >> name >> signature;
+            valid = false;
+            for (int j=0; j<actors.size(); j++) {
+                if (actors[j]->asciiModuleName() == name) {
+                    valid = actorSignature(actors[j]) == signature;
+                    break;
+                }
+            }
+        }
+
+        if (valid) {
+            stream >> executable;
+            valid = stream.status() == QDataStream::Ok && !executable.isEmpty();
+        }
+    }
+    if (valid) {
+        ++counted_.hits;
+    }
+    else {
+        ++counted_.misses;
+    }
+    return valid;
+}
+
+void BytecodeCache::store(const QByteArray &key,
+                          const AST::DataPtr &ast,
+                          const QStringList &includedFiles,
+                          const QByteArray &executable) const
+{
+    if (!isEnabled()) {
+        return;
+    }
+    QStringList files = includedFiles;
+    QList<const Shared::ActorInterface*> actors;
+    Q_FOREACH(const AST::ModulePtr & module, ast->modules) {
+        if (module->header.type == AST::ModTypeCached) {
+            // Module source is compiled again on import if it is newer
+            const QString kodFileName = QFileInfo(module->header.name).absoluteFilePath();
+            files << kodFileName;
+            files << kodFileName.left(kodFileName.length()-4) + ".kum";
+        }
+        else if (module->header.type == AST::ModTypeExternal && module->impl.actor) {
+            actors << module->impl.actor;
+        }
+    }
+    files.removeDuplicates();
+
+    QDir().mkpath(directory_);
+    const QString cacheFileName = entryFileName(key);
+    const QString tempFileName = cacheFileName + "." +
+            QString::number(QCoreApplication::applicationPid()) + ".tmp";
+    QFile file(tempFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream stream(&file);
+    stream << CacheMagic << CacheFormatVersion;
+    stream << quint32(files.size());
+    Q_FOREACH(const QString & fileName, files) {
+        stream << fileName << fileHash(fileName);
+    }
+    stream << quint32(actors.size());
+    Q_FOREACH(const Shared::ActorInterface * actor, actors) {
+        stream << actor->asciiModuleName() << actorSignature(actor);
+    }
+    stream << executable;
+    file.close();
+    QFile::remove(cacheFileName);
+    QFile::rename(tempFileName, cacheFileName);
+    ++counted_.stores;
+}
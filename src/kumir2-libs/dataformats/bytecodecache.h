@@ -0,0 +1,78 @@
+#ifndef BYTECODECACHE_H
+#define BYTECODECACHE_H
+
+#include "ast.h"
+
+#include <kumir2/actorinterface.h>
+
+#include <QtCore>
+
+#ifdef DATAFORMATS_LIBRARY
+#define BYTECODECACHE_EXPORT Q_DECL_EXPORT
+#else
+#define BYTECODECACHE_EXPORT Q_DECL_IMPORT
+#endif
+
+/* On-disk cache of bytecode compiled from Kumir programs.
+
+   Entries are addressed by hash of source text, its location and
+   compiler build and options. Each entry also lists contents hashes
+   of included files and imported .kod modules, and signatures of used
+   actors; entry is valid only while all of them are the same, so
+   unchanged programs are not analyzed and generated again.
+   Location of cache might be set by KUMIR2_BYTECODE_CACHE_DIR
+   environment variable, its empty value disables cache */
+class BYTECODECACHE_EXPORT BytecodeCache
+{
+public:
+    struct Statistics {
+        quint64 hits;
+        quint64 misses;
+        quint64 stores;
+    };
+
+    BytecodeCache();
+
+    /** Adds own events to statistics file shared by all processes */
+    ~BytecodeCache();
+
+    inline bool isEnabled() const { return !directory_.isEmpty(); }
+
+    /** Identifies build of Kumir, which is a part of each key */
+    static QByteArray buildId();
+
+    /** Key of program; location is absolute source file name or directory
+      * used to resolve includes and imports, options are options of
+      * compiler and generator affecting result */
+    static QByteArray sourceKey(const QString & sourceText,
+                                const QString & location,
+                                const QByteArray & options);
+
+    /** Finds executable by key if none of its dependencies changed */
+    bool find(const QByteArray & key,
+              const QList<Shared::ActorInterface*> & actors,
+              QByteArray & executable) const;
+
+    /** Stores executable generated from AST with given key */
+    void store(const QByteArray & key,
+               const AST::DataPtr & ast,
+               const QStringList & includedFiles,
+               const QByteArray & executable) const;
+
+    /** Totals of all processes using this cache, including own
+      * events not saved yet */
+    Statistics statistics() const;
+
+private:
+    Q_DISABLE_COPY(BytecodeCache)
+    QString entryFileName(const QByteArray & key) const;
+    bool lockStatistics() const;
+    void saveStatistics() const;
+    static QByteArray fileHash(const QString & fileName);
+    static QByteArray actorSignature(const Shared::ActorInterface * actor);
+
+    QString directory_;
+    mutable Statistics counted_;
+};
+
+#endif // BYTECODECACHE_H
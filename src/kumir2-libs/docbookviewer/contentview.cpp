@@ -88,12 +88,29 @@ bool ContentView::isEmpty() const
     return toPlainText().trimmed().isEmpty();
 }
 
+void ContentView::clearRenderedPages()
+{
+    renderedPages_.clear();
+    // Shown page is rendered again on next request
+    loadedModel_.clear();
+}
+
 void ContentView::renderData(ModelPtr data)
 {
+    // Code font is taken from editor settings, which change
+    // without notifying this view
+    const QString codeFont = codeFontFamily() + " " + codeFontSize();
+    if (codeFont != renderedCodeFont_) {
+        clearRenderedPages();
+        renderedCodeFont_ = codeFont;
+    }
     ModelPtr dataToRender = onePageParentModel(data);
     if (dataToRender != loadedModel_) {
         loadedModel_ = dataToRender;
-        const QString html = wrapHTML(renderModel(dataToRender));
+        QString & html = renderedPages_[dataToRender];
+        if (html.isEmpty()) {
+            html = wrapHTML(renderModel(dataToRender));
+        }
         setHtml(html);
     }
     if (dataToRender != data) {
@@ -1753,6 +1770,15 @@ void ContentView::contextMenuEvent(QContextMenuEvent *e)
     e->accept();
 }
 
+void ContentView::changeEvent(QEvent *e)
+{
+    // Rendered pages depend on colors and fonts
+    if (e->type() == QEvent::PaletteChange || e->type() == QEvent::FontChange) {
+        clearRenderedPages();
+    }
+    QTextBrowser::changeEvent(e);
+}
+
 QString ContentView::codeFontSize() const
 {
     using Shared::EditorInterface;
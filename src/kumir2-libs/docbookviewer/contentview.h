@@ -25,6 +25,7 @@ public:
     explicit ContentView(QWidget * parent);
     bool isEmpty() const;
     void reset();
+    void clearRenderedPages();
     void renderData(ModelPtr data);
     QSize minimumSizeHint() const;
 
@@ -35,6 +36,7 @@ private:
     void resizeEvent(QResizeEvent *e);
     void wheelEvent(QWheelEvent *e);
     void contextMenuEvent(QContextMenuEvent *e);
+    void changeEvent(QEvent *e);
 
     QString codeFontSize() const;
     QString codeFontFamily() const;
@@ -138,6 +140,11 @@ private:
 
 private /*fields*/:
     ModelPtr loadedModel_;
+    // HTML of pages rendered in this session; it depends on palette
+    // and code font, so it is kept in memory only and rendered again
+    // when any of them changes
+    QMap<ModelPtr,QString> renderedPages_;
+    QString renderedCodeFont_;
     QUrl lastAnchorUrl_;
     bool ignoreClearAnchorUrl_;
 
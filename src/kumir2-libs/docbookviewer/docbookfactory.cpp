@@ -8,9 +8,17 @@
 #include <QtXml>
 #include <QApplication>
 #include <QPalette>
+#if QT_VERSION >= 0x050000
+# include <QStandardPaths>
+#else
+# include <QDesktopServices>
+#endif
 
 namespace DocBookViewer {
 
+static const quint32 CacheMagic = 0x4b444243u; // 'KDBC'
+static const quint32 CacheFormatVersion = 1u;
+
 
 DocBookFactory* DocBookFactory::self()
 {
@@ -31,15 +39,173 @@ Document DocBookFactory::parseDocument(const QMap<ModelType,QString> roleValues,
 {
     // TODO network url loading
     const QString fileName = url.toLocalFile();
-    ModelPtr content;
+    const QString cacheName = cacheFileName(roleValues, url);
+    ModelPtr content = loadFromCache(cacheName);
+    if (content) {
+        if (error)
+            error->clear();
+        return Document(url, content);
+    }
     QFile file(fileName);
     if (file.open(QIODevice::ReadOnly)) {
+        dependencies_.clear();
+        dependencies_.append(fileName);
         content = parseDocument(roleValues, &file, url, error);
         file.close();
+        if (content) {
+            storeToCache(cacheName, content);
+        }
     }
     return Document(url, content);
 }
 
+QString DocBookFactory::cacheFileName(const QMap<ModelType, QString> &roles,
+                                      const QUrl &url) const
+{
+#if QT_VERSION >= 0x050000
+    static const QString CacheLocation =
+            QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#else
+    static const QString CacheLocation =
+            QDesktopServices::storageLocation(QDesktopServices::CacheLocation);
+#endif
+    if (CacheLocation.isEmpty() || !url.isLocalFile()) {
+        return QString();
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(url.toLocalFile().toUtf8());
+    hash.addData(effectiveConfigurationName().toUtf8());
+    Q_FOREACH(const ModelType key, roles.keys()) {
+        hash.addData(QByteArray::number(int(key)));
+        hash.addData(roles[key].toUtf8());
+    }
+    // Images are preprocessed to match current palette
+    QApplication * guiApp = qobject_cast<QApplication*>(qApp->instance());
+    if (guiApp) {
+        const QPalette palette = QApplication::palette();
+        hash.addData(palette.brush(QPalette::Text).color().name().toLatin1());
+        hash.addData(palette.brush(QPalette::Base).color().name().toLatin1());
+    }
+    return CacheLocation + "/docbook/" +
+            QString::fromLatin1(hash.result().toHex()) + ".cache";
+}
+
+qint64 DocBookFactory::fileModificationTime(const QString &fileName)
+{
+    const QFileInfo fileInfo(fileName);
+    return fileInfo.exists()
+            ? fileInfo.lastModified().toMSecsSinceEpoch()
+            : qint64(-1);
+}
+
+ModelPtr DocBookFactory::loadFromCache(const QString &cacheFileName) const
+{
+    if (cacheFileName.isEmpty()) {
+        return ModelPtr();
+    }
+    QFile file(cacheFileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return ModelPtr();
+    }
+    QDataStream stream(&file);
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (CacheMagic != magic || CacheFormatVersion != version) {
+        return ModelPtr();
+    }
+
+    // Cache is valid only if none of source files changed
+    quint32 dependenciesCount = 0;
+    stream >> dependenciesCount;
+    for (quint32 i=0; i<dependenciesCount; ++i) {
+        QString fileName;
+        qint64 lastModified = 0;
+        stream >> fileName >> lastModified;
+        if (stream.status() != QDataStream::Ok ||
+                fileModificationTime(fileName) != lastModified)
+        {
+            return ModelPtr();
+        }
+    }
+
+    ModelPtr result = readModel(stream, ModelPtr());
+    if (stream.status() != QDataStream::Ok) {
+        result.clear();
+    }
+    return result;
+}
+
+void DocBookFactory::storeToCache(const QString &cacheFileName, ModelPtr root) const
+{
+    if (cacheFileName.isEmpty()) {
+        return;
+    }
+    QDir().mkpath(QFileInfo(cacheFileName).absolutePath());
+    const QString tempFileName = cacheFileName + ".tmp";
+    QFile file(tempFileName);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return;
+    }
+    QDataStream stream(&file);
+    stream << CacheMagic << CacheFormatVersion;
+    dependencies_.removeDuplicates();
+    stream << quint32(dependencies_.size());
+    Q_FOREACH(const QString & fileName, dependencies_) {
+        stream << fileName << fileModificationTime(fileName);
+    }
+    writeModel(stream, root);
+    file.close();
+    QFile::remove(cacheFileName);
+    QFile::rename(tempFileName, cacheFileName);
+}
+
+void DocBookFactory::writeModel(QDataStream &stream, ModelPtr model)
+{
+    stream << quint16(model->modelType_)
+           << model->title_ << model->titleAbbrev_ << model->subtitle_
+           << model->text_ << model->id_ << model->os_
+           << model->configuration_ << model->xrefLinkEnd_
+           << model->xrefEndTerm_ << model->role_
+           << model->href_ << model->format_;
+    // SVG images are rendered lazily, so store source instead of pixels
+    const bool hasImage = model->svgData_.isEmpty() &&
+            !model->cachedImage_.isNull();
+    stream << model->svgData_ << hasImage;
+    if (hasImage) {
+        stream << model->cachedImage_;
+    }
+    stream << quint32(model->children_.size());
+    foreach (ModelPtr child, model->children_) {
+        writeModel(stream, child);
+    }
+}
+
+ModelPtr DocBookFactory::readModel(QDataStream &stream, ModelPtr parent)
+{
+    quint16 modelType = 0;
+    stream >> modelType;
+    ModelPtr model(new DocBookModel(parent, ModelType(modelType)));
+    stream >> model->title_ >> model->titleAbbrev_ >> model->subtitle_
+           >> model->text_ >> model->id_ >> model->os_
+           >> model->configuration_ >> model->xrefLinkEnd_
+           >> model->xrefEndTerm_ >> model->role_
+           >> model->href_ >> model->format_;
+    bool hasImage = false;
+    stream >> model->svgData_ >> hasImage;
+    if (hasImage) {
+        stream >> model->cachedImage_;
+    }
+    if (!model->svgData_.isEmpty()) {
+        model->svgRenderer_ = SvgRendererPtr(new QSvgRenderer(model->svgData_));
+    }
+    quint32 childrenCount = 0;
+    stream >> childrenCount;
+    for (quint32 i=0; i<childrenCount && stream.status()==QDataStream::Ok; ++i) {
+        model->children_.append(readModel(stream, model));
+    }
+    return model;
+}
+
 Document DocBookFactory::createNamedSet(const QString &name, const QList<Document> documents) const
 {
     ModelPtr namedSetRoot(new DocBookModel(ModelPtr(), Set));
@@ -122,11 +288,8 @@ void DocBookFactory::filterByOs(ModelPtr root) const
     root->children_ = newList;
 }
 
-void DocBookFactory::filterByConfiguration(ModelPtr root) const
+QString DocBookFactory::effectiveConfigurationName() const
 {
-    if (!root)
-        return;
-
     QString confName;
     if (configurationName_.isEmpty()) {
         static const QString applicationLanucher = QDir::fromNativeSeparators(qApp->arguments().at(0));
@@ -144,6 +307,15 @@ void DocBookFactory::filterByConfiguration(ModelPtr root) const
     else {
         confName = configurationName_;
     }
+    return confName;
+}
+
+void DocBookFactory::filterByConfiguration(ModelPtr root) const
+{
+    if (!root)
+        return;
+
+    const QString confName = effectiveConfigurationName();
     QList<ModelPtr> newList;
     for (ModelIterator it = root->children_.begin();
          it!=root->children_.end();
@@ -361,6 +533,8 @@ bool DocBookFactory::startElement(
                 QString localError;
                 ModelPtr include =
                         innerFactory->parseDocument(roles_, &file, hrefUrl, &localError);
+                dependencies_.append(fileName);
+                dependencies_ += innerFactory->dependencies_;
                 if (include) {
                     if (root_) {
                         include->parent_ = root_;
@@ -429,12 +603,14 @@ bool DocBookFactory::startElement(
             const QString href = atts.value("fileref");
             if (href.length() > 0) {
                 model->href_ = url_.resolved(href);
+                dependencies_.append(model->href().toLocalFile());
                 if (model->format()=="png") {
                     model->cachedImage_ = loadAndPreprocessPng(model->href().toLocalFile());
                 }
                 else if (model->format()=="svg") {
+                    model->svgData_ = loadAndPreprocessSvg(model->href().toLocalFile());
                     model->svgRenderer_ = SvgRendererPtr(
-                                new QSvgRenderer(loadAndPreprocessSvg(model->href().toLocalFile()))
+                                new QSvgRenderer(model->svgData_)
                                 );
                 }
             }
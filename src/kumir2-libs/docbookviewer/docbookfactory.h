@@ -9,6 +9,7 @@
 #include <QXmlDefaultHandler>
 #include <QXmlSimpleReader>
 #include <QUrl>
+#include <QDataStream>
 
 
 #ifdef DOCBOOKVIEWER_LIBRARY
@@ -69,6 +70,7 @@ private /*methods*/:
     void filterByRoles(const QMap<ModelType,QString> & roles,
                        ModelPtr root) const;
     void filterByConfiguration(ModelPtr root) const;
+    QString effectiveConfigurationName() const;
 
     static QList<ModelPtr> findEntriesOfType(ModelPtr root,
                                              ModelType findType
@@ -77,12 +79,21 @@ private /*methods*/:
     static QByteArray loadAndPreprocessSvg(const QString & fileName);
     static QImage loadAndPreprocessPng(const QString & fileName);
 
+    QString cacheFileName(const QMap<ModelType,QString> & roles,
+                          const QUrl & url) const;
+    ModelPtr loadFromCache(const QString & cacheFileName) const;
+    void storeToCache(const QString & cacheFileName, ModelPtr root) const;
+    static qint64 fileModificationTime(const QString & fileName);
+    static void writeModel(QDataStream & stream, ModelPtr model);
+    static ModelPtr readModel(QDataStream & stream, ModelPtr parent);
+
 
 private /*fields*/:
     mutable QXmlSimpleReader* reader_;
     mutable ModelPtr doc_;
     mutable QUrl url_;
     mutable QMap<ModelType,QString> roles_;
+    mutable QStringList dependencies_;
 
     ModelPtr root_;
     QString buffer_;
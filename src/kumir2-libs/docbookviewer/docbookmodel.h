@@ -78,6 +78,7 @@ protected /*fields*/:
     QString role_;
     QUrl href_;
     QString format_;
+    QByteArray svgData_;
     mutable SvgRendererPtr svgRenderer_;
     mutable QImage cachedImage_;
 };
@@ -206,6 +206,7 @@ void DocBookViewImpl::updateSettings(ExtensionSystem::SettingsPtr settings, cons
 {
     settings_ = settings;
     settingsPrefix_ = prefix;
+    content_->clearRenderedPages();
 }
 
 void DocBookViewImpl::saveState(ExtensionSystem::SettingsPtr settings, const QString &prefix)
@@ -0,0 +1,100 @@
+#include "searchindex.h"
+
+namespace DocBookViewer {
+
+void SearchIndex::addDocument(ModelPtr root)
+{
+    if (root) {
+        addModel(root, root);
+    }
+}
+
+void SearchIndex::clear()
+{
+    terms_.clear();
+    models_.clear();
+}
+
+bool SearchIndex::isSearchTarget(ModelPtr model)
+{
+    return model->isSectioningNode() ||
+            model == Example ||
+            model == FuncSynopsys;
+}
+
+void SearchIndex::addModel(ModelPtr model, ModelPtr target)
+{
+    if (isSearchTarget(model)) {
+        target = model;
+    }
+    addText(model->title(), target);
+    addText(model->subtitle(), target);
+    if (model == Text) {
+        addText(model->text(), target);
+    }
+    foreach (ModelPtr child, model->children()) {
+        addModel(child, target);
+    }
+}
+
+void SearchIndex::addText(const QString &text, ModelPtr target)
+{
+    if (text.isEmpty()) {
+        return;
+    }
+    const quintptr key = quintptr(target.data());
+    const QStringList words = splitIntoWords(text);
+    if (words.isEmpty()) {
+        return;
+    }
+    models_[key] = target;
+    foreach (const QString & word, words) {
+        terms_[word].insert(key);
+    }
+}
+
+QStringList SearchIndex::splitIntoWords(const QString &text)
+{
+    QStringList result;
+    QString word;
+    for (int i=0; i<=text.length(); i++) {
+        const QChar ch = i < text.length() ? text.at(i) : QChar(' ');
+        if (ch.isLetterOrNumber()) {
+            word.append(ch.toLower());
+        }
+        else if (word.length() > 0) {
+            result.append(word);
+            word.clear();
+        }
+    }
+    return result;
+}
+
+SearchIndex::Postings SearchIndex::findPrefix(const QString &prefix) const
+{
+    Postings result;
+    QMap<QString,Postings>::const_iterator it = terms_.lowerBound(prefix);
+    for ( ; it!=terms_.end() && it.key().startsWith(prefix); ++it) {
+        result += it.value();
+    }
+    return result;
+}
+
+QList<ModelPtr> SearchIndex::find(const QString &query) const
+{
+    QList<ModelPtr> result;
+    const QStringList words = splitIntoWords(query);
+    if (words.isEmpty()) {
+        return result;
+    }
+    Postings matched = findPrefix(words.first());
+    for (int i=1; i<words.size() && !matched.isEmpty(); i++) {
+        matched.intersect(findPrefix(words[i]));
+    }
+    foreach (const quintptr key, matched) {
+        result.append(models_[key]);
+    }
+    return result;
+}
+
+} // namespace DocBookViewer
@@ -0,0 +1,42 @@
+#ifndef DOCBOOKVIEWER_SEARCHINDEX_H
+#define DOCBOOKVIEWER_SEARCHINDEX_H
+
+#include "docbookmodel.h"
+
+#include <QtCore>
+
+namespace DocBookViewer {
+
+/** Inverted full-text index over loaded documents.
+ *
+ * Each word of text is mapped to the nearest enclosing node which
+ * can be shown in navigation: section, example or algorithm description.
+ */
+class SearchIndex
+{
+public:
+    void addDocument(ModelPtr root);
+    void clear();
+
+    /** Returns nodes containing all the words of query,
+     *  each word is matched as a prefix */
+    QList<ModelPtr> find(const QString & query) const;
+
+private /*types*/:
+    typedef QSet<quintptr> Postings;
+
+private /*methods*/:
+    void addModel(ModelPtr model, ModelPtr target);
+    void addText(const QString & text, ModelPtr target);
+    Postings findPrefix(const QString & prefix) const;
+    static QStringList splitIntoWords(const QString & text);
+    static bool isSearchTarget(ModelPtr model);
+
+private /*fields*/:
+    QMap<QString,Postings> terms_;
+    QHash<quintptr,ModelPtr> models_;
+};
+
+} // namespace DocBookViewer
+
+#endif // DOCBOOKVIEWER_SEARCHINDEX_H
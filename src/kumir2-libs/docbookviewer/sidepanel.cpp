@@ -75,6 +75,7 @@ void SidePanel::addDocument(Document document, bool bookSetItemsAsTopLevel)
         createListOfTables(model);
         createListOfAlgorithms(model);
         createIndex(model);
+        searchIndex_.addDocument(model);
         modelsOfItems_[item] = model;
         itemsOfModels_[model] = item;
     }
@@ -412,6 +413,10 @@ void SidePanel::doFilter(const QString &text)
 
     QSet<QTreeWidgetItem*> matchedItems = findFilteredItems(text.simplified(), tree, nullptr);
 
+    if (!text.simplified().isEmpty()) {
+        matchedItems += findIndexedItems(text, tree);
+    }
+
     QSet<QTreeWidgetItem*> unmatchedItems = allItems - matchedItems;
 
     foreach (QTreeWidgetItem* item, unmatchedItems) {
@@ -456,6 +461,25 @@ SidePanel::findFilteredItems(const QString &text,
     return result;
 }
 
+QSet<QTreeWidgetItem*>
+SidePanel::findIndexedItems(const QString &text, QTreeWidget *tree) const
+{
+    QSet<QTreeWidgetItem*> result;
+    foreach (ModelPtr model, searchIndex_.find(text)) {
+        // Nested sections might have no own item, so use closest parent
+        ModelPtr node = model;
+        while (node) {
+            QTreeWidgetItem * item = itemsOfModels_.value(node, nullptr);
+            if (item && item->treeWidget() == tree) {
+                result.insert(item);
+                break;
+            }
+            node = node->parent();
+        }
+    }
+    return result;
+}
+
 SidePanel::~SidePanel()
 {
     delete ui;
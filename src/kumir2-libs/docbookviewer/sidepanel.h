@@ -2,6 +2,7 @@
 #define DOCBOOKVIEWER_SIDEPANEL_H
 
 #include "document.h"
+#include "searchindex.h"
 
 #include <kumir2-libs/extensionsystem/settings.h>
 
@@ -62,6 +63,11 @@ private:
             QTreeWidgetItem * root
             );
 
+    QSet<QTreeWidgetItem*> findIndexedItems(
+            const QString & text,
+            QTreeWidget * tree
+            ) const;
+
     typedef QPair<QString,QString> FunctionName; // <Package,Function>
 
     Ui::SidePanel *ui;
@@ -70,6 +76,7 @@ private:
     QMap<ModelPtr, QTreeWidgetItem*> itemsOfModels_;
     QMap<FunctionName, ModelPtr> functionsIndex_;
     QMap<QString, ModelPtr> keywordsIndex_;
+    SearchIndex searchIndex_;
     QList<Document> loadedDocuments_;
     QList<ModelPtr> topLevelItems_;
 
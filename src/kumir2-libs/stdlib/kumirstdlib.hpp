@@ -36,6 +36,14 @@
 #endif
 #include <stdlib.h>
 
+#if defined(__has_builtin)
+#   if __has_builtin(__builtin_add_overflow)
+#       define KUMIR_HAS_OVERFLOW_BUILTINS
+#   endif
+#elif defined(__GNUC__) && __GNUC__ >= 5
+#   define KUMIR_HAS_OVERFLOW_BUILTINS
+#endif
+
 
 namespace VM { class Variable; }
 
@@ -56,8 +64,8 @@ typedef double real;
 struct FileType {
     enum OpenMode { NotOpen, Read, Write, Append };
     enum SpecialType { RegularFile, Console };
-    inline static const char * _() { return "siibbl"; }
-    inline FileType() { valid = false; mode = NotOpen; type = RegularFile; autoClose = false; handle = 0; }
+    inline static const char * _() { return "siibbli"; }
+    inline FileType() { valid = false; mode = NotOpen; type = RegularFile; autoClose = false; handle = 0; key = 0; }
     inline void setName(const String &name) {
         fullPath = name;
     }
@@ -82,6 +90,7 @@ struct FileType {
     inline void invalidate() {
         valid = false;
         handle = 0;
+        key = 0;
     }
     inline bool operator==(const FileType & other) const {
         return other.fullPath==fullPath;
@@ -96,10 +105,12 @@ struct FileType {
     bool valid;
     bool autoClose;
     FILE* handle;
+    int key; // 1-based slot in Files handle table, 0 if unknown
 };
 
 class AbstractInputBuffer {
 public:
+    inline virtual ~AbstractInputBuffer() {}
     virtual bool readRawChar(Char & ch) = 0;
     virtual void pushLastCharBack() = 0;
     virtual void clear() = 0;    
@@ -107,9 +118,29 @@ public:
 
 class AbstractOutputBuffer {
 public:
+    inline virtual ~AbstractOutputBuffer() {}
     virtual void writeRawString(const String & ) = 0;
 };
 
+struct FilesState;
+
+/* Library state of one program. Programs use process-wide state unless
+   host evaluating several programs in parallel threads binds a thread
+   to state of program it evaluates, see Core::bindThreadState */
+struct ProgramState {
+    inline ProgramState()
+        : consoleInputBuffer(0), consoleOutputBuffer(0), memoryUsed(0), files(0) {}
+    inline ~ProgramState();
+    String error;
+    AbstractInputBuffer * consoleInputBuffer;
+    AbstractOutputBuffer * consoleOutputBuffer;
+    int64_t memoryUsed; // strings and tables data, see VM::ValuesMemory
+    FilesState * files; // created on first use by Files
+private:
+    ProgramState(const ProgramState &);
+    ProgramState & operator=(const ProgramState &);
+};
+
 class StringList:
         public std::deque<String>
 {
@@ -141,9 +172,14 @@ class Core {
     friend class VM::Variable;
 public:
     static void (*AbortHandler)();
-    inline static void init() { error.clear(); }
+    inline static void init() { currentError().clear(); }
     inline static void finalize() {}
-    inline static const String & getError() { return error; }
+    inline static const String & getError() { return currentError(); }
+
+    /** Makes calling thread use state of given program instead of
+     *  process-wide one, or process-wide state again if nullptr */
+    inline static void bindThreadState(ProgramState * state) { threadState = state; }
+    inline static ProgramState * boundThreadState() { return threadState; }
 
     inline static String fromUtf8(const std::string & s) {
         String result;
@@ -284,16 +320,20 @@ public:
 #endif
 
     inline static void abort(const String & err) {
-        error = err;
+        currentError() = err;
         if (AbortHandler) {
             AbortHandler();
         }
     }
 protected:
     inline static void unsetError() {
-        error.clear();
+        currentError().clear();
+    }
+    inline static String & currentError() {
+        return threadState? threadState->error : error;
     }
     static String error;
+    static thread_local ProgramState * threadState;
 };
 
 class Math {
@@ -325,6 +365,42 @@ public:
         return result;
     }
 
+    // Calculate and check for overflow at once, using compiler
+    // intrinsics (single add/sub/mul with overflow flag) if available.
+    // Return false on overflow
+    inline static bool checkedSumm(int32_t l, int32_t r, int32_t & res)
+    {
+#ifdef KUMIR_HAS_OVERFLOW_BUILTINS
+        return !__builtin_add_overflow(l, r, &res);
+#else
+        const int64_t wide = (int64_t) l + (int64_t) r;
+        res = (int32_t) wide;
+        return INT32_MIN <= wide && wide <= INT32_MAX;
+#endif
+    }
+
+    inline static bool checkedDiff(int32_t l, int32_t r, int32_t & res)
+    {
+#ifdef KUMIR_HAS_OVERFLOW_BUILTINS
+        return !__builtin_sub_overflow(l, r, &res);
+#else
+        const int64_t wide = (int64_t) l - (int64_t) r;
+        res = (int32_t) wide;
+        return INT32_MIN <= wide && wide <= INT32_MAX;
+#endif
+    }
+
+    inline static bool checkedProd(int32_t l, int32_t r, int32_t & res)
+    {
+#ifdef KUMIR_HAS_OVERFLOW_BUILTINS
+        return !__builtin_mul_overflow(l, r, &res);
+#else
+        const int64_t wide = (int64_t) l * (int64_t) r;
+        res = (int32_t) wide;
+        return INT32_MIN <= wide && wide <= INT32_MAX;
+#endif
+    }
+
     static bool isCorrectDouble(double x)
     {
         // !!! WARNING !!
@@ -1235,22 +1311,409 @@ public:
     }
 };
 
+/** Buffered writer of text files and standard output.
+ *
+ * Encodes strings directly into a reusable byte buffer and writes it
+ * to file only when the buffer grows over capacity, the flush interval
+ * elapses, a line ends (in line buffered mode) or on explicit flush().
+ */
+class FileOutputBuffer
+        : public AbstractOutputBuffer
+{
+public:
+    enum { DefaultCapacity = 64 * 1024 };
+
+    inline FileOutputBuffer(FILE * f, Encoding enc)
+        : file_(f)
+        , encoding_(enc==DefaultEncoding ? UTF8 : enc)
+        , capacity_(DefaultCapacity)
+        , flushInterval_(0)
+        , lineBuffered_(false)
+        , lastFlush_(currentMsecs())
+    {
+        writeBom_ = encoding_==UTF8 && file_!=stdout && ftell(file_)==0;
+        bytes_.reserve(capacity_);
+    }
+
+    inline ~FileOutputBuffer() {
+        flush();
+    }
+
+    inline Encoding encoding() const { return encoding_; }
+
+    inline void setEncoding(Encoding enc) {
+        if (enc!=DefaultEncoding && enc!=encoding_) {
+            flush();
+            encoding_ = enc;
+        }
+    }
+
+    /** Sets flush policy: after each line if lineBuffered, otherwise when
+     *  buffer exceeds capacity bytes or interval msecs (0 to disable)
+     *  elapsed since last flush */
+    inline void setBuffering(bool lineBuffered, size_t capacity, int interval) {
+        flush();
+        lineBuffered_ = lineBuffered;
+        capacity_ = capacity;
+        flushInterval_ = interval;
+    }
+
+    inline void writeRawString(const String & s) {
+        write(s);
+    }
+
+    /** Returns false if string contains character not representable
+     *  in target encoding; all other characters are written anyway */
+    inline bool write(const String & s) {
+        if (writeBom_) {
+            bytes_.append("\xEF\xBB\xBF");
+            writeBom_ = false;
+        }
+        EncodingError error = NoEncodingError;
+        bool success = true;
+        bool newLine = false;
+        for (size_t i=0; i<s.length(); i++) {
+            const Char ch = s[i];
+            newLine = newLine || ch==Char('\n');
+            if (encoding_==UTF8) {
+                if (ch < 0x80) {
+                    bytes_.push_back(static_cast<char>(ch));
+                    continue;
+                }
+                const MultiByte mb = UTF8CodingTable::enc(ch, error);
+                bytes_.append(reinterpret_cast<const char*>(mb.data), mb.size);
+            }
+            else if (encoding_==CP866)
+                bytes_.push_back(CP866CodingTable::enc(ch, error));
+            else if (encoding_==CP1251)
+                bytes_.push_back(CP1251CodingTable::enc(ch, error));
+            else if (encoding_==KOI8R)
+                bytes_.push_back(KOI8RCodingTable::enc(ch, error));
+            else
+                bytes_.push_back(AsciiCodingTable::enc(ch, error));
+            success = success && !error;
+        }
+        if (bytes_.size() >= capacity_ || (lineBuffered_ && newLine)) {
+            flush();
+        }
+        else if (flushInterval_ > 0 && currentMsecs() - lastFlush_ >= static_cast<unsigned long>(flushInterval_)) {
+            flush();
+        }
+        return success;
+    }
+
+    inline void flush() {
+        if (bytes_.length() > 0) {
+            fwrite(bytes_.c_str(), sizeof(char), bytes_.length(), file_);
+            bytes_.clear();
+        }
+        fflush(file_);
+        if (flushInterval_ > 0)
+            lastFlush_ = currentMsecs();
+    }
+
+private:
+    inline static unsigned long currentMsecs() {
+#if defined(WIN32) || defined(_WIN32)
+        return GetTickCount();
+#else
+        struct timeval tv;
+        gettimeofday(&tv, 0);
+        return tv.tv_sec * 1000ul + tv.tv_usec / 1000ul;
+#endif
+    }
+
+    FILE * file_;
+    Encoding encoding_;
+    std::string bytes_;
+    size_t capacity_;
+    int flushInterval_;
+    bool lineBuffered_;
+    bool writeBom_;
+    unsigned long lastFlush_;
+};
+
+/** Block-buffered reader of text files and redirected standard input.
+ *
+ * Reads raw bytes in large blocks (line by line for standard input,
+ * to keep interactive programs responsive), decodes them at once into
+ * a reusable wide char buffer and gives characters one by one.
+ * There is only one buffer per FILE, so all streams created for
+ * the same file share reading position.
+ */
+class FileInputBuffer
+        : public AbstractInputBuffer
+{
+public:
+    enum { BlockSize = 64 * 1024 };
+
+    inline FileInputBuffer(FILE * f, Encoding enc)
+        : file_(f)
+        , encoding_(enc)
+        , position_(0)
+        , pending_(0)
+        , skipBom_(false)
+        , eof_(false)
+        , tied_(0)
+    {
+        if (encoding_==DefaultEncoding) {
+            bool forceUtf8 = false;
+            if (file_!=stdin) {
+                long curpos = ftell(file_);
+                fseek(file_, 0, SEEK_SET);
+                unsigned char B[3];
+                if (fread(B, 1, 3, file_)==3) {
+                    forceUtf8 = B[0]==0xEF && B[1]==0xBB && B[2]==0xBF;
+                }
+                fseek(file_, curpos, SEEK_SET);
+            }
+            encoding_ = forceUtf8 ? UTF8 : Core::getSystemEncoding();
+        }
+        skipBom_ = encoding_==UTF8 && ftell(file_)==0;
+        bytes_.resize(BlockSize);
+        chars_.reserve(BlockSize);
+    }
+
+    inline Encoding encoding() const { return encoding_; }
+
+    /** Output buffer to be flushed every time before reading file,
+     *  so user can see prompt before entering data */
+    inline void tie(FileOutputBuffer * output) { tied_ = output; }
+
+    inline bool readRawChar(Char & ch) {
+        if (position_==chars_.size() && !fill()) {
+            return false;
+        }
+        ch = chars_[position_];
+        position_ ++;
+        return true;
+    }
+
+    inline void pushLastCharBack() {
+        if (position_>0)
+            position_ --;
+    }
+
+    /** Drops all buffered data, must be called after seek */
+    inline void clear() {
+        chars_.clear();
+        position_ = 0;
+        pending_ = 0;
+        eof_ = false;
+        skipBom_ = encoding_==UTF8 && ftell(file_)==0;
+    }
+
+    /** Returns true if no more characters available */
+    inline bool atEnd() {
+        return position_==chars_.size() && !fill();
+    }
+
+    /** Returns true if there is non-space character left in file */
+    inline bool hasData() {
+        size_t offset = 0;
+        do {
+            for ( ; position_+offset<chars_.size(); offset++) {
+                const Char ch = chars_[position_+offset];
+                if (ch!=' ' && ch!='\t' && ch!='\r' && ch!='\n')
+                    return true;
+            }
+        } while (fill());
+        return false;
+    }
+
+    /** Parses decimal integer directly from decoded buffer.
+     *  Returns false without consuming anything if the next lexem is not
+     *  a plain decimal number or not completely read yet, so caller
+     *  should fall back to generic word parsing */
+    inline bool readDecimalInteger(const String & delimiters, int & value) {
+        size_t pos = position_;
+        bool negative = false;
+        if (pos<chars_.size() && (chars_[pos]=='-' || chars_[pos]=='+')) {
+            negative = chars_[pos]=='-';
+            pos ++;
+        }
+        const unsigned int maxabs = (1U << 31) - (negative ? 0 : 1);
+        unsigned int result = 0;
+        size_t digits = 0;
+        for ( ; pos<chars_.size(); pos++) {
+            const Char ch = chars_[pos];
+            if ('0'<=ch && ch<='9') {
+                const unsigned int digit = static_cast<unsigned int>(ch - '0');
+                if (result > (maxabs - digit) / 10)
+                    return false; // overflow is reported by generic parser
+                result = result * 10 + digit;
+                digits ++;
+            }
+            else if (ch=='\r') {
+                continue;
+            }
+            else if (delimiters.find(ch)!=String::npos) {
+                break;
+            }
+            else {
+                return false;
+            }
+        }
+        if (digits==0 || (pos==chars_.size() && !eof_))
+            return false;
+        position_ = pos;
+        value = negative ? -static_cast<int>(result - 1) - 1 : static_cast<int>(result);
+        return true;
+    }
+
+private:
+    /** Reads and decodes next block, appending it to unread characters.
+     *  The last read character is kept to make pushLastCharBack() possible */
+    inline bool fill() {
+        if (eof_)
+            return false;
+        if (position_>1) {
+            chars_.erase(0, position_-1);
+            position_ = 1;
+        }
+        const size_t before = chars_.size();
+        while (chars_.size()==before && !eof_) {
+            if (tied_)
+                tied_->flush();
+            size_t got = 0;
+            if (file_==stdin) {
+                if (fgets(&bytes_[pending_], BlockSize-pending_, file_))
+                    got = strlen(&bytes_[pending_]);
+            }
+            else {
+                got = fread(&bytes_[pending_], sizeof(char), BlockSize-pending_, file_);
+            }
+            if (got==0) {
+                eof_ = true;
+                if (pending_>0) {
+                    Core::abort(Core::fromUtf8("Ошибка чтения данных из файла: UTF-8 файл поврежден"));
+                    return false;
+                }
+            }
+            if (!decode(pending_ + got))
+                return false;
+        }
+        return chars_.size() > before;
+    }
+
+    inline bool decode(size_t size) {
+        size_t i = 0;
+        while (i<size) {
+            const unsigned char byte = static_cast<unsigned char>(bytes_[i]);
+            size_t length = 1;
+            if (encoding_==UTF8) {
+                if ((byte >> 5)==0x06)
+                    length = 2;
+                else if ((byte >> 4)==0x0E)
+                    length = 3;
+                if (i+length > size)
+                    break; // incomplete sequence at block end
+            }
+            charptr p = &bytes_[i];
+            EncodingError error = NoEncodingError;
+            uint32_t ch = 0;
+            if (byte=='\0')
+                error = StreamEnded;
+            else if (encoding_==UTF8)
+                ch = UTF8CodingTable::dec(p, error);
+            else if (encoding_==CP866)
+                ch = CP866CodingTable::dec(p, error);
+            else if (encoding_==CP1251)
+                ch = CP1251CodingTable::dec(p, error);
+            else if (encoding_==KOI8R)
+                ch = KOI8RCodingTable::dec(p, error);
+            else
+                ch = AsciiCodingTable::dec(p, error);
+            if (error) {
+                Core::abort(Core::fromUtf8("Ошибка перекодирования при чтении данных из текстового файла"));
+                return false;
+            }
+            if (skipBom_) {
+                skipBom_ = false;
+                if (ch==0xFEFF) {
+                    i += length;
+                    continue;
+                }
+            }
+            chars_.push_back(static_cast<Char>(ch));
+            i += length;
+        }
+        // Keep incomplete UTF-8 sequence for the next block
+        pending_ = size - i;
+        for (size_t j=0; j<pending_; j++)
+            bytes_[j] = bytes_[i+j];
+        return true;
+    }
+
+    FILE * file_;
+    Encoding encoding_;
+    std::vector<char> bytes_;
+    String chars_;
+    size_t position_;
+    size_t pending_;
+    bool skipBom_;
+    bool eof_;
+    FileOutputBuffer * tied_;
+};
+
+/* Files opened by program, buffers reading and writing them, streams
+   assigned by program instead of standard ones and encoding of files */
+struct FilesState {
+    /** Handle table entry: file key and buffers bound to it,
+     *  so input and output calls do not search for them */
+    struct OpenedFile {
+        FileType file;
+        FileInputBuffer * input;
+        FileOutputBuffer * output;
+    };
+
+    inline FilesState()
+        : assignedIN(stdin), assignedOUT(stdout), fileEncoding(DefaultEncoding) {}
+
+    std::vector<OpenedFile> openedFiles;
+    std::vector<size_t> freeFileSlots;
+    std::map<FILE*,FileInputBuffer*> inputBuffers;
+    std::map<FILE*,FileOutputBuffer*> outputBuffers;
+    FILE * assignedIN;
+    FILE * assignedOUT;
+    Encoding fileEncoding;
+private:
+    FilesState(const FilesState &);
+    FilesState & operator=(const FilesState &);
+};
+
 class Files {
     friend class IO;
+    friend struct ProgramState;
 public:
     inline static void setConsoleInputBuffer(AbstractInputBuffer * b) {
-        consoleInputBuffer = b;
+        if (Core::threadState)
+            Core::threadState->consoleInputBuffer = b;
+        else
+            consoleInputBuffer = b;
     }
 
     inline static void setConsoleOutputBuffer(AbstractOutputBuffer * b) {
-        consoleOutputBuffer = b;
+        if (Core::threadState)
+            Core::threadState->consoleOutputBuffer = b;
+        else
+            consoleOutputBuffer = b;
+    }
+
+    inline static AbstractInputBuffer * getConsoleInputBuffer() {
+        return Core::threadState? Core::threadState->consoleInputBuffer : consoleInputBuffer;
+    }
+
+    inline static AbstractOutputBuffer * getConsoleOutputBuffer() {
+        return Core::threadState? Core::threadState->consoleOutputBuffer : consoleOutputBuffer;
     }
 
     inline static bool isOpenedFiles() {
+        FilesState & files = state();
         bool remainingOpenedFiles = false;
-        for (std::deque<FileType>::iterator it=openedFiles.begin(); it != openedFiles.end(); ++it) {
-            FileType & f = *it;
-            if (!f.autoClose) {
+        for (size_t i=0; i<files.openedFiles.size(); i++) {
+            const FileType & f = files.openedFiles[i].file;
+            if (f.handle && !f.autoClose) {
                 remainingOpenedFiles = true;
                 break;
             }
@@ -1259,32 +1722,49 @@ public:
     }
 
     inline static void init() {
-        fileEncoding = DefaultEncoding;
+        FilesState & files = state();
+        files.fileEncoding = DefaultEncoding;
     }
 
     inline static void finalize() {
+        FilesState & files = state();
         if (isOpenedFiles() && Core::getError().length()==0)
             Core::abort(Core::fromUtf8("Остались не закрытые файлы"));
-        for (size_t i=0; i<openedFiles.size(); i++) {
-            FileType & f = openedFiles[i];
+        while (files.inputBuffers.size() > files.inputBuffers.count(stdin)) {
+            std::map<FILE*,FileInputBuffer*>::iterator it = files.inputBuffers.begin();
+            if (it->first==stdin)
+                ++it;
+            releaseInputBuffer(it->first);
+        }
+        while (files.outputBuffers.size() > files.outputBuffers.count(stdout)) {
+            std::map<FILE*,FileOutputBuffer*>::iterator it = files.outputBuffers.begin();
+            if (it->first==stdout)
+                ++it;
+            releaseOutputBuffer(it->first);
+        }
+        flushOutputBuffers();
+        for (size_t i=0; i<files.openedFiles.size(); i++) {
+            FileType & f = files.openedFiles[i].file;
             if (f.handle)
                 fclose(f.handle);
         }
-        openedFiles.clear();
-        if (assignedIN!=stdin)
-            fclose(assignedIN);
-        if (assignedOUT!=stdout)
-            fclose(assignedOUT);
+        files.openedFiles.clear();
+        files.freeFileSlots.clear();
+        if (files.assignedIN!=stdin)
+            fclose(files.assignedIN);
+        if (files.assignedOUT!=stdout)
+            fclose(files.assignedOUT);
 
-        assignedIN = stdin;
-        assignedOUT = stdout;
+        files.assignedIN = stdin;
+        files.assignedOUT = stdout;
     }
 
     inline static void setFileEncoding(const String & enc) {
+        FilesState & files = state();
         String encoding = Core::toLowerCaseW(enc);
         StringUtils::trim<String,Char>(encoding);
         if (encoding.length()==0) {
-            fileEncoding = DefaultEncoding;
+            files.fileEncoding = DefaultEncoding;
             return;
         }
         size_t minus = encoding.find_first_of(Char('-'));
@@ -1315,22 +1795,22 @@ public:
         static const String intel4 = Core::fromUtf8("юникод");
         static const String motorola = Core::fromAscii("utf16be");
         if (encoding==ansi1 || encoding==ansi2 || encoding==ansi3 || encoding==ansi4 || encoding==ansi5) {
-            fileEncoding = CP1251;
+            files.fileEncoding = CP1251;
         }
         else if (encoding==oem1 || encoding==oem2 || encoding==oem3 || encoding==oem4 || encoding==oem5 || encoding==oem6) {
-            fileEncoding = CP866;
+            files.fileEncoding = CP866;
         }
         else if (encoding==koi1 || encoding==koi2 || encoding==koi3 || encoding==koi4) {
-            fileEncoding = KOI8R;
+            files.fileEncoding = KOI8R;
         }
         else if (encoding==utf1 || encoding==utf2 || encoding==utf3) {
-            fileEncoding = UTF8;
+            files.fileEncoding = UTF8;
         }
         else if (encoding==intel1 || encoding==intel2 || encoding==intel3 || encoding==intel4) {
-            fileEncoding = UTF16INTEL;
+            files.fileEncoding = UTF16INTEL;
         }
         else if (encoding==motorola) {
-            fileEncoding = UTF16MOTOROLA;
+            files.fileEncoding = UTF16MOTOROLA;
         }
         else {
             Core::abort(Core::fromUtf8("Неизвестная кодировка"));
@@ -1610,7 +2090,7 @@ public:
 #endif
 
     inline static FileType getConsoleBuffer() {
-        if (!consoleInputBuffer) {
+        if (!getConsoleInputBuffer()) {
             Core::abort(Core::fromUtf8("Консоль не доступна"));
             return FileType();
         }
@@ -1623,10 +2103,11 @@ public:
     }
 
     inline static FileType open(const String & shortName, FileType::OpenMode mode, bool remember, FILE* *fh) {
+        FilesState & files = state();
         const String fileName = getAbsolutePath(shortName);
-        for (std::deque<FileType>::const_iterator it = openedFiles.begin(); it!=openedFiles.end(); ++it) {
-            const FileType & f = (*it);
-            if (f.getName()==fileName) {
+        for (size_t i=0; i<files.openedFiles.size(); i++) {
+            const FileType & f = files.openedFiles[i].file;
+            if (f.handle && f.getName()==fileName) {
                 Core::abort(Core::fromUtf8("Файл уже открыт: ")+fileName);
                 return FileType();
             }
@@ -1684,7 +2165,20 @@ public:
             f.setMode(mode);
             f.handle = res;
             f.autoClose = !remember;
-            openedFiles.push_back(f);
+            OpenedFile entry;
+            entry.file = f;
+            entry.input = 0;
+            entry.output = 0;
+            if (files.freeFileSlots.empty()) {
+                files.openedFiles.push_back(entry);
+                f.key = int(files.openedFiles.size());
+            }
+            else {
+                f.key = files.freeFileSlots.back() + 1;
+                files.freeFileSlots.pop_back();
+            }
+            entry.file.key = f.key;
+            files.openedFiles[f.key-1] = entry;
             if (fh) {
                 *fh = res;
             }
@@ -1692,55 +2186,46 @@ public:
         return f;
     }
     inline static void close(const FileType & key) {
-        std::deque<FileType>::iterator it = openedFiles.begin();        
-        for (; it!=openedFiles.end(); ++it) {
-            FileType f = (*it);
-            if (f==key) {
-                break;
-            }
-        }
-        if (it==openedFiles.end()) {
+        FilesState & files = state();
+        OpenedFile * entry = findOpenedFile(key);
+        if (!entry) {
             Core::abort(Core::fromUtf8("Неверный ключ"));
             return;
         }
-        FileType f = (*it);
-        FILE * fh = f.handle;
-        f.invalidate();
+        FILE * fh = entry->file.handle;
+        const size_t slot = size_t(entry->file.key - 1);
+        releaseInputBuffer(fh);
+        releaseOutputBuffer(fh);
         if (fh)
             fclose(fh);
-        openedFiles.erase(it);        
+        entry->file.invalidate();
+        entry->input = 0;
+        entry->output = 0;
+        files.freeFileSlots.push_back(slot);
     }
 
     inline static void reset(FileType & key) {
-        std::deque<FileType>::iterator it = openedFiles.begin();
-        for (; it!=openedFiles.end(); ++it) {
-            const FileType & f = (*it);
-            if (f==key) {
-                break;
-            }
-        }
-        if (it==openedFiles.end()) {
+        OpenedFile * entry = findOpenedFile(key);
+        if (!entry) {
             Core::abort(Core::fromUtf8("Неверный ключ"));
             return;
         }
-        const FileType & f = (*it);
-        FILE * fh = f.handle;
+        FILE * fh = entry->file.handle;
+        if (entry->output)
+            entry->output->flush();
         fseek(fh, 0, 0);
+        if (entry->input)
+            entry->input->clear();
     }
     inline static bool eof(const FileType & key) {
-        std::deque<FileType>::iterator it = openedFiles.begin();
-        for (; it!=openedFiles.end(); ++it) {
-            const FileType & f = (*it);
-            if (f==key) {
-                break;
-            }
-        }
-        if (it==openedFiles.end()) {
+        OpenedFile * entry = findOpenedFile(key);
+        if (!entry) {
             Core::abort(Core::fromUtf8("Неверный ключ"));
             return false;
         }
-        const FileType & f = (*it);
-        FILE * fh = f.handle;
+        FILE * fh = entry->file.handle;
+        if (entry->file.getMode()==FileType::Read)
+            return inputBufferOf(*entry)->atEnd();
         if (feof(fh))
             return true;
         unsigned char ch = 0x00;
@@ -1756,18 +2241,14 @@ public:
         return ch==0xFF;
     }
     inline static bool hasData(const FileType & key) {
-        std::deque<FileType>::iterator it = openedFiles.begin();
-        for (; it!=openedFiles.end(); ++it) {
-            const FileType & f = (*it);
-            if (f==key) {
-                break;
-            }
-        }
-        if (it==openedFiles.end()) {
+        OpenedFile * entry = findOpenedFile(key);
+        if (!entry) {
             Core::abort(Core::fromUtf8("Неверный ключ"));
             return false;
         }
-        FILE * fh = (*it).handle;
+        FILE * fh = entry->file.handle;
+        if (entry->file.getMode()==FileType::Read)
+            return inputBufferOf(*entry)->hasData();
         long backPos = -1;
         if (fh!=stdin)
             backPos = ftell(fh);
@@ -1806,47 +2287,175 @@ public:
     }
 
     inline static bool overloadedStdIn() {
-        return assignedIN!=stdin;
+        return state().assignedIN!=stdin;
     }
 
     inline static bool overloadedStdOut() {
-        return assignedOUT!=stdout;
+        return state().assignedOUT!=stdout;
     }
 
     inline static FILE* getAssignedIn() {
-        return assignedIN;
+        return state().assignedIN;
     }
 
     inline static FILE* getAssignedOut() {
-        return assignedOUT;
+        return state().assignedOUT;
+    }
+
+    /** Returns buffer for program standard output, which must be used
+     *  instead of writing to stdout directly to keep output order */
+    inline static FileOutputBuffer* getStdOutBuffer(Encoding enc) {
+        return getOutputBuffer(stdout, enc);
+    }
+
+    /** Writes all pending output; called on input requests,
+     *  program end and runtime errors */
+    inline static void flushOutputBuffers() {
+        FilesState & files = state();
+        for (std::map<FILE*,FileOutputBuffer*>::iterator it=files.outputBuffers.begin(); it!=files.outputBuffers.end(); ++it) {
+            it->second->flush();
+        }
     }
 
     inline static void assignInStream(String fileName) {
+        FilesState & files = state();
         StringUtils::trim<String,Char>(fileName);
-        if (assignedIN!=stdin)
-            fclose(assignedIN);
+        releaseInputBuffer(files.assignedIN);
+        if (files.assignedIN!=stdin)
+            fclose(files.assignedIN);
         if (fileName.length()>0)
-            open(fileName, FileType::Read, false, &assignedIN);
+            open(fileName, FileType::Read, false, &files.assignedIN);
         else
-            assignedIN = stdin;
+            files.assignedIN = stdin;
     }
 
     inline static void assignOutStream(String fileName) {
+        FilesState & files = state();
         StringUtils::trim<String,Char>(fileName);
-        if (assignedIN!=stdout)
-            fclose(assignedOUT);
+        releaseOutputBuffer(files.assignedOUT);
+        if (files.assignedOUT!=stdout)
+            fclose(files.assignedOUT);
         if (fileName.length()>0)
-            open(fileName, FileType::Write, false, &assignedOUT);
+            open(fileName, FileType::Write, false, &files.assignedOUT);
         else
-            assignedOUT = stdout;
+            files.assignedOUT = stdout;
     }
 
 private:
 
-    static FILE * assignedIN;
-    static FILE * assignedOUT;
+    /** Returns input buffer shared by all streams reading the file */
+    inline static FileInputBuffer* getInputBuffer(FILE * fh, Encoding enc) {
+        FilesState & files = state();
+        std::map<FILE*,FileInputBuffer*>::iterator it = files.inputBuffers.find(fh);
+        if (it!=files.inputBuffers.end())
+            return it->second;
+        FileInputBuffer * buffer = new FileInputBuffer(fh, enc);
+        if (fh==stdin)
+            buffer->tie(getOutputBuffer(stdout, DefaultEncoding));
+        files.inputBuffers[fh] = buffer;
+        return buffer;
+    }
+
+    /** Standard input buffer lives until process exit,
+     *  because console input functors keep streams reading it */
+    inline static void releaseInputBuffer(FILE * fh) {
+        FilesState & files = state();
+        if (fh==stdin)
+            return;
+        std::map<FILE*,FileInputBuffer*>::iterator it = files.inputBuffers.find(fh);
+        if (it!=files.inputBuffers.end()) {
+            delete it->second;
+            files.inputBuffers.erase(it);
+        }
+    }
+
+    inline static FileOutputBuffer* getOutputBuffer(FILE * fh, Encoding enc) {
+        FilesState & files = state();
+        std::map<FILE*,FileOutputBuffer*>::iterator it = files.outputBuffers.find(fh);
+        if (it!=files.outputBuffers.end()) {
+            it->second->setEncoding(enc);
+            return it->second;
+        }
+        FileOutputBuffer * buffer = new FileOutputBuffer(fh, enc);
+        files.outputBuffers[fh] = buffer;
+        return buffer;
+    }
+
+    inline static void releaseOutputBuffer(FILE * fh) {
+        FilesState & files = state();
+        std::map<FILE*,FileOutputBuffer*>::iterator it = files.outputBuffers.find(fh);
+        if (it==files.outputBuffers.end())
+            return;
+        if (fh==stdout) {
+            it->second->flush();
+            return;
+        }
+        delete it->second;
+        files.outputBuffers.erase(it);
+    }
+
+    typedef FilesState::OpenedFile OpenedFile;
+
+    /** Closes files left opened by program and frees all buffers
+     *  of its state, including ones of standard streams */
+    inline static void releaseState(FilesState & files) {
+        for (std::map<FILE*,FileOutputBuffer*>::iterator it=files.outputBuffers.begin(); it!=files.outputBuffers.end(); ++it) {
+            it->second->flush();
+            delete it->second;
+        }
+        for (std::map<FILE*,FileInputBuffer*>::iterator it=files.inputBuffers.begin(); it!=files.inputBuffers.end(); ++it) {
+            delete it->second;
+        }
+        for (size_t i=0; i<files.openedFiles.size(); i++) {
+            if (files.openedFiles[i].file.handle)
+                fclose(files.openedFiles[i].file.handle);
+        }
+    }
+
+    /** Finds opened file by its slot in handle table. Keys without
+     *  slot (e.g. made from user input) are looked up by file name */
+    inline static OpenedFile* findOpenedFile(const FileType & key) {
+        FilesState & files = state();
+        const size_t slot = size_t(key.key - 1);
+        if (key.key > 0 && slot < files.openedFiles.size()) {
+            OpenedFile & entry = files.openedFiles[slot];
+            if (entry.file.handle && entry.file==key)
+                return &entry;
+        }
+        for (size_t i=0; i<files.openedFiles.size(); i++) {
+            OpenedFile & entry = files.openedFiles[i];
+            if (entry.file.handle && entry.file==key)
+                return &entry;
+        }
+        return 0;
+    }
+
+    inline static FileInputBuffer* inputBufferOf(OpenedFile & entry) {
+        FilesState & files = state();
+        if (!entry.input)
+            entry.input = getInputBuffer(entry.file.handle, files.fileEncoding);
+        return entry.input;
+    }
+
+    inline static FileOutputBuffer* outputBufferOf(OpenedFile & entry) {
+        FilesState & files = state();
+        if (!entry.output)
+            entry.output = getOutputBuffer(entry.file.handle, files.fileEncoding);
+        return entry.output;
+    }
+
+    /** Returns files of program bound to calling thread,
+     *  or process-wide ones if thread is not bound */
+    inline static FilesState & state() {
+        ProgramState * program = Core::threadState;
+        if (!program)
+            return processFiles;
+        if (!program->files)
+            program->files = new FilesState;
+        return *program->files;
+    }
 
-    static std::deque<FileType> openedFiles;
+    static FilesState processFiles;
 
     static AbstractInputBuffer* consoleInputBuffer;
     static AbstractOutputBuffer* consoleOutputBuffer;
@@ -1872,7 +2481,6 @@ private:
     struct StringFormat {
         enum LexemFormat { Word, Literal, Line } literal;
     };
-    static Encoding fileEncoding;
 };
 
 
@@ -1895,6 +2503,7 @@ public:
             buffer.reserve(100);
             streamType_ = InternalBuffer;
             externalBuffer_ = 0;
+            fileBuffer_ = 0;
         }
         OutputStream(FILE * f, Encoding enc) {
             streamType_ = File;
@@ -1904,12 +2513,21 @@ public:
             else
                 encoding = enc;
             externalBuffer_ = 0;
+            fileBuffer_ = Files::getOutputBuffer(f, encoding);
+        }
+        OutputStream(FILE * f, FileOutputBuffer * buffer) {
+            streamType_ = File;
+            file = f;
+            encoding = buffer->encoding();
+            externalBuffer_ = 0;
+            fileBuffer_ = buffer;
         }
         OutputStream(AbstractOutputBuffer * buffer) {
             streamType_ = ExternalBuffer;
             file = 0;
             encoding = UTF8;
             externalBuffer_ = buffer;
+            fileBuffer_ = 0;
         }
 
         inline const String & getBuffer() const { return buffer; }
@@ -1917,17 +2535,9 @@ public:
 
         void writeRawString(const String & s) {
             if (type() == File) {
-                if (encoding==UTF8 && ftell(file)==0) {
-                    static const char * BOM = "\xEF\xBB\xBF";
-                    fwrite(BOM, sizeof(char), 3, file);
-                }
-                std::string bytes;
-                EncodingError encodingError;
-                bytes = Coder::encode(encoding, s, encodingError);
-                if (encodingError) {
+                if (!fileBuffer_->write(s)) {
                     Core::abort(Core::fromUtf8("Ошибка кодирования строки вывода: недопустимый символ"));
                 }
-                fwrite(bytes.c_str(), sizeof(char), bytes.length(), file);
             }
             else if (type() == ExternalBuffer) {
                 if (!externalBuffer_) {
@@ -1948,6 +2558,7 @@ public:
         Encoding encoding;
         String buffer;
         AbstractOutputBuffer * externalBuffer_;
+        FileOutputBuffer * fileBuffer_;
 
     };
 
@@ -1958,6 +2569,7 @@ public:
         inline InputStream() {
             streamType_ = InternalBuffer;
             file_=0;
+            fileBuffer_=0;
             encoding_=UTF8;
             errStart_=0;
             errLength_=0;
@@ -1968,6 +2580,7 @@ public:
         inline InputStream(const String & b) {
             streamType_ = InternalBuffer;
             file_=0;
+            fileBuffer_=0;
             encoding_=UTF8;
             errStart_=0;
             errLength_=0;
@@ -1979,6 +2592,7 @@ public:
         inline InputStream(AbstractInputBuffer * buffer) {
             streamType_ = ExternalBuffer;
             file_=0;
+            fileBuffer_=0;
             encoding_=UTF8;
             errStart_=0;
             errLength_=0;
@@ -1990,37 +2604,21 @@ public:
             streamType_ = File;
             file_ = f;
             externalBuffer_ = 0;
-            if (enc==DefaultEncoding) {
-                bool forceUtf8 = false;
-                if (f!=stdin) {
-                    long curpos = ftell(f);
-                    fseek(f, 0, SEEK_SET);
-                    unsigned char B[3];
-                    if (fread(B, 1, 3, f)==3) {
-                        forceUtf8 = B[0]==0xEF && B[1]==0xBB && B[2]==0xBF;
-                    }
-                    fseek(f, curpos, SEEK_SET);
-                }
-                if (forceUtf8)
-                    encoding_ = UTF8;
-                else
-                    encoding_ = Core::getSystemEncoding();
-            }
-            else {
-                encoding_ = enc;
-            }
+            fileBuffer_ = Files::getInputBuffer(f, enc);
+            encoding_ = fileBuffer_->encoding();
+            errStart_ = 0;
+            errLength_ = 0;
+            currentPosition_=0;
+        }
+        inline InputStream(FILE * f, FileInputBuffer * buffer) {
+            streamType_ = File;
+            file_ = f;
+            externalBuffer_ = 0;
+            fileBuffer_ = buffer;
+            encoding_ = fileBuffer_->encoding();
             errStart_ = 0;
             errLength_ = 0;
             currentPosition_=0;
-            if (f == stdin) {
-                fileSize_ = -1;
-            }
-            else {
-                long curpos = ftell(f);
-                fseek(f, 0L, SEEK_END);
-                fileSize_ = ftell(f);
-                fseek(f, curpos, SEEK_SET);
-            }
         }
         inline int currentPosition() const {
             return currentPosition_;
@@ -2050,7 +2648,6 @@ public:
             errStart_ = currentPosition_; errLength_ = 0; error_.clear();
         }
         inline bool readRawChar(Char & x) {
-            lastCharBuffer_[0] = lastCharBuffer_[1] = lastCharBuffer_[2] = '\0';
             if ( type() == InternalBuffer ) {
                 if (currentPosition_==buffer_.length())
                     return false;
@@ -2063,76 +2660,7 @@ public:
                 return externalBuffer_->readRawChar(x);
             }
             else {
-                if (feof(file_))
-                    return false;
-                long pos = ftell(file_);
-                if (fileSize_ != -1 && pos >= fileSize_) {
-                    return false;
-                }
-                charptr buffer = reinterpret_cast<charptr>(&lastCharBuffer_);
-                if (encoding_!=UTF8) {
-                    // Read only one byte
-                    lastCharBuffer_[0] = fgetc(file_);
-                    uint8_t firstByte = lastCharBuffer_[0];
-                    if (firstByte == 255 && fileSize_ == -1) {
-                        return false;
-                    }
-                }
-                else {
-                    // More complex...
-                    long cpos = ftell(file_);
-                    if (cpos==0) {
-                        // Try to read BOM
-                        static const char * BOM = "\xEF\xBB\xBF";
-                        char firstThree[3];
-                        bool seekBack = true;
-                        if (fread(firstThree,sizeof(char),3,file_)==3
-                                && strncmp(BOM, firstThree, 3)==0)
-                            seekBack = false;
-                        if (seekBack)
-                            fseek(file_, 0, SEEK_SET);
-                    }
-                    lastCharBuffer_[0] = fgetc(file_);
-                    uint8_t firstByte = lastCharBuffer_[0];
-                    uint8_t oneSymbMark = firstByte >> 5;
-                    uint8_t twoSymbMark = firstByte >> 4;
-                    if (firstByte==255 && file_==Files::getAssignedIn()) {
-//                        Core::abort(Core::fromUtf8("Ошибка чтения данных: входной поток закончился"));
-                        return false;
-                    }
-                    else if (firstByte==255) {
-                        return false;
-                    }
-                    int extraBytes = 0;
-                    if (firstByte>127) {
-                        if ( oneSymbMark & 0x06 )
-                            extraBytes = 1;
-                        else if ( twoSymbMark & 0x0E ) {
-                            extraBytes = 2;
-                        }
-                    }
-                    for (int i=0; i<extraBytes; i++) {
-                        if (feof(file_)) {
-                            Core::abort(Core::fromUtf8("Ошибка чтения данных из файла: UTF-8 файл поврежден"));
-                            return false;
-                        }
-                        lastCharBuffer_[i+1] = fgetc(file_);
-                    }
-                }
-                const std::string sb(buffer);
-                std::wstring res;
-                EncodingError encodingError;
-                res = Coder::decode(encoding_, sb, encodingError);
-                if (encodingError) {
-                    Core::abort(Core::fromUtf8("Ошибка перекодирования при чтении данных из текстового файла"));
-                    return false;
-                }
-                if (res.length()==0) {
-                    Core::abort(Core::fromUtf8("Ошибка перекодирования при чтении данных из текстового файла"));
-                    return false;
-                }
-                x = res.at(0);
-                return true;
+                return fileBuffer_->readRawChar(x);
             }
         }
         inline void pushLastCharBack() {
@@ -2144,18 +2672,16 @@ public:
                 externalBuffer_->pushLastCharBack();
             }
             else /* File */ {
-                if (file_==stdin) {
-                    if (lastCharBuffer_[2]!='\0')
-                        ungetc(lastCharBuffer_[2], file_);
-                    if (lastCharBuffer_[1]!='\0')
-                        ungetc(lastCharBuffer_[1], file_);
-                    ungetc(lastCharBuffer_[0], file_);
-                }
-                else {
-                    fseek(file_, -1*strlen(lastCharBuffer_), SEEK_CUR);
-                }
+                fileBuffer_->pushLastCharBack();
             }
         }
+        inline bool readDecimalInteger(const String & delimeters, int & value) {
+            if ( type() != File )
+                return false;
+            skipDelimiters(delimeters);
+            markPossibleErrorStart();
+            return fileBuffer_->readDecimalInteger(delimeters, value);
+        }
         inline String readUntil(const String & delimeters) {
             String result;
             result.reserve(100);
@@ -2190,15 +2716,14 @@ public:
     private:        
         StreamType streamType_;
         FILE * file_;
-        long fileSize_;
         Encoding encoding_;
         String buffer_;
         String error_;
         int errStart_;
         int errLength_;
         int currentPosition_;
-        char lastCharBuffer_[3];
         AbstractInputBuffer * externalBuffer_;
+        FileInputBuffer * fileBuffer_;
     }; // end inner class InputStream
 
 
@@ -2277,6 +2802,9 @@ public:
         return result;
     }
     inline static int readInteger(InputStream & is) {
+        int value = 0;
+        if (is.readDecimalInteger(inputDelimeters, value))
+            return value;
         String word = readWord(is);
         if (is.hasError()) return 0;
         Converter::ParseError error = Converter::NoError;
@@ -2417,25 +2945,19 @@ public:
             return InputStream(Files::getAssignedIn(), LOCALE_ENCODING);
         }
         else if (fileNo.getType() == FileType::Console) {
-            return InputStream(Files::consoleInputBuffer);
+            return InputStream(Files::getConsoleInputBuffer());
         }
         else {
-            std::deque<FileType>::iterator it = Files::openedFiles.begin();            
-            for ( ; it!=Files::openedFiles.end(); ++it) {
-                if (*it==fileNo) {
-                    break;
-                }
-            }
-            if (it==Files::openedFiles.end()) {
+            Files::OpenedFile * entry = Files::findOpenedFile(fileNo);
+            if (!entry) {
                 Core::abort(Core::fromUtf8("Файл с таким ключем не открыт"));
                 return InputStream();
             }
-            const FileType file = (*it);
-            if (file.getMode()!=FileType::Read) {
+            if (entry->file.getMode()!=FileType::Read) {
                 Core::abort(Core::fromUtf8("Файл с таким ключем открыт на запись"));
                 return InputStream();
             }
-            return InputStream((*it).handle, Files::fileEncoding);
+            return InputStream(entry->file.handle, Files::inputBufferOf(*entry));
         }
     }
 
@@ -2445,25 +2967,19 @@ public:
             return OutputStream(Files::getAssignedOut(), LOCALE_ENCODING);
         }
         else if (fileNo.getType() == FileType::Console) {
-            return OutputStream(Files::consoleOutputBuffer);
+            return OutputStream(Files::getConsoleOutputBuffer());
         }
         else {
-            std::deque<FileType>::iterator it = Files::openedFiles.begin();            
-            for ( ; it!=Files::openedFiles.end(); ++it) {
-                if (*it==fileNo) {
-                    break;
-                }
-            }
-            if (it==Files::openedFiles.end()) {
+            Files::OpenedFile * entry = Files::findOpenedFile(fileNo);
+            if (!entry) {
                 Core::abort(Core::fromUtf8("Файл с таким ключем не открыт"));
                 return OutputStream();
             }
-            const FileType file = (*it);
-            if (file.getMode()==FileType::Read) {
+            if (entry->file.getMode()==FileType::Read) {
                 Core::abort(Core::fromUtf8("Файл с таким ключем открыт на чтение"));
                 return OutputStream();
             }
-            return OutputStream((*it).handle, Files::fileEncoding);
+            return OutputStream(entry->file.handle, Files::outputBufferOf(*entry));
         }
     }
 
@@ -2581,6 +3097,14 @@ inline void initStandardLibrary() {
     System::init();
 }
 
+ProgramState::~ProgramState()
+{
+    if (files) {
+        Files::releaseState(*files);
+        delete files;
+    }
+}
+
 inline void finalizeStandardLibrary() {
     Core::finalize();
     Math::finalize();
@@ -2593,19 +3117,17 @@ inline void finalizeStandardLibrary() {
 
 #ifndef DO_NOT_DECLARE_STATIC
 String Core::error = String();
+thread_local ProgramState * Core::threadState = 0;
 void (*Core::AbortHandler)() = 0;
-std::deque<FileType> Files::openedFiles;
+FilesState Files::processFiles;
 AbstractInputBuffer* Files::consoleInputBuffer = 0;
 AbstractOutputBuffer* Files::consoleOutputBuffer = 0;
 AbstractOutputBuffer* Files::consoleErrorBuffer = 0;
-FILE * Files::assignedIN = stdin;
-FILE * Files::assignedOUT = stdout;
 #if defined(WIN32) || defined(_WIN32)
 Encoding IO::LOCALE_ENCODING = CP866;
 #else
 Encoding IO::LOCALE_ENCODING = UTF8;
 #endif
-Encoding Files::fileEncoding;
 String Kumir::IO::inputDelimeters = Kumir::Core::fromAscii(" \n\t");
 #endif
 
@@ -5,6 +5,7 @@
 #include "variant.hpp"
 #include "vm_instruction.hpp"
 #include "vm_tableelem.hpp"
+#include "vm_bytecode_image.hpp"
 
 namespace VM {
 
@@ -19,13 +20,34 @@ enum ContextRunMode {
 typedef std::pair<String,String> TwoStrings;
 
 struct ExternReference {
+    inline ExternReference() {
+        moduleContext = 0; funcKey = 0; platformDependent = false;
+        clearCallCache();
+    }
+
+    /* Forget targets resolved by calls, must be done when module
+     * contexts or call functor may be changed */
+    inline void clearCallCache() {
+        resolved = false; module = nullptr;
+        function = nullptr; locals = nullptr;
+        arguments.clear();
+    }
+
     int moduleContext;
     uint32_t funcKey;
     std::string moduleAsciiName;
     String moduleLocalizedName;
+    String algorithmName;
     bool platformDependent;
     String fileName;
     std::string platformModuleName;
+
+    // Inline cache filled by first call
+    bool resolved;
+    void * module; // handle of platform-dependent module
+    const Bytecode::TableElem * function; // algorithm of kumir module
+    const std::vector<Variable> * locals; // clean locals of kumir algorithm
+    std::deque<Variable> arguments; // reused by calls of platform-dependent module
 };
 
 typedef std::map<uint32_t, ExternReference> ExternsMap;
@@ -44,6 +66,9 @@ typedef std::vector<Variable> VariantArray;
 // module_id|alogithm_id -> local variable
 typedef std::map<uint32_t, VariantArray> LocalsMap;
 
+// module_id|alogithm_id -> local variables not decoded yet
+typedef std::map<uint32_t, std::vector<Bytecode::TableElem> > LazyLocalsMap;
+
 struct Context {
     inline Context() {
         IP = -1; type = Bytecode::EL_FUNCTION;
@@ -54,7 +79,15 @@ struct Context {
         columnStart = columnEnd = 0u;
     }
 
-    VM::AnyValue registers[255];
+    /** Register r (1..255) of this context, allocated on first access
+     *  to keep deep recursion frames small */
+    inline VM::AnyValue & registerAt(uint8_t r) {
+        if (r>=registers.size())
+            registers.resize(r+1);
+        return registers[r];
+    }
+
+    std::vector<VM::AnyValue> registers;
     int IP;
     std::vector<Variable> locals;
     const std::vector<Bytecode::Instruction> * program;
@@ -69,6 +102,24 @@ struct Context {
     Kumir::String name;
 };
 
+/* Identity of a context kept after it is popped from stack,
+ * so returning from a deep frame never copies its locals */
+struct ContextSummary {
+    inline ContextSummary() {
+        type = Bytecode::EL_FUNCTION; runMode = CRM_ToEnd;
+        moduleId = 0; algId = -1;
+    }
+    inline explicit ContextSummary(const Context & c) {
+        type = c.type; runMode = c.runMode;
+        moduleId = c.moduleId; algId = c.algId;
+    }
+
+    Bytecode::ElemType type;
+    ContextRunMode runMode;
+    uint8_t moduleId;
+    int algId;
+};
+
 struct ModuleContext {
     Kumir::String filename;
     FunctionMap functions;
@@ -76,6 +127,8 @@ struct ModuleContext {
     std::list<ExternReference> externInits;
     std::deque<Bytecode::TableElem> inits;
     LocalsMap cleanLocalTables;
+    LazyLocalsMap lazyLocalTables;
+    std::shared_ptr<const Bytecode::Image> image;
     GlobalsMap globals;
     std::vector<Kumir::String> moduleNames;
     ConstantsMap constants;
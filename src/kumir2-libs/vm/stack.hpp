@@ -3,71 +3,118 @@
 
 #include <cstdlib>
 #include <vector>
+#include <utility>
 
 namespace VM {
 
+/* Stack of fixed size segments. Growing never moves existing elements,
+ * so pushing is O(1) at any depth and references to elements stay valid
+ * until reset. Popped elements are kept to be reused by next pushes */
 template <class T> class Stack
 {
 public:
     inline void push(const T& t)
     {
         currentIndex_ ++;
-        if (currentIndex_>=(int)data_.size()) {
-            data_.resize(data_.size()+deltaSize_);
-        }
-        data_[currentIndex_] = t;
+        if (currentIndex_>=reservedSize())
+            grow();
+        at(currentIndex_) = t;
+    }
+
+    inline void push(T&& t)
+    {
+        currentIndex_ ++;
+        if (currentIndex_>=reservedSize())
+            grow();
+        at(currentIndex_) = std::move(t);
     }
 
     inline T pop()
     {
         currentIndex_--;
-        return data_[currentIndex_+1];
+        return at(currentIndex_+1);
+    }
+
+    /** Removes top element without copying it */
+    inline void drop()
+    {
+        currentIndex_--;
     }
 
     inline T& top()
     {
-        return data_[currentIndex_];
+        return at(currentIndex_);
     }
 
     inline const T& top() const
     {
-        return data_[currentIndex_];
+        return at(currentIndex_);
     }
 
     inline T& at(int index)
     {
-        return data_[index];
+        return segments_[index >> SegmentBits][index & SegmentMask];
     }
 
     inline const T& at(int index) const
     {
-        return data_[index];
+        return segments_[index >> SegmentBits][index & SegmentMask];
     }
 
     inline int size() const { return currentIndex_+1; }
-    inline int reservedSize() const { return data_.size(); }
+    inline int reservedSize() const { return int(segments_.size()) << SegmentBits; }
 
     inline void reset()
     {
-        data_ = std::vector<T>(initialSize_);
+        // Keep the first segment allocated, it is enough for most programs
+        for (size_t i=1; i<segments_.size(); i++)
+            delete[] segments_[i];
+        segments_.resize(1);
+        for (int i=0; i<SegmentSize; i++)
+            segments_[0][i] = T();
         currentIndex_ = -1;
     }
 
     inline ~Stack()
     {
-        data_.clear();
+        for (size_t i=0; i<segments_.size(); i++)
+            delete[] segments_[i];
+        segments_.clear();
     }
 
 private:
-    int initialSize_;
-    int deltaSize_;
+    enum { SegmentBits = 7, SegmentSize = 1 << SegmentBits, SegmentMask = SegmentSize - 1 };
+
+    inline void grow()
+    {
+        segments_.push_back(new T[SegmentSize]);
+    }
+
     int currentIndex_;
-    std::vector<T> data_;
+    std::vector<T*> segments_;
+
 public:
     inline Stack() {
-        initialSize_ = deltaSize_ = 100;
         currentIndex_ = 0;
-        data_ = std::vector<T>(100);
+        grow();
+    }
+
+    inline Stack(const Stack & other) {
+        currentIndex_ = other.currentIndex_;
+        for (size_t i=0; i<other.segments_.size(); i++) {
+            grow();
+            for (int j=0; j<SegmentSize; j++)
+                segments_[i][j] = other.segments_[i][j];
+        }
+    }
+
+    inline Stack & operator=(const Stack & other) {
+        if (this != &other) {
+            Stack copy(other);
+            std::swap(currentIndex_, copy.currentIndex_);
+            std::swap(segments_, copy.segments_);
+        }
+        return *this;
     }
 };
 
@@ -10,6 +10,7 @@
 #include <kumir2-libs/stdlib/kumirstdlib.hpp>
 #include "vm_enums.h"
 
+#include <atomic>
 
 
 
@@ -25,6 +26,45 @@ struct Record {
     std::vector<class AnyValue> fields;
 };
 
+/* Total size of strings and tables data held by values, used to limit
+ * memory of running program. Values of program evaluated by thread bound
+ * to its library state (see Kumir::Core::bindThreadState) are counted
+ * there, so programs evaluated in parallel do not share the counter */
+struct ValuesMemory {
+    static std::atomic<int64_t> allocated;
+    inline static void add(int64_t bytes) {
+        Kumir::ProgramState * program = Kumir::Core::boundThreadState();
+        if (program)
+            program->memoryUsed += bytes;
+        else
+            allocated.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    inline static int64_t used() {
+        const Kumir::ProgramState * program = Kumir::Core::boundThreadState();
+        return program? program->memoryUsed : allocated.load(std::memory_order_relaxed);
+    }
+};
+
+/* String data shared by copies of AnyValue. Copying a value just
+ * increments the counter, and the data is never modified while
+ * it is visible through more than one value */
+class SharedString
+{
+public:
+    inline explicit SharedString(const String & s): data(s), refs_(1) {
+        ValuesMemory::add(bytes());
+    }
+    inline ~SharedString() { ValuesMemory::add(-bytes()); }
+    inline int64_t bytes() const { return int64_t(data.length())*sizeof(Char); }
+    inline void ref() { refs_++; }
+    inline void unref() { if (--refs_ == 0) delete this; }
+    inline int refs() const { return refs_; }
+
+    String data;
+private:
+    std::atomic<int> refs_;
+};
+
 class AnyValue
 {
     friend class Variable;
@@ -34,13 +74,15 @@ public:
         __init__();
         type_ = other.type_;
         if (other.svalue_) {
-            svalue_ = new String(*(other.svalue_));
+            svalue_ = other.svalue_;
+            svalue_->ref();
         }
         if (other.uvalue_) {
             uvalue_ = new Record(*(other.uvalue_));
         }
         if (other.avalue_) {
             avalue_ = new std::vector<class AnyValue>(*(other.avalue_));
+            ValuesMemory::add(arrayBytes(avalue_->size()));
         }
         if (type_==VT_int)
             ivalue_ = other.ivalue_;
@@ -52,7 +94,7 @@ public:
             cvalue_ = other.cvalue_;
     }
 
-    inline explicit AnyValue(ValueType t): svalue_(0), avalue_(0), uvalue_(0) { __init__(); type_ = t;  svalue_ = t==VT_string? new String() : 0; ivalue_ = 0; }
+    inline explicit AnyValue(ValueType t): svalue_(0), avalue_(0), uvalue_(0) { __init__(); type_ = t;  svalue_ = t==VT_string? new SharedString(String()) : 0; ivalue_ = 0; }
     inline explicit AnyValue(int v): svalue_(0), avalue_(0), uvalue_(0) {
         __init__();
         type_ = VT_int;
@@ -61,35 +103,45 @@ public:
     inline explicit AnyValue(real v): svalue_(0), avalue_(0), uvalue_(0) { __init__(); type_ = VT_real;  rvalue_ = v; }
     inline explicit AnyValue(bool v): svalue_(0), avalue_(0), uvalue_(0) { __init__(); type_ = VT_bool; bvalue_ = v; }
     inline explicit AnyValue(Char v): svalue_(0), avalue_(0), uvalue_(0) { __init__(); type_ = VT_char; cvalue_ = v; }
-    inline explicit AnyValue(const String & v): svalue_(0), avalue_(0), uvalue_(0) { __init__(); type_ = VT_string; svalue_ = new String(v); }
+    inline explicit AnyValue(const String & v): svalue_(0), avalue_(0), uvalue_(0) { __init__(); type_ = VT_string; svalue_ = new SharedString(v); }
     inline explicit AnyValue(const Record & value): svalue_(0), avalue_(0), uvalue_(0) {
         __init__();
         type_ = VT_record;
         uvalue_ = new Record(value);
     }
 
-    inline void operator=(ValueType t) { __init__(); type_ = t;  svalue_ = t==VT_string? new String() : 0; }
+    inline void operator=(ValueType t) { __init__(); type_ = t;  svalue_ = t==VT_string? new SharedString(String()) : 0; }
     inline void operator=(int v) { __init__(); type_ = VT_int;  ivalue_ = v; }
     inline void operator=(real v) { __init__(); type_ = VT_real; rvalue_ = v; }
     inline void operator=(bool v) { __init__(); type_ = VT_bool; bvalue_ = v; }
     inline void operator=(Char v) { __init__(); type_ = VT_char; cvalue_ = v; }
-    inline void operator=(const String & v) { __init__(); type_ = VT_string; svalue_ = new String(v); }
+    inline void operator=(const String & v) {
+        SharedString * newString = new SharedString(v);
+        __init__();
+        type_ = VT_string;
+        svalue_ = newString;
+    }
     inline void operator=(const Record & value) {
         __init__();
         type_ = VT_record;
         uvalue_ = new Record(value);
     }
     inline void operator=(const AnyValue &other) {
+        if (this == &other)
+            return;
+        // Take a reference before releasing own data, they might be the same
+        SharedString * otherString = other.svalue_;
+        if (otherString)
+            otherString->ref();
         __init__();
         type_ = other.type_;
-        if (other.svalue_) {
-            svalue_ = new String(*(other.svalue_));
-        }
+        svalue_ = otherString;
         if (other.uvalue_) {
             uvalue_ = new Record(*(other.uvalue_));
         }
         if (other.avalue_) {
             avalue_ = new std::vector<class AnyValue>(*(other.avalue_));
+            ValuesMemory::add(arrayBytes(avalue_->size()));
         }
         if (type_==VT_int)
             ivalue_ = other.ivalue_;
@@ -114,12 +166,12 @@ public:
         if (type_==VT_int) return ivalue_ > 0;
         else if (type_==VT_real) return rvalue_ > 0.0;
         else if (type_==VT_char) return cvalue_ != '\0';
-        else if (type_==VT_string) return svalue_ && svalue_->length() > 0;
+        else if (type_==VT_string) return svalue_ && svalue_->data.length() > 0;
         else return bvalue_;
     }
     inline Char toChar() const {
         if (type_==VT_int) return static_cast<Char>(ivalue_);
-        else if (type_==VT_string && svalue_ && svalue_->length()==1) return svalue_->at(0);
+        else if (type_==VT_string && svalue_ && svalue_->data.length()==1) return svalue_->data.at(0);
         else return cvalue_;
     }
     inline String toString() const {
@@ -133,10 +185,25 @@ public:
         }
         else if (type_==VT_void) return String();
         else if (svalue_)
-            return String(*svalue_);
+            return svalue_->data;
         else
             return String();
     }
+
+    /** Appends to string value in place instead of making a new string.
+     *  It is possible only when string data is not shared with other
+     *  values, except 'owner' which is going to be overwritten by
+     *  this value right after. Returns false if a copy is required */
+    inline bool appendString(const String & s, const AnyValue * owner) {
+        if (type_!=VT_string || !svalue_)
+            return false;
+        const int allowedRefs = owner && owner->svalue_==svalue_ ? 2 : 1;
+        if (svalue_->refs() != allowedRefs)
+            return false;
+        svalue_->data.append(s);
+        ValuesMemory::add(int64_t(s.length())*sizeof(Char));
+        return true;
+    }
     inline const Record & toRecord() const {
         return *uvalue_;
     }
@@ -156,8 +223,9 @@ public:
     inline size_t rawSize() const { return avalue_? avalue_->size() : 0; }
     inline ~AnyValue() {
         if (svalue_)
-            delete svalue_;
+            svalue_->unref();
         if (avalue_) {
+            ValuesMemory::add(-arrayBytes(avalue_->size()));
             avalue_->clear();
             delete avalue_;
         }
@@ -170,28 +238,35 @@ public:
 protected:
 
     inline void resize(size_t size) {
-        if (!avalue_)
+        if (!avalue_) {
             avalue_ = new std::vector<class AnyValue>(size);
+            ValuesMemory::add(arrayBytes(size));
+        }
         if (size==0) {
-            if (avalue_->size())
+            if (avalue_->size()) {
+                ValuesMemory::add(-arrayBytes(avalue_->size()));
                 avalue_->clear();
+            }
         }
         else {
             if (size != avalue_->size()) {
-                size_t asize = avalue_->size();
+                ValuesMemory::add(arrayBytes(size) - arrayBytes(avalue_->size()));
                 avalue_->resize(size);
             }
         }
     }
 
 private:
+    inline static int64_t arrayBytes(size_t size) { return int64_t(size)*sizeof(AnyValue); }
+
     inline void __init__() {
         if (avalue_) {
+            ValuesMemory::add(-arrayBytes(avalue_->size()));
             avalue_->clear();
             delete avalue_;
         }
         if (svalue_) {
-            delete svalue_;
+            svalue_->unref();
         }
         if (uvalue_) {
             delete uvalue_;
@@ -210,7 +285,7 @@ private:
         Char cvalue_;
         bool bvalue_;
     };
-    String * svalue_;
+    SharedString * svalue_;
     std::vector<class AnyValue> * avalue_;
     Record * uvalue_;
 };
@@ -373,6 +448,20 @@ public:
     inline AnyValue & operator[](size_t index) { return at(index); }
 
     inline bool isReference() const { return reference_!=0; }
+
+    /** Storage of scalar value (following references), or null
+     *  if this is a reference to table element */
+    inline const AnyValue * plainValueStorage() const {
+        if (!reference_)
+            return &value_;
+        else if (referenceIndeces_[3]==0)
+            return reference_->plainValueStorage();
+        else
+            return 0;
+    }
+    inline bool appendString(const String & s, const AnyValue * owner) {
+        return !reference_ && dimension_==0 && value_.appendString(s, owner);
+    }
     inline void setReference(Variable * r, int effectiveBounds[7]) {
         reference_ = r;
         memcpy(bounds_, effectiveBounds, 7*sizeof(int));
@@ -1041,6 +1130,7 @@ String Variable::fullReferenceName() const
 
 #ifndef DO_NOT_DECLARE_STATIC_VARIANT
 bool Variable::ignoreUndefinedError = false;
+std::atomic<int64_t> ValuesMemory::allocated(0);
 #endif
 
 }
@@ -10,6 +10,7 @@
 #include <fstream>
 #include <memory>
 #include <algorithm>
+#include <chrono>
 
 #include <kumir2-libs/stdlib/kumirstdlib.hpp>
 #include "vm_bytecode.hpp"
@@ -19,6 +20,7 @@
 #include "stack.hpp"
 #include "vm_abstract_handlers.h"
 #include "vm_breakpoints_table.hpp"
+#include "vm_profiler.hpp"
 
 #ifndef MAX_RECURSION_SIZE
 #define MAX_RECURSION_SIZE 4000
@@ -40,6 +42,10 @@ public /*methods*/:
 
     inline bool loadProgramFromBinaryBuffer(std::list<char> & stream, bool isMain, const String & filename, String & error);
 
+    /** Load program from bytecode image, algorithms and their local
+     *  variables are decoded on first call */
+    inline bool loadProgramFromImage(const std::shared_ptr<const Bytecode::Image> & image, bool isMain, const String & filename, String & error);
+
     /** Set entry point to Main or Testing algorithm */
     inline void setEntryPoint(EntryPoint ep) { entryPoint_ = ep; }
     inline EntryPoint entryPoint() const { return entryPoint_; }
@@ -54,16 +60,50 @@ public /*methods*/:
     /** Reset program to initial state */
     inline void reset();
 
+    /** Capture globals after modules initialization on the first run and
+     *  restore them on next resets instead of evaluating initialization
+     *  code again. Useful to run the same program many times.
+     *  Modules initialization calling any algorithms is always evaluated */
+    inline void setInitSnapshotEnabled(bool enabled) { initSnapshotEnabled_ = enabled; }
+    inline bool isInitSnapshotEnabled() const { return initSnapshotEnabled_; }
+
     inline bool hasTestingAlgorithm() const;
     inline unsigned long int stepsDone() const { return stepsCounter_; }
 
-
-    /** Breakpoint operations */
+    enum ResourceLimit {
+        RL_None,
+        RL_Instructions,
+        RL_Time,
+        RL_Memory
+    };
+
+    /** Resource limits to run untrusted programs, 0 means no limit.
+     *  Memory limit counts strings and tables data allocated after reset.
+     *  A program exceeding some limit stops with an error,
+     *  and exceededLimit() tells which one */
+    inline void setInstructionsLimit(uint64_t count) { instructionsLimit_ = count; }
+    inline void setTimeLimit(uint32_t msecs) { timeLimit_ = msecs; }
+    inline void setMemoryLimit(uint64_t bytes) { memoryLimit_ = bytes; }
+    inline ResourceLimit exceededLimit() const { return exceededLimit_; }
+    inline uint64_t instructionsDone() const {
+        return instructionsDone_ + (limitsCheckInterval_ - limitsCheckCountdown_);
+    }
+
+
+    /** Breakpoint operations; condition is compiled in place of breakpoint
+     *  line: element of function or initializer holding instructions which
+     *  calculate condition and constants they load, or empty data for
+     *  breakpoint without condition */
     inline void removeAllBreakpoints();
-    inline void insertOrChangeBreakpoint(const bool enabled, const String &fileName, const uint32_t lineNo, const uint32_t ignoreCount, const String &condition);
+    inline void insertOrChangeBreakpoint(const bool enabled, const String &fileName, const uint32_t lineNo, const uint32_t ignoreCount, const Bytecode::Data &condition);
     inline void insertSingleHitBreakpoint(const String &fileName, uint32_t lineNo);
     inline void removeBreakpoint(const String &fileName, const uint32_t lineNo);
 
+    /** Sets profiler to collect lines and algorithms statistics
+     *  or nullptr to run without profiling */
+    inline void setProfiler(Profiler * profiler) { profiler_ = profiler; }
+    inline Profiler * profiler() const { return profiler_; }
+
     /** Sets the Debugging Interaction handler for this VM */
     inline void setDebuggingHandler(
             DebuggingInteractionHandler * h
@@ -94,6 +134,11 @@ public /*methods*/:
     inline bool hasMoreInstructions() const;
     inline void evaluateNextInstruction();
 
+    /** Returns 'true' if next instruction reads console input, so host
+     *  evaluating many programs in turns can postpone it until
+     *  user types something instead of blocking */
+    inline bool isAboutToReadConsole() const;
+
     /** Return current 'line number' or -1 if not applicable */
     inline int effectiveLineNo() const;
     inline std::pair<uint32_t,uint32_t> effectiveColumn() const;
@@ -114,6 +159,11 @@ public /*methods*/:
     inline size_t functionCallStackSize() const;
     inline const Stack<Context> & callStack() const { return contextsStack_; }
 
+    /** Maximum depth of algorithm calls, 0 means no limit.
+     *  Default is MAX_RECURSION_SIZE */
+    inline void setRecursionLimit(int limit) { recursionLimit_ = limit; }
+    inline int recursionLimit() const { return recursionLimit_; }
+
     /** Returns last error */
     inline const String & error() const {
         if (error_.length()==0 && Kumir::Core::getError().length()>0)
@@ -164,7 +214,8 @@ private /*fields*/:
 
     uint8_t evaluationResult_;
 
-    Context lastContext_;
+    ContextSummary lastContext_;
+    int recursionLimit_;
     int backtraceSkip_;
     String error_;
     AnyValue register0_;
@@ -184,12 +235,34 @@ private /*fields*/:
     uint32_t previousColEnd_;
 
     BreakpointsTable breakpointsTable_;
+    Profiler * profiler_;
+
+    uint64_t instructionsLimit_;
+    uint32_t timeLimit_;
+    uint64_t memoryLimit_;
+    ResourceLimit exceededLimit_;
+    uint64_t instructionsDone_;
+    int limitsCheckInterval_;
+    int limitsCheckCountdown_;
+    std::chrono::steady_clock::time_point startTime_;
+    int64_t memoryAtStart_;
+
+    typedef std::pair<std::string, Kumir::String> ModuleRef;
+    bool initSnapshotEnabled_;
+    bool initSnapshotValid_;
+    bool initSnapshotAllowed_;
+    std::vector<GlobalsMap> initSnapshot_;
+    std::set<ModuleRef> snapshotExternalModules_;
 
 
 public /*constructors*/:
     inline KumirVM();
 private /*methods*/:
+    friend class BreakpointsTable;
     inline static Variable fromTableElem(const Bytecode::TableElem & e);
+    inline bool isBreakpointConditionSatisfied(BreakpointCondition & condition);
+    inline Bytecode::TableElem & loadedFunction(ModuleContext & moduleContext, uint32_t key);
+    inline void clearExternCallCaches();
     inline int contextByIds(int moduleId, int algorhitmId) const;
     inline Context & currentContext();
     inline void nextIP();
@@ -201,6 +274,19 @@ private /*methods*/:
     inline void checkFunctors();
 
     inline bool isRunningMain() const;
+    inline bool appendToStringInPlace();
+    inline void resetResourceCounters();
+    inline bool checkResourceLimits();
+    inline bool checkMemoryLimit(int64_t bytesToAllocate);
+    inline void stopByLimit(ResourceLimit limit);
+    inline bool isRecursionLimitReached() const {
+        return recursionLimit_>0 && contextsStack_.size()>=recursionLimit_;
+    }
+
+    inline void profileEnterContext(const Context & c);
+
+    inline static bool isSnapshotSafe(const std::vector<Bytecode::Instruction> & program);
+    inline void captureInitSnapshot();
 
 private /*instruction methods*/:
     inline void do_call(uint8_t, uint16_t);
@@ -253,6 +339,18 @@ private /*instruction methods*/:
     inline void do_gt();
     inline void do_leq();
     inline void do_geq();
+
+    inline void do_isum();
+    inline void do_isub();
+    inline void do_imul();
+    inline void do_ineg();
+    inline void do_icompare(Bytecode::InstructionType op);
+    inline void do_rsum();
+    inline void do_rsub();
+    inline void do_rmul();
+    inline void do_rdiv();
+    inline void do_rneg();
+    inline void do_rcompare(Bytecode::InstructionType op);
 };
 
 
@@ -353,6 +451,7 @@ void KumirVM::setFunctor(Functor * functor)
     case Functor::ExternalModuleCall:
         externalModuleCall_ =
                 dynamic_cast<ExternalModuleCallFunctor*>(functor);
+        clearExternCallCaches();
         break;
     case Functor::Input:
         input_ =
@@ -393,11 +492,14 @@ void KumirVM::setFunctor(Functor * functor)
 
 void KumirVM::setProgram(const Bytecode::Data &program, bool isMain, const String & filename, Kumir::String * error)
 {
+    initSnapshotValid_ = false;
+    initSnapshot_.clear();
     if (isMain) {
         moduleContexts_.clear();
     }
     moduleContexts_.push_back(ModuleContext());
     moduleContexts_.back().filename = filename;
+    moduleContexts_.back().image = program.image;
     int currentModuleContext = moduleContexts_.size()-1;
     moduleContexts_.back().globals.clear();
     moduleContexts_.back().constants.clear();
@@ -411,7 +513,7 @@ void KumirVM::setProgram(const Bytecode::Data &program, bool isMain, const Strin
     moduleContexts_.back().constants.reserve(256);
     LocalsMap locals;
     for (int i=0; i<(int)program.d.size(); i++) {
-        const TableElem e = program.d[i];
+        const TableElem & e = program.d[i];
         if (e.type==EL_GLOBAL) {
             if (moduleContexts_[currentModuleContext].globals.size()<=e.module) {
                 moduleContexts_[currentModuleContext].globals.resize(e.module+1);
@@ -430,6 +532,10 @@ void KumirVM::setProgram(const Bytecode::Data &program, bool isMain, const Strin
             moduleContexts_[currentModuleContext].constants[e.id] = fromTableElem(e);
 
         }
+        else if (e.type==EL_LOCAL && e.imageOffset) {
+            const uint32_t key = (uint32_t(e.module) << 16) | e.algId;
+            moduleContexts_[currentModuleContext].lazyLocalTables[key].push_back(e);
+        }
         else if (e.type==EL_LOCAL) {
             uint32_t key = 0x00000000;
             uint32_t alg = e.algId;
@@ -470,11 +576,11 @@ void KumirVM::setProgram(const Bytecode::Data &program, bool isMain, const Strin
                 }
                 Kumir::EncodingError encodingError;
                 const std::string filename = Kumir::Coder::encode(VM_LOCALE, modulePath, encodingError);
-                std::ifstream externalfile(filename.c_str());
-                if (
-                        !Kumir::Files::exist(modulePath)
-                        || !externalfile.is_open()
-                   )
+                // Large modules are mapped, so only algorithms called are read
+                std::shared_ptr<const Bytecode::Image> image;
+                if (Kumir::Files::exist(modulePath))
+                    image = Bytecode::Image::fromFile(filename);
+                if (!image)
                 {
                     int errorCode = errno;
                     Kumir::String errorMessage = Kumir::Core::fromUtf8("Не могу загрузить внешний исполнитель: ")
@@ -489,8 +595,7 @@ void KumirVM::setProgram(const Bytecode::Data &program, bool isMain, const Strin
                     return;
                 }
                 Bytecode::Data programData;
-                Bytecode::bytecodeFromDataStream(externalfile, programData);
-                externalfile.close();
+                Bytecode::bytecodeFromImage(image, programData);
                 setProgram(programData, false, e.fileName, error);
                 if (error && error->length())
                     return;
@@ -567,6 +672,7 @@ void KumirVM::setProgram(const Bytecode::Data &program, bool isMain, const Strin
             reference.funcKey = alg;
             reference.moduleAsciiName = e.moduleAsciiName;
             reference.moduleLocalizedName = e.moduleLocalizedName;
+            reference.algorithmName = e.name;
             reference.fileName = e.fileName;
             Kumir::EncodingError encodingError;
             reference.platformModuleName = Kumir::Coder::encode(
@@ -632,6 +738,36 @@ void KumirVM::setProgram(const Bytecode::Data &program, bool isMain, const Strin
     currentConstants_ = nullptr;
 }
 
+Bytecode::TableElem & KumirVM::loadedFunction(ModuleContext & moduleContext, uint32_t key)
+{
+    Bytecode::TableElem & function = moduleContext.functions[key];
+    if (function.imageOffset) {
+        Bytecode::decodeLazyTableElem(*moduleContext.image, function);
+    }
+    LazyLocalsMap::iterator lazyLocals = moduleContext.lazyLocalTables.find(key);
+    if (lazyLocals!=moduleContext.lazyLocalTables.end()) {
+        VariantArray & lcs = moduleContext.cleanLocalTables[key];
+        std::vector<Bytecode::TableElem> & elems = lazyLocals->second;
+        for (size_t i=0; i<elems.size(); i++) {
+            Bytecode::decodeLazyTableElem(*moduleContext.image, elems[i]);
+            lcs.push_back(fromTableElem(elems[i]));
+            lcs.back().setAlgorhitmName(function.name);
+        }
+        moduleContext.lazyLocalTables.erase(lazyLocals);
+    }
+    return function;
+}
+
+void KumirVM::clearExternCallCaches()
+{
+    for (size_t i=0; i<moduleContexts_.size(); i++) {
+        ExternsMap & externs = moduleContexts_[i].externs;
+        for (ExternsMap::iterator it=externs.begin(); it!=externs.end(); ++it) {
+            it->second.clearCallCache();
+        }
+    }
+}
+
 KumirVM::KumirVM()
     : moduleContexts_(std::vector<ModuleContext>())
     , entryPoint_(EP_Main)
@@ -650,7 +786,8 @@ KumirVM::KumirVM()
     , returnMainValue_(nullptr)
     , pause_(nullptr)
     , delay_(nullptr)
-    , lastContext_(Context())
+    , lastContext_(ContextSummary())
+    , recursionLimit_(MAX_RECURSION_SIZE)
     , backtraceSkip_(0)
     , error_(Kumir::String())
     , register0_(AnyValue(0))
@@ -661,6 +798,18 @@ KumirVM::KumirVM()
     , currentGlobals_(nullptr)
     , currentLocals_(nullptr)
     , consoleInputBuffer_(nullptr)
+    , profiler_(nullptr)
+    , instructionsLimit_(0u)
+    , timeLimit_(0u)
+    , memoryLimit_(0u)
+    , exceededLimit_(RL_None)
+    , instructionsDone_(0u)
+    , limitsCheckInterval_(0)
+    , limitsCheckCountdown_(0)
+    , memoryAtStart_(0)
+    , initSnapshotEnabled_(false)
+    , initSnapshotValid_(false)
+    , initSnapshotAllowed_(false)
 {
 
 }
@@ -748,10 +897,29 @@ void KumirVM::removeAllBreakpoints()
     if (stacksMutex_) stacksMutex_->unlock();
 }
 
-void KumirVM::insertOrChangeBreakpoint(const bool enabled, const Kumir::String &fileName, const uint32_t lineNo, const uint32_t ignoreCount, const Kumir::String &)
+void KumirVM::insertOrChangeBreakpoint(const bool enabled, const Kumir::String &fileName, const uint32_t lineNo, const uint32_t ignoreCount, const Bytecode::Data &condition)
 {
+    BreakpointCondition compiled;
+    for (size_t i=0; i<condition.d.size(); i++) {
+        const TableElem & e = condition.d[i];
+        if (e.type==EL_CONST) {
+            if (compiled.constants.size()<=e.id)
+                compiled.constants.resize(e.id+1);
+            compiled.constants[e.id] = fromTableElem(e);
+        }
+        else if (e.type==EL_INIT) {
+            compiled.instructions = e.instructions;
+            compiled.moduleId = e.module;
+            compiled.algId = -1;
+        }
+        else if (e.type==EL_FUNCTION || e.type==EL_MAIN || e.type==EL_TESTING) {
+            compiled.instructions = e.instructions;
+            compiled.moduleId = e.module;
+            compiled.algId = e.algId;
+        }
+    }
     if (stacksMutex_) stacksMutex_->lock();
-    breakpointsTable_.insertOrChangeBreakpoint(enabled, fileName, lineNo, ignoreCount, 0);
+    breakpointsTable_.insertOrChangeBreakpoint(enabled, fileName, lineNo, ignoreCount, compiled);
     if (stacksMutex_) stacksMutex_->unlock();
 }
 
@@ -775,7 +943,7 @@ void KumirVM::reset()
     if (stacksMutex_) {
         stacksMutex_->reset();
     }
-    lastContext_ = Context();
+    lastContext_ = ContextSummary();
     blindMode_ = false;
     nextCallInto_ = false;
     backtraceSkip_ = 0;
@@ -789,6 +957,10 @@ void KumirVM::reset()
     previousLineNo_ = -1;
     previousColStart_ = previousColEnd_ = 0u;
     evaluationResult_ = 0u;
+    breakpointsTable_.resetHitCounts();
+    // Module contexts might be moved while loading program
+    clearExternCallCaches();
+    const bool useInitSnapshot = initSnapshotEnabled_ && initSnapshotValid_;
 
     checkFunctors();
 
@@ -819,6 +991,7 @@ void KumirVM::reset()
         uint32_t mod = pMainProgram->module;
         uint32_t alg = pMainProgram->algId;
         uint32_t key = (mod << 16) | alg;
+        loadedFunction(mainModuleContext, key);
         c.locals = mainModuleContext.cleanLocalTables[key];
         c.program = &(pMainProgram->instructions);
         c.type = pMainProgram->type;
@@ -832,6 +1005,7 @@ void KumirVM::reset()
         uint32_t mod = pTestingProgram->module;
         uint32_t alg = pTestingProgram->algId;
         uint32_t key = (mod << 16) | alg;
+        loadedFunction(mainModuleContext, key);
         c.locals = mainModuleContext.cleanLocalTables[key];
         c.program = &(pTestingProgram->instructions);
         c.type = EL_TESTING;
@@ -862,12 +1036,24 @@ void KumirVM::reset()
             ? nullptr
             : &(mainModuleContext.globals.back());
 
+    if (useInitSnapshot) {
+        // Globals are in the same state as after initialization sections
+        for (size_t i=0; i<moduleContexts_.size(); i++) {
+            moduleContexts_[i].globals = initSnapshot_[i];
+        }
+        if (contextsStack_.size()>0) {
+            const Context & top = contextsStack_.top();
+            currentGlobals_ =
+                    &(moduleContexts_[top.moduleContextNo].globals[top.moduleId]);
+        }
+    }
 
     // Each kumir module have 'initialization' section,
     // so push all these sections (if any) into stack
     // to call them BEFORE startup context
+    initSnapshotAllowed_ = initSnapshotEnabled_ && !useInitSnapshot;
     for (int moduleContextNo=moduleContexts_.size()-1;
-         moduleContextNo>=0;
+         !useInitSnapshot && moduleContextNo>=0;
          moduleContextNo--)
     {
         const ModuleContext & currentModule = moduleContexts_.at(moduleContextNo);
@@ -876,6 +1062,8 @@ void KumirVM::reset()
         {
             const Bytecode::TableElem & e = inits.at(initNo);
             if (e.instructions.size()>0) {
+                if (!isSnapshotSafe(e.instructions))
+                    initSnapshotAllowed_ = false;
                 Context initContext;
                 initContext.program = &(e.instructions);
                 initContext.type = EL_INIT;
@@ -893,12 +1081,20 @@ void KumirVM::reset()
         }
     }
 
-    typedef std::pair<std::string, Kumir::String> ModuleRef;
+    if (profiler_) {
+        profiler_->reset();
+        for (int i=0; i<contextsStack_.size(); i++) {
+            profileEnterContext(contextsStack_.at(i));
+        }
+    }
 
     std::set<ModuleRef> usedExternalModules;
+    if (useInitSnapshot) {
+        usedExternalModules = snapshotExternalModules_;
+    }
 
     // Push globals to debugger and make a list of used external modules
-    for (size_t i_context=0; i_context<moduleContexts_.size(); i_context++) {
+    for (size_t i_context=0; !useInitSnapshot && i_context<moduleContexts_.size(); i_context++) {
         const ModuleContext & mc = moduleContexts_[i_context];
 
         const ExternsMap & contextExterns = mc.externs;
@@ -930,9 +1126,15 @@ void KumirVM::reset()
         }
     }
 
+    if (!useInitSnapshot) {
+        snapshotExternalModules_ = usedExternalModules;
+    }
+
     // Prepare standard library
     Kumir::initStandardLibrary();
 
+    resetResourceCounters();
+
     // Reset used external modules
     if (externalModuleReset_) {
         for (std::set<ModuleRef>::const_iterator it=usedExternalModules.begin();
@@ -978,6 +1180,28 @@ bool KumirVM::hasMoreInstructions() const
     }
 }
 
+bool KumirVM::isAboutToReadConsole() const
+{
+    if (contextsStack_.size()==0 || !consoleInputBuffer_)
+        return false;
+    const Context & context = contextsStack_.top();
+    const int ip = context.IP==-1 ? 0 : context.IP;
+    if (!context.program || ip >= int(context.program->size()))
+        return false;
+    const Instruction & instr = context.program->at(ip);
+    if (instr.type!=CALL || instr.module!=0xFF || instr.arg!=0x00 || valuesStack_.size()==0)
+        return false;
+    // Arguments count is on stack top, then references to input
+    const int argsCount = valuesStack_.top().toInt();
+    for (int i=1; i<=argsCount && i<valuesStack_.size(); i++) {
+        const Variable & ref = valuesStack_.at(valuesStack_.size()-1-i);
+        if (ref.baseType()==VT_record
+                && ref.recordClassAsciiName()==std::string("file"))
+            return false;
+    }
+    return true;
+}
+
 void KumirVM::evaluateNextInstruction()
 {
     int ip = contextsStack_.top().IP;
@@ -988,7 +1212,13 @@ void KumirVM::evaluateNextInstruction()
     if (ip >=(int) program->size()) {
         return;
     }
+    if (limitsCheckCountdown_==0 && !checkResourceLimits()) {
+        return;
+    }
+    limitsCheckCountdown_--;
     const Instruction & instr = program->at(ip);
+    if (profiler_)
+        profiler_->countInstruction();
     switch (instr.type) {
     case CALL:
         do_call(instr.module, instr.arg);
@@ -1110,6 +1340,49 @@ void KumirVM::evaluateNextInstruction()
     case GEQ:
         do_geq();
         break;
+    case ISUM:
+        do_isum();
+        break;
+    case ISUB:
+        do_isub();
+        break;
+    case IMUL:
+        do_imul();
+        break;
+    case INEG:
+        do_ineg();
+        break;
+    case IEQ:
+    case INEQ:
+    case ILS:
+    case IGT:
+    case ILEQ:
+    case IGEQ:
+        do_icompare(instr.type);
+        break;
+    case RSUM:
+        do_rsum();
+        break;
+    case RSUB:
+        do_rsub();
+        break;
+    case RMUL:
+        do_rmul();
+        break;
+    case RDIV:
+        do_rdiv();
+        break;
+    case RNEG:
+        do_rneg();
+        break;
+    case REQ:
+    case RNEQ:
+    case RLS:
+    case RGT:
+    case RLEQ:
+    case RGEQ:
+        do_rcompare(instr.type);
+        break;
     case SHOWREG:
         do_showreg(instr.registerr);
         break;
@@ -1130,6 +1403,115 @@ void KumirVM::evaluateNextInstruction()
         error_ = Kumir::Core::getError();
 }
 
+void KumirVM::profileEnterContext(const Context & c)
+{
+    const uint32_t key = (uint32_t(c.moduleId) << 16) | uint16_t(c.algId);
+    const ProfileFunctionId id(c.moduleContextNo, key);
+    if (!profiler_->isFunctionRegistered(id)) {
+        const ModuleContext & mc = moduleContexts_[c.moduleContextNo];
+        String name;
+        if (c.type==EL_INIT) {
+            name = Kumir::Core::fromAscii("<init>");
+            if (c.moduleId < mc.moduleNames.size() && mc.moduleNames[c.moduleId].length()>0)
+                name = Kumir::Core::fromAscii("<init ") + mc.moduleNames[c.moduleId] + Kumir::Core::fromAscii(">");
+        }
+        else {
+            FunctionMap::const_iterator it = mc.functions.find(key);
+            if (it!=mc.functions.end())
+                name = it->second.name;
+            if (name.length()==0)
+                name = Kumir::Core::fromAscii("<main>");
+        }
+        profiler_->registerFunction(id, name, mc.filename);
+    }
+    profiler_->enterFunction(id);
+}
+
+void KumirVM::resetResourceCounters()
+{
+    exceededLimit_ = RL_None;
+    instructionsDone_ = 0u;
+    limitsCheckInterval_ = limitsCheckCountdown_ = 0;
+    startTime_ = std::chrono::steady_clock::now();
+    memoryAtStart_ = ValuesMemory::used();
+}
+
+bool KumirVM::checkResourceLimits()
+{
+    // Limits are checked once per interval, so time is not requested
+    // on every instruction; interval is shortened near the instructions
+    // limit to stop exactly on it
+    static const int MaxCheckInterval = 4096;
+    instructionsDone_ += limitsCheckInterval_;
+    limitsCheckInterval_ = 0;
+    if (instructionsLimit_ && instructionsDone_ >= instructionsLimit_) {
+        stopByLimit(RL_Instructions);
+        return false;
+    }
+    if (timeLimit_) {
+        const std::chrono::steady_clock::duration elapsed =
+                std::chrono::steady_clock::now() - startTime_;
+        if (std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count() >= timeLimit_) {
+            stopByLimit(RL_Time);
+            return false;
+        }
+    }
+    if (!checkMemoryLimit(0)) {
+        return false;
+    }
+    uint64_t interval = MaxCheckInterval;
+    if (instructionsLimit_ && instructionsLimit_ - instructionsDone_ < interval)
+        interval = instructionsLimit_ - instructionsDone_;
+    limitsCheckInterval_ = limitsCheckCountdown_ = int(interval);
+    return true;
+}
+
+bool KumirVM::checkMemoryLimit(int64_t bytesToAllocate)
+{
+    if (memoryLimit_ &&
+            ValuesMemory::used() - memoryAtStart_ + bytesToAllocate > int64_t(memoryLimit_))
+    {
+        stopByLimit(RL_Memory);
+        return false;
+    }
+    return true;
+}
+
+void KumirVM::stopByLimit(ResourceLimit limit)
+{
+    exceededLimit_ = limit;
+    if (limit==RL_Instructions)
+        error_ = Kumir::Core::fromUtf8("Превышено ограничение на количество выполняемых команд");
+    else if (limit==RL_Time)
+        error_ = Kumir::Core::fromUtf8("Превышено ограничение времени выполнения");
+    else if (limit==RL_Memory)
+        error_ = Kumir::Core::fromUtf8("Превышено ограничение памяти");
+}
+
+bool KumirVM::isSnapshotSafe(const std::vector<Bytecode::Instruction> & program)
+{
+    // Calls might have side effects (output, random numbers, actors),
+    // so such initialization must be evaluated on every run
+    for (size_t i=0; i<program.size(); i++) {
+        const InstructionType t = program[i].type;
+        if (t==CALL || t==PAUSE || t==HALT || t==ERRORR)
+            return false;
+    }
+    return true;
+}
+
+void KumirVM::captureInitSnapshot()
+{
+    initSnapshotAllowed_ = false;
+    if (error_.length()>0 || Kumir::Core::getError().length()>0)
+        return;
+    initSnapshot_.resize(moduleContexts_.size());
+    for (size_t i=0; i<moduleContexts_.size(); i++) {
+        initSnapshot_[i] = moduleContexts_[i].globals;
+    }
+    initSnapshotValid_ = true;
+}
+
 /***** BEGIN INSTRUCTIONS IMPLEMENTATION *****/
 
 void KumirVM::do_call(uint8_t mod, uint16_t alg)
@@ -1148,97 +1530,128 @@ void KumirVM::do_call(uint8_t mod, uint16_t alg)
         do_specialcall(alg);
     else if (moduleContexts_[contextsStack_.top().moduleContextNo].functions.count(p)) {
 
-        if (contextsStack_.size()>=MAX_RECURSION_SIZE) {
+        if (isRecursionLimitReached()) {
             error_ = Kumir::Core::fromUtf8("Слишком много вложенных вызовов алгоритмов");
         }
         else {
             if (stacksMutex_)
                 stacksMutex_->lock();
+            ModuleContext & moduleContext = moduleContexts_[contextsStack_.top().moduleContextNo];
+            const Bytecode::TableElem & function = loadedFunction(moduleContext, p);
             Context c;
-            c.program = & (moduleContexts_[contextsStack_.top().moduleContextNo].functions[p].instructions );
-            c.locals = moduleContexts_[contextsStack_.top().moduleContextNo].cleanLocalTables[p];
-            c.type = moduleContexts_[contextsStack_.top().moduleContextNo].functions[p].type;
+            c.program = & (function.instructions );
+            c.locals = moduleContext.cleanLocalTables[p];
+            c.type = function.type;
             if (nextCallInto_)
                 c.runMode = CRM_OneStep;
             else if (contextsStack_.top().type==EL_BELOWMAIN && c.type==EL_MAIN)
                 c.runMode = contextsStack_.top().runMode;
             else
                 c.runMode = CRM_ToEnd;
-            c.moduleId = moduleContexts_[contextsStack_.top().moduleContextNo].functions[p].module;
-            c.algId = moduleContexts_[contextsStack_.top().moduleContextNo].functions[p].algId;
+            c.moduleId = function.module;
+            c.algId = function.algId;
             if (!blindMode_)
-                c.name = moduleContexts_[contextsStack_.top().moduleContextNo].functions[p].name;
+                c.name = function.name;
             c.moduleContextNo = contextsStack_.top().moduleContextNo;
+            // Context is moved into stack, so fields used after are kept
+            const ContextRunMode runMode = c.runMode;
+            const size_t moduleContextNo = c.moduleContextNo;
+            const uint8_t moduleId = c.moduleId;
             if (stacksMutex_)
                 stacksMutex_->unlock();
-            if (debugHandler_ && c.runMode==CRM_OneStep)
+            if (debugHandler_ && runMode==CRM_OneStep)
                 debugHandler_->debuggerNoticeBeforePushContext();
             if (stacksMutex_)
                 stacksMutex_->lock();
-            contextsStack_.push(c);
+            contextsStack_.push(std::move(c));
+            if (profiler_)
+                profileEnterContext(contextsStack_.top());
             if (stacksMutex_)
                 stacksMutex_->unlock();
-            if (debugHandler_ && c.runMode==CRM_OneStep)
+            if (debugHandler_ && runMode==CRM_OneStep)
                 debugHandler_->debuggerNoticeAfterPushContext();
             if (stacksMutex_)
                 stacksMutex_->lock();
             nextCallInto_ = false;
-            valuesStack_.pop(); // current implementation doesn't requere args count
+            valuesStack_.drop(); // current implementation doesn't requere args count
             currentLocals_ = &(contextsStack_.top().locals);
             currentGlobals_ =
-                    &(moduleContexts_[c.moduleContextNo].globals[c.moduleId]);
+                    &(moduleContexts_[moduleContextNo].globals[moduleId]);
             currentConstants_ =
-                    &(moduleContexts_[c.moduleContextNo].constants);
+                    &(moduleContexts_[moduleContextNo].constants);
             if (stacksMutex_)
                 stacksMutex_->unlock();
         }
 
     }
-    else if (moduleContexts_[contextsStack_.top().moduleContextNo].externs.count(p)) {
-        if (contextsStack_.size()>=MAX_RECURSION_SIZE) {
+    else {
+        ExternsMap & externs = moduleContexts_[contextsStack_.top().moduleContextNo].externs;
+        const ExternsMap::iterator externIt = externs.find(p);
+        if (externIt==externs.end()) {
+            error_ = Kumir::Core::fromUtf8("Вызов алгоритма из недоступного исполнителя");
+        }
+        else if (isRecursionLimitReached()) {
             error_ = Kumir::Core::fromUtf8("Слишком много вложенных вызовов алгоритмов");
         }
         else {
-            ExternReference reference = moduleContexts_[contextsStack_.top().moduleContextNo].externs[p];
+            ExternReference & reference = externIt->second;
             if (!reference.platformDependent) {
                 // External call of algorithm found in another kumir file
                 if (stacksMutex_) stacksMutex_->lock();
-                uint32_t key = reference.funcKey;
+                if (!reference.resolved) {
+                    ModuleContext & moduleContext = moduleContexts_[reference.moduleContext];
+                    reference.function = &loadedFunction(moduleContext, reference.funcKey);
+                    reference.locals = &moduleContext.cleanLocalTables[reference.funcKey];
+                    reference.resolved = true;
+                }
+                const Bytecode::TableElem & function = *reference.function;
                 Context c;
-                c.program = & (moduleContexts_[reference.moduleContext].functions[key].instructions );
-                c.locals = moduleContexts_[reference.moduleContext].cleanLocalTables[key];
-                c.type = moduleContexts_[reference.moduleContext].functions[key].type;
+                c.program = & (function.instructions );
+                c.locals = *reference.locals;
+                c.type = function.type;
                 c.runMode = CRM_ToEnd;
-                c.moduleId = moduleContexts_[reference.moduleContext].functions[key].module;
-                c.algId = moduleContexts_[reference.moduleContext].functions[key].algId;
+                c.moduleId = function.module;
+                c.algId = function.algId;
                 c.moduleContextNo = reference.moduleContext;
-                contextsStack_.push(c);
+                contextsStack_.push(std::move(c));
+                if (profiler_)
+                    profileEnterContext(contextsStack_.top());
                 currentLocals_ = &(contextsStack_.top().locals);
                 currentGlobals_ =
-                        &(moduleContexts_[c.moduleContextNo].globals[c.moduleId]);
+                        &(moduleContexts_[reference.moduleContext].globals[function.module]);
                 currentConstants_ =
                         &(moduleContexts_[reference.moduleContext].constants);
                 nextCallInto_ = false;
-                valuesStack_.pop(); // current implementation doesn't requere args count
+                valuesStack_.drop(); // current implementation doesn't requere args count
                 if (stacksMutex_) stacksMutex_->unlock();
             }
             else if (externalModuleCall_) {
                 uint16_t algKey = reference.funcKey & 0xffff;
-                const std::string moduleAsciiName = reference.moduleAsciiName;
-                const Kumir::String moduleLocalizedName = reference.moduleLocalizedName;
+                if (!reference.resolved) {
+                    reference.module = externalModuleCall_->resolveModule(reference.moduleAsciiName);
+                    reference.resolved = true;
+                }
                 if (stacksMutex_) stacksMutex_->lock();
                 int argsCount = valuesStack_.pop().toInt();
-                std::deque<Variable> args;
+                std::deque<Variable> & args = reference.arguments;
+                args.clear();
                 for (int i=0; i<argsCount; i++) {
-                    Variable arg = valuesStack_.pop();
-                    args.push_front(arg);
+                    args.push_front(valuesStack_.pop());
                 }
                 if (stacksMutex_) stacksMutex_->unlock();
                 AnyValue algResult;
                 Kumir::String localError;
+                if (profiler_)
+                    profiler_->beginExternalCall(reference.moduleLocalizedName, reference.algorithmName);
                 algResult = (*externalModuleCall_)(
-                            moduleAsciiName, moduleLocalizedName, algKey, args, &localError
+                            reference.module,
+                            reference.moduleAsciiName, reference.moduleLocalizedName,
+                            algKey, args, &localError
                             );
+                if (profiler_)
+                    profiler_->endExternalCall();
+                // Storage is kept for next call, but not references to variables
+                args.clear();
 
                 if (stacksMutex_) stacksMutex_->lock();
                 if (localError.length()>0) {
@@ -1258,9 +1671,6 @@ void KumirVM::do_call(uint8_t mod, uint16_t alg)
             }
         }
     }
-    else {
-        error_ = Kumir::Core::fromUtf8("Вызов алгоритма из недоступного исполнителя");
-    }
     if (Kumir::Core::getError().length()>0 && error_.length()==0) {
         error_ = Kumir::Core::getError();
     }
@@ -1915,16 +2325,19 @@ inline Kumir::FileType KumirVM::fromRecordValue(const Record & record) {
     result.mode = record.fields[1].toInt();
     result.type = record.fields[2].toInt();
     result.valid = record.fields[3].toBool();
+    if (record.fields.size() > 4)
+        result.key = record.fields[4].toInt();
     return result;
 }
 
 inline Record KumirVM::toRecordValue(const Kumir::FileType & ft) {
     Record record;
-    record.fields.resize(4);
+    record.fields.resize(5);
     record.fields[0] = AnyValue(ft.fullPath);
     record.fields[1] = AnyValue(ft.mode);
     record.fields[2] = AnyValue(ft.type);
-    record.fields[3] = AnyValue(ft.valid);    
+    record.fields[3] = AnyValue(ft.valid);
+    record.fields[4] = AnyValue(ft.key);
     return record;
 }
 
@@ -2270,6 +2683,28 @@ void KumirVM::do_setarr(uint8_t s, uint16_t id)
         for (int i=0; i<dim*2; i++) {
             bounds[i] = valuesStack_.pop().toInt();
         }
+        if (memoryLimit_) {
+            // Product is checked on each step, so huge bounds can't
+            // wrap it around to a size allowed by limit
+            const int64_t maxElements = int64_t(memoryLimit_ / sizeof(AnyValue));
+            int64_t elements = 1;
+            bool tooLarge = false;
+            for (int i=0; i<dim; i++) {
+                const int64_t extent = std::max(int64_t(0),
+                        int64_t(bounds[i*2+1]) - int64_t(bounds[i*2]) + 1);
+                if (extent>0 && elements > maxElements / extent) {
+                    tooLarge = true;
+                    break;
+                }
+                elements *= extent;
+            }
+            if (tooLarge)
+                stopByLimit(RL_Memory);
+            if (tooLarge || !checkMemoryLimit(elements*int64_t(sizeof(AnyValue)))) {
+                if (stacksMutex_) stacksMutex_->unlock();
+                return;
+            }
+        }
         if (debugHandler_ && currentContext().runMode==CRM_OneStep) {
             stacksMutex_->unlock();
             debugHandler_->debuggerNoticeBeforeArrayInitialize(var, bounds);
@@ -2585,7 +3020,7 @@ void KumirVM::do_loadarr(uint8_t s, uint16_t id)
             else if (val.baseType()==VT_char)
                 register0_ = val.toChar();
             else if (val.baseType()==VT_string)
-                register0_ = val.toString();
+                register0_ = vv;
             else if (val.baseType()==VT_bool)
                 register0_ = val.toBool();
         }
@@ -2678,7 +3113,7 @@ void KumirVM::do_jnz(uint8_t r, uint16_t ip)
 {
     const AnyValue & registerValue = r==0u
             ? register0_
-            : currentContext().registers[r];
+            : currentContext().registerAt(r);
 
     const bool value = registerValue.toBool();
     if (value) {
@@ -2694,7 +3129,7 @@ void KumirVM::do_jz(uint8_t r, uint16_t ip)
 {
     const AnyValue & registerValue = r==0u
             ? register0_
-            : currentContext().registers[r];
+            : currentContext().registerAt(r);
 
     const bool value = registerValue.toBool();
     if (! value) {
@@ -2711,7 +3146,7 @@ void KumirVM::do_push(uint8_t r)
     if (r==0)
         v = register0_;
     else
-        v = contextsStack_.top().registers[r];
+        v = contextsStack_.top().registerAt(r);
     valuesStack_.push(Variable(v));
     nextIP();
 }
@@ -2721,7 +3156,7 @@ void KumirVM::do_pop(uint8_t r)
     Variable v = valuesStack_.pop();
     AnyValue & registerToStore = r==0u
             ? register0_
-           : currentContext().registers[r];
+           : currentContext().registerAt(r);
     if (v.hasValue() && v.dimension() == 0u) {
         registerToStore = v.value();
     }
@@ -2781,7 +3216,7 @@ void KumirVM::do_showreg(uint8_t regNo) {
         {
             const AnyValue & val = regNo==0u
                     ? register0_
-                    : currentContext().registers[regNo];
+                    : currentContext().registerAt(regNo);
             if (debugHandler_)
                 if (contextsStack_.top().moduleContextNo == 0)
                     debugHandler_->appendTextToMargin(lineNo, val.toString());
@@ -2811,7 +3246,7 @@ void KumirVM::do_ret()
         contextsStack_.top().runMode=CRM_OneStep;
     }
     else {
-        lastContext_ = contextsStack_.top();        
+        lastContext_ = ContextSummary(contextsStack_.top());
 //        if (lastContext_.type != Bytecode::EL_MAIN &&
 //                lastContext_.type != Bytecode::EL_TESTING)
             // Do not pop last context before program exit
@@ -2822,13 +3257,22 @@ void KumirVM::do_ret()
                 debugHandler_->debuggerNoticeBeforePopContext();
                 stacksMutex_->lock();
             }
-            contextsStack_.pop();
+            contextsStack_.drop();
+            if (profiler_)
+                profiler_->leaveFunction();
             if (debugHandler_ && !blindMode_ && lastContext_.type == Bytecode::EL_FUNCTION) {
                 stacksMutex_->unlock();
                 debugHandler_->debuggerNoticeAfterPopContext();
                 stacksMutex_->lock();
             }
         }
+        if (lastContext_.type==Bytecode::EL_INIT
+                && initSnapshotAllowed_
+                && (contextsStack_.size()==0 || contextsStack_.top().type!=Bytecode::EL_INIT)
+                )
+        {
+            captureInitSnapshot();
+        }
         if (lastContext_.type==Bytecode::EL_INIT
                 && lastContext_.runMode == CRM_OneStep
                 )
@@ -2865,6 +3309,96 @@ void KumirVM::do_error(uint8_t s, uint16_t id)
     }
 }
 
+bool KumirVM::isBreakpointConditionSatisfied(BreakpointCondition & condition)
+{
+    // Condition instructions run in place of program of current context,
+    // so they access its locals and call algorithms as the program does.
+    // Condition which can not be evaluated is satisfied, so user sees
+    // the problem at breakpoint. It runs with profiler and limits of
+    // instructions and time turned off, so watching does not count as
+    // work of program
+    static const int MaxInstructions = 1000000;
+    Context & context = currentContext();
+    if (condition.moduleId!=context.moduleId || condition.algId!=context.algId)
+        return true;
+    const int contextsCount = contextsStack_.size();
+    const int valuesCount = valuesStack_.size();
+    const int cacheCount = cacheStack_.size();
+    const std::vector<Instruction> * program = context.program;
+    const int ip = context.IP;
+    VariablesTable * const constants = currentConstants_;
+    const AnyValue register0 = register0_;
+    const ContextSummary lastContext = lastContext_;
+    const bool nextCallInto = nextCallInto_;
+    const unsigned long int stepsCounter = stepsCounter_;
+    const int previousLineNo = previousLineNo_;
+    const uint32_t previousColStart = previousColStart_;
+    const uint32_t previousColEnd = previousColEnd_;
+    const ResourceLimit exceededLimit = exceededLimit_;
+    const bool blindMode = blindMode_;
+    Profiler * const profiler = profiler_;
+    const uint64_t instructionsLimit = instructionsLimit_;
+    const uint32_t timeLimit = timeLimit_;
+    const uint64_t instructionsDone = instructionsDone_;
+    const int limitsCheckInterval = limitsCheckInterval_;
+    const int limitsCheckCountdown = limitsCheckCountdown_;
+
+    blindMode_ = true;
+    nextCallInto_ = false;
+    profiler_ = nullptr;
+    instructionsLimit_ = 0u;
+    timeLimit_ = 0u;
+    limitsCheckInterval_ = limitsCheckCountdown_ = 0;
+    context.program = &condition.instructions;
+    context.IP = 0;
+    for (int i=0; i<MaxInstructions && error_.length()==0; i++) {
+        if (contextsStack_.size()==contextsCount) {
+            if (context.IP >= int(condition.instructions.size()))
+                break;
+            // Returning from called algorithm sets constants of module
+            currentConstants_ = &condition.constants;
+        }
+        evaluateNextInstruction();
+    }
+    bool result = true;
+    if (error_.length()==0 && contextsStack_.size()==contextsCount
+            && context.IP >= int(condition.instructions.size())
+            && valuesStack_.size()==valuesCount+1)
+    {
+        result = valuesStack_.top().toBool();
+    }
+
+    while (contextsStack_.size() > contextsCount)
+        contextsStack_.drop();
+    while (valuesStack_.size() > valuesCount)
+        valuesStack_.drop();
+    while (cacheStack_.size() > cacheCount)
+        cacheStack_.drop();
+    error_.clear();
+    Variable::unsetError();
+    exceededLimit_ = exceededLimit;
+    context.program = program;
+    context.IP = ip;
+    currentLocals_ = &context.locals;
+    currentGlobals_ = &(moduleContexts_[context.moduleContextNo].globals[context.moduleId]);
+    currentConstants_ = constants;
+    register0_ = register0;
+    lastContext_ = lastContext;
+    nextCallInto_ = nextCallInto;
+    stepsCounter_ = stepsCounter;
+    previousLineNo_ = previousLineNo;
+    previousColStart_ = previousColStart;
+    previousColEnd_ = previousColEnd;
+    blindMode_ = blindMode;
+    profiler_ = profiler;
+    instructionsLimit_ = instructionsLimit;
+    timeLimit_ = timeLimit;
+    instructionsDone_ = instructionsDone;
+    limitsCheckInterval_ = limitsCheckInterval;
+    limitsCheckCountdown_ = limitsCheckCountdown;
+    return result;
+}
+
 void KumirVM::do_line(const Bytecode::Instruction & instr)
 {
     uint32_t from = 0u, to = 0u;
@@ -2906,10 +3440,12 @@ void KumirVM::do_line(const Bytecode::Instruction & instr)
 //        }
         currentContext().lineNo = no;
         currentContext().columnStart = currentContext().columnEnd = 0u;
+        if (profiler_)
+            profiler_->lineHit(no);
         if (!blindMode_ && debugHandler_) {
             const uint8_t modId = currentContext().moduleId;
             const int lineNo = currentContext().lineNo;
-            if (breakpointsTable_.processBreakpointHit(modId, lineNo, nullptr)) {
+            if (breakpointsTable_.processBreakpointHit(modId, lineNo, *this)) {
                 const String & sourceFileName = breakpointsTable_.registeredSourceFileName(modId);
                 debugHandler_->debuggerNoticeOnBreakpointHit(sourceFileName, uint32_t(lineNo));
             }
@@ -2918,8 +3454,37 @@ void KumirVM::do_line(const Bytecode::Instruction & instr)
     nextIP();
 }
 
+bool KumirVM::appendToStringInPlace()
+{
+    // 's := s + x' is evaluated in linear time: the left operand is
+    // extended in place when nobody but the assigned variable shares it
+    Variable & a = valuesStack_.at(valuesStack_.size()-2);
+    const Variable & b = valuesStack_.top();
+    if (a.baseType()!=VT_string)
+        return false;
+    if (b.baseType()!=VT_string && b.baseType()!=VT_char)
+        return false;
+    const Context & context = contextsStack_.top();
+    const AnyValue * target = 0;
+    if (context.IP+1 < (int)context.program->size()) {
+        const Instruction & next = context.program->at(context.IP+1);
+        if (next.type==STORE && VariableScope(next.scope)!=CONSTT)
+            target = findVariable(next.scope, next.arg).plainValueStorage();
+    }
+    if (!a.appendString(b.toString(), target))
+        return false;
+    valuesStack_.drop();
+    return true;
+}
+
 void KumirVM::do_sum()
 {
+    if (appendToStringInPlace()) {
+        if (memoryLimit_)
+            checkMemoryLimit(0);
+        nextIP();
+        return;
+    }
     Variable b = valuesStack_.pop();
     Variable a = valuesStack_.pop();
     if (a.baseType()==VT_int && b.baseType()==VT_int) {
@@ -2939,6 +3504,8 @@ void KumirVM::do_sum()
     else if (a.baseType()==VT_string || a.baseType()==VT_char) {
         Variable r(a.toString()+b.toString());
         valuesStack_.push(r);
+        if (memoryLimit_)
+            checkMemoryLimit(0);
     }
     nextIP();
 }
@@ -3225,6 +3792,166 @@ void KumirVM::do_geq()
     nextIP();
 }
 
+// Typed operations: operand types are known at compile time, so values
+// are taken from stack in-place without checking their types
+
+void KumirVM::do_isum()
+{
+    const int b = valuesStack_.top().toInt();
+    valuesStack_.drop();
+    Variable & a = valuesStack_.top();
+    int32_t r = 0;
+    if (!Kumir::Math::checkedSumm(a.toInt(), b, r)) {
+        error_ = Kumir::Core::fromUtf8("Целочисленное переполнение");
+    }
+    a = Variable(r);
+    nextIP();
+}
+
+void KumirVM::do_isub()
+{
+    const int b = valuesStack_.top().toInt();
+    valuesStack_.drop();
+    Variable & a = valuesStack_.top();
+    int32_t r = 0;
+    if (!Kumir::Math::checkedDiff(a.toInt(), b, r)) {
+        error_ = Kumir::Core::fromUtf8("Целочисленное переполнение");
+    }
+    a = Variable(r);
+    nextIP();
+}
+
+void KumirVM::do_imul()
+{
+    const int b = valuesStack_.top().toInt();
+    valuesStack_.drop();
+    Variable & a = valuesStack_.top();
+    int32_t r = 0;
+    if (!Kumir::Math::checkedProd(a.toInt(), b, r)) {
+        error_ = Kumir::Core::fromUtf8("Целочисленное переполнение");
+    }
+    a = Variable(r);
+    nextIP();
+}
+
+void KumirVM::do_ineg()
+{
+    Variable & a = valuesStack_.top();
+    int32_t r = 0;
+    if (!Kumir::Math::checkedDiff(0, a.toInt(), r)) {
+        error_ = Kumir::Core::fromUtf8("Целочисленное переполнение");
+    }
+    a = Variable(r);
+    nextIP();
+}
+
+void KumirVM::do_icompare(Bytecode::InstructionType op)
+{
+    const int b = valuesStack_.top().toInt();
+    valuesStack_.drop();
+    Variable & a = valuesStack_.top();
+    const int av = a.toInt();
+    bool result = false;
+    switch (op) {
+    case IEQ:  result = av == b; break;
+    case INEQ: result = av != b; break;
+    case ILS:  result = av <  b; break;
+    case IGT:  result = av >  b; break;
+    case ILEQ: result = av <= b; break;
+    case IGEQ: result = av >= b; break;
+    default: break;
+    }
+    a = Variable(result);
+    register0_ = AnyValue(result);
+    nextIP();
+}
+
+void KumirVM::do_rsum()
+{
+    const real b = valuesStack_.top().toReal();
+    valuesStack_.drop();
+    Variable & a = valuesStack_.top();
+    const real r = a.toReal() + b;
+    if (!Kumir::Math::isCorrectReal(r)) {
+        error_ = Kumir::Core::fromUtf8("Вещественное переполнение");
+    }
+    a = Variable(r);
+    nextIP();
+}
+
+void KumirVM::do_rsub()
+{
+    const real b = valuesStack_.top().toReal();
+    valuesStack_.drop();
+    Variable & a = valuesStack_.top();
+    const real r = a.toReal() - b;
+    if (!Kumir::Math::isCorrectReal(r)) {
+        error_ = Kumir::Core::fromUtf8("Вещественное переполнение");
+    }
+    a = Variable(r);
+    nextIP();
+}
+
+void KumirVM::do_rmul()
+{
+    const real b = valuesStack_.top().toReal();
+    valuesStack_.drop();
+    Variable & a = valuesStack_.top();
+    const real r = a.toReal() * b;
+    if (!Kumir::Math::isCorrectReal(r)) {
+        error_ = Kumir::Core::fromUtf8("Вещественное переполнение");
+    }
+    a = Variable(r);
+    nextIP();
+}
+
+void KumirVM::do_rdiv()
+{
+    const real b = valuesStack_.top().toReal();
+    valuesStack_.drop();
+    if (b==0.0) {
+        valuesStack_.drop();
+        error_ = Kumir::Core::fromUtf8("Деление на ноль");
+    }
+    else {
+        Variable & a = valuesStack_.top();
+        const real r = a.toReal() / b;
+        if (!Kumir::Math::isCorrectReal(r)) {
+            error_ = Kumir::Core::fromUtf8("Вещественное переполнение");
+        }
+        a = Variable(r);
+    }
+    nextIP();
+}
+
+void KumirVM::do_rneg()
+{
+    Variable & a = valuesStack_.top();
+    a = Variable(0.0 - a.toReal());
+    nextIP();
+}
+
+void KumirVM::do_rcompare(Bytecode::InstructionType op)
+{
+    const real b = valuesStack_.top().toReal();
+    valuesStack_.drop();
+    Variable & a = valuesStack_.top();
+    const real av = a.toReal();
+    bool result = false;
+    switch (op) {
+    case REQ:  result = av == b; break;
+    case RNEQ: result = av != b; break;
+    case RLS:  result = av <  b; break;
+    case RGT:  result = av >  b; break;
+    case RLEQ: result = av <= b; break;
+    case RGEQ: result = av >= b; break;
+    default: break;
+    }
+    a = Variable(result);
+    register0_ = AnyValue(result);
+    nextIP();
+}
+
 void KumirVM::do_ctl(uint8_t parameter, uint16_t value)
 {
     if (parameter==0x00) {
@@ -3376,6 +4103,21 @@ bool KumirVM::loadProgramFromBinaryBuffer(std::list<char> &stream, bool isMain,
 }
 
 
+bool KumirVM::loadProgramFromImage(const std::shared_ptr<const Bytecode::Image> & image, bool isMain, const String & filename, String & error)
+{
+    breakpointsTable_.reset();
+    error.clear();
+    if (!Bytecode::isValidSignature(*image)) {
+        error = Kumir::Core::fromUtf8("Это не исполняемый файл Кумир 2.x");
+        return false;
+    }
+    Bytecode::Data d;
+    Bytecode::bytecodeFromImage(image, d);
+    setProgram(d, isMain, filename, &error);
+    return error.length() == 0;
+}
+
+
 int KumirVM::contextByIds(int moduleId, int algorhitmId) const
 {
     for (int i=contextsStack_.size()-1; i>=0; i--) {
@@ -146,11 +146,34 @@ public:
  *  An arguments list is passed to functor; return value is a
  *  calling function return (is any), or a dummy any value (if void).
  *
+ *  VM resolves module once for each called algorithm and then passes
+ *  the handle to every call, so functor implementation can skip
+ *  searching module by name.
  */
 class ExternalModuleCallFunctor: public Functor {
 public:
     inline Type type() const _override { return ExternalModuleCall; }
     typedef const std::deque<Variable> & VariableReferencesList;
+    typedef void * ModuleHandle;
+
+    /** Returns handle of module to be passed to calls, or nullptr
+     *  if calls must find module by name */
+    inline virtual ModuleHandle resolveModule(const std::string & /*asciiModuleName*/) {
+        return nullptr;
+    }
+
+    inline virtual AnyValue operator()(
+            ModuleHandle /*module*/,
+            const std::string & asciiModuleName,
+            const Kumir::String & localizedModuleName,
+            const uint16_t algorithmId,
+            VariableReferencesList arguments,
+            Kumir::String * error
+            )
+    {
+        return (*this)(asciiModuleName, localizedModuleName, algorithmId, arguments, error);
+    }
+
     inline virtual AnyValue operator()(
             const std::string & /*asciiModuleName*/,
             const Kumir::String & localizedModuleName,
@@ -3,6 +3,7 @@
 
 #include <map>
 #include <utility>
+#include <vector>
 extern "C" {
     #include <wchar.h>
 }
@@ -18,11 +19,26 @@ extern "C" {
 //     typedef std::wstring std::wstring;
 // #endif
 
+#include "variant.hpp"
+#include "vm_instruction.hpp"
+
 namespace VM {
 
 typedef std::pair<uint8_t,uint32_t> BreakpointLocation;
-typedef void* BreakpointCondition; // TODO condition support
-typedef bool (*BreakpointConditionChecker)(const BreakpointCondition&);
+
+/* Condition of breakpoint compiled by generator in place of breakpoint
+   line: instructions calculating boolean value in context of algorithm
+   having breakpoint and constants they load. Breakpoint without
+   instructions has no condition */
+struct BreakpointCondition {
+    inline BreakpointCondition(): moduleId(0), algId(-1) {}
+    inline bool isEmpty() const { return instructions.empty(); }
+
+    std::vector<Bytecode::Instruction> instructions;
+    std::vector<Variable> constants;
+    uint8_t moduleId; // context condition was compiled for
+    int algId;
+};
 
 struct BreakpointData {
     bool enabled;
@@ -30,12 +46,18 @@ struct BreakpointData {
     uint32_t hitCount;
     BreakpointCondition condition;
 
-    inline explicit BreakpointData(): enabled(true), ignoreCount(0), hitCount(0), condition(0) {}
+    inline explicit BreakpointData(): enabled(true), ignoreCount(0), hitCount(0) {}
 };
 
 class BreakpointsTable {
 public:
-    inline bool processBreakpointHit(const uint8_t modId, const int lineNo, const BreakpointConditionChecker * conditionChecker);
+    /** Called on every line in debug mode. Lines without breakpoints are
+     *  rejected by bitmap lookup; condition is evaluated only at lines
+     *  having breakpoint by checker.isBreakpointConditionSatisfied */
+    template <class ConditionChecker>
+    inline bool processBreakpointHit(const uint8_t modId, const int lineNo,
+                                     ConditionChecker & checker);
+    inline void resetHitCounts();
 
     inline void reset();
     inline void registerSourceFileName(const std::wstring & sourceFileName, const uint8_t modId);
@@ -51,17 +73,25 @@ private:
     typedef std::map<std::wstring,uint8_t> SourcesToIdsTable;
     typedef std::map<uint8_t,std::wstring> IdsToSourcesTable;
 
+    inline void updateLineMark(const BreakpointLocation & loc);
+
     BreaksTable breakpoints_;
     BreaksTable singleHits_;
     SourcesToIdsTable sourceToIds_;
     IdsToSourcesTable idsToSources_;
+    std::vector< std::vector<bool> > lineMarks_; // [modId][lineNo]
 };
 
 // ------------ INLINE IMPLEMENTATION
 
-bool BreakpointsTable::processBreakpointHit(const uint8_t modId, const int lineNo, const BreakpointConditionChecker *conditionChecker)
+template <class ConditionChecker>
+bool BreakpointsTable::processBreakpointHit(const uint8_t modId, const int lineNo,
+                                            ConditionChecker & checker)
 {
-    if (-1 == lineNo)
+    if (lineNo < 0 || modId >= lineMarks_.size())
+        return false;
+    const std::vector<bool> & moduleMarks = lineMarks_[modId];
+    if (size_t(lineNo) >= moduleMarks.size() || !moduleMarks[lineNo])
         return false;
 
     bool result = false;
@@ -70,25 +100,51 @@ bool BreakpointsTable::processBreakpointHit(const uint8_t modId, const int lineN
     if (singleHits_.end() != shitIt) {
         result = true;
         singleHits_.erase(shitIt);
+        updateLineMark(loc);
     }
     if (!result) {
-        BreaksTable::const_iterator locIt = breakpoints_.find(loc);
+        BreaksTable::iterator locIt = breakpoints_.find(loc);
         if (breakpoints_.end() != locIt) {
-            const BreakpointData & data = locIt->second;
-            if (data.enabled) {
-                result = true; // TODO check for hit count and condition
+            BreakpointData & data = locIt->second;
+            if (data.enabled && (data.condition.isEmpty()
+                                 || checker.isBreakpointConditionSatisfied(data.condition)))
+            {
+                data.hitCount ++;
+                result = data.hitCount > data.ignoreCount;
             }
         }
     }
     return result;
 }
 
+void BreakpointsTable::resetHitCounts()
+{
+    for (BreaksTable::iterator it=breakpoints_.begin(); it!=breakpoints_.end(); ++it) {
+        it->second.hitCount = 0;
+    }
+}
+
+void BreakpointsTable::updateLineMark(const BreakpointLocation & loc)
+{
+    const bool marked = breakpoints_.count(loc) || singleHits_.count(loc);
+    if (lineMarks_.size() <= loc.first)
+        lineMarks_.resize(loc.first + 1);
+    std::vector<bool> & moduleMarks = lineMarks_[loc.first];
+    if (moduleMarks.size() <= loc.second) {
+        if (!marked)
+            return;
+        moduleMarks.resize(loc.second + 1, false);
+    }
+    moduleMarks[loc.second] = marked;
+}
+
 void BreakpointsTable::reset()
 {
     breakpoints_.clear();
     singleHits_.clear();
     sourceToIds_.clear();
     idsToSources_.clear();
+    lineMarks_.clear();
 }
 
 void BreakpointsTable::registerSourceFileName(const std::wstring & sourceFileName, const uint8_t modId)
@@ -106,6 +162,7 @@ void BreakpointsTable::removeAllBreakpoints()
 {
     singleHits_.clear();
     breakpoints_.clear();
+    lineMarks_.clear();
 }
 
 void BreakpointsTable::insertOrChangeBreakpoint(const bool enabled, const std::wstring &fileName, const uint32_t lineNo, const uint32_t ignoreCount, const BreakpointCondition & condition)
@@ -114,20 +171,11 @@ void BreakpointsTable::insertOrChangeBreakpoint(const bool enabled, const std::w
     if (sourceToIds_.end() != fnIt) {
         const uint8_t modId = fnIt->second;
         const BreakpointLocation loc(modId, lineNo);
-        BreaksTable::iterator locIt = breakpoints_.find(loc);
-        if (breakpoints_.end() != locIt) {
-            BreakpointData & data = locIt->second;
-            data.enabled = enabled;
-            data.ignoreCount = ignoreCount;
-            data.condition = condition;
-        }
-        else {
-            BreakpointData data;
-            data.enabled = enabled;
-            data.ignoreCount = ignoreCount;
-            data.condition = condition;
-            breakpoints_[loc] = data;
-        }
+        BreakpointData & data = breakpoints_[loc];
+        data.enabled = enabled;
+        data.ignoreCount = ignoreCount;
+        data.condition = condition;
+        updateLineMark(loc);
     }
 }
 
@@ -138,11 +186,11 @@ void BreakpointsTable::insertSingleHitBreakpoint(const std::wstring &fileName, u
         const uint8_t modId = fnIt->second;
         const BreakpointLocation loc(modId, lineNo);
         BreakpointData data;
-        data.condition = 0;
         data.ignoreCount = 0;
         data.hitCount = 0;
         data.enabled = true;
         singleHits_[loc] = data;
+        updateLineMark(loc);
     }
 }
 
@@ -155,6 +203,7 @@ void BreakpointsTable::removeBreakpoint(const std::wstring &fileName, const uint
         BreaksTable::iterator locIt = breakpoints_.find(loc);
         if (breakpoints_.end() != locIt) {
             breakpoints_.erase(locIt);
+            updateLineMark(loc);
         }
     }
 }
@@ -2,6 +2,7 @@
 #define BYTECODE_DATA_H
 
 #include "vm_tableelem.hpp"
+#include "vm_bytecode_image.hpp"
 
 #include <deque>
 #include <stdint.h>
@@ -15,6 +16,8 @@ struct Data {
     uint8_t versionMin;
     uint8_t versionRel;
     unsigned long lastModified;
+    std::shared_ptr<const Image> image; // image which elements loaded
+                                        // lazily refer to
 };
 
 inline void bytecodeToDataStream(std::list<char> & ds, const Data & data)
@@ -71,6 +74,13 @@ inline bool isValidSignature(const std::list<char> & ds)
     return firstMatch || secondMatch;
 }
 
+inline bool isValidSignature(const Image & image)
+{
+    const size_t lineSize = std::find(image.data(), image.data()+image.size(), '\n') - image.data();
+    const std::list<char> first(image.data(), image.data()+std::min(lineSize, size_t(255)));
+    return isValidSignature(first);
+}
+
 inline void bytecodeFromDataStream(std::list<char> & ds, Data & data)
 {
     if (ds.size()>0 && ds.front()=='#') {
@@ -109,6 +119,104 @@ inline void bytecodeFromDataStream(std::istream & is, Data & data)
     bytecodeFromDataStream(bytes, data);
 }
 
+inline void skipStringInDataStream(ImageReader & ds)
+{
+    uint16_t u16size;
+    valueFromDataStream(ds, u16size);
+    ds.skip(size_t(u16size));
+}
+
+/* Reads element from image leaving instructions of algorithms and
+   local variables to be decoded on first call, see imageOffset */
+inline void lazyTableElemFromImage(ImageReader & ds, TableElem & e)
+{
+    const size_t start = ds.offset();
+    if (ElemType(uint8_t(ds.front()))==EL_LOCAL) {
+        // Only fields needed to find algorithm of variable
+        uint8_t t, d, r, m;
+        uint16_t a, id;
+        valueFromDataStream(ds, t);
+        e.type = ElemType(t);
+        vtypeFromDataStream(ds, e.vtype);
+        valueFromDataStream(ds, d);
+        e.dimension = d;
+        valueFromDataStream(ds, r);
+        e.refvalue = ValueKind(r);
+        valueFromDataStream(ds, m);
+        e.module = m;
+        valueFromDataStream(ds, a);
+        e.algId = a;
+        valueFromDataStream(ds, id);
+        e.id = id;
+        // name, module and record type names
+        for (int i=0; i<7; i++) {
+            skipStringInDataStream(ds);
+        }
+        e.imageOffset = uint32_t(start);
+        return;
+    }
+    tableElemHeaderFromBinaryStream(ds, e);
+    if (e.type==EL_CONST) {
+        constantFromDataStream(ds, e.vtype, e.initialValue, e.dimension);
+    }
+    else if (e.type==EL_INIT) {
+        // Initialization is always evaluated
+        instructionsFromDataStream(ds, e.instructions);
+    }
+    else if (e.type==EL_FUNCTION || e.type==EL_MAIN || e.type==EL_TESTING || e.type==EL_BELOWMAIN) {
+        e.imageOffset = uint32_t(ds.offset());
+        uint16_t u16sz;
+        valueFromDataStream(ds, u16sz);
+        ds.skip(size_t(u16sz) * sizeof(uint32_t));
+    }
+}
+
+/* Decodes data of element which lazyTableElemFromImage has left in image */
+inline void decodeLazyTableElem(const Image & image, TableElem & e)
+{
+    if (e.imageOffset==0) {
+        return;
+    }
+    ImageReader ds(image, e.imageOffset);
+    e.imageOffset = 0;
+    if (e.type==EL_LOCAL) {
+        tableElemFromBinaryStream(ds, e);
+    }
+    else {
+        instructionsFromDataStream(ds, e.instructions);
+    }
+}
+
+/* Reads bytecode from image the same way as bytecodeFromDataStream,
+   except elements left to decode later by decodeLazyTableElem */
+inline void bytecodeFromImage(const std::shared_ptr<const Image> & image, Data & data)
+{
+    ImageReader ds(*image);
+    if (ds.size()>0 && ds.front()=='#') {
+        while (ds.size()>0) {
+            const char cur = ds.front();
+            ds.pop_front();
+            if (cur=='\n')
+                break;
+        }
+    }
+    if (ds.size()>0)
+        valueFromDataStream(ds, data.versionMaj);
+    if (ds.size()>0)
+        valueFromDataStream(ds, data.versionMin);
+    if (ds.size()>0)
+        valueFromDataStream(ds, data.versionRel);
+    uint32_t u32_size = 0;
+    if (ds.size()>=4)
+        valueFromDataStream(ds, u32_size);
+    size_t size = size_t(u32_size);
+    data.d.resize(size);
+    for (size_t i=0; i<size; i++) {
+        lazyTableElemFromImage(ds, data.d.at(i));
+    }
+    data.image = image;
+}
+
 inline void makeHelpersForTextRepresentation(const Data & data, AS_Helpers & helpers)
 {
     Kumir::EncodingError encodingError;
@@ -0,0 +1,128 @@
+#ifndef BYTECODE_IMAGE_H
+#define BYTECODE_IMAGE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <algorithm>
+#include <stdint.h>
+
+#if !defined(WIN32) && !defined(_WIN32)
+extern "C" {
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+}
+#endif
+
+namespace Bytecode {
+
+/* Read-only contents of bytecode file. The file is mapped into memory
+   where supported, so parts of large modules which are never used
+   are not even read from disk. Compiled files are replaced by rename,
+   so mapped contents do not change while program runs */
+class Image {
+public:
+    /** Returns image of file or nullptr if file can't be read */
+    inline static std::shared_ptr<Image> fromFile(const std::string & fileName);
+
+    /** Returns image of copy of bytes already loaded into memory */
+    inline static std::shared_ptr<Image> fromBuffer(const char * bytes, size_t size);
+
+    inline const char * data() const { return data_; }
+    inline size_t size() const { return size_; }
+
+    inline ~Image();
+
+private:
+    inline Image() : data_(nullptr), size_(0), mapped_(false) {}
+    Image(const Image &) = delete;
+    Image & operator=(const Image &) = delete;
+
+    const char * data_;
+    size_t size_;
+    bool mapped_;
+    std::vector<char> buffer_;
+};
+
+/* Sequential reader of image bytes, used in place of std::list<char>
+   by functions reading bytecode from data stream */
+class ImageReader {
+public:
+    inline explicit ImageReader(const Image & image, size_t offset = 0)
+        : begin_(image.data())
+        , current_(image.data() + std::min(offset, image.size()))
+        , end_(image.data() + image.size())
+    {}
+
+    inline char front() const { return current_ < end_ ? *current_ : '\0'; }
+    inline void pop_front() { if (current_ < end_) ++current_; }
+    inline size_t size() const { return size_t(end_ - current_); }
+    inline size_t offset() const { return size_t(current_ - begin_); }
+    inline void skip(size_t count) { current_ += std::min(count, size()); }
+
+private:
+    const char * begin_;
+    const char * current_;
+    const char * end_;
+};
+
+std::shared_ptr<Image> Image::fromFile(const std::string & fileName)
+{
+    std::shared_ptr<Image> image(new Image);
+#if !defined(WIN32) && !defined(_WIN32)
+    const int fd = ::open(fileName.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return std::shared_ptr<Image>();
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        void * address = ::mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED) {
+            image->data_ = static_cast<const char*>(address);
+            image->size_ = size_t(st.st_size);
+            image->mapped_ = true;
+        }
+    }
+    ::close(fd);
+    if (image->mapped_) {
+        return image;
+    }
+#endif
+    // Windows keeps mapped file locked against replacing,
+    // so it is read into memory as a whole
+    std::ifstream file(fileName.c_str(), std::ios::in|std::ios::binary);
+    if (!file.is_open()) {
+        return std::shared_ptr<Image>();
+    }
+    image->buffer_.assign(std::istreambuf_iterator<char>(file),
+                          std::istreambuf_iterator<char>());
+    image->data_ = image->buffer_.empty() ? nullptr : &image->buffer_[0];
+    image->size_ = image->buffer_.size();
+    return image;
+}
+
+std::shared_ptr<Image> Image::fromBuffer(const char * bytes, size_t size)
+{
+    std::shared_ptr<Image> image(new Image);
+    image->buffer_.assign(bytes, bytes + size);
+    image->data_ = image->buffer_.empty() ? nullptr : &image->buffer_[0];
+    image->size_ = image->buffer_.size();
+    return image;
+}
+
+Image::~Image()
+{
+#if !defined(WIN32) && !defined(_WIN32)
+    if (mapped_) {
+        ::munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+}
+
+} // namespace Bytecode
+
+#endif // BYTECODE_IMAGE_H
@@ -24,10 +24,8 @@ using namespace Kumir;
 
 inline void do_output(const String &s, const Encoding locale)
 {
-    EncodingError encodingError;
-    const std::string localstring = Coder::encode(locale, s, encodingError);
-    std::cout << localstring;
-    std::cout.flush();
+    // Flushed by stdlib on input request, program end or error
+    Files::getStdOutBuffer(locale)->write(s);
 }
 
 inline void do_output(const std::string & s, const Encoding locale)
@@ -136,6 +134,7 @@ public:
         , locale_(UTF8)
     #endif
         , customTypeToString_(nullptr)
+        , buffer_(nullptr)
     {}
     inline void operator ()(VariableReferencesList alist, FormatsList formats, Kumir::String * error) _override;
     inline void setLocale(const Encoding loc) { locale_ = loc; }
@@ -143,11 +142,14 @@ public:
     {
         customTypeToString_ = f;
     }
+    /** Writes output to buffer instead of standard output */
+    inline void setOutputBuffer(Kumir::AbstractOutputBuffer * buffer) { buffer_ = buffer; }
     inline void writeRawString(const String &) _override;
 
 private:
     Encoding locale_;
     VM::CustomTypeToStringFunctor * customTypeToString_;
+    Kumir::AbstractOutputBuffer * buffer_;
 };
 
 void OutputFunctor::operator ()(
@@ -187,12 +189,15 @@ void OutputFunctor::operator ()(
             return;
         }
     }    
-    do_output(os.getBuffer(), locale_);
+    writeRawString(os.getBuffer());
 }
 
 void OutputFunctor::writeRawString(const String &s)
 {
-    do_output(s, locale_);
+    if (buffer_)
+        buffer_->writeRawString(s);
+    else
+        do_output(s, locale_);
 }
 
 class ReturnMainValueFunctor
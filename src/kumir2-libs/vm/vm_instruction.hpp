@@ -47,6 +47,31 @@ enum InstructionType {
     CACHEBEGIN  = 0x33, // Push begin marker into cache
     CACHEEND    = 0x34, // Clear cache until marker
 
+    // Operations on operands of statically known type,
+    // evaluated without checking operand types
+
+    ISUM        = 0x40, // Integer operations with overflow check
+    ISUB        = 0x41,
+    IMUL        = 0x42,
+    INEG        = 0x43,
+    IEQ         = 0x44,
+    INEQ        = 0x45,
+    ILS         = 0x46,
+    IGT         = 0x47,
+    ILEQ        = 0x48,
+    IGEQ        = 0x49,
+
+    RSUM        = 0x50, // Real operations with overflow check
+    RSUB        = 0x51,
+    RMUL        = 0x52,
+    RDIV        = 0x53,
+    RNEG        = 0x54,
+    REQ         = 0x55,
+    RNEQ        = 0x56,
+    RLS         = 0x57,
+    RGT         = 0x58,
+    RLEQ        = 0x59,
+    RGEQ        = 0x5A,
 
     // Common operations -- no comments need
 
@@ -150,6 +175,27 @@ inline std::string typeToString(const InstructionType & t)
     else if (t==CDROPZ) return ("cdropz");
     else if (t==CACHEBEGIN) return ("cachebegin");
     else if (t==CACHEEND) return ("cacheend");
+    else if (t==ISUM) return ("isum");
+    else if (t==ISUB) return ("isub");
+    else if (t==IMUL) return ("imul");
+    else if (t==INEG) return ("ineg");
+    else if (t==IEQ) return ("ieq");
+    else if (t==INEQ) return ("ineq");
+    else if (t==ILS) return ("ils");
+    else if (t==IGT) return ("igt");
+    else if (t==ILEQ) return ("ileq");
+    else if (t==IGEQ) return ("igeq");
+    else if (t==RSUM) return ("rsum");
+    else if (t==RSUB) return ("rsub");
+    else if (t==RMUL) return ("rmul");
+    else if (t==RDIV) return ("rdiv");
+    else if (t==RNEG) return ("rneg");
+    else if (t==REQ) return ("req");
+    else if (t==RNEQ) return ("rneq");
+    else if (t==RLS) return ("rls");
+    else if (t==RGT) return ("rgt");
+    else if (t==RLEQ) return ("rleq");
+    else if (t==RGEQ) return ("rgeq");
     else return "nop";
 }
 
@@ -204,6 +250,27 @@ inline InstructionType typeFromString(const std::string & ss)
     else if (s=="cdropz") return CDROPZ;
     else if (s=="cachebegin") return CACHEBEGIN;
     else if (s=="cacheend") return CACHEEND;
+    else if (s=="isum") return ISUM;
+    else if (s=="isub") return ISUB;
+    else if (s=="imul") return IMUL;
+    else if (s=="ineg") return INEG;
+    else if (s=="ieq") return IEQ;
+    else if (s=="ineq") return INEQ;
+    else if (s=="ils") return ILS;
+    else if (s=="igt") return IGT;
+    else if (s=="ileq") return ILEQ;
+    else if (s=="igeq") return IGEQ;
+    else if (s=="rsum") return RSUM;
+    else if (s=="rsub") return RSUB;
+    else if (s=="rmul") return RMUL;
+    else if (s=="rdiv") return RDIV;
+    else if (s=="rneg") return RNEG;
+    else if (s=="req") return REQ;
+    else if (s=="rneq") return RNEQ;
+    else if (s=="rls") return RLS;
+    else if (s=="rgt") return RGT;
+    else if (s=="rleq") return RLEQ;
+    else if (s=="rgeq") return RGEQ;
     else return NOP;
 }
 
@@ -0,0 +1,447 @@
+#ifndef VM_PROFILER_HPP
+#define VM_PROFILER_HPP
+
+#include <map>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <ostream>
+#include <sstream>
+#include <chrono>
+
+#include <kumir2-libs/stdlib/kumirstdlib.hpp>
+
+namespace VM {
+
+/* Module context number and (module_id << 16 | algorithm_id) key */
+typedef std::pair<size_t,uint32_t> ProfileFunctionId;
+
+struct ProfileLineData {
+    uint64_t hits;
+    uint64_t instructions;
+    uint64_t time; // nanoseconds
+
+    inline explicit ProfileLineData(): hits(0), instructions(0), time(0) {}
+};
+
+struct ProfileFunctionData;
+
+struct ProfileCallData {
+    uint64_t calls;
+    uint64_t instructions;
+    uint64_t time; // nanoseconds
+
+    inline explicit ProfileCallData(): calls(0), instructions(0), time(0) {}
+};
+
+/* Callee and line in caller source where it was called from */
+typedef std::pair<const ProfileFunctionData*,int> ProfileCallSite;
+
+struct ProfileFunctionData {
+    std::wstring name;
+    std::wstring fileName;
+    bool external;
+    int firstLine;
+    int depth; // active calls, to not count recursive calls twice
+    uint64_t calls;
+    uint64_t inclusiveInstructions;
+    uint64_t exclusiveInstructions;
+    uint64_t inclusiveTime; // nanoseconds
+    uint64_t exclusiveTime; // nanoseconds
+    std::map<int,ProfileLineData> lines;
+    std::map<ProfileCallSite,ProfileCallData> callees;
+
+    inline explicit ProfileFunctionData()
+        : external(false), firstLine(-1), depth(0), calls(0)
+        , inclusiveInstructions(0), exclusiveInstructions(0)
+        , inclusiveTime(0), exclusiveTime(0) {}
+};
+
+/** Collects per-line and per-algorithm execution statistics.
+ *
+ *  The VM reports algorithm entries and exits, LINE instructions and
+ *  actor calls; each evaluated instruction is counted by a single
+ *  increment. A VM without profiler set does no profiling work at all.
+ */
+class Profiler {
+public:
+    inline Profiler(): instructions_(0) {}
+
+    inline void reset();
+
+    inline bool isFunctionRegistered(const ProfileFunctionId & id) const;
+    inline void registerFunction(const ProfileFunctionId & id, const std::wstring & name, const std::wstring & fileName);
+
+    inline void enterFunction(const ProfileFunctionId & id);
+    inline void leaveFunction();
+    inline void countInstruction() { instructions_ ++; }
+    inline void lineHit(int lineNo);
+
+    inline void beginExternalCall(const std::wstring & moduleName, const std::wstring & algorithmName);
+    inline void endExternalCall() { leaveFunction(); }
+
+    /** Closes algorithms still running (program stopped or failed) */
+    inline void finish();
+
+    inline uint64_t instructionsCount() const { return instructions_; }
+
+    /** Writes human-readable summary of most expensive algorithms,
+     *  lines and actor calls */
+    inline std::wstring textReport(size_t maxEntries = 20) const;
+
+    /** Writes profile in Callgrind format, readable by KCachegrind
+     *  and callgrind_annotate. Events are instructions and microseconds */
+    inline void writeCallgrindReport(std::ostream & out) const;
+
+private:
+    struct Frame {
+        ProfileFunctionData * function;
+        bool outermost;
+        int line;
+        uint64_t startInstructions;
+        uint64_t startTime;
+        uint64_t childInstructions;
+        uint64_t childTime;
+        uint64_t lineStartInstructions;
+        uint64_t lineStartTime;
+        uint64_t lineChildInstructions;
+        uint64_t lineChildTime;
+    };
+
+    typedef std::map<ProfileFunctionId,ProfileFunctionData> FunctionsTable;
+    typedef std::pair<std::wstring,std::wstring> ExternalFunctionId;
+    typedef std::map<ExternalFunctionId,ProfileFunctionData> ExternalFunctionsTable;
+
+    inline static uint64_t now();
+    inline void enterFunction(ProfileFunctionData * function);
+    inline void closeLine(Frame & frame, uint64_t time);
+    inline std::vector<const ProfileFunctionData*> allFunctions() const;
+    inline static std::string toUtf8(const std::wstring & s);
+    inline static size_t fileId(std::map<std::wstring,size_t> & ids, const std::wstring & fileName, bool & isNew);
+
+    uint64_t instructions_;
+    FunctionsTable functions_;
+    ExternalFunctionsTable externalFunctions_;
+    std::vector<Frame> frames_;
+};
+
+// ------------ INLINE IMPLEMENTATION
+
+uint64_t Profiler::now()
+{
+    return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now().time_since_epoch()
+                        ).count());
+}
+
+void Profiler::reset()
+{
+    instructions_ = 0;
+    functions_.clear();
+    externalFunctions_.clear();
+    frames_.clear();
+}
+
+bool Profiler::isFunctionRegistered(const ProfileFunctionId &id) const
+{
+    return functions_.count(id) > 0;
+}
+
+void Profiler::registerFunction(const ProfileFunctionId &id, const std::wstring &name, const std::wstring &fileName)
+{
+    ProfileFunctionData & data = functions_[id];
+    data.name = name;
+    data.fileName = fileName;
+}
+
+void Profiler::enterFunction(const ProfileFunctionId &id)
+{
+    enterFunction(&functions_[id]);
+}
+
+void Profiler::beginExternalCall(const std::wstring &moduleName, const std::wstring &algorithmName)
+{
+    ProfileFunctionData & data = externalFunctions_[ExternalFunctionId(moduleName, algorithmName)];
+    if (data.name.empty()) {
+        data.name = moduleName.empty() ? algorithmName : moduleName + L": " + algorithmName;
+        data.fileName = moduleName;
+        data.external = true;
+    }
+    enterFunction(&data);
+}
+
+void Profiler::enterFunction(ProfileFunctionData *function)
+{
+    const uint64_t time = now();
+    Frame frame;
+    frame.function = function;
+    frame.outermost = 0 == function->depth;
+    frame.line = -1;
+    frame.startInstructions = frame.lineStartInstructions = instructions_;
+    frame.startTime = frame.lineStartTime = time;
+    frame.childInstructions = frame.lineChildInstructions = 0;
+    frame.childTime = frame.lineChildTime = 0;
+    function->depth ++;
+    function->calls ++;
+    frames_.push_back(frame);
+}
+
+void Profiler::closeLine(Frame &frame, uint64_t time)
+{
+    if (-1 == frame.line)
+        return;
+    ProfileLineData & data = frame.function->lines[frame.line];
+    data.instructions += instructions_ - frame.lineStartInstructions - frame.lineChildInstructions;
+    data.time += time - frame.lineStartTime - frame.lineChildTime;
+}
+
+void Profiler::lineHit(int lineNo)
+{
+    if (frames_.empty())
+        return;
+    const uint64_t time = now();
+    Frame & frame = frames_.back();
+    closeLine(frame, time);
+    frame.line = lineNo;
+    frame.lineStartInstructions = instructions_;
+    frame.lineStartTime = time;
+    frame.lineChildInstructions = frame.lineChildTime = 0;
+    frame.function->lines[lineNo].hits ++;
+    if (-1 == frame.function->firstLine)
+        frame.function->firstLine = lineNo;
+}
+
+void Profiler::leaveFunction()
+{
+    if (frames_.empty())
+        return;
+    const uint64_t time = now();
+    Frame & frame = frames_.back();
+    closeLine(frame, time);
+    const uint64_t instructions = instructions_ - frame.startInstructions;
+    const uint64_t elapsed = time - frame.startTime;
+    ProfileFunctionData * function = frame.function;
+    function->depth --;
+    function->exclusiveInstructions += instructions - frame.childInstructions;
+    function->exclusiveTime += elapsed - frame.childTime;
+    if (frame.outermost) {
+        function->inclusiveInstructions += instructions;
+        function->inclusiveTime += elapsed;
+    }
+    frames_.pop_back();
+    if (!frames_.empty()) {
+        Frame & caller = frames_.back();
+        caller.childInstructions += instructions;
+        caller.childTime += elapsed;
+        caller.lineChildInstructions += instructions;
+        caller.lineChildTime += elapsed;
+        ProfileCallData & call = caller.function->callees[ProfileCallSite(function, caller.line)];
+        call.calls ++;
+        call.instructions += instructions;
+        call.time += elapsed;
+    }
+}
+
+void Profiler::finish()
+{
+    while (!frames_.empty())
+        leaveFunction();
+}
+
+std::vector<const ProfileFunctionData*> Profiler::allFunctions() const
+{
+    std::vector<const ProfileFunctionData*> result;
+    for (FunctionsTable::const_iterator it=functions_.begin(); it!=functions_.end(); ++it)
+        result.push_back(&(it->second));
+    for (ExternalFunctionsTable::const_iterator it=externalFunctions_.begin(); it!=externalFunctions_.end(); ++it)
+        result.push_back(&(it->second));
+    return result;
+}
+
+std::string Profiler::toUtf8(const std::wstring &s)
+{
+    Kumir::EncodingError encodingError;
+    return Kumir::Coder::encode(Kumir::UTF8, s, encodingError);
+}
+
+size_t Profiler::fileId(std::map<std::wstring,size_t> &ids, const std::wstring &fileName, bool &isNew)
+{
+    std::map<std::wstring,size_t>::const_iterator it = ids.find(fileName);
+    isNew = ids.end() == it;
+    if (!isNew)
+        return it->second;
+    const size_t id = ids.size() + 1;
+    ids[fileName] = id;
+    return id;
+}
+
+namespace ProfilerDetails {
+
+inline bool moreExclusiveInstructions(const ProfileFunctionData * a, const ProfileFunctionData * b)
+{
+    return a->exclusiveInstructions > b->exclusiveInstructions;
+}
+
+inline bool moreInclusiveTime(const ProfileFunctionData * a, const ProfileFunctionData * b)
+{
+    return a->inclusiveTime > b->inclusiveTime;
+}
+
+struct LineEntry {
+    const ProfileFunctionData * function;
+    int line;
+    ProfileLineData data;
+};
+
+inline bool moreLineInstructions(const LineEntry & a, const LineEntry & b)
+{
+    return a.data.instructions > b.data.instructions;
+}
+
+inline double msecs(uint64_t nsecs)
+{
+    return double(nsecs) / 1000000.0;
+}
+
+}
+
+std::wstring Profiler::textReport(size_t maxEntries) const
+{
+    using namespace ProfilerDetails;
+    std::vector<const ProfileFunctionData*> functions;
+    std::vector<const ProfileFunctionData*> actors;
+    std::vector<LineEntry> lines;
+    for (FunctionsTable::const_iterator it=functions_.begin(); it!=functions_.end(); ++it) {
+        const ProfileFunctionData & f = it->second;
+        if (0 == f.calls)
+            continue;
+        functions.push_back(&f);
+        for (std::map<int,ProfileLineData>::const_iterator l=f.lines.begin(); l!=f.lines.end(); ++l) {
+            LineEntry entry;
+            entry.function = &f;
+            entry.line = l->first;
+            entry.data = l->second;
+            lines.push_back(entry);
+        }
+    }
+    for (ExternalFunctionsTable::const_iterator it=externalFunctions_.begin(); it!=externalFunctions_.end(); ++it) {
+        actors.push_back(&(it->second));
+    }
+    std::sort(functions.begin(), functions.end(), moreExclusiveInstructions);
+    std::sort(lines.begin(), lines.end(), moreLineInstructions);
+    std::sort(actors.begin(), actors.end(), moreInclusiveTime);
+
+    std::wostringstream out;
+    out << L"Instructions executed: " << instructions_ << L"\n\n";
+
+    out << L"Algorithms by exclusive instructions:\n";
+    out << L"       calls    excl.instr    incl.instr  excl.ms  incl.ms  algorithm\n";
+    for (size_t i=0; i<functions.size() && i<maxEntries; i++) {
+        const ProfileFunctionData * f = functions[i];
+        wchar_t buffer[128];
+        swprintf(buffer, 128, L"%12llu  %12llu  %12llu %8.1f %8.1f  ",
+                 (unsigned long long)(f->calls),
+                 (unsigned long long)(f->exclusiveInstructions),
+                 (unsigned long long)(f->inclusiveInstructions),
+                 msecs(f->exclusiveTime), msecs(f->inclusiveTime));
+        out << buffer << f->name << L"\n";
+    }
+
+    out << L"\nLines by instructions:\n";
+    out << L"        hits         instr       ms  line  algorithm\n";
+    for (size_t i=0; i<lines.size() && i<maxEntries; i++) {
+        const LineEntry & e = lines[i];
+        wchar_t buffer[128];
+        swprintf(buffer, 128, L"%12llu  %12llu %8.1f %5d  ",
+                 (unsigned long long)(e.data.hits),
+                 (unsigned long long)(e.data.instructions),
+                 msecs(e.data.time), e.line + 1);
+        out << buffer << e.function->name << L"\n";
+    }
+
+    if (!actors.empty()) {
+        out << L"\nActor calls by time:\n";
+        out << L"       calls       ms  algorithm\n";
+        for (size_t i=0; i<actors.size() && i<maxEntries; i++) {
+            const ProfileFunctionData * f = actors[i];
+            wchar_t buffer[64];
+            swprintf(buffer, 64, L"%12llu %8.1f  ",
+                     (unsigned long long)(f->calls),
+                     msecs(f->inclusiveTime));
+            out << buffer << f->name << L"\n";
+        }
+    }
+    return out.str();
+}
+
+void Profiler::writeCallgrindReport(std::ostream &out) const
+{
+    const std::vector<const ProfileFunctionData*> functions = allFunctions();
+    std::map<const ProfileFunctionData*,size_t> functionIds;
+    std::map<std::wstring,size_t> fileIds;
+    for (size_t i=0; i<functions.size(); i++)
+        functionIds[functions[i]] = i + 1;
+
+    out << "# callgrind format\n";
+    out << "version: 1\n";
+    out << "creator: kumir2\n";
+    out << "positions: line\n";
+    out << "events: Ir us\n";
+    uint64_t totalTime = 0;
+    for (size_t i=0; i<functions.size(); i++)
+        totalTime += functions[i]->exclusiveTime;
+    out << "summary: " << instructions_ << " " << totalTime / 1000 << "\n";
+
+    // Files and functions are named once, then referred by id
+    std::map<const ProfileFunctionData*,bool> named;
+    for (size_t i=0; i<functions.size(); i++) {
+        const ProfileFunctionData * f = functions[i];
+        if (0 == f->calls)
+            continue;
+        out << "\n";
+        bool newFile = false;
+        out << "fl=(" << fileId(fileIds, f->fileName, newFile) << ")";
+        if (newFile)
+            out << " " << toUtf8(f->fileName);
+        out << "\n";
+        out << "fn=(" << functionIds[f] << ")";
+        if (!named[f])
+            out << " " << toUtf8(f->name);
+        named[f] = true;
+        out << "\n";
+
+        // Self cost by lines; the part not covered by lines goes to line 0
+        uint64_t linesInstructions = 0, linesTime = 0;
+        for (std::map<int,ProfileLineData>::const_iterator l=f->lines.begin(); l!=f->lines.end(); ++l) {
+            out << l->first + 1 << " " << l->second.instructions << " " << l->second.time / 1000 << "\n";
+            linesInstructions += l->second.instructions;
+            linesTime += l->second.time;
+        }
+        if (f->exclusiveInstructions > linesInstructions || f->exclusiveTime / 1000 > linesTime / 1000) {
+            out << "0 "
+                << (f->exclusiveInstructions > linesInstructions ? f->exclusiveInstructions - linesInstructions : 0) << " "
+                << (f->exclusiveTime > linesTime ? (f->exclusiveTime - linesTime) / 1000 : 0) << "\n";
+        }
+
+        for (std::map<ProfileCallSite,ProfileCallData>::const_iterator c=f->callees.begin(); c!=f->callees.end(); ++c) {
+            const ProfileFunctionData * callee = c->first.first;
+            bool newCalleeFile = false;
+            out << "cfl=(" << fileId(fileIds, callee->fileName, newCalleeFile) << ")";
+            if (newCalleeFile)
+                out << " " << toUtf8(callee->fileName);
+            out << "\n";
+            out << "cfn=(" << functionIds[callee] << ")";
+            if (!named[callee])
+                out << " " << toUtf8(callee->name);
+            named[callee] = true;
+            out << "\n";
+            out << "calls=" << c->second.calls << " " << callee->firstLine + 1 << "\n";
+            out << c->first.second + 1 << " " << c->second.instructions << " " << c->second.time / 1000 << "\n";
+        }
+    }
+    out.flush();
+}
+
+}
+
+#endif // VM_PROFILER_HPP
@@ -0,0 +1,524 @@
+#ifndef VM_SCHEDULER_HPP
+#define VM_SCHEDULER_HPP
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <kumir2-libs/stdlib/kumirstdlib.hpp>
+#include "vm.hpp"
+
+namespace VM {
+
+class Scheduler;
+
+/* Work done by program evaluated by Scheduler */
+struct SessionStatistics {
+    uint64_t instructions;
+    uint64_t quanta;
+    uint64_t migrations; // quanta evaluated by worker which stole session
+    uint64_t cpuTime;    // nanoseconds spent evaluating on worker threads
+
+    inline SessionStatistics()
+        : instructions(0), quanta(0), migrations(0), cpuTime(0) {}
+};
+
+/** Program evaluated by Scheduler in turns with other programs.
+ *
+ *  Host loads program by setProgram, sets functors of vm() and console
+ *  output buffer by setConsoleOutputBuffer, calls reset and passes
+ *  session to Scheduler::start. Console input statement and 'wait'
+ *  algorithm park session, so worker thread evaluates other programs
+ *  meanwhile. Actor calls return their values synchronously, so they
+ *  take worker thread for the time of call. Files left opened by
+ *  program are closed when session is destroyed.
+ */
+class Session: public std::enable_shared_from_this<Session> {
+public:
+    enum State {
+        Created,
+        Ready,
+        Running,
+        WaitingForInput,
+        Sleeping,
+        Finished
+    };
+
+    inline Session();
+    inline ~Session();
+
+    inline KumirVM & vm() { return *vm_; }
+    inline State state() const { return State(state_.load()); }
+
+    /** Loads main program, must be used in place of vm().setProgram,
+     *  so memory taken by program is counted for this session */
+    inline void setProgram(const Bytecode::Data & data,
+                           const Kumir::String & fileName,
+                           Kumir::String * error);
+
+    /** Sets buffer for console output of this program only */
+    inline void setConsoleOutputBuffer(Kumir::AbstractOutputBuffer * buffer);
+
+    /** Resets vm to start of program keeping library state of other
+     *  programs untouched, must be used in place of vm().reset() */
+    inline void reset();
+
+    /** Appends text typed by user. Input statement waits
+     *  until whole line is typed */
+    inline void provideInput(const Kumir::String & text);
+
+    /** Reading more input than provided is an error after this */
+    inline void closeInput();
+
+    inline SessionStatistics statistics() const;
+
+    /** Blocks calling thread until program is finished */
+    inline void waitForFinished();
+
+private:
+    friend class Scheduler;
+
+    class InputBuffer: public Kumir::AbstractInputBuffer {
+    public:
+        inline explicit InputBuffer(std::mutex & mutex)
+            : mutex_(mutex), position_(0), closed_(false) {}
+        inline bool readRawChar(Kumir::Char & ch) _override;
+        inline void pushLastCharBack() _override;
+        inline void clear() _override;
+        inline void append(const Kumir::String & text);
+        inline void close() { closed_ = true; }
+        inline bool isReady() const;
+    private:
+        std::mutex & mutex_;
+        Kumir::String data_;
+        size_t position_;
+        bool closed_;
+    };
+
+    /* 'wait' algorithm parks session instead of sleeping */
+    class DelayFunctor: public VM::DelayFunctor {
+    public:
+        inline explicit DelayFunctor(Session * session): session_(session) {}
+        inline void operator()(uint32_t msec) _override {
+            session_->sleeping_ = true;
+            session_->wakeTime_ = std::chrono::steady_clock::now()
+                    + std::chrono::milliseconds(msec);
+        }
+    private:
+        Session * session_;
+    };
+
+    /* Binds calling thread to library state of session while alive */
+    class StateBinding {
+    public:
+        inline explicit StateBinding(Session & session)
+            : previous_(Kumir::Core::boundThreadState()) {
+            Kumir::Core::bindThreadState(&session.programState_);
+        }
+        inline ~StateBinding() { Kumir::Core::bindThreadState(previous_); }
+    private:
+        Kumir::ProgramState * previous_;
+    };
+
+    inline void setState(State state);
+    inline bool parkForInput();
+
+    mutable std::mutex mutex_;
+    std::condition_variable finished_;
+    std::atomic<int> state_;
+    InputBuffer input_;
+    DelayFunctor delay_;
+    Kumir::ProgramState programState_;
+    std::unique_ptr<KumirVM> vm_;
+    Scheduler * scheduler_;
+    bool sleeping_;
+    std::chrono::steady_clock::time_point wakeTime_;
+    SessionStatistics statistics_;
+};
+
+/** Evaluates many programs on fixed pool of worker threads.
+ *
+ *  Each worker evaluates a quantum of instructions of a program, then
+ *  puts program to the end of its own queue. Idle worker steals
+ *  program from the end of another worker queue. Library state of
+ *  program (error, console buffers, opened files and memory counted
+ *  for memory limit) is bound to worker while it evaluates program.
+ */
+class Scheduler {
+public:
+    /** Starts workers, by default one per processor. Quantum is count
+     *  of instructions evaluated before worker takes next program */
+    inline explicit Scheduler(unsigned workersCount = 0, uint32_t quantum = 10000);
+
+    /** Stops workers after their current quanta, programs not
+     *  finished are left as they are. Sessions given to scheduler
+     *  must not get input after it is destroyed */
+    inline ~Scheduler();
+
+    inline void start(const std::shared_ptr<Session> & session);
+    inline size_t workersCount() const { return workers_.size(); }
+
+private:
+    friend class Session;
+    struct Worker {
+        std::mutex mutex;
+        std::deque< std::shared_ptr<Session> > queue;
+        std::thread thread;
+    };
+    typedef std::chrono::steady_clock Clock;
+    typedef std::multimap< Clock::time_point, std::shared_ptr<Session> > SleepingMap;
+
+    inline void run(size_t workerIndex);
+    inline std::shared_ptr<Session> take(size_t workerIndex, bool & stolen);
+    inline void enqueue(const std::shared_ptr<Session> & session, size_t workerIndex);
+    inline void resume(const std::shared_ptr<Session> & session) { enqueue(session, nextWorker_++); }
+    inline void wakeUpSleeping(size_t workerIndex);
+    inline Session::State evaluate(Session & session, bool stolen);
+
+    Scheduler(const Scheduler &) = delete;
+    Scheduler & operator=(const Scheduler &) = delete;
+
+    std::vector< std::unique_ptr<Worker> > workers_;
+    std::mutex mutex_;
+    std::condition_variable wakeUp_;
+    SleepingMap sleeping_;
+    std::atomic<long> readyCount_;
+    std::atomic<size_t> nextWorker_;
+    bool stopping_;
+    uint32_t quantum_;
+};
+
+
+Session::Session()
+    : state_(Created)
+    , input_(mutex_)
+    , delay_(this)
+    , vm_(new KumirVM)
+    , scheduler_(nullptr)
+    , sleeping_(false)
+{
+    vm_->setFunctor(&delay_);
+    // VM sets library console buffer too, so it must not be process-wide one
+    StateBinding binding(*this);
+    vm_->setConsoleInputBuffer(&input_);
+}
+
+Session::~Session()
+{
+    // Values of program are freed with memory counter they were taken by
+    StateBinding binding(*this);
+    vm_.reset();
+}
+
+void Session::setProgram(const Bytecode::Data & data,
+                         const Kumir::String & fileName,
+                         Kumir::String * error)
+{
+    StateBinding binding(*this);
+    vm_->setProgram(data, true, fileName, error);
+}
+
+void Session::setConsoleOutputBuffer(Kumir::AbstractOutputBuffer * buffer)
+{
+    StateBinding binding(*this);
+    vm_->setConsoleOutputBuffer(buffer);
+}
+
+void Session::reset()
+{
+    StateBinding binding(*this);
+    vm_->reset();
+}
+
+void Session::provideInput(const Kumir::String & text)
+{
+    bool wakeUp = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        input_.append(text);
+        if (state_==WaitingForInput && input_.isReady()) {
+            state_ = Ready;
+            wakeUp = true;
+        }
+    }
+    if (wakeUp)
+        scheduler_->resume(shared_from_this());
+}
+
+void Session::closeInput()
+{
+    bool wakeUp = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        input_.close();
+        if (state_==WaitingForInput) {
+            state_ = Ready;
+            wakeUp = true;
+        }
+    }
+    if (wakeUp)
+        scheduler_->resume(shared_from_this());
+}
+
+SessionStatistics Session::statistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return statistics_;
+}
+
+void Session::waitForFinished()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (state_!=Finished)
+        finished_.wait(lock);
+}
+
+void Session::setState(State state)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    state_ = state;
+    if (state==Finished)
+        finished_.notify_all();
+}
+
+bool Session::parkForInput()
+{
+    // Checked under the same lock as provideInput, so input typed
+    // right now is never missed
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (input_.isReady())
+        return false;
+    state_ = WaitingForInput;
+    return true;
+}
+
+bool Session::InputBuffer::readRawChar(Kumir::Char & ch)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (position_ >= data_.length())
+        return false;
+    ch = data_[position_++];
+    return true;
+}
+
+void Session::InputBuffer::pushLastCharBack()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (position_ > 0)
+        position_--;
+}
+
+void Session::InputBuffer::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    data_.clear();
+    position_ = 0;
+}
+
+void Session::InputBuffer::append(const Kumir::String & text)
+{
+    // Called with lock held
+    data_.erase(0, position_);
+    position_ = 0;
+    data_.append(text);
+}
+
+bool Session::InputBuffer::isReady() const
+{
+    // Called with lock held
+    return closed_ || data_.find(Kumir::Char('\n'), position_)!=Kumir::String::npos;
+}
+
+
+Scheduler::Scheduler(unsigned workersCount, uint32_t quantum)
+    : readyCount_(0)
+    , nextWorker_(0)
+    , stopping_(false)
+    , quantum_(quantum>0? quantum : 1u)
+{
+    if (workersCount==0)
+        workersCount = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned i=0; i<workersCount; i++) {
+        workers_.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    for (size_t i=0; i<workers_.size(); i++) {
+        workers_[i]->thread = std::thread(&Scheduler::run, this, i);
+    }
+}
+
+Scheduler::~Scheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    wakeUp_.notify_all();
+    for (size_t i=0; i<workers_.size(); i++) {
+        workers_[i]->thread.join();
+    }
+}
+
+void Scheduler::start(const std::shared_ptr<Session> & session)
+{
+    session->scheduler_ = this;
+    session->setState(Session::Ready);
+    enqueue(session, nextWorker_++);
+}
+
+void Scheduler::enqueue(const std::shared_ptr<Session> & session, size_t workerIndex)
+{
+    Worker & worker = *workers_[workerIndex % workers_.size()];
+    {
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.queue.push_back(session);
+    }
+    {
+        // Counted under lock idle workers check it with, so
+        // worker going to sleep right now is woken up
+        std::lock_guard<std::mutex> lock(mutex_);
+        readyCount_++;
+    }
+    wakeUp_.notify_one();
+}
+
+void Scheduler::wakeUpSleeping(size_t workerIndex)
+{
+    std::vector< std::shared_ptr<Session> > awaken;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const Clock::time_point now = Clock::now();
+        while (!sleeping_.empty() && sleeping_.begin()->first<=now) {
+            awaken.push_back(sleeping_.begin()->second);
+            sleeping_.erase(sleeping_.begin());
+        }
+    }
+    for (size_t i=0; i<awaken.size(); i++) {
+        awaken[i]->setState(Session::Ready);
+        enqueue(awaken[i], workerIndex);
+    }
+}
+
+std::shared_ptr<Session> Scheduler::take(size_t workerIndex, bool & stolen)
+{
+    std::shared_ptr<Session> result;
+    stolen = false;
+    Worker & own = *workers_[workerIndex];
+    {
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.queue.empty()) {
+            result = own.queue.front();
+            own.queue.pop_front();
+        }
+    }
+    for (size_t i=1; !result && i<workers_.size(); i++) {
+        Worker & other = *workers_[(workerIndex+i) % workers_.size()];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.queue.empty()) {
+            result = other.queue.back();
+            other.queue.pop_back();
+            stolen = true;
+        }
+    }
+    if (result)
+        readyCount_--;
+    return result;
+}
+
+void Scheduler::run(size_t workerIndex)
+{
+    for (;;) {
+        wakeUpSleeping(workerIndex);
+        bool stolen = false;
+        const std::shared_ptr<Session> session = take(workerIndex, stolen);
+        if (!session) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            if (stopping_)
+                return;
+            if (readyCount_<=0) {
+                if (sleeping_.empty()) {
+                    wakeUp_.wait(lock);
+                }
+                else {
+                    // Copied, as other worker may wake session up while
+                    // lock is released by waiting
+                    const Clock::time_point wakeTime = sleeping_.begin()->first;
+                    wakeUp_.wait_until(lock, wakeTime);
+                }
+            }
+            continue;
+        }
+        const Session::State state = evaluate(*session, stolen);
+        if (state==Session::Ready) {
+            enqueue(session, workerIndex);
+        }
+        else if (state==Session::Sleeping) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            sleeping_.insert(std::make_pair(session->wakeTime_, session));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (stopping_)
+                return;
+        }
+    }
+}
+
+Session::State Scheduler::evaluate(Session & session, bool stolen)
+{
+    const Clock::time_point start = Clock::now();
+    KumirVM & vm = *session.vm_;
+    session.setState(Session::Running);
+    Session::State state = Session::Ready;
+    uint32_t done = 0;
+    Session::StateBinding binding(session);
+    for ( ; done<quantum_; done++) {
+        if (!vm.hasMoreInstructions() || vm.error().length()>0) {
+            state = Session::Finished;
+            break;
+        }
+        if (vm.isAboutToReadConsole()) {
+            std::lock_guard<std::mutex> lock(session.mutex_);
+            if (!session.input_.isReady()) {
+                state = Session::WaitingForInput;
+                break;
+            }
+        }
+        vm.evaluateNextInstruction();
+        if (session.sleeping_) {
+            session.sleeping_ = false;
+            state = Session::Sleeping;
+            done++;
+            break;
+        }
+    }
+    if (state==Session::Ready && (!vm.hasMoreInstructions() || vm.error().length()>0))
+        state = Session::Finished;
+    {
+        std::lock_guard<std::mutex> lock(session.mutex_);
+        session.statistics_.instructions += done;
+        session.statistics_.quanta++;
+        if (stolen)
+            session.statistics_.migrations++;
+        session.statistics_.cpuTime += uint64_t(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now()-start).count());
+    }
+    // Session parked for input may be taken by other worker right
+    // after parkForInput, so it is not touched here after that
+    if (state==Session::WaitingForInput && session.parkForInput())
+        return state;
+    if (state==Session::WaitingForInput)
+        state = Session::Ready; // input typed while finishing quantum
+    session.setState(state);
+    return state;
+}
+
+}
+
+#endif // VM_SCHEDULER_HPP
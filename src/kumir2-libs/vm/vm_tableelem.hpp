@@ -41,6 +41,9 @@ struct TableElem {
     String recordClassLocalizedName;
     Variable initialValue; // constant value
     std::vector<Instruction> instructions; // for local defined function
+    uint32_t imageOffset; // position of data not decoded yet in bytecode
+                          // image (instructions of function or whole
+                          // local variable), 0 if element is decoded
     inline TableElem() {
         type = EL_NONE;
         vtype.push_back(VT_void);
@@ -48,6 +51,7 @@ struct TableElem {
         refvalue = VK_Plain;
         module = 0;
         algId = id = 0;
+        imageOffset = 0;
     }
 
 
@@ -69,13 +73,13 @@ template <typename T> inline void valueToDataStream(std::list<char> & stream, T
         }
     }
     else {
-        for (int i=0; i<sizeof(T); i++) {
+        for (size_t i=0; i<sizeof(T); i++) {
             stream.push_back(buf[i]);
         }
     }
 }
 
-template <typename T> inline void valueFromDataStream(std::list<char> & stream, T &value)
+template <class Stream, typename T> inline void valueFromDataStream(Stream & stream, T &value)
 {
     char buf[sizeof(T)];
     static const bool le = isLittleEndian();
@@ -86,7 +90,7 @@ template <typename T> inline void valueFromDataStream(std::list<char> & stream,
         }
     }
     else {
-        for (int i=0; i<sizeof(value); i++) {
+        for (size_t i=0; i<sizeof(value); i++) {
             buf[i] = stream.front();
             stream.pop_front();
         }
@@ -110,7 +114,8 @@ inline void stringToDataStream(std::list<char>& stream, const String & str) {
     stdStringToDataStream(stream, utf);
 }
 
-inline void stdStringFromDataStream(std::list<char>& stream, std::string & str)
+template <class Stream>
+inline void stdStringFromDataStream(Stream & stream, std::string & str)
 {
     uint16_t u16size;
     valueFromDataStream(stream, u16size);
@@ -122,7 +127,8 @@ inline void stdStringFromDataStream(std::list<char>& stream, std::string & str)
     }
 }
 
-inline void stringFromDataStream(std::list<char>& stream, String & str)
+template <class Stream>
+inline void stringFromDataStream(Stream & stream, String & str)
 {
     std::string utf;
     stdStringFromDataStream(stream, utf);
@@ -210,7 +216,8 @@ inline void vtypeToDataStream(std::list<char> & ds, const std::list<ValueType> &
     }
 }
 
-inline void vtypeFromDataStream(std::list<char> & ds, std::list<ValueType> & vtype)
+template <class Stream>
+inline void vtypeFromDataStream(Stream & ds, std::list<ValueType> & vtype)
 {
     uint8_t u8;
     valueFromDataStream(ds, u8);
@@ -278,7 +285,8 @@ inline void tableElemToBinaryStream(std::list<char> & ds, const TableElem &e)
     }
 }
 
-inline void scalarConstantFromDataStream(std::list<char> & stream, ValueType type, VM::AnyValue & val)
+template <class Stream>
+inline void scalarConstantFromDataStream(Stream & stream, ValueType type, VM::AnyValue & val)
 {
     switch (type) {
     case VT_int: {
@@ -316,7 +324,8 @@ inline void scalarConstantFromDataStream(std::list<char> & stream, ValueType typ
     }
 }
 
-inline void scalarConstantFromDataStream(std::list<char> & stream, const std::list<ValueType> & type, VM::AnyValue & val)
+template <class Stream>
+inline void scalarConstantFromDataStream(Stream & stream, const std::list<ValueType> & type, VM::AnyValue & val)
 {
     if (type.front()!=VT_record) {
         scalarConstantFromDataStream(stream, type.front(), val);
@@ -334,7 +343,8 @@ inline void scalarConstantFromDataStream(std::list<char> & stream, const std::li
     }
 }
 
-inline void constantFromDataStream(std::list<char> & stream,
+template <class Stream>
+inline void constantFromDataStream(Stream & stream,
                                    const std::list<ValueType> & baseType,
                                    Variable & val,
                                    uint8_t dimension )
@@ -370,7 +380,23 @@ inline void constantFromDataStream(std::list<char> & stream,
     }
 }
 
-inline void tableElemFromBinaryStream(std::list<char> & ds, TableElem &e)
+template <class Stream>
+inline void instructionsFromDataStream(Stream & ds, std::vector<Instruction> & instructions)
+{
+    uint16_t u16sz;
+    valueFromDataStream(ds, u16sz);
+    size_t sz = size_t(u16sz);
+    instructions.resize(sz);
+    for (size_t i=0; i<sz; i++) {
+        uint32_t instr;
+        valueFromDataStream(ds, instr);
+        instructions[i] = fromUint32(instr);
+    }
+}
+
+/* Reads all fields of element except constant value and instructions */
+template <class Stream>
+inline void tableElemHeaderFromBinaryStream(Stream & ds, TableElem &e)
 {
     uint8_t t;
     uint8_t d;
@@ -427,19 +453,17 @@ inline void tableElemFromBinaryStream(std::list<char> & ds, TableElem &e)
         e.recordClassAsciiName = Kumir::Coder::encode(Kumir::ASCII, us, encodingError);
         stringFromDataStream(ds, e.recordClassLocalizedName);
     }
+}
+
+template <class Stream>
+inline void tableElemFromBinaryStream(Stream & ds, TableElem &e)
+{
+    tableElemHeaderFromBinaryStream(ds, e);
     if (e.type==EL_CONST) {
         constantFromDataStream(ds, e.vtype, e.initialValue, e.dimension);
     }
     else if (e.type==EL_FUNCTION || e.type==EL_MAIN || e.type==EL_TESTING || e.type==EL_BELOWMAIN || e.type==EL_INIT) {
-        uint16_t u16sz;
-        valueFromDataStream(ds, u16sz);
-        size_t sz = size_t(u16sz);
-        e.instructions.resize(sz);
-        for (size_t i=0; i<sz; i++) {
-            uint32_t instr;
-            valueFromDataStream(ds, instr);
-            e.instructions[i] = fromUint32(instr);
-        }
+        instructionsFromDataStream(ds, e.instructions);
     }
 }
 
@@ -1,5 +1,7 @@
 #include "coursemanager_plugin.h"
 #include <kumir2-libs/dataformats/kumfile.h>
+#include <kumir2-libs/dataformats/bytecodecache.h>
+#include <kumir2/actorinterface.h>
 #include "task/coursemanager_window.h"
 #include <kumir2/analizerinterface.h>
 #include <kumir2/runinterface.h>
@@ -191,34 +193,47 @@ int Plugin::checkTaskFromConsole(const int taskID)
             kumFile = analizer->sourceFileHandler()->fromString(course->getUserText(taskID));
         }
         else return 1;
-        Shared::Analizer::InstanceInterface * analizer_i =
-        analizer->createInstance();
+        const QString sourceText = kumFile.visibleText + "\n" + kumFile.hiddenText;
+
+        // The same solutions are checked many times, so unchanged ones
+        // are taken from cache of compiled programs
+        const BytecodeCache cache;
+        const QByteArray cacheKey = cache.isEnabled()
+                ? BytecodeCache::sourceKey(sourceText, curDir, "course-check")
+                : QByteArray();
+        QByteArray outData;
+        if (!cache.find(cacheKey, ExtensionSystem::PluginManager::instance()->findPlugins<Shared::ActorInterface>(), outData))
+        {
+            Shared::Analizer::InstanceInterface * analizer_i =
+            analizer->createInstance();
         
-        QString dirname = curDir;
-        analizer_i->setSourceDirName(dirname);
-        analizer_i->setSourceText(kumFile.visibleText + "\n" + kumFile.hiddenText);
+            QString dirname = curDir;
+            analizer_i->setSourceDirName(dirname);
+            analizer_i->setSourceText(sourceText);
         
-        QList<Shared::Analizer::Error> errors = analizer_i->errors();
-        for (int i=0; i<errors.size(); i++) {
-            Shared::Analizer::Error e = errors[i];
-            QString errorMessage = tr("Error: ") +
-            task.name+
-            ":" + QString::number(e.line+1) +
-            ":" + QString::number(e.start+1) + "-" + QString::number(e.start+e.len) +
-            ": " + e.message;
-            std::cerr << errorMessage.toLocal8Bit().data();
-            std::cerr << std::endl;
-        }
-       // if(errors.size()>0)
-       // {
+            QList<Shared::Analizer::Error> errors = analizer_i->errors();
+            for (int i=0; i<errors.size(); i++) {
+                Shared::Analizer::Error e = errors[i];
+                QString errorMessage = tr("Error: ") +
+                task.name+
+                ":" + QString::number(e.line+1) +
+                ":" + QString::number(e.start+1) + "-" + QString::number(e.start+e.len) +
+                ": " + e.message;
+                std::cerr << errorMessage.toLocal8Bit().data();
+                std::cerr << std::endl;
+            }
+           // if(errors.size()>0)
+           // {
             
-      //  }
-       AST::DataPtr ast = analizer_i->compiler()->abstractSyntaxTree();
-       Shared::GeneratorInterface * generator_ = ExtensionSystem::PluginManager::instance()->findPlugin<Shared::GeneratorInterface>();
-       QString suffix;
-       QString mimeType;
-       QByteArray outData;
-       generator_->generateExecutable(ast, outData, mimeType, suffix);
+          //  }
+           AST::DataPtr ast = analizer_i->compiler()->abstractSyntaxTree();
+           Shared::GeneratorInterface * generator_ = ExtensionSystem::PluginManager::instance()->findPlugin<Shared::GeneratorInterface>();
+           QString suffix;
+           QString mimeType;
+           generator_->generateExecutable(ast, outData, mimeType, suffix);
+           if (errors.isEmpty() && mimeType == "executable/kumir2-bytecode")
+               cache.store(cacheKey, ast, analizer_i->compiler()->includedFiles(), outData);
+        }
        QDir::setCurrent(curDir);
        Shared::RunInterface * runner = ExtensionSystem::PluginManager::instance()->findPlugin<Shared::RunInterface>();
         Shared::RunInterface::RunnableProgram program;
@@ -1065,6 +1065,21 @@ const AST::DataPtr Analizer::abstractSyntaxTree() const
     return _ast;
 }
 
+QStringList Analizer::includedFiles() const
+{
+    // Include statements are kept in front of statements of included files
+    QStringList result;
+    Q_FOREACH(TextStatementPtr st, _statements) {
+        if (LxSecInclude == st->type && 2 == st->data.size() &&
+                LxConstLiteral == st->data.at(1)->type)
+        {
+            result << _lexer->includeFilePath(st->data.at(1)->data);
+        }
+    }
+    result.removeDuplicates();
+    return result;
+}
+
 
 const AST::ModulePtr Analizer::findModuleByLine(int lineNo) const
 {
@@ -83,6 +83,7 @@ public slots:
     QString createImportStatementLine(const QString &importName) const;
 
     const AST::DataPtr abstractSyntaxTree() const;
+    QStringList includedFiles() const;
 
     const AST::ModulePtr findModuleByLine(int lineNo) const;
 
@@ -0,0 +1,294 @@
+#include "lexemscanner.h"
+
+#include <algorithm>
+#include <map>
+
+using namespace Shared;
+
+namespace KumirAnalizer {
+
+// Character classes of ASCII, Latin and Cyrillic letters are looked up
+// by direct table access, the rest of characters by binary search
+static const int LowClassesTableSize = 0x500;
+
+LexemScanner::LexemScanner()
+{
+    clear();
+}
+
+void LexemScanner::clear()
+{
+    nfa_.clear();
+    patterns_.clear();
+    transitions_.clear();
+    acceptPlain_.clear();
+    acceptWholeWord_.clear();
+    highClasses_.clear();
+    literalSpaceClasses_.assign(2, false);
+    classesCount_ = 2;
+    wordStartWithoutBoundary_ = false;
+    lowClasses_.assign(LowClassesTableSize, OtherClass);
+    for (int i=0; i<LowClassesTableSize; i++) {
+        if (QChar(ushort(i)).isSpace())
+            lowClasses_[i] = SpaceClass;
+    }
+    addNfaState();
+}
+
+bool LexemScanner::isWordChar(const QChar &ch)
+{
+    // The same definition as "\\b" of QRegExp uses
+    return ch.isLetterOrNumber() || ch.isMark() || ch == QLatin1Char('_');
+}
+
+int LexemScanner::addNfaState()
+{
+    NfaState state;
+    state.accept = -1;
+    nfa_.push_back(state);
+    return int(nfa_.size()) - 1;
+}
+
+int LexemScanner::classOfLiteral(ushort code)
+{
+    // Whitespace written literally matches only itself, like in QRegExp,
+    // so it gets its own class, which "\\s" matches too
+    const bool space = QChar(code).isSpace();
+    if (code < LowClassesTableSize) {
+        if (lowClasses_[code] == OtherClass || lowClasses_[code] == SpaceClass) {
+            lowClasses_[code] = classesCount_++;
+            literalSpaceClasses_.push_back(space);
+        }
+        return lowClasses_[code];
+    }
+    std::vector< std::pair<ushort,unsigned char> >::iterator it =
+            std::lower_bound(highClasses_.begin(), highClasses_.end(),
+                             std::make_pair(code, (unsigned char)0));
+    if (it != highClasses_.end() && it->first == code)
+        return it->second;
+    highClasses_.insert(it, std::make_pair(code, (unsigned char)(classesCount_)));
+    literalSpaceClasses_.push_back(space);
+    return classesCount_++;
+}
+
+int LexemScanner::charClass(const QChar &ch) const
+{
+    const ushort code = ch.unicode();
+    if (code < LowClassesTableSize)
+        return lowClasses_[code];
+    std::vector< std::pair<ushort,unsigned char> >::const_iterator it =
+            std::lower_bound(highClasses_.begin(), highClasses_.end(),
+                             std::make_pair(code, (unsigned char)0));
+    if (it != highClasses_.end() && it->first == code)
+        return it->second;
+    return ch.isSpace() ? SpaceClass : OtherClass;
+}
+
+void LexemScanner::addPattern(const QString &pattern, LexemType type, bool wholeWord)
+{
+    Q_ASSERT(classesCount_ < 255);
+    const int patternIndex = int(patterns_.size());
+    Pattern p;
+    p.type = type;
+    p.wholeWord = wholeWord;
+    patterns_.push_back(p);
+    transitions_.clear();
+
+    // Each pattern has its own chain of states, so loops of
+    // whitespace classes never affect other patterns
+    int current = addNfaState();
+    nfa_[0].epsilons.push_back(current);
+
+    bool first = true;
+    for (int i=0; i<pattern.length(); ) {
+        int cls = OtherClass;
+        bool spaces = false;
+        QChar quantifier;
+        if (pattern[i]==QLatin1Char('\\') && i+1<pattern.length()) {
+            if (pattern[i+1]==QLatin1Char('s')) {
+                spaces = true;
+                i += 2;
+                if (i<pattern.length() && (pattern[i]==QLatin1Char('+') || pattern[i]==QLatin1Char('*'))) {
+                    quantifier = pattern[i];
+                    i ++;
+                }
+            }
+            else {
+                cls = classOfLiteral(pattern[i+1].unicode());
+                if (first && !wholeWord && isWordChar(pattern[i+1]))
+                    wordStartWithoutBoundary_ = true;
+                i += 2;
+            }
+        }
+        else {
+            cls = classOfLiteral(pattern[i].unicode());
+            if (first && !wholeWord && isWordChar(pattern[i]))
+                wordStartWithoutBoundary_ = true;
+            i ++;
+        }
+        first = false;
+
+        const int next = addNfaState();
+        if (!spaces) {
+            nfa_[current].edges.push_back(std::make_pair(cls, next));
+        }
+        else {
+            if (quantifier==QLatin1Char('*'))
+                nfa_[current].epsilons.push_back(next);
+            else
+                nfa_[current].edges.push_back(std::make_pair(int(SpaceClass), next));
+            if (!quantifier.isNull())
+                nfa_[next].edges.push_back(std::make_pair(int(SpaceClass), next));
+        }
+        current = next;
+    }
+    nfa_[current].accept = patternIndex;
+}
+
+void LexemScanner::closure(std::vector<int> &states) const
+{
+    std::vector<int> stack = states;
+    std::vector<bool> visited(nfa_.size(), false);
+    for (size_t i=0; i<states.size(); i++)
+        visited[states[i]] = true;
+    while (!stack.empty()) {
+        const int s = stack.back();
+        stack.pop_back();
+        const std::vector<int> & eps = nfa_[s].epsilons;
+        for (size_t i=0; i<eps.size(); i++) {
+            if (!visited[eps[i]]) {
+                visited[eps[i]] = true;
+                states.push_back(eps[i]);
+                stack.push_back(eps[i]);
+            }
+        }
+    }
+    std::sort(states.begin(), states.end());
+}
+
+void LexemScanner::build()
+{
+    // Subset construction: each DFA state is a set of NFA states
+    transitions_.clear();
+    acceptPlain_.clear();
+    acceptWholeWord_.clear();
+
+    std::map<std::vector<int>, int> ids;
+    std::vector< std::vector<int> > sets;
+
+    std::vector<int> start(1, 0);
+    closure(start);
+    ids[start] = 0;
+    sets.push_back(start);
+
+    for (size_t d=0; d<sets.size(); d++) {
+        transitions_.resize((d+1) * classesCount_, short(DeadState));
+        int plain = -1, wholeWord = -1;
+        for (size_t i=0; i<sets[d].size(); i++) {
+            const int p = nfa_[sets[d][i]].accept;
+            if (p==-1)
+                continue;
+            int & target = patterns_[p].wholeWord ? wholeWord : plain;
+            if (target==-1 || p<target)
+                target = p;
+        }
+        acceptPlain_.push_back(plain);
+        acceptWholeWord_.push_back(wholeWord);
+
+        for (int cls=SpaceClass; cls<classesCount_; cls++) {
+            std::vector<int> next;
+            for (size_t i=0; i<sets[d].size(); i++) {
+                const std::vector< std::pair<int,int> > & edges = nfa_[sets[d][i]].edges;
+                for (size_t j=0; j<edges.size(); j++) {
+                    const int edgeClass = edges[j].first;
+                    if (edgeClass==cls || (edgeClass==SpaceClass && literalSpaceClasses_[cls]))
+                        next.push_back(edges[j].second);
+                }
+            }
+            if (next.empty())
+                continue;
+            closure(next);
+            next.erase(std::unique(next.begin(), next.end()), next.end());
+            std::map<std::vector<int>, int>::const_iterator it = ids.find(next);
+            int id;
+            if (it==ids.end()) {
+                id = int(sets.size());
+                Q_ASSERT(id < 0x7FFF);
+                ids[next] = id;
+                sets.push_back(next);
+            }
+            else {
+                id = it->second;
+            }
+            transitions_[d*classesCount_ + cls] = short(id);
+        }
+    }
+}
+
+bool LexemScanner::isWordBoundary(const QString &text, int pos) const
+{
+    const bool before = pos>0 && isWordChar(text[pos-1]);
+    const bool after = pos<text.length() && isWordChar(text[pos]);
+    return before != after;
+}
+
+int LexemScanner::matchAt(const QString &text, int pos, LexemType &type) const
+{
+    int best = 0;
+    int bestPattern = -1;
+    int startBoundary = -1; // not computed yet
+    int state = 0;
+    const int length = text.length();
+    const QChar * data = text.constData();
+    for (int i=pos; i<length; i++) {
+        state = transitions_[state*classesCount_ + charClass(data[i])];
+        if (state==DeadState)
+            break;
+        int p = acceptPlain_[state];
+        const int w = acceptWholeWord_[state];
+        if (w!=-1 && (p==-1 || w<p)) {
+            if (startBoundary==-1)
+                startBoundary = isWordBoundary(text, pos) ? 1 : 0;
+            if (startBoundary && isWordBoundary(text, i+1))
+                p = w;
+        }
+        if (p!=-1) {
+            best = i+1-pos;
+            bestPattern = p;
+        }
+    }
+    if (bestPattern!=-1)
+        type = patterns_[bestPattern].type;
+    return best;
+}
+
+bool LexemScanner::findNext(const QString &text, int from, Match &match) const
+{
+    Q_ASSERT(isBuilt());
+    const int length = text.length();
+    const QChar * data = text.constData();
+    bool prevIsWord = from>0 && from<=length && isWordChar(data[from-1]);
+    for (int pos=qMax(0, from); pos<length; pos++) {
+        const QChar ch = data[pos];
+        const bool isWord = isWordChar(ch);
+        // Cheap rejections: no pattern starts with this character,
+        // or this is a middle of word and all words must be whole ones
+        const bool skip =
+                transitions_[charClass(ch)]==DeadState ||
+                (isWord && prevIsWord && !wordStartWithoutBoundary_);
+        prevIsWord = isWord;
+        if (skip)
+            continue;
+        LexemType type = LxTypeEmpty;
+        const int matched = matchAt(text, pos, type);
+        if (matched>0) {
+            match.pos = pos;
+            match.length = matched;
+            match.type = type;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
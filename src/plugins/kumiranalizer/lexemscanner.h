@@ -0,0 +1,80 @@
+#ifndef LEXEMSCANNER_H
+#define LEXEMSCANNER_H
+
+#include <kumir2/lexemtype.h>
+
+#include <QtCore>
+
+#include <vector>
+#include <utility>
+
+namespace KumirAnalizer {
+
+/* Deterministic scanner for keywords and operators of the language.
+
+   Patterns use the same syntax as .keywords files: plain characters,
+   escaped characters ("\\*") and whitespace classes "\\s", "\\s*", "\\s+".
+   All the patterns are compiled into one DFA over character classes,
+   so finding next keyword is a single pass with no string allocations.
+   Matching semantics are the same as of the former compound QRegExp:
+   leftmost match, longest of alternatives at that position, whole word
+   patterns are surrounded by implicit "\\b" */
+class LexemScanner
+{
+public:
+    struct Match {
+        int pos;
+        int length;
+        Shared::LexemType type;
+    };
+
+    LexemScanner();
+
+    void clear();
+    void addPattern(const QString & pattern, Shared::LexemType type, bool wholeWord);
+    void build();
+
+    inline bool isBuilt() const { return !transitions_.empty(); }
+
+    bool findNext(const QString & text, int from, Match & match) const;
+
+    static bool isWordChar(const QChar & ch);
+
+private:
+    enum { DeadState = -1, OtherClass = 0, SpaceClass = 1 };
+
+    struct NfaState {
+        std::vector< std::pair<int,int> > edges; // (class, target)
+        std::vector<int> epsilons;
+        int accept; // pattern index or -1
+    };
+
+    struct Pattern {
+        Shared::LexemType type;
+        bool wholeWord;
+    };
+
+    int charClass(const QChar & ch) const;
+    int classOfLiteral(ushort code);
+    int addNfaState();
+    void closure(std::vector<int> & states) const;
+    int matchAt(const QString & text, int pos, Shared::LexemType & type) const;
+    bool isWordBoundary(const QString & text, int pos) const;
+
+    std::vector<NfaState> nfa_;
+    std::vector<Pattern> patterns_;
+    int classesCount_;
+    std::vector<unsigned char> lowClasses_;
+    std::vector< std::pair<ushort,unsigned char> > highClasses_;
+    std::vector<bool> literalSpaceClasses_; // by class
+
+    // DFA: transitions_[state*classesCount_+class] is next state or DeadState
+    std::vector<short> transitions_;
+    std::vector<int> acceptPlain_;
+    std::vector<int> acceptWholeWord_;
+    bool wordStartWithoutBoundary_;
+};
+
+}
+
+#endif // LEXEMSCANNER_H
@@ -458,14 +458,28 @@ void Lexer::InitNormalizator(const QString &fileName)
     _Compounds += _TypeNames;
     _Compounds += _ConstNames;
 
-//    keyWords << tr("value");
-    for (int i=0; i<_Compounds.size(); i++) {
-        _Compounds[i] = "\\b("+_Compounds[i]+")\\b";
+    // Operators and compound keywords are matched by one scanner,
+    // the scanner returns lexem type, so no map lookup is required
+    _CompoundScanner.clear();
+    foreach (const QString & op, _Operators) {
+        const QString symb = QString(op).remove('\\');
+        LexemType type = _KwdMap.value(symb, LxTypeEmpty);
+        if (symb=="|")
+            type = LxTypeComment;
+        else if (symb=="#")
+            type = LxTypeDoc;
+        else if (symb=="\"" || symb=="'")
+            type = LxConstLiteral;
+        _CompoundScanner.addPattern(op, type, false);
+    }
+    foreach (const QString & compound, _Compounds) {
+        const QStringList variants = compound.split("|");
+        foreach (const QString & variant, variants) {
+            const QString key = allVariants(variant).first();
+            _CompoundScanner.addPattern(variant, _KwdMap.value(key, LxTypeEmpty), true);
+        }
     }
-
-//    QString operatorsPattern = operators.join("|");
-
-    QString compoundsPattern = _Compounds.join("|");
+    _CompoundScanner.build();
 
     QString keywordsPattern = "\\b"+_KeyWords.join("|")+"\\b";
     keywordsPattern.replace("|","\\b|\\b");
@@ -476,14 +490,11 @@ void Lexer::InitNormalizator(const QString &fileName)
     QString constsPattern = "\\b"+_ConstNames.join("|")+"\\b";
     constsPattern.replace("|","\\b|\\b");
 
-    _RxCompound = QRegExp(_Operators.join("|")+ "|"+
-                             compoundsPattern);
     _RxTypes =  QRegExp(typesPattern);
     _RxConst = QRegExp(constsPattern);
     _RxKeyWords = QRegExp(keywordsPattern);
 
     _RxKeyWords.setMinimal(false);
-    _RxCompound.setMinimal(false);
 }
 
 bool isDecimalIntegerConstant(const QString &s) {
@@ -672,134 +683,105 @@ void searchUserTypeNames(QList<LexemPtr> & lexems, const QStringList & names) {
     }
 }
 
+static bool isBlankLine(const QString &text)
+{
+    for (int i=0; i<text.length(); i++) {
+        if (!text[i].isSpace())
+            return false;
+    }
+    return true;
+}
+
+static bool needsSimplification(const QString &s)
+{
+    for (int i=0; i<s.length(); i++) {
+        const QChar ch = s[i];
+        if (ch.isSpace() &&
+                (ch!=' ' || i==0 || i==s.length()-1 || s[i+1].isSpace()))
+            return true;
+    }
+    return false;
+}
+
+static LexemPtr newLexem(const QString &text, int from, int to, LexemType type)
+{
+    LexemPtr lx = LexemPtr(new Lexem);
+    lx->type = type;
+    lx->linePos = from;
+    lx->length = to - from;
+    lx->data = text.mid(from, to - from);
+    return lx;
+}
+
 void Lexer::splitLineIntoLexems(const QString &text
                                        , QList<LexemPtr> &lexems
                                        , const QStringList & extraTypeNames
                                        ) const
 {
     lexems.clear();
-    Q_ASSERT(_RxCompound.isValid());
-    bool inLit = false;
-    QChar litSimb;
-    int cur = 0;
-    int prev = -1;
-    if (text.trimmed().isEmpty()) {
+    Q_ASSERT(_CompoundScanner.isBuilt());
+    if (isBlankLine(text)) {
         return;
     }
-    forever {
-        cur = _RxCompound.indexIn(text, qMax(0,prev));
-        if (cur!=-1) {
-            if ( (cur-prev>1&&prev==-1) || (cur-prev>0&&prev>=0) ) {
-                if (inLit) {
-                    const QString app = text.mid(prev, cur-prev);
-                    lexems.last()->data += app;
-                }
-                else {
-                    LexemPtr lx = LexemPtr(new Lexem);
-                    lx->linePos = qMax(prev, 0);
-                    lx->type = LxTypeName;
-                    lx->data = text.mid(qMax(prev,0), prev>=0? cur-prev : cur-prev-1);
-                    lexems << lx;
-                }
-            }
-            QString symb = _RxCompound.cap(0);
-            if (inLit) {
-                if ( (symb=="\"" || symb=="'") && symb[0]==litSimb) {
-                    inLit = false;
-                }
-                else {
-                    lexems.last()->data += symb;
-                }
-
-            }
-            else {
-                if (symb=="|") {
-                    LexemPtr lx = LexemPtr(new Lexem);
-                    lx->type = LxTypeComment;
-                    lx->data = text.mid(cur);
-                    lx->linePos = cur;
-                    lexems << lx;
-                    break;
-                }
-                else if (symb=="#") {
-                    LexemPtr lx = LexemPtr(new Lexem);
-                    lx->type = LxTypeDoc;
-                    lx->data = text.mid(cur);
-                    lx->linePos = cur;
-                    lexems << lx;
-                    break;
-                }
-                else if (symb=="\"" || symb=="'") {
-                    litSimb = symb[0];
-                    LexemPtr lx = LexemPtr(new Lexem);
-                    lx->type = LxConstLiteral;
-                    lx->linePos = cur;
-                    inLit = true;
-                    lexems << lx;
-                }
-                else {
-                    QString simplifiedSymb = symb;
-                    simplifiedSymb.remove(' ');
-                    simplifiedSymb.remove('_');
-                    LexemPtr lx = LexemPtr(new Lexem);
-                    lx->type = _KwdMap[simplifiedSymb];
-                    lx->data = symb;
-                    lx->linePos = cur;
-                    lexems << lx;
-                }
+    // Lexems are found as offsets in line, the only strings created
+    // are data of resulting lexems
+    LexemScanner::Match match;
+    int pos = 0;
+    while (pos<text.length()) {
+        const bool found = _CompoundScanner.findNext(text, pos, match);
+        int nameStart = pos;
+        int nameEnd = found ? match.pos : text.length();
+        while (nameStart<nameEnd && text[nameStart]==' ')
+            nameStart ++;
+        while (nameEnd>nameStart && text[nameEnd-1]==' ')
+            nameEnd --;
+        if (nameStart<nameEnd) {
+            lexems << newLexem(text, nameStart, nameEnd, LxTypeName);
+        }
+        if (!found) {
+            break;
+        }
+        if (match.type==LxTypeComment || match.type==LxTypeDoc) {
+            lexems << newLexem(text, match.pos, text.length(), match.type);
+            break;
+        }
+        else if (match.type==LxConstLiteral) {
+            const int close = text.indexOf(text[match.pos], match.pos+1);
+            const int end = close==-1 ? text.length() : close+1;
+            // Lexem covers quotes, but data is text between them
+            LexemPtr lx = LexemPtr(new Lexem);
+            lx->type = LxConstLiteral;
+            lx->linePos = match.pos;
+            lx->length = end - match.pos;
+            lx->data = text.mid(match.pos+1, (close==-1 ? end : close)-match.pos-1);
+            if (close==-1) {
+                lx->error = _("Unpaired quote");
+                lx->errorStage = AST::Lexem::Lexer;
             }
-            prev = cur + _RxCompound.matchedLength();
-        } // end if cur!=-1
+            lexems << lx;
+            pos = end;
+        }
         else {
-            if (inLit) {
-                lexems.last()->data += text.mid(prev+1);
-                lexems.last()->error = _("Unpaired quote");
-                lexems.last()->errorStage = AST::Lexem::Lexer;
-
-            }
-            else {
-                if (!lexems.isEmpty()) {
-                    LexemPtr lx = lexems.last();
-                    if (lx->type==LxTypeComment || lx->type==LxTypeDoc)
-                        lexems.last()->data += text.mid(prev+1);
-                    else {
-                        if (prev<text.length()) {
-                            LexemPtr llx = LexemPtr(new Lexem);
-                            llx->type = LxTypeName;
-                            llx->linePos = qMax(prev, 0);
-                            llx->data = text.mid(prev);
-                            lexems << llx;
-                        }
-                    }
-                }
-                else {
-                    LexemPtr lx = LexemPtr(new Lexem);
-                    lx->type = LxTypeName;
-                    lx->linePos = 0;
-                    lx->data = text;
-                    lexems << lx;
-                }
-            }
-            break;
+            lexems << newLexem(text, match.pos, match.pos+match.length, match.type);
+            pos = match.pos + match.length;
         }
     }
     searchUserTypeNames(lexems, extraTypeNames);
     for (int i=0; i<lexems.size(); i++) {
-        lexems[i]->length = lexems[i]->data.size();
         if (lexems[i]->type!=LxConstLiteral) {
-            while (lexems[i]->data.startsWith(' ')) {
-                lexems[i]->data = lexems[i]->data.mid(1);
-                lexems[i]->length--;
-                lexems[i]->linePos++;
+            const QString & data = lexems[i]->data;
+            int leading = 0, trailing = 0;
+            while (leading<data.length() && data[leading]==' ')
+                leading ++;
+            while (trailing<data.length()-leading && data[data.length()-1-trailing]==' ')
+                trailing ++;
+            if (leading || trailing) {
+                lexems[i]->data = data.mid(leading, data.length()-leading-trailing);
+                lexems[i]->length -= leading + trailing;
+                lexems[i]->linePos += leading;
             }
-            while (lexems[i]->data.endsWith(' ')) {
-                lexems[i]->data = lexems[i]->data.mid(0, lexems[i]->data.length()-1);
-                lexems[i]->length--;
-            }
-            lexems[i]->data = lexems[i]->data.simplified();
-        }
-        else {
-            lexems[i]->length += 2;
+            if (needsSimplification(lexems[i]->data))
+                lexems[i]->data = lexems[i]->data.simplified();
         }
     }
     QList<LexemPtr>::iterator it = lexems.begin();
@@ -888,8 +870,7 @@ QList<TextStatementPtr> Lexer::preprocessOneIncludeStatement(const TextStatement
                                                                  , const QStringList & extraTypeNames) const
 {
     QList<TextStatementPtr> newStatements;
-    const QString fileName = include->data.at(1)->data;
-    const QString absoluteFileName = QDir(_sourceDirName).absoluteFilePath(fileName);
+    const QString absoluteFileName = includeFilePath(include->data.at(1)->data);
     QFile includeFile(absoluteFileName);
     if (!includeFile.open(QIODevice::ReadOnly|QIODevice::Text)) {
         include->setError(_("Include file not found"), Lexem::Lexer, Lexem::AsIs);
@@ -1392,7 +1373,7 @@ QStringList Lexer::_TypeNames = QStringList();
 QStringList Lexer::_ConstNames = QStringList();
 QStringList Lexer::_Compounds = QStringList();
 QHash<QString,LexemType> Lexer::_KwdMap = QHash<QString, LexemType>();
-QRegExp Lexer::_RxCompound = QRegExp();
+LexemScanner Lexer::_CompoundScanner;
 QRegExp Lexer::_RxKeyWords = QRegExp();
 QRegExp Lexer::_RxConst = QRegExp();
 QRegExp Lexer::_RxTypes = QRegExp();
@@ -1542,6 +1523,11 @@ void Lexer::setSourceDirName(const QString &dir)
     _sourceDirName = dir;
 }
 
+QString Lexer::includeFilePath(const QString &fileName) const
+{
+    return QDir(_sourceDirName).absoluteFilePath(fileName);
+}
+
 bool Lexer::isLanguageReservedName(const QString &lexem) const
 {
     if (_RxKeyWords.exactMatch(lexem) || _KeyWords.contains(lexem))
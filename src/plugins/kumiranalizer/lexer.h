@@ -4,6 +4,7 @@
 #include <kumir2-libs/dataformats/lexem.h>
 #include <kumir2/lexemtype.h>
 #include "statement.h"
+#include "lexemscanner.h"
 #include <kumir2-libs/dataformats/ast_variabletype.h>
 
 #include <QtCore>
@@ -28,6 +29,7 @@ public:
     inline QString inputLexemName() const { return QString::fromUtf8("ввод"); }
     inline QString outputLexemName() const{ return QString::fromUtf8("вывод"); }
     void setSourceDirName(const QString &dir);
+    QString includeFilePath(const QString & fileName) const;
 
     bool isLanguageReservedName(const QString &lexem) const;
 
@@ -69,7 +71,7 @@ private /*fields*/:
     static QHash<QString,bool> _BoolConstantValues;
     static QSet<QString> _ArrayTypes;
     static QString _RetvalKeyword;
-    static QRegExp _RxCompound;
+    static LexemScanner _CompoundScanner;
     static QRegExp _RxKeyWords;
     static QRegExp _RxConst;
     static QRegExp _RxTypes;
@@ -465,12 +465,15 @@ class Files
 
     inline TypeList typeList() const {
         TypeList result;
-        Field fileKey(QByteArray("key"), Int);
+        // Same fields in the same order as file records made by VM
+        // (KumirVM::toRecordValue) and by LLVM runtime
+        Field fileName(QByteArray("name"), String);
         Field openMode(QByteArray("mode"), Int);
         Field specialType(QByteArray("type"), Int);
-        Field fileName(QByteArray("name"), String);
+        Field fileValid(QByteArray("valid"), Bool);
+        Field fileKey(QByteArray("key"), Int);
         Record fileRecord;
-        fileRecord << fileKey << openMode << specialType << fileName;
+        fileRecord << fileName << openMode << specialType << fileValid << fileKey;
         RecordSpecification fileType;
         fileType.asciiName = "file";
         fileType.localizedNames[QLocale::Russian] = QString::fromUtf8("файл");
@@ -0,0 +1,127 @@
+#include "symboltables.h"
+
+#include <kumir2/actorinterface.h>
+
+namespace KumirAnalizer {
+
+QString SymbolTables::algorithmName(const AST::ModulePtr &module,
+                                    const AST::AlgorithmPtr &algorithm,
+                                    QVariantList *templateParameters)
+{
+    const QString & name = algorithm->header.name;
+    if (!module->impl.actor || !name.contains("%"))
+        return name;
+    const QVariantList actorTemplateParameters =
+            module->impl.actor->templateParameters();
+    QString pattern = name;
+    for (int t=0; t<actorTemplateParameters.size(); ++t) {
+        const QString placeholder = "%" + QString::number(t+1);
+        if (-1 != pattern.indexOf(placeholder)) {
+            pattern.replace(placeholder, actorTemplateParameters[t].toString());
+            if (templateParameters)
+                templateParameters->push_back(actorTemplateParameters[t]);
+        }
+    }
+    return pattern.simplified();
+}
+
+bool SymbolTables::isExternal(const AST::ModulePtr &module)
+{
+    return module->header.type==AST::ModTypeExternal ||
+            module->header.type==AST::ModTypeCached;
+}
+
+void SymbolTables::updateModules(const QList<AST::ModulePtr> &modules)
+{
+    QHash<const AST::Module*, ModuleTables> tables;
+    externalModulesByName_.clear();
+    userModules_.clear();
+    for (int i=0; i<modules.size(); i++) {
+        const AST::ModulePtr & module = modules.at(i);
+        if (!isExternal(module)) {
+            userModules_.push_back(i);
+            continue;
+        }
+        // Tables of modules loaded before are reused
+        ModuleTables & t = tables[module.data()];
+        t = externalTables_.value(module.data());
+        t.module = module;
+        const AlgorithmNameOf nameOf(module);
+        t.publicAlgorithms.update(module->header.algorhitms, nameOf);
+        t.privateAlgorithms.update(module->impl.algorhitms, nameOf);
+        const QHash<QString,int> * lists[2] = {
+            &t.publicAlgorithms.positions(), &t.privateAlgorithms.positions()
+        };
+        for (int l=0; l<2; l++) {
+            QHash<QString,int>::const_iterator it;
+            for (it=lists[l]->constBegin(); it!=lists[l]->constEnd(); ++it) {
+                QVector<int> & positions = externalModulesByName_[it.key()];
+                if (positions.isEmpty() || positions.last()!=i)
+                    positions.push_back(i);
+            }
+        }
+    }
+    externalTables_ = tables;
+    indexedModulesCount_ = modules.size();
+    firstIndexedModule_ = modules.isEmpty() ? AST::ModulePtr() : modules.first();
+    lastIndexedModule_ = modules.isEmpty() ? AST::ModulePtr() : modules.last();
+}
+
+QVector<int> SymbolTables::modulesByAlgorithmName(const QList<AST::ModulePtr> &modules,
+                                                  const QString &name)
+{
+    const bool changed = modules.size()!=indexedModulesCount_ ||
+            (!modules.isEmpty() &&
+             (modules.first()!=firstIndexedModule_ || modules.last()!=lastIndexedModule_));
+    if (changed)
+        updateModules(modules);
+    const QHash<QString, QVector<int> >::const_iterator it =
+            externalModulesByName_.constFind(name);
+    if (it==externalModulesByName_.constEnd())
+        return userModules_;
+
+    // Merge keeping order of modules in AST
+    const QVector<int> & external = it.value();
+    QVector<int> result;
+    result.reserve(external.size() + userModules_.size());
+    int e = 0, u = 0;
+    while (e<external.size() || u<userModules_.size()) {
+        if (u==userModules_.size() || (e<external.size() && external[e]<userModules_[u]))
+            result.push_back(external[e++]);
+        else
+            result.push_back(userModules_[u++]);
+    }
+    return result;
+}
+
+SymbolTables::ModuleTables & SymbolTables::moduleTables(const AST::ModulePtr &module)
+{
+    QHash<const AST::Module*, ModuleTables> & tables =
+            isExternal(module) ? externalTables_ : userTables_;
+    ModuleTables & t = tables[module.data()];
+    if (!t.module)
+        t.module = module;
+    return t;
+}
+
+int SymbolTables::algorithmIndex(const AST::ModulePtr &module, bool allowPrivate, const QString &name)
+{
+    ModuleTables & t = moduleTables(module);
+    const AlgorithmNameOf nameOf(module);
+    return allowPrivate
+            ? t.privateAlgorithms.indexOf(module->impl.algorhitms, name, nameOf)
+            : t.publicAlgorithms.indexOf(module->header.algorhitms, name, nameOf);
+}
+
+int SymbolTables::variableIndex(const QList<AST::VariablePtr> &variables, const QString &name)
+{
+    return variableTables_[&variables].indexOf(variables, name, VariableNameOf());
+}
+
+void SymbolTables::clearUserTables()
+{
+    userTables_.clear();
+    variableTables_.clear();
+}
+
+}
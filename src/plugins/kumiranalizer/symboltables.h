@@ -0,0 +1,177 @@
+#ifndef SYMBOLTABLES_H
+#define SYMBOLTABLES_H
+
+#include <kumir2-libs/dataformats/ast.h>
+#include <kumir2-libs/dataformats/ast_module.h>
+#include <kumir2-libs/dataformats/ast_algorhitm.h>
+#include <kumir2-libs/dataformats/ast_variable.h>
+
+#include <QtCore>
+
+namespace KumirAnalizer {
+
+/* Hash index of named items of a list owned by AST.
+
+   Analizer modifies AST lists directly in many places, so index is
+   checked against its list on every lookup: appended items are indexed
+   incrementally, any other change causes complete rebuild. Items are
+   often appended before they got a name, such items are indexed later,
+   when the name is assigned. Like a linear search, index gives the
+   first item with a given name */
+template <class T> class NameIndex
+{
+public:
+    inline NameIndex() : indexedCount_(0) {}
+
+    template <class NameOf>
+    inline int indexOf(const QList<T> & list, const QString & name, const NameOf & nameOf)
+    {
+        update(list, nameOf);
+        int index = positions_.value(name, -1);
+        if (index!=-1 && nameOf(list.at(index))!=name) {
+            // Item was replaced in place or renamed
+            rebuild(list, nameOf);
+            index = positions_.value(name, -1);
+        }
+        return index;
+    }
+
+    template <class NameOf>
+    inline void update(const QList<T> & list, const NameOf & nameOf)
+    {
+        const int size = list.size();
+        const bool changed = size<indexedCount_ ||
+                (indexedCount_>0 && (list.first()!=first_ || list.at(indexedCount_-1)!=last_));
+        if (changed) {
+            rebuild(list, nameOf);
+            return;
+        }
+        if (!unnamed_.isEmpty())
+            indexUnnamed(list, nameOf);
+        for (int i=indexedCount_; i<size; i++)
+            indexItem(list, i, nameOf);
+        indexedCount_ = size;
+        if (size>0) {
+            first_ = list.first();
+            last_ = list.last();
+        }
+    }
+
+    inline const QHash<QString,int> & positions() const { return positions_; }
+
+private:
+    template <class NameOf>
+    inline void rebuild(const QList<T> & list, const NameOf & nameOf)
+    {
+        positions_.clear();
+        unnamed_.clear();
+        indexedCount_ = 0;
+        first_ = last_ = T();
+        update(list, nameOf);
+    }
+
+    template <class NameOf>
+    inline void indexItem(const QList<T> & list, int index, const NameOf & nameOf)
+    {
+        const QString name = nameOf(list.at(index));
+        if (name.isEmpty()) {
+            unnamed_.push_back(index);
+        }
+        else {
+            QHash<QString,int>::iterator it = positions_.find(name);
+            if (it==positions_.end())
+                positions_.insert(name, index);
+            else if (index < it.value())
+                it.value() = index;
+        }
+    }
+
+    template <class NameOf>
+    inline void indexUnnamed(const QList<T> & list, const NameOf & nameOf)
+    {
+        QVector<int> stillUnnamed;
+        for (int i=0; i<unnamed_.size(); i++) {
+            if (nameOf(list.at(unnamed_[i])).isEmpty())
+                stillUnnamed.push_back(unnamed_[i]);
+            else
+                indexItem(list, unnamed_[i], nameOf);
+        }
+        unnamed_ = stillUnnamed;
+    }
+
+    QHash<QString,int> positions_;
+    QVector<int> unnamed_;
+    int indexedCount_;
+    // Strong references, so addresses of indexed items can not be reused
+    T first_;
+    T last_;
+};
+
+/* Symbol tables used by SyntaxAnalizer for name resolution.
+
+   Algorithms of external modules (actors, standard library and compiled
+   .kod files) are indexed once per module and merged into one table, so
+   looking for an algorithm does not depend on number of loaded modules.
+   Tables of user modules, algorithms and variables are refilled while
+   analysis adds declarations and dropped at start of the next analysis */
+class SymbolTables
+{
+public:
+    inline SymbolTables() : indexedModulesCount_(-1) {}
+
+    /** Name of algorithm as it is written in program, i.e. with
+      * actor template parameters substituted */
+    static QString algorithmName(const AST::ModulePtr & module,
+                                 const AST::AlgorithmPtr & algorithm,
+                                 QVariantList * templateParameters = 0);
+
+    /** Positions in modules of those ones which might contain
+      * an algorithm with given name, in ascending order */
+    QVector<int> modulesByAlgorithmName(const QList<AST::ModulePtr> & modules,
+                                        const QString & name);
+
+    /** Position of algorithm in public or private list of module or -1 */
+    int algorithmIndex(const AST::ModulePtr & module, bool allowPrivate, const QString & name);
+
+    /** Position of variable in list of locals or globals or -1 */
+    int variableIndex(const QList<AST::VariablePtr> & variables, const QString & name);
+
+    /** Drops tables of user modules, algorithms and variables */
+    void clearUserTables();
+
+private:
+    struct AlgorithmNameOf {
+        inline explicit AlgorithmNameOf(const AST::ModulePtr & m) : module(m) {}
+        inline QString operator()(const AST::AlgorithmPtr & a) const { return algorithmName(module, a); }
+        AST::ModulePtr module;
+    };
+
+    struct VariableNameOf {
+        inline QString operator()(const AST::VariablePtr & v) const { return v->name; }
+    };
+
+    struct ModuleTables {
+        AST::ModulePtr module;
+        NameIndex<AST::AlgorithmPtr> publicAlgorithms;
+        NameIndex<AST::AlgorithmPtr> privateAlgorithms;
+    };
+
+    static bool isExternal(const AST::ModulePtr & module);
+    void updateModules(const QList<AST::ModulePtr> & modules);
+    ModuleTables & moduleTables(const AST::ModulePtr & module);
+
+    // Analizer only appends modules to AST or erases user modules and
+    // appends new ones, so size and ends of list identify its contents
+    int indexedModulesCount_;
+    AST::ModulePtr firstIndexedModule_;
+    AST::ModulePtr lastIndexedModule_;
+    QHash<QString, QVector<int> > externalModulesByName_;
+    QVector<int> userModules_;
+    QHash<const AST::Module*, ModuleTables> externalTables_;
+    QHash<const AST::Module*, ModuleTables> userTables_;
+    QHash<const void*, NameIndex<AST::VariablePtr> > variableTables_;
+};
+
+}
+
+#endif // SYMBOLTABLES_H
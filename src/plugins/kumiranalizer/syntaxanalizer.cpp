@@ -5,6 +5,7 @@
 #include <stack>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 
 #include <kumir2-libs/dataformats/ast_variable.h>
 #include <kumir2-libs/dataformats/ast_type.h>
@@ -32,6 +33,27 @@ SyntaxAnalizer::SyntaxAnalizer(Lexer * lexer,
 {
 }
 
+SyntaxAnalizer::SyntaxAnalizer(const SyntaxAnalizer *master,
+                               const QVector<int> &statementIndeces)
+    : QObject(0)
+    , lexer_(master->lexer_)
+    , analizer_(master->analizer_)
+    , ast_(new AST::Data)
+    , alwaysEnabledModules_(master->alwaysEnabledModules_)
+    , sourceDirName_(master->sourceDirName_)
+    , currentPosition_(-1)
+    , teacherMode_(master->teacherMode_)
+    , symbols_(master->symbols_)
+    , stringLengthAlgorithm_(master->stringLengthAlgorithm_)
+{
+    // Own list of modules, so worker never detaches list of master
+    ast_->modules = master->ast_->modules;
+    ast_->lastModified = master->ast_->lastModified;
+    for (int i=0; i<statementIndeces.size(); i++) {
+        statements_ << master->statements_.at(statementIndeces[i]);
+    }
+}
+
 
 void SyntaxAnalizer::init(
     QList<TextStatementPtr> &statements,
@@ -60,6 +82,8 @@ void SyntaxAnalizer::init(
     }
 
     unresolvedImports_.clear();
+    symbols_.clearUserTables();
+    stringLengthAlgorithm_.clear();
 }
 
 QString SyntaxAnalizer::suggestFileName() const
@@ -1232,15 +1256,16 @@ void SyntaxAnalizer::buildTables(bool isInternalBuild)
             QString kodFilePath = QDir::toNativeSeparators(kodFile.absoluteFilePath());
             char programName[1024];
             strcpy(programName, kodFilePath.toLocal8Bit().constData());
-            std::ifstream programFile(programName,  std::ios::in|std::ios::binary);
+            // Only headers of algorithms are read, not their instructions
+            const std::shared_ptr<const Bytecode::Image> image =
+                    Bytecode::Image::fromFile(programName);
             Bytecode::Data programData;
-            if (!programFile.is_open()) {
+            if (!image) {
                 error = _("Can't open module file");
             }
-            else {                
-                Bytecode::bytecodeFromDataStream(programFile, programData);
+            else {
+                Bytecode::bytecodeFromImage(image, programData);
             }
-            programFile.close();
             if (error.length()==0) {
                 AST::ModulePtr  module = AST::ModulePtr(new AST::Module);
                 module->header.type = AST::ModTypeCached;
@@ -1390,7 +1415,6 @@ void SyntaxAnalizer::processAnalisys()
         }
     }
     for (int i=0; i<statements_.size(); i++) {
-        currentPosition_ = i;
         TextStatement & st = statements_[i];
         // Fix unmatched modules first
         if (!st.mod) {
@@ -1409,103 +1433,233 @@ void SyntaxAnalizer::processAnalisys()
             ast_->modules.push_back(dummyModule);
             st.mod  = dummyModule;
         }
-        bool wasError = st.hasError();
-        if (st.statement) {
-            statements_[i].statement->expressions.clear();
+    }
+    QVector<int> otherStatements;
+    if (processAlgorithmsInParallel(otherStatements)) {
+        for (int i=0; i<otherStatements.size(); i++) {
+            processStatement(otherStatements[i]);
         }
-        if (st.statement) {
-            if (st.type==LxPriAssign) {
-                parseAssignment(i);
-            }
-            else if (st.type==LxNameClass && st.alg) {
-                parseVarDecl(i);
-            }
-            else if (
-                     st.type==LxPriAssert
-                     || st.type==LxPriPre
-                     || st.type==LxPriPost
-                     )
-            {
-                parseAssertPrePost(i);
-            }
-            else if (st.type==LxPriInput) {
-                parseInput(i);
-            }
-            else if (
-                     st.type==LxPriOutput
-                     )
-            {
-                parseOutput(i);
-            }
-
-            else if (st.type==LxPriEndModule
-                     ||st.type==LxPriAlgBegin
-                     ||st.type==LxPriAlgEnd
-                     ||st.type==LxPriThen
-                     ||st.type==LxPriElse
-                     ||st.type==LxPriFi
-                     ||st.type==LxPriSwitch
-                     ||st.type==LxPriExit
-                     ||st.type==LxPriPause
-                     ||st.type==LxPriHalt
-                     )
-            {
-                parseOneLexemInstruction(i);
-            }
-            else if (st.type==LxPriEndLoop) {
-                parseEndLoop(i);
-            }
-            else if (st.type==LxPriIf||st.type==LxPriCase) {
-                parseIfCase(i);
-            }
-            else if (st.type==LxPriLoop) {
-                parseLoopBegin(i);
-            }
+    }
+    else {
+        processStatements();
+    }
+}
+
+void SyntaxAnalizer::processStatements()
+{
+    for (int i=0; i<statements_.size(); i++) {
+        processStatement(i);
+    }
+}
+
+void SyntaxAnalizer::processStatement(int i)
+{
+    currentPosition_ = i;
+    TextStatement & st = statements_[i];
+    bool wasError = st.hasError();
+    if (st.statement) {
+        statements_[i].statement->expressions.clear();
+    }
+    if (st.statement) {
+        if (st.type==LxPriAssign) {
+            parseAssignment(i);
         }
-        if (st.type==LxPriEndModule || st.type==LxPriAlgEnd) {
-            parseEndNamedBlock(st);
+        else if (st.type==LxNameClass && st.alg) {
+            parseVarDecl(i);
         }
-        if (st.statement && st.statement->expressions.size() > 0) {
-            // Check for wrong "ds" keyword usage
-            bool hasDSError = false;
-            for (int j=0; j<st.statement->expressions.size(); j++) {
-                hasDSError = hasDSError || checkWrongDSUsage(st.statement->expressions.at(j));
-            }
-            if (hasDSError) {
-                st.statement->expressions.clear();
-            }
+        else if (
+                 st.type==LxPriAssert
+                 || st.type==LxPriPre
+                 || st.type==LxPriPost
+                 )
+        {
+            parseAssertPrePost(i);
         }
-        for (int j=0; j<st.data.size(); j++) {
-            if (!st.data[j]->error.isEmpty()) {
-                if (st.statement) {
-                    if (st.type==LxPriLoop || st.type==LxPriSwitch) {
-                        st.statement->beginBlockError = st.data[j]->error;
-                    }
-                    else if (st.type==LxPriEndLoop || st.type==LxPriFi) {
-                        st.statement->endBlockError = st.data[j]->error;
-                    }
-                    else if (st.type==LxPriCase || st.type==LxPriElse) {
-                        if (st.conditionalIndex < st.statement->conditionals.size()) {
-                            st.statement->conditionals[st.conditionalIndex].conditionError = st.data[j]->error;
-                        }
-                    }
-                    else {
-                        st.statement->type = AST::StError;
-                        st.statement->error = st.data[j]->error;
+        else if (st.type==LxPriInput) {
+            parseInput(i);
+        }
+        else if (
+                 st.type==LxPriOutput
+                 )
+        {
+            parseOutput(i);
+        }
+
+        else if (st.type==LxPriEndModule
+                 ||st.type==LxPriAlgBegin
+                 ||st.type==LxPriAlgEnd
+                 ||st.type==LxPriThen
+                 ||st.type==LxPriElse
+                 ||st.type==LxPriFi
+                 ||st.type==LxPriSwitch
+                 ||st.type==LxPriExit
+                 ||st.type==LxPriPause
+                 ||st.type==LxPriHalt
+                 )
+        {
+            parseOneLexemInstruction(i);
+        }
+        else if (st.type==LxPriEndLoop) {
+            parseEndLoop(i);
+        }
+        else if (st.type==LxPriIf||st.type==LxPriCase) {
+            parseIfCase(i);
+        }
+        else if (st.type==LxPriLoop) {
+            parseLoopBegin(i);
+        }
+    }
+    if (st.type==LxPriEndModule || st.type==LxPriAlgEnd) {
+        parseEndNamedBlock(st);
+    }
+    if (st.statement && st.statement->expressions.size() > 0) {
+        // Check for wrong "ds" keyword usage
+        bool hasDSError = false;
+        for (int j=0; j<st.statement->expressions.size(); j++) {
+            hasDSError = hasDSError || checkWrongDSUsage(st.statement->expressions.at(j));
+        }
+        if (hasDSError) {
+            st.statement->expressions.clear();
+        }
+    }
+    for (int j=0; j<st.data.size(); j++) {
+        if (!st.data[j]->error.isEmpty()) {
+            if (st.statement) {
+                if (st.type==LxPriLoop || st.type==LxPriSwitch) {
+                    st.statement->beginBlockError = st.data[j]->error;
+                }
+                else if (st.type==LxPriEndLoop || st.type==LxPriFi) {
+                    st.statement->endBlockError = st.data[j]->error;
+                }
+                else if (st.type==LxPriCase || st.type==LxPriElse) {
+                    if (st.conditionalIndex < st.statement->conditionals.size()) {
+                        st.statement->conditionals[st.conditionalIndex].conditionError = st.data[j]->error;
                     }
-                    break;
                 }
-            }
-        }        
-        if (!wasError && statements_[i].hasError()) {
-            foreach (LexemPtr lx, statements_[i].data) {
-                if (lx->errorStage==AST::Lexem::NoError && !lx->error.isEmpty())  {
-                    lx->errorStage = AST::Lexem::Semantics;
+                else {
+                    st.statement->type = AST::StError;
+                    st.statement->error = st.data[j]->error;
                 }
-
+                break;
+            }
+        }
+    }        
+    if (!wasError && statements_[i].hasError()) {
+        foreach (LexemPtr lx, statements_[i].data) {
+            if (lx->errorStage==AST::Lexem::NoError && !lx->error.isEmpty())  {
+                lx->errorStage = AST::Lexem::Semantics;
             }
+
+        }
+    }
+}
+
+namespace {
+
+class AlgorithmAnalisysTask
+        : public QRunnable
+{
+public:
+    inline explicit AlgorithmAnalisysTask(SyntaxAnalizer * worker, QSemaphore * done)
+        : worker_(worker), done_(done) {}
+    inline void run() {
+        worker_->processStatements();
+        done_->release();
+    }
+private:
+    SyntaxAnalizer * worker_;
+    QSemaphore * done_;
+};
+
+inline bool hasMoreStatements(const QVector<int> & a, const QVector<int> & b)
+{
+    return a.size() > b.size();
+}
+
+// Small programs are analyzed faster than thread pool starts tasks
+const int MinStatementsForParallelAnalisys = 200;
+
+}
+
+void SyntaxAnalizer::prepareForParallelAnalisys()
+{
+    // Workers access lists of shared modules and algorithms by non-const
+    // operators, that is safe only while these lists are not implicitly
+    // shared with other ones
+    for (int i=0; i<ast_->modules.size(); i++) {
+        const AST::ModulePtr module = ast_->modules[i];
+        module->header.algorhitms.detach();
+        module->header.operators.detach();
+        module->header.types.detach();
+        module->impl.algorhitms.detach();
+        module->impl.globals.detach();
+        const QList<AST::AlgorithmPtr> * lists[3] = {
+            &module->header.algorhitms, &module->header.operators, &module->impl.algorhitms
+        };
+        for (int l=0; l<3; l++) {
+            for (int j=0; j<lists[l]->size(); j++) {
+                const AST::AlgorithmPtr & alg = lists[l]->at(j);
+                alg->header.arguments.detach();
+                alg->impl.locals.detach();
+            }
+        }
+    }
+    // Resolved once for all the workers
+    stringLengthAlgorithm();
+}
+
+bool SyntaxAnalizer::processAlgorithmsInParallel(QVector<int> & otherStatements)
+{
+    if (statements_.size() < MinStatementsForParallelAnalisys
+            || QThread::idealThreadCount() < 2)
+        return false;
+
+    // Statements of one algorithm are processed by the same worker
+    // in source order, statements outside algorithms by this object
+    QHash<const AST::Algorithm*, int> groupOfAlgorithm;
+    QVector< QVector<int> > groups;
+    for (int i=0; i<statements_.size(); i++) {
+        const AST::AlgorithmPtr & alg = statements_.at(i).alg;
+        if (!alg) {
+            otherStatements.push_back(i);
+            continue;
+        }
+        QHash<const AST::Algorithm*, int>::iterator it = groupOfAlgorithm.find(alg.data());
+        if (it == groupOfAlgorithm.end()) {
+            it = groupOfAlgorithm.insert(alg.data(), groups.size());
+            groups.push_back(QVector<int>());
         }
+        groups[it.value()].push_back(i);
     }
+    if (groups.size() < 2) {
+        otherStatements.clear();
+        return false;
+    }
+
+    // The largest algorithms are started first, so total time is close
+    // to time of analysis of the largest one
+    std::stable_sort(groups.begin(), groups.end(), hasMoreStatements);
+
+    prepareForParallelAnalisys();
+    QList<SyntaxAnalizer*> workers;
+    QSemaphore done;
+    for (int g=0; g<groups.size(); g++) {
+        SyntaxAnalizer * worker = new SyntaxAnalizer(this, groups[g]);
+        workers << worker;
+        QThreadPool::globalInstance()->start(new AlgorithmAnalisysTask(worker, &done));
+    }
+    done.acquire(groups.size());
+
+    // Each statement is taken from its worker, so result does not depend
+    // on order of tasks completion
+    for (int g=0; g<groups.size(); g++) {
+        const QVector<int> & indeces = groups[g];
+        for (int j=0; j<indeces.size(); j++) {
+            statements_[indeces[j]] = workers[g]->statements_.at(j);
+        }
+    }
+    qDeleteAll(workers);
+    return true;
 }
 
 
@@ -1853,15 +2007,16 @@ AST::ModulePtr SyntaxAnalizer::loadKodFile(const QString &name, QString &error)
     QString kodFilePath = QDir::toNativeSeparators(kodFile.absoluteFilePath());
     char programName[1024];
     strcpy(programName, kodFilePath.toLocal8Bit().constData());
-    std::ifstream programFile(programName,  std::ios::in|std::ios::binary);
+    // Only headers of algorithms are read, not their instructions
+    const std::shared_ptr<const Bytecode::Image> image =
+            Bytecode::Image::fromFile(programName);
     Bytecode::Data programData;
-    if (!programFile.is_open()) {
+    if (!image) {
         error = _("Can't open module file");
     }
-    else {        
-        Bytecode::bytecodeFromDataStream(programFile, programData);
+    else {
+        Bytecode::bytecodeFromImage(image, programData);
     }
-    programFile.close();
     AST::ModulePtr result;
     if (error.length()==0) {
         AST::Module * module = new AST::Module;
@@ -4418,8 +4573,10 @@ bool SyntaxAnalizer::findAlgorithm(
 {
     algorithm.clear();
     module.clear();
-    for (int i=0; i<ast_->modules.size(); i++) {
-        module = ast_->modules[i];
+    // Only modules having algorithm with such name are checked
+    const QVector<int> candidates = symbols_.modulesByAlgorithmName(ast_->modules, name);
+    for (int i=0; i<candidates.size(); i++) {
+        module = ast_->modules[candidates[i]];
         bool moduleAvailable =
                 module->builtInID == 0xF0 ||
                 module->isEnabledFor(currentModule) ||
@@ -4467,52 +4624,21 @@ bool SyntaxAnalizer::findAlgorithmInModule(const QString &name,
     algorithm = AlgorithmPtr();
     templateParameters = QVariantList();
     const QList<AlgorithmPtr> & algList = allowPrivate
-            ? module->impl.algorhitms : module->header.algorhitms;    
-    Q_FOREACH(AlgorithmPtr a, algList) {
+            ? module->impl.algorhitms : module->header.algorhitms;
+    const int index = symbols_.algorithmIndex(module, allowPrivate, name);
+    if (index==-1)
+        return false;
+    for (int i=index; i<algList.size(); i++) {
+        // Broken algorithm might hide the valid one having the same name,
+        // in this rare case continue with linear search
+        const AlgorithmPtr & a = algList.at(i);
         bool skip = !allowBroken && a->header.broken;
         if (skip) continue;
-        if (module->impl.actor && a->header.name.contains("%")) {
-            const QVariantList actorTemplateParameters =
-                    module->impl.actor->templateParameters();
-            QVariantList usedTemplateParameters;
-            QString pattern = a->header.name;
-            for (int t=0; t<actorTemplateParameters.size(); ++t) {
-                if (-1 != pattern.indexOf("%" + QString::number(t+1))) {
-                    pattern.replace("%" + QString::number(t+1),
-                                    actorTemplateParameters[t].toString());
-                    usedTemplateParameters.push_back(actorTemplateParameters[t]);
-                }
-            }
-            pattern = pattern.simplified();
-            if (name == pattern) {
-                templateParameters = usedTemplateParameters;
-                algorithm = a;
-                return true;
-            }
-        }
-//        if (module->header.nameTemplate.length() > 0) {
-//            // construct fully-qualified name and search by regexp
-//            QString pattern = a->header.name;
-//            QVariantList params;
-//            for (int t=0; t<module->header.templateParameters.size(); t++) {
-//                if (-1 != pattern.indexOf("%" + QString::number(t+1))) {
-//                    pattern.replace("%" + QString::number(t+1), module->header.templateParameters[t].toString());
-//                    params.append(module->header.templateParameters[t]);
-//                }
-//            }
-//            pattern = pattern.simplified();
-//            if (name == pattern) {
-//                templateParameters = params;
-//                algorithm = a;
-//                return true;
-//            }
-//        }
-        else {
-            // check plaint name match
-            if (name == a->header.name) {
-                algorithm = a;
-                return true;
-            }
+        QVariantList usedTemplateParameters;
+        if (name == SymbolTables::algorithmName(module, a, &usedTemplateParameters)) {
+            templateParameters = usedTemplateParameters;
+            algorithm = a;
+            return true;
         }
     }
     return false;
@@ -4766,13 +4892,9 @@ AST::ExpressionPtr  SyntaxAnalizer::makeCustomBinaryOperation(const QString & op
 bool SyntaxAnalizer::findGlobalVariable(const QString &name, const AST::ModulePtr module, AST::VariablePtr &var) const
 {
     var.clear();
-    for (int i=0; i<module->impl.globals.size(); i++) {
-        AST::VariablePtr  v = module->impl.globals[i];
-        if (v->name==name) {
-            var = v;
-            break;
-        }
-    }
+    const int index = symbols_.variableIndex(module->impl.globals, name);
+    if (index!=-1)
+        var = module->impl.globals.at(index);
     if (!var && (module->header.type==AST::ModTypeTeacher || module->header.type==AST::ModTypeTeacherMain)) {
         AST::ModulePtr userMainModule;
         for (int i=0; i<ast_->modules.size(); i++) {
@@ -4783,13 +4905,9 @@ bool SyntaxAnalizer::findGlobalVariable(const QString &name, const AST::ModulePt
             }
         }
         if (userMainModule) {
-            for (int i=0; i<userMainModule->impl.globals.size(); i++) {
-                AST::VariablePtr  v = userMainModule->impl.globals[i];
-                if (v->name==name) {
-                    var = v;
-                    break;
-                }
-            }
+            const int index = symbols_.variableIndex(userMainModule->impl.globals, name);
+            if (index!=-1)
+                var = userMainModule->impl.globals.at(index);
         }
     }
     return !var.isNull();
@@ -4798,13 +4916,9 @@ bool SyntaxAnalizer::findGlobalVariable(const QString &name, const AST::ModulePt
 bool SyntaxAnalizer::findLocalVariable(const QString &name, const AST::AlgorithmPtr alg, AST::VariablePtr &var) const
 {
     var.clear();
-    for (int i=0; i<alg->impl.locals.size(); i++) {
-        AST::VariablePtr  v = alg->impl.locals[i];
-        if (v->name==name) {
-            var = v;
-            break;
-        }
-    }
+    const int index = symbols_.variableIndex(alg->impl.locals, name);
+    if (index!=-1)
+        var = alg->impl.locals.at(index);
     return !var.isNull();
 }
 
@@ -5720,14 +5834,19 @@ AST::ExpressionPtr  SyntaxAnalizer::parseFunctionCall(const QList<LexemPtr> &lex
     return result;
 }
 
+AST::AlgorithmPtr SyntaxAnalizer::stringLengthAlgorithm() const
+{
+    if (!stringLengthAlgorithm_) {
+        AST::ModulePtr strlenMod;
+        QVariantList functionTemplateParameters;
+        findAlgorithm(QString::fromUtf8("длин"), AST::ModulePtr(), AST::AlgorithmPtr(), strlenMod, stringLengthAlgorithm_, functionTemplateParameters);
+    }
+    return stringLengthAlgorithm_;
+}
+
 void SyntaxAnalizer::updateSliceDSCall(AST::ExpressionPtr  expr, AST::VariablePtr  var) const
 {
-    static AST::AlgorithmPtr  strlenAlg;
-    static AST::ModulePtr strlenMod;
-    static AST::ModulePtr  stdlibMod;
-    static QVariantList functionTemplateParameters;
-    if (!strlenAlg)
-        findAlgorithm(QString::fromUtf8("длин"), stdlibMod, AST::AlgorithmPtr(), strlenMod, strlenAlg, functionTemplateParameters);
+    const AST::AlgorithmPtr strlenAlg = stringLengthAlgorithm();
     if (expr->kind==AST::ExprFunctionCall
             && expr->function==strlenAlg
             && expr->operands.size()==0)
@@ -5746,13 +5865,8 @@ void SyntaxAnalizer::updateSliceDSCall(AST::ExpressionPtr  expr, AST::VariablePt
 
 bool SyntaxAnalizer::checkWrongDSUsage(ExpressionPtr expression)
 {
-    static AST::AlgorithmPtr  strlenAlg;
-    static AST::ModulePtr strlenMod;
-    static AST::ModulePtr  stdlibMod;
-    static QVariantList functionTemplateParameters;
+    const AST::AlgorithmPtr strlenAlg = stringLengthAlgorithm();
     bool hasError = false;
-    if (!strlenAlg)
-        findAlgorithm(QString::fromUtf8("длин"), stdlibMod, AST::AlgorithmPtr(), strlenMod, strlenAlg, functionTemplateParameters);
     if (expression->kind==AST::ExprFunctionCall
             && expression->function==strlenAlg
             && expression->operands.size()==0)
@@ -9,6 +9,7 @@
 #include <kumir2-libs/dataformats/ast_algorhitm.h>
 #include <kumir2/analizerinterface.h>
 #include "lexer.h"
+#include "symboltables.h"
 
 typedef AST::Data AST_Data;
 typedef AST::Algorithm AST_Algorhitm;
@@ -53,6 +54,9 @@ public:
             const AST::ModulePtr contextModule,
             const AST::AlgorithmPtr contextAlgorithm
             ) const;
+    /** Analyzes contents of algorithms. Algorithms are independent at
+      * this stage, so large programs are analyzed by thread pool, one task
+      * per algorithm; results are the same as of sequential analysis */
     void processAnalisys();
     QString suggestFileName() const;
     ~SyntaxAnalizer();
@@ -72,10 +76,22 @@ private /*fields*/:
     QString sourceDirName_;
     int currentPosition_;
     bool teacherMode_;
+    mutable SymbolTables symbols_;
+    mutable AST::AlgorithmPtr stringLengthAlgorithm_;
+
+private /*methods*/:
+    // Worker to analyze given statements of master in other thread
+    explicit SyntaxAnalizer(const SyntaxAnalizer * master,
+                            const QVector<int> & statementIndeces);
+    void prepareForParallelAnalisys();
+    bool processAlgorithmsInParallel(QVector<int> & otherStatements);
 
 public /*methods*/:
     void checkForEmitImportsSignal();
 
+    void processStatement(int str);
+    void processStatements();
+    AST::AlgorithmPtr stringLengthAlgorithm() const;
     void parseImport(int str);
     void parseModuleHeader(int str);
     void parseAlgHeader(int str, bool onlyName, bool allowOperatorsDeclaration);
@@ -41,7 +41,9 @@ void Generator::reset(const AST::DataPtr ast, Bytecode::Data *bc)
     ast_ = ast;
     byteCode_ = bc;
     constants_.clear();
+    constantsIndex_.clear();
     externs_.clear();
+    pendingBreaks_.clear();
 }
 
 static void getVarListSizes(const QVariant & var, int sizes[3], int fromDim)
@@ -472,6 +474,53 @@ Bytecode::InstructionType Generator::operation(AST::ExpressionOperator op)
         return Bytecode::NOP;
 }
 
+Bytecode::InstructionType Generator::typedOperation(const AST::ExpressionPtr st)
+{
+    // Use operations without runtime type checks when types of all operands
+    // are the same and known at compile time, generic ones otherwise
+    bool allIntegers = st->operands.size() > 0;
+    bool allReals = st->operands.size() > 0;
+    for (int i=0; i<st->operands.size(); i++) {
+        const AST::ExpressionPtr & operand = st->operands[i];
+        const bool scalar = 0 == operand->dimension;
+        allIntegers = allIntegers && scalar && operand->baseType.kind==AST::TypeInteger;
+        allReals = allReals && scalar && operand->baseType.kind==AST::TypeReal;
+    }
+    const AST::ExpressionOperator op = st->operatorr;
+    if (st->operands.size()==1 && op==AST::OpSubstract) {
+        if (allIntegers)
+            return Bytecode::INEG;
+        else if (allReals)
+            return Bytecode::RNEG;
+        else
+            return Bytecode::NEG;
+    }
+    if (st->operands.size()==2 && allIntegers) {
+        if (op==AST::OpSumm) return Bytecode::ISUM;
+        if (op==AST::OpSubstract) return Bytecode::ISUB;
+        if (op==AST::OpMultiply) return Bytecode::IMUL;
+        if (op==AST::OpEqual) return Bytecode::IEQ;
+        if (op==AST::OpNotEqual) return Bytecode::INEQ;
+        if (op==AST::OpLess) return Bytecode::ILS;
+        if (op==AST::OpGreater) return Bytecode::IGT;
+        if (op==AST::OpLessOrEqual) return Bytecode::ILEQ;
+        if (op==AST::OpGreaterOrEqual) return Bytecode::IGEQ;
+    }
+    if (st->operands.size()==2 && allReals) {
+        if (op==AST::OpSumm) return Bytecode::RSUM;
+        if (op==AST::OpSubstract) return Bytecode::RSUB;
+        if (op==AST::OpMultiply) return Bytecode::RMUL;
+        if (op==AST::OpDivision) return Bytecode::RDIV;
+        if (op==AST::OpEqual) return Bytecode::REQ;
+        if (op==AST::OpNotEqual) return Bytecode::RNEQ;
+        if (op==AST::OpLess) return Bytecode::RLS;
+        if (op==AST::OpGreater) return Bytecode::RGT;
+        if (op==AST::OpLessOrEqual) return Bytecode::RLEQ;
+        if (op==AST::OpGreaterOrEqual) return Bytecode::RGEQ;
+    }
+    return operation(op);
+}
+
 void Generator::addModule(const AST::ModulePtr mod)
 {
     int id = ast_->modules.indexOf(mod);
@@ -510,7 +559,8 @@ void Generator::addKumirModule(int id, const AST::ModulePtr mod)
     initElem.type = Bytecode::EL_INIT;
     initElem.module = quint8(id);
     initElem.moduleLocalizedName = mod->header.name.toStdWString();
-    initElem.instructions = instructions(id, -1, 0, mod->impl.initializerBody).toVector().toStdVector();
+    instructions(id, -1, 0, mod->impl.initializerBody, initElem.instructions);
+    pendingBreaks_.remove(0);
     if (!initElem.instructions.empty())
         initElem.instructions << returnFromInit;
     if (!initElem.instructions.empty())
@@ -542,21 +592,12 @@ void Generator::addKumirModule(int id, const AST::ModulePtr mod)
     }
 }
 
-void Generator::shiftInstructions(QList<Bytecode::Instruction> &instrs, int offset)
-{
-    for (int i=0; i<instrs.size(); i++) {
-        Bytecode::InstructionType t = instrs.at(i).type;
-        if (t==Bytecode::JNZ || t==Bytecode::JZ || t==Bytecode::JUMP) {
-            instrs[i].arg += offset;
-        }
-    }
-}
-
 void Generator::addInputArgumentsMainAlgorhitm(int moduleId, int algorhitmId, const AST::ModulePtr mod, const AST::AlgorithmPtr alg)
 {
     // Generate hidden algorhitm, which will called before main to input arguments
     int algId = mod->impl.algorhitms.size();
-    QList<Bytecode::Instruction> instrs = makeLineInstructions(alg->impl.headerLexems);
+    CodeBuffer instrs;
+    makeLineInstructions(alg->impl.headerLexems, instrs);
     QList<quint16> varsToOut;
     int locOffset = 0;
 
@@ -604,17 +645,8 @@ void Generator::addInputArgumentsMainAlgorhitm(int moduleId, int algorhitmId, co
         // Initialize argument
         if (var->dimension > 0) {
             for (int j=var->dimension-1; j>=0 ; j--) {
-                QList<Bytecode::Instruction> initBounds;
-                initBounds << calculate(moduleId, algorhitmId, 0, var->bounds[j].second);
-                initBounds << calculate(moduleId, algorhitmId, 0, var->bounds[j].first);
-                for (int i_bounds=0; i_bounds<initBounds.size(); i_bounds++) {
-                    Bytecode::Instruction & instr = initBounds[i_bounds];
-                    if (instr.type==Bytecode::LOAD || instr.type==Bytecode::LOADARR) {
-//                        if (instr.scope==Bytecode::LOCAL)
-//                            instr.arg = uint16_t(instr.arg-locOffset);
-                    }
-                }
-                instrs << initBounds;
+                calculate(moduleId, algorhitmId, 0, var->bounds[j].second, instrs);
+                calculate(moduleId, algorhitmId, 0, var->bounds[j].first, instrs);
             }
             Bytecode::Instruction bounds;
             bounds.type = Bytecode::SETARR;
@@ -732,7 +764,7 @@ void Generator::addInputArgumentsMainAlgorhitm(int moduleId, int algorhitmId, co
     func.module = moduleId;
     func.moduleLocalizedName = mod->header.name.toStdWString();
     func.name = QString::fromLatin1("@below_main").toStdWString();
-    func.instructions = instrs.toVector().toStdVector();
+    func.instructions.swap(instrs);
     byteCode_->d.push_back(func);
 
 }
@@ -838,9 +870,9 @@ void Generator::addFunction(int id, int moduleId, Bytecode::ElemType type, const
     func.name = alg->header.name.toStdWString();
     func.signature = signature.toStdWString();
     func.moduleLocalizedName = mod->header.name.toStdWString();
-    QList<Bytecode::Instruction> argHandle;
+    CodeBuffer & argHandle = func.instructions;
 
-    argHandle += makeLineInstructions(alg->impl.headerLexems);
+    makeLineInstructions(alg->impl.headerLexems, argHandle);
 
     if (headerError.length()>0) {
         Bytecode::Instruction err;
@@ -902,8 +934,8 @@ void Generator::addFunction(int id, int moduleId, Bytecode::ElemType type, const
         const AST::VariablePtr  var = alg->header.arguments[i];
         if (var->dimension>0) {
             for (int i=var->dimension-1; i>=0; i--) {
-                argHandle << calculate(moduleId, id, 0, var->bounds[i].second);
-                argHandle << calculate(moduleId, id, 0, var->bounds[i].first);
+                calculate(moduleId, id, 0, var->bounds[i].second, argHandle);
+                calculate(moduleId, id, 0, var->bounds[i].first, argHandle);
             }
             Bytecode::Instruction bounds;
             bounds.type = Bytecode::UPDARR;
@@ -919,7 +951,7 @@ void Generator::addFunction(int id, int moduleId, Bytecode::ElemType type, const
     }
 
     if (alg->impl.beginLexems.size()) {
-        argHandle += makeLineInstructions(alg->impl.beginLexems);
+        makeLineInstructions(alg->impl.beginLexems, argHandle);
     }
 
     if (beginError.length()>0) {
@@ -933,25 +965,20 @@ void Generator::addFunction(int id, int moduleId, Bytecode::ElemType type, const
     if (debugLevel_==GeneratorInterface::LinesAndVariables)
         argHandle << ctlOff;
 
-    QList<Bytecode::Instruction> pre = instructions(moduleId, id, 0, alg->impl.pre);
-    QList<Bytecode::Instruction> body = instructions(moduleId, id, 0, alg->impl.body);
-    QList<Bytecode::Instruction> post = instructions(moduleId, id, 0, alg->impl.post);
-
-    shiftInstructions(pre, argHandle.size());
+    // Pre-condition, body and post-condition are emitted directly into
+    // function code, so all jump targets are absolute from the start
+    instructions(moduleId, id, 0, alg->impl.pre, func.instructions);
+    instructions(moduleId, id, 0, alg->impl.body, func.instructions);
+    instructions(moduleId, id, 0, alg->impl.post, func.instructions);
 
-    int offset = argHandle.size() + pre.size();
-    shiftInstructions(body, offset);
-    offset += body.size();
-    shiftInstructions(post, offset);
+    CodeBuffer & ret = func.instructions;
 
-    QList<Bytecode::Instruction> ret;
+    const int retIp = func.instructions.size();
 
-    int retIp = argHandle.size() + pre.size() + body.size() + post.size();
+    patchBreaks(func.instructions, 0, retIp);
 
-    setBreakAddress(body, 0, retIp);
 
-
-    ret += makeLineInstructions(alg->impl.endLexems);
+    makeLineInstructions(alg->impl.endLexems, ret);
 
     if (alg->impl.endLexems.size()>0) {
         QString endError;
@@ -984,16 +1011,14 @@ void Generator::addFunction(int id, int moduleId, Bytecode::ElemType type, const
     retturn.type = Bytecode::RET;
     ret << retturn;
 
-    QList<Bytecode::Instruction> instrs = argHandle + pre + body + post + ret;
-    func.instructions = instrs.toVector().toStdVector();
     byteCode_->d.push_back(func);
 }
 
-QList<Bytecode::Instruction> Generator::instructions(
+void Generator::instructions(
     int modId, int algId, int level,
-    const QList<AST::StatementPtr > &statements)
+    const QList<AST::StatementPtr > &statements,
+    CodeBuffer & result)
 {
-    QList<Bytecode::Instruction> result;
     for (int i=0; i<statements.size(); i++) {
         const AST::StatementPtr  st = statements[i];
         switch (st->type) {
@@ -1038,7 +1063,6 @@ QList<Bytecode::Instruction> Generator::instructions(
             break;
         }
     }
-    return result;
 }
 
 quint16 Generator::constantValue(Bytecode::ValueType type, quint8 dimension, const QVariant &value,
@@ -1059,18 +1083,30 @@ quint16 Generator::constantValue(const QList<Bytecode::ValueType> & type, quint8
     c.value = value;
     c.recordModuleName = moduleName;
     c.recordClassLocalizedName = className;
-    if (!constants_.contains(c)) {
-        constants_ << c;
-        return constants_.size()-1;
+
+    // Constants are looked up by hash of the same fields
+    // ConstValue::operator== compares, so pool lookup does not
+    // depend on the number of constants already collected
+    QByteArray key;
+    QDataStream keyStream(&key, QIODevice::WriteOnly);
+    keyStream << c.dimension << c.recordModuleName << c.recordClassAsciiName << c.value;
+    foreach (Bytecode::ValueType t, c.baseType) {
+        keyStream << quint8(t);
     }
-    else {
-        return constants_.indexOf(c);
+
+    QHash<QByteArray,quint16>::const_iterator it = constantsIndex_.find(key);
+    if (it != constantsIndex_.end()) {
+        return it.value();
     }
+    const quint16 index = constants_.size();
+    constants_ << c;
+    constantsIndex_.insert(key, index);
+    return index;
 }
 
-void Generator::ERRORR(int , int , int , const AST::StatementPtr  st, QList<Bytecode::Instruction>  & result)
+void Generator::ERRORR(int , int , int , const AST::StatementPtr  st, CodeBuffer & result)
 {
-    result += makeLineInstructions(st->lexems);
+    makeLineInstructions(st->lexems, result);
     const QString error = ErrorMessages::message("KumirAnalizer", QLocale::Russian, st->error);
     Bytecode::Instruction e;
     e.type = Bytecode::ERRORR;
@@ -1131,9 +1167,8 @@ void Generator::findFunction(const AST::AlgorithmPtr alg, quint8 &module, quint1
     }
 }
 
-QList<Bytecode::Instruction> Generator::makeLineInstructions(const QList<AST::LexemPtr> &lexems) const
+void Generator::makeLineInstructions(const QList<AST::LexemPtr> &lexems, CodeBuffer & result) const
 {
-    QList<Bytecode::Instruction> result;
     if (debugLevel_ != GeneratorInterface::NoDebug) {
         Bytecode::Instruction lineNoInstruction, lineColInstruction;
         lineNoInstruction.type = lineColInstruction.type = Bytecode::LINE;
@@ -1155,17 +1190,14 @@ QList<Bytecode::Instruction> Generator::makeLineInstructions(const QList<AST::Le
             result << lineNoInstruction << lineColInstruction;
         }
     }
-    return result;
 }
 
-void Generator::ASSIGN(int modId, int algId, int level, const AST::StatementPtr st, QList<Bytecode::Instruction> & result)
+void Generator::ASSIGN(int modId, int algId, int level, const AST::StatementPtr st, CodeBuffer & result)
 {
-    result += makeLineInstructions(st->lexems);
+    makeLineInstructions(st->lexems, result);
 
     const AST::ExpressionPtr rvalue = st->expressions[0];
-    QList<Bytecode::Instruction> rvalueInstructions = calculate(modId, algId, level, rvalue);
-    shiftInstructions(rvalueInstructions, result.size());
-    result << rvalueInstructions;
+    calculate(modId, algId, level, rvalue, result);
 
 
     if (st->expressions.size()>1) {
@@ -1179,7 +1211,7 @@ void Generator::ASSIGN(int modId, int algId, int level, const AST::StatementPtr
             findVariable(modId, algId, lvalue->variable, load.scope, load.arg);
             load.type = lvalue->variable->dimension>0? Bytecode::LOADARR : Bytecode::LOAD;
             for (int i=lvalue->variable->dimension-1; i>=0 ;i--) {
-                result << calculate(modId, algId, level, lvalue->operands[i]);
+                calculate(modId, algId, level, lvalue->operands[i], result);
             }
             result << load;
         }
@@ -1187,8 +1219,8 @@ void Generator::ASSIGN(int modId, int algId, int level, const AST::StatementPtr
         if (diff==1) {
             // Set character
 
-            result << calculate(modId, algId, level,
-                                lvalue->operands[lvalue->operands.count()-1]);
+            calculate(modId, algId, level,
+                                lvalue->operands[lvalue->operands.count()-1], result);
             Bytecode::Instruction argsCount;
             argsCount.type = Bytecode::LOAD;
             argsCount.scope = Bytecode::CONSTT;
@@ -1205,10 +1237,10 @@ void Generator::ASSIGN(int modId, int algId, int level, const AST::StatementPtr
         if (diff==2) {
             // Set slice
 
-            result << calculate(modId, algId, level,
-                                lvalue->operands[lvalue->operands.count()-2]);
-            result << calculate(modId, algId, level,
-                                lvalue->operands[lvalue->operands.count()-1]);
+            calculate(modId, algId, level,
+                                lvalue->operands[lvalue->operands.count()-2], result);
+            calculate(modId, algId, level,
+                                lvalue->operands[lvalue->operands.count()-1], result);
             Bytecode::Instruction argsCount;
             argsCount.type = Bytecode::LOAD;
             argsCount.scope = Bytecode::CONSTT;
@@ -1227,7 +1259,7 @@ void Generator::ASSIGN(int modId, int algId, int level, const AST::StatementPtr
         store.type = lvalue->variable->dimension>0? Bytecode::STOREARR : Bytecode::STORE;
         if (lvalue->kind==AST::ExprArrayElement) {
             for (int i=lvalue->variable->dimension-1; i>=0 ;i--) {
-                result << calculate(modId, algId, level, lvalue->operands[i]);
+                calculate(modId, algId, level, lvalue->operands[i], result);
             }
         }
 
@@ -1239,9 +1271,8 @@ void Generator::ASSIGN(int modId, int algId, int level, const AST::StatementPtr
     }
 }
 
-QList<Bytecode::Instruction> Generator::calculate(int modId, int algId, int level, const AST::ExpressionPtr st)
+void Generator::calculate(int modId, int algId, int level, const AST::ExpressionPtr st, CodeBuffer & result)
 {
-    QList<Bytecode::Instruction> result;
     if (st->useFromCache) {
         Bytecode::Instruction instr;
         memset(&instr, 0, sizeof(Bytecode::Instruction));
@@ -1272,7 +1303,7 @@ QList<Bytecode::Instruction> Generator::calculate(int modId, int algId, int leve
         instr.type = Bytecode::LOAD;
         if (st->variable->dimension>0) {
             for (int i=st->variable->dimension-1; i>=0; i--) {
-                result << calculate(modId, algId, level, st->operands[i]);
+                calculate(modId, algId, level, st->operands[i], result);
             }
             instr.type = Bytecode::LOADARR;
         }
@@ -1286,8 +1317,8 @@ QList<Bytecode::Instruction> Generator::calculate(int modId, int algId, int leve
         specialFunction.module = 0xff;
         if (diff==1) {
             // Get char
-            result << calculate(modId, algId, level,
-                                st->operands[st->operands.count()-1]);
+            calculate(modId, algId, level,
+                                st->operands[st->operands.count()-1], result);
             argsCount.arg = constantValue(Bytecode::VT_int, 0, 2, QString(), QString());
             result << argsCount;
             specialFunction.arg = 0x04;
@@ -1295,10 +1326,10 @@ QList<Bytecode::Instruction> Generator::calculate(int modId, int algId, int leve
         }
         else if (diff==2) {
             // Get slice
-            result << calculate(modId, algId, level,
-                                st->operands[st->operands.count()-2]);
-            result << calculate(modId, algId, level,
-                                st->operands[st->operands.count()-1]);
+            calculate(modId, algId, level,
+                                st->operands[st->operands.count()-2], result);
+            calculate(modId, algId, level,
+                                st->operands[st->operands.count()-1], result);
             argsCount.arg = constantValue(Bytecode::VT_int, 0, 3, QString(), QString());
             result << argsCount;
             specialFunction.arg = 0x06;
@@ -1320,7 +1351,7 @@ QList<Bytecode::Instruction> Generator::calculate(int modId, int algId, int leve
                 result << ref;
             }
             else if (t==AST::AccessArgumentIn && !arr)
-                result << calculate(modId, algId, level, st->operands[i]);
+                calculate(modId, algId, level, st->operands[i], result);
             else if (t==AST::AccessArgumentIn && arr) {
                 // load the whole array into stack
                 Bytecode::Instruction load;
@@ -1345,9 +1376,7 @@ QList<Bytecode::Instruction> Generator::calculate(int modId, int algId, int leve
     else if (st->kind==AST::ExprSubexpression) {
         std::list<int> jmps;
         for (int i=0; i<st->operands.size(); i++) {
-            QList<Bytecode::Instruction> operandInstrs = calculate(modId, algId, level, st->operands[i]);
-            shiftInstructions(operandInstrs, result.size());
-            result << operandInstrs;
+            calculate(modId, algId, level, st->operands[i], result);
             // Drop cached value in case of compare-chains calculations and Z-flag
             if (st->operands[i]->clearCacheOnFailure) {
                 Bytecode::Instruction clearCacheOnZ;
@@ -1392,10 +1421,8 @@ QList<Bytecode::Instruction> Generator::calculate(int modId, int algId, int leve
             }
         }
         Bytecode::Instruction instr;
-        instr.type = operation(st->operatorr);
-        if (st->operatorr==AST::OpSubstract && st->operands.size()==1) {
-            instr.type = Bytecode::NEG;
-        }
+        memset(&instr, 0, sizeof(Bytecode::Instruction));
+        instr.type = typedOperation(st);
         result << instr;
         for (std::list<int>::iterator it=jmps.begin(); it!=jmps.end(); it++) {
             int index = *it;
@@ -1410,14 +1437,11 @@ QList<Bytecode::Instruction> Generator::calculate(int modId, int algId, int leve
         instr.type = Bytecode::CSTORE;
         result << instr;
     }
-
-
-    return result;
 }
 
-void Generator::PAUSE_STOP(int , int , int , const AST::StatementPtr  st, QList<Bytecode::Instruction> & result)
+void Generator::PAUSE_STOP(int , int , int , const AST::StatementPtr  st, CodeBuffer & result)
 {
-    result += makeLineInstructions(st->lexems);
+    makeLineInstructions(st->lexems, result);
 
     Bytecode::Instruction a;
     a.type = st->type==AST::StPause? Bytecode::PAUSE : Bytecode::HALT;
@@ -1425,15 +1449,12 @@ void Generator::PAUSE_STOP(int , int , int , const AST::StatementPtr  st, QList<
     result << a;
 }
 
-void Generator::ASSERT(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result)
+void Generator::ASSERT(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result)
 {
-    result += makeLineInstructions(st->lexems);
+    makeLineInstructions(st->lexems, result);
 
     for (int i=0; i<st->expressions.size(); i++) {
-        QList<Bytecode::Instruction> exprInstrs;
-        exprInstrs = calculate(modId, algId, level, st->expressions[i]);
-        shiftInstructions(exprInstrs, result.size());
-        result << exprInstrs;
+        calculate(modId, algId, level, st->expressions[i], result);
         Bytecode::Instruction pop;
         pop.type = Bytecode::POP;
         pop.registerr = 0;
@@ -1457,16 +1478,16 @@ void Generator::ASSERT(int modId, int algId, int level, const AST::StatementPtr
     }
 }
 
-void Generator::INIT(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result)
+void Generator::INIT(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result)
 {
-    result += makeLineInstructions(st->lexems);
+    makeLineInstructions(st->lexems, result);
 
     for (int i=0; i<st->variables.size(); i++) {
         const AST::VariablePtr  var = st->variables[i];
         if (var->dimension > 0 && var->bounds.size()>0) {
             for (int i=var->dimension-1; i>=0 ; i--) {
-                result << calculate(modId, algId, level, var->bounds[i].second);
-                result << calculate(modId, algId, level, var->bounds[i].first);
+                calculate(modId, algId, level, var->bounds[i].second, result);
+                calculate(modId, algId, level, var->bounds[i].first, result);
             }
             Bytecode::Instruction bounds;
             bounds.type = Bytecode::SETARR;
@@ -1503,9 +1524,9 @@ void Generator::INIT(int modId, int algId, int level, const AST::StatementPtr  s
     }
 }
 
-void Generator::CALL_SPECIAL(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result)
+void Generator::CALL_SPECIAL(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result)
 {
-    result += makeLineInstructions(st->lexems);
+    makeLineInstructions(st->lexems, result);
 
     quint16 argsCount;
 
@@ -1517,25 +1538,16 @@ void Generator::CALL_SPECIAL(int modId, int algId, int level, const AST::Stateme
             const AST::ExpressionPtr  expr = st->expressions[3*i];
             const AST::ExpressionPtr  format1 = st->expressions[3*i+1];
             const AST::ExpressionPtr  format2 = st->expressions[3*i+2];
-            QList<Bytecode::Instruction> instrs;
-            instrs = calculate(modId, algId, level, expr);
-            shiftInstructions(instrs, result.size());
-            result << instrs;
+            calculate(modId, algId, level, expr, result);
 
-            instrs = calculate(modId, algId, level, format1);
-            shiftInstructions(instrs, result.size());
-            result << instrs;
+            calculate(modId, algId, level, format1, result);
 
-            instrs = calculate(modId, algId, level, format2);
-            shiftInstructions(instrs, result.size());
-            result << instrs;
+            calculate(modId, algId, level, format2, result);
         }
 
         if (st->expressions.size() % 3) {
             // File handle
-            QList<Bytecode::Instruction> instrs = calculate(modId, algId, level, st->expressions.last());
-            shiftInstructions(instrs, result.size());
-            result << instrs;
+            calculate(modId, algId, level, st->expressions.last(), result);
         }
 
         argsCount = st->expressions.size();
@@ -1562,16 +1574,12 @@ void Generator::CALL_SPECIAL(int modId, int algId, int level, const AST::Stateme
             else if (varExpr->kind == AST::ExprArrayElement) {
                 ref.type = Bytecode::REFARR;
                 for (int j=varExpr->operands.size()-1; j>=0; j--) {
-                    QList<Bytecode::Instruction> operandInstrs = calculate(modId, algId, level, varExpr->operands[j]);
-                    shiftInstructions(operandInstrs, result.size());
-                    result << operandInstrs;
+                    calculate(modId, algId, level, varExpr->operands[j], result);
                 }
                 result << ref;
             }
             else {
-                QList<Bytecode::Instruction> operandInstrs = calculate(modId, algId, level, varExpr);
-                shiftInstructions(operandInstrs, result.size());
-                result << operandInstrs;
+                calculate(modId, algId, level, varExpr, result);
             }
 
         }
@@ -1596,15 +1604,13 @@ void Generator::CALL_SPECIAL(int modId, int algId, int level, const AST::Stateme
 }
 
 
-void Generator::IFTHENELSE(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> &result)
+void Generator::IFTHENELSE(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result)
 {
     int jzIP = -1;
-    result += makeLineInstructions(st->lexems);
+    makeLineInstructions(st->lexems, result);
 
     if (st->conditionals[0].condition) {
-        QList<Bytecode::Instruction> conditionInstructions = calculate(modId, algId, level, st->conditionals[0].condition);
-        shiftInstructions(conditionInstructions, result.size());
-        result << conditionInstructions;
+        calculate(modId, algId, level, st->conditionals[0].condition, result);
 
         Bytecode::Instruction pop;
         pop.type = Bytecode::POP;
@@ -1644,10 +1650,10 @@ void Generator::IFTHENELSE(int modId, int algId, int level, const AST::Statement
     Bytecode::Instruction error;
     if (st->conditionals[0].conditionError.size()>0) {        
         if (st->conditionals[0].lexems.isEmpty()) {
-            result += makeLineInstructions(st->lexems);
+            makeLineInstructions(st->lexems, result);
         }
         else {
-            result += makeLineInstructions(st->conditionals[0].lexems);
+            makeLineInstructions(st->conditionals[0].lexems, result);
         }
         const QString msg = ErrorMessages::message("KumirAnalizer", QLocale::Russian, st->conditionals[0].conditionError);
         error.type = Bytecode::ERRORR;
@@ -1656,9 +1662,7 @@ void Generator::IFTHENELSE(int modId, int algId, int level, const AST::Statement
         result << error;
     }
     else {
-        QList<Bytecode::Instruction> thenInstrs = instructions(modId, algId, level, st->conditionals[0].body);
-        shiftInstructions(thenInstrs, result.size());
-        result += thenInstrs;
+        instructions(modId, algId, level, st->conditionals[0].body, result);
     }
 
     if (jzIP!=-1)
@@ -1673,10 +1677,10 @@ void Generator::IFTHENELSE(int modId, int algId, int level, const AST::Statement
         if (st->conditionals[1].conditionError.size()>0) {
             const QString msg = ErrorMessages::message("KumirAnalizer", QLocale::Russian, st->conditionals[1].conditionError);
             if (st->conditionals[1].lexems.isEmpty()) {
-                result += makeLineInstructions(st->lexems);
+                makeLineInstructions(st->lexems, result);
             }
             else {
-                result += makeLineInstructions(st->conditionals[1].lexems);
+                makeLineInstructions(st->conditionals[1].lexems, result);
             }
             error.type = Bytecode::ERRORR;
             error.scope = Bytecode::CONSTT;
@@ -1684,9 +1688,7 @@ void Generator::IFTHENELSE(int modId, int algId, int level, const AST::Statement
             result << error;
         }
         else {
-            QList<Bytecode::Instruction> elseInstrs = instructions(modId, algId, level, st->conditionals[1].body);
-            shiftInstructions(elseInstrs, result.size());
-            result += elseInstrs;
+            instructions(modId, algId, level, st->conditionals[1].body, result);
         }
         result[jumpIp].arg = result.size();
     }
@@ -1694,10 +1696,10 @@ void Generator::IFTHENELSE(int modId, int algId, int level, const AST::Statement
     if (st->endBlockError.size()>0) {
         const QString msg = ErrorMessages::message("KumirAnalizer", QLocale::Russian, st->endBlockError);
         if (st->conditionals[0].lexems.isEmpty()) {
-            result += makeLineInstructions(st->lexems);
+            makeLineInstructions(st->lexems, result);
         }
         else {
-            result += makeLineInstructions(st->endBlockLexems);
+            makeLineInstructions(st->endBlockLexems, result);
         }
         error.type = Bytecode::ERRORR;
         error.scope = Bytecode::CONSTT;
@@ -1707,7 +1709,7 @@ void Generator::IFTHENELSE(int modId, int algId, int level, const AST::Statement
 
 }
 
-void Generator::SWITCHCASEELSE(int modId, int algId, int level, const AST::StatementPtr st, QList<Bytecode::Instruction> & result)
+void Generator::SWITCHCASEELSE(int modId, int algId, int level, const AST::StatementPtr st, CodeBuffer & result)
 {
     if (st->headerError.size()>0) {
         Bytecode::Instruction garbage;
@@ -1746,7 +1748,7 @@ void Generator::SWITCHCASEELSE(int modId, int algId, int level, const AST::State
             result[lastJzIp].arg = result.size();
             lastJzIp = -1;
         }
-        result += makeLineInstructions(st->conditionals[i].lexems);
+        makeLineInstructions(st->conditionals[i].lexems, result);
         if (!st->conditionals[i].conditionError.isEmpty()) {
             const QString error = ErrorMessages::message("KumirAnalizer", QLocale::Russian, st->conditionals[i].conditionError);
             Bytecode::Instruction err;
@@ -1757,9 +1759,7 @@ void Generator::SWITCHCASEELSE(int modId, int algId, int level, const AST::State
         }
         else {
             if (st->conditionals[i].condition) {
-                QList<Bytecode::Instruction> condInstrs = calculate(modId, algId, level, st->conditionals[i].condition);
-                shiftInstructions(condInstrs, result.size());
-                result << condInstrs;
+                calculate(modId, algId, level, st->conditionals[i].condition, result);
                 Bytecode::Instruction pop;
                 pop.type = Bytecode::POP;
                 pop.registerr = 0;
@@ -1774,9 +1774,7 @@ void Generator::SWITCHCASEELSE(int modId, int algId, int level, const AST::State
                 lastJzIp = result.size();
                 result << jz;
             }
-            QList<Bytecode::Instruction> instrs = instructions(modId, algId, level, st->conditionals[i].body);
-            shiftInstructions(instrs, result.size());
-            result += instrs;
+            instructions(modId, algId, level, st->conditionals[i].body, result);
             if (i<st->conditionals.size()-1) {
                 Bytecode::Instruction jump;
                 jump.type = Bytecode::JUMP;
@@ -1804,22 +1802,23 @@ const AST::VariablePtr  Generator::returnValue(const AST::AlgorithmPtr  alg)
 
 void Generator::BREAK(int , int , int level,
                       const AST::StatementPtr  st,
-                      QList<Bytecode::Instruction> & result)
+                      CodeBuffer & result)
 {
-    result += makeLineInstructions(st->lexems);
+    makeLineInstructions(st->lexems, result);
 
     Bytecode::Instruction jump;
 //    jump.type = Bytecode::JUMP;
     jump.type = Bytecode::InstructionType(127);
     jump.registerr = level;
 
+    pendingBreaks_[level].push_back(result.size());
     result << jump;
 }
 
 void Generator::LOOP(int modId, int algId,
                      int level,
                      const AST::StatementPtr st,
-                     QList<Bytecode::Instruction> &result)
+                     CodeBuffer & result)
 {
     Bytecode::Instruction ctlOn;
     ctlOn.module = 0x00;
@@ -1833,7 +1832,7 @@ void Generator::LOOP(int modId, int algId,
 
     if (st->beginBlockError.size()>0) {
         const QString error = ErrorMessages::message("KumirAnalizer", QLocale::Russian, st->beginBlockError);
-        result += makeLineInstructions(st->lexems);
+        makeLineInstructions(st->lexems, result);
         Bytecode::Instruction err;
         err.type = Bytecode::ERRORR;
         err.scope = Bytecode::CONSTT;
@@ -1858,13 +1857,11 @@ void Generator::LOOP(int modId, int algId,
 
     if (st->loop.type==AST::LoopWhile || st->loop.type==AST::LoopForever) {
         // Highlight line and clear margin
-        result += makeLineInstructions(st->lexems);
+        makeLineInstructions(st->lexems, result);
 
         if (st->loop.whileCondition) {
             // Calculate condition
-            QList<Bytecode::Instruction> whileCondInstructions = calculate(modId, algId, level, st->loop.whileCondition);
-            shiftInstructions(whileCondInstructions, result.size());
-            result << whileCondInstructions;
+            calculate(modId, algId, level, st->loop.whileCondition, result);
 
             // Check condition result
             Bytecode::Instruction a;
@@ -1905,12 +1902,10 @@ void Generator::LOOP(int modId, int algId,
     }
     else if (st->loop.type==AST::LoopTimes) {
         // Highlight line
-        result += makeLineInstructions(st->lexems);
+        makeLineInstructions(st->lexems, result);
 
         // Calculate times value
-        QList<Bytecode::Instruction> timesValueInstructions = calculate(modId, algId, level, st->loop.timesValue);
-        shiftInstructions(timesValueInstructions, result.size());
-        result << timesValueInstructions;
+        calculate(modId, algId, level, st->loop.timesValue, result);
         Bytecode::Instruction a;
 
         // Store value in register
@@ -1934,7 +1929,7 @@ void Generator::LOOP(int modId, int algId,
 
         // Highlight line and clear margin
 
-        result += makeLineInstructions(st->lexems);
+        makeLineInstructions(st->lexems, result);
         if (st->lexems.size() > 0 && st->lexems.first()->lineNo!=-1 &&
                  debugLevel_==GeneratorInterface::LinesAndVariables) {
             result << clmarg;
@@ -1948,7 +1943,7 @@ void Generator::LOOP(int modId, int algId,
         a.scope = Bytecode::CONSTT;
         a.arg = constantValue(Bytecode::VT_int, 0, 1, QString(), QString());
         result << a;
-        a.type = Bytecode::SUM;
+        a.type = Bytecode::ISUM;
         result << a;
         a.type = Bytecode::POP;
         a.registerr = level * 5;
@@ -1961,7 +1956,7 @@ void Generator::LOOP(int modId, int algId,
         a.type = Bytecode::PUSH;
         a.registerr = level * 5 - 1;
         result << a;
-        a.type = Bytecode::GT;
+        a.type = Bytecode::IGT;
         result << a;
         a.type = Bytecode::POP;
         a.registerr = 0;
@@ -1982,10 +1977,10 @@ void Generator::LOOP(int modId, int algId,
     else if (st->loop.type==AST::LoopFor) {
 
         // Highlight line
-        result += makeLineInstructions(st->lexems);
+        makeLineInstructions(st->lexems, result);
 
         // Calculate 'from'-value
-        result << calculate(modId, algId, level, st->loop.fromValue);
+        calculate(modId, algId, level, st->loop.fromValue, result);
 
         Bytecode::Instruction popFrom;
         popFrom.type = Bytecode::POP;
@@ -1998,7 +1993,7 @@ void Generator::LOOP(int modId, int algId,
 
 
         // First time: Load 'to'-value and store it in register
-        result << calculate(modId, algId, level, st->loop.toValue);
+        calculate(modId, algId, level, st->loop.toValue, result);
 
         Bytecode::Instruction popTo;
         popTo.type = Bytecode::POP;
@@ -2011,7 +2006,7 @@ void Generator::LOOP(int modId, int algId,
 
         // First time: Load 'step'-value and store it in register
         if (st->loop.stepValue) {
-            result << calculate(modId, algId, level, st->loop.stepValue);
+            calculate(modId, algId, level, st->loop.stepValue, result);
         }
         else {
             Bytecode::Instruction loadOneStep;
@@ -2035,7 +2030,7 @@ void Generator::LOOP(int modId, int algId,
         // be increased in nearest future
 
         Bytecode::Instruction subInitial;
-        subInitial.type = Bytecode::SUB;
+        subInitial.type = Bytecode::ISUB;
         result << pushFrom << pushStep << subInitial;
 
         Bytecode::Instruction popCurrent;
@@ -2061,7 +2056,7 @@ void Generator::LOOP(int modId, int algId,
         //    b) calculate current value and store into variable
         result << pushCurrent << pushStep;
         Bytecode::Instruction sum;
-        sum.type = Bytecode::SUM;
+        sum.type = Bytecode::ISUM;
         result << sum;
         result << popCurrent << pushCurrent;
         //    c) check if variable in range
@@ -2077,7 +2072,7 @@ void Generator::LOOP(int modId, int algId,
         result << gotoEnd;
 
         // Clear margin
-        result += makeLineInstructions(st->lexems);
+        makeLineInstructions(st->lexems, result);
 
         if (st->lexems.size() > 0 && st->lexems.first()->lineNo!=-1 &&
                 debugLevel_==GeneratorInterface::LinesAndVariables) {
@@ -2091,14 +2086,12 @@ void Generator::LOOP(int modId, int algId,
         result << pushCurrent << setVariableValue << popVoid;
     }
 
-    QList<Bytecode::Instruction> instrs = instructions(modId, algId, level, st->loop.body);
-    shiftInstructions(instrs, result.size());
-    result += instrs;
+    instructions(modId, algId, level, st->loop.body, result);
 
     bool endsWithError = st->endBlockError.length()>0;
     if (endsWithError) {
         const QString error = ErrorMessages::message("KumirAnalizer", QLocale::Russian, st->endBlockError);
-        result += makeLineInstructions(st->loop.endLexems);
+        makeLineInstructions(st->loop.endLexems, result);
         Bytecode::Instruction ee;
         ee.type = Bytecode::ERRORR;
         ee.scope = Bytecode::CONSTT;
@@ -2110,10 +2103,8 @@ void Generator::LOOP(int modId, int algId,
     int endJzIp = -1;
 
     if (st->loop.endCondition) {
-        result += makeLineInstructions(st->loop.endLexems);
-        QList<Bytecode::Instruction> endCondInstructions = calculate(modId, algId, level, st->loop.endCondition);
-        shiftInstructions(endCondInstructions, result.size());
-        result << endCondInstructions;
+        makeLineInstructions(st->loop.endLexems, result);
+        calculate(modId, algId, level, st->loop.endCondition, result);
         Bytecode::Instruction e;
         e.type = Bytecode::POP;
         e.registerr = 0;
@@ -2130,7 +2121,7 @@ void Generator::LOOP(int modId, int algId,
         result << e;
     }    
     else if (debugLevel_!=GeneratorInterface::NoDebug) {
-        result += makeLineInstructions(st->loop.endLexems);
+        makeLineInstructions(st->loop.endLexems, result);
     }
 
     int jzIp2 = -1;
@@ -2158,19 +2149,18 @@ void Generator::LOOP(int modId, int algId,
 
     int endPos = result.size();
 
-    setBreakAddress(result, level, endPos);
+    patchBreaks(result, level, endPos);
 
 }
 
-void Generator::setBreakAddress(QList<Bytecode::Instruction> &instrs,
-                                int level,
-                                int address)
+void Generator::patchBreaks(CodeBuffer & instrs,
+                            int level,
+                            int address)
 {
-    for (int i=0; i<instrs.size(); i++) {
-        if (int(instrs[i].type)==127 && instrs[i].registerr==level) {
-            instrs[i].type = Bytecode::JUMP;
-            instrs[i].arg = address;
-        }
+    const QList<int> ips = pendingBreaks_.take(level);
+    foreach (int ip, ips) {
+        instrs[ip].type = Bytecode::JUMP;
+        instrs[ip].arg = address;
     }
 }
 
@@ -25,6 +25,12 @@ struct Lexem;
 namespace KumirCodeGenerator {
 
 typedef Shared::GeneratorInterface::DebugLevel DebugLevel;
+
+/** Code of one table element. All statement and expression handlers
+ *  append to the end of a single buffer, so jump targets are absolute
+ *  at the moment of emission and never need to be relocated */
+typedef std::vector<Bytecode::Instruction> CodeBuffer;
+
 struct ConstValue {
     QVariant value;
     QList<Bytecode::ValueType> baseType;
@@ -58,7 +64,7 @@ public:
     void generateExternTable();
     void setDebugLevel(DebugLevel debugLevel);
 private:
-    QList<Bytecode::Instruction> makeLineInstructions(const QList<AST::LexemPtr> & lexems) const;
+    void makeLineInstructions(const QList<AST::LexemPtr> & lexems, CodeBuffer & result) const;
     quint16 constantValue(Bytecode::ValueType type, quint8 dimension, const QVariant & value,
                           const QString & recordModule, const QString & recordClass
                           );
@@ -69,25 +75,25 @@ private:
     void addFunction(int id, int moduleId, Bytecode::ElemType type, const AST::ModulePtr  mod, const AST::AlgorithmPtr  alg);
     void addInputArgumentsMainAlgorhitm(int moduleId, int algorhitmId, const AST::ModulePtr  mod, const AST::AlgorithmPtr  alg);
 
-    QList<Bytecode::Instruction> instructions(
+    void instructions(
         int modId, int algId, int level,
-        const QList<AST::StatementPtr> & statements);
+        const QList<AST::StatementPtr> & statements,
+        CodeBuffer & result);
 
-    static void shiftInstructions(QList<Bytecode::Instruction> &instrs, int offset);
-    static void setBreakAddress(QList<Bytecode::Instruction> &instrs, int level, int address);
+    void patchBreaks(CodeBuffer & instrs, int level, int address);
 
-    void ERRORR(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void ASSIGN(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void ASSERT(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void PAUSE_STOP(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void INIT(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void CALL_SPECIAL(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void LOOP(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void IFTHENELSE(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void SWITCHCASEELSE(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
-    void BREAK(int modId, int algId, int level, const AST::StatementPtr  st, QList<Bytecode::Instruction> & result);
+    void ERRORR(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void ASSIGN(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void ASSERT(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void PAUSE_STOP(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void INIT(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void CALL_SPECIAL(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void LOOP(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void IFTHENELSE(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void SWITCHCASEELSE(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
+    void BREAK(int modId, int algId, int level, const AST::StatementPtr  st, CodeBuffer & result);
 
-    QList<Bytecode::Instruction> calculate(int modId, int algId, int level, const AST::ExpressionPtr st);
+    void calculate(int modId, int algId, int level, const AST::ExpressionPtr st, CodeBuffer & result);
 
     void findVariable(int modId, int algId, const AST::VariablePtr  var, Bytecode::VariableScope & scope, quint16 & id) const;
     static const AST::VariablePtr  returnValue(const AST::AlgorithmPtr  alg);
@@ -97,12 +103,15 @@ private:
     static QList<Bytecode::ValueType> valueType(const AST::Type & t);
     static Bytecode::ValueKind valueKind(AST::VariableAccessType t);
     static Bytecode::InstructionType operation(AST::ExpressionOperator op);
+    static Bytecode::InstructionType typedOperation(const AST::ExpressionPtr st);
 
     AST::DataPtr ast_;
     Bytecode::Data * byteCode_;
     QList< ConstValue > constants_;
+    QHash< QByteArray, quint16 > constantsIndex_;
     QList< QPair<quint8,quint16> > externs_;
     DebugLevel debugLevel_;
+    QHash< int, QList<int> > pendingBreaks_; // loop level -> IPs of unresolved breaks
 
 };
 
@@ -7,6 +7,7 @@
 #include "generator.h"
 #include "kumircodegeneratorplugin.h"
 #include <kumir2-libs/extensionsystem/pluginmanager.h>
+#include <kumir2-libs/dataformats/ast_optimizer.h>
 
 using namespace KumirCodeGenerator;
 using namespace Bytecode;
@@ -18,6 +19,8 @@ KumirCodeGeneratorPlugin::KumirCodeGeneratorPlugin()
     : KPlugin()
     , d(new Generator(this))
     , textMode_(false)
+    , optimize_(true)
+    , debugLevel_(LinesOnly)
 {
 }
 
@@ -37,6 +40,12 @@ KumirCodeGeneratorPlugin::acceptableCommandLineParameters() const
                   tr("Generate code with debug level from 0 (nothing) to 2 (maximum debug information)"),
                   QVariant::Int, false
                   );
+    result << CommandLineParameter(
+                  false,
+                  'O', "optimize",
+                  tr("Optimization level: 0 (none) or 1 (constant folding and dead code elimination, default)"),
+                  QVariant::Int, false
+                  );
     return result;
 }
 
@@ -52,6 +61,9 @@ QString KumirCodeGeneratorPlugin::initialize(const QStringList &/*configurationA
         debugLevel = DebugLevel(level);
     }
     setDebugLevel(debugLevel);
+    if (runtimeArguments.value('O').isValid()) {
+        optimize_ = runtimeArguments.value('O').toInt() > 0;
+    }
     return QString();
 }
 
@@ -69,6 +81,7 @@ void KumirCodeGeneratorPlugin::createPluginSpec()
 
 void KumirCodeGeneratorPlugin::setDebugLevel(DebugLevel debugLevel)
 {
+    debugLevel_ = debugLevel;
     d->setDebugLevel(debugLevel);
 }
 
@@ -83,7 +96,7 @@ void KumirCodeGeneratorPlugin::stop()
 }
 
 void KumirCodeGeneratorPlugin::generateExecutable(
-        const AST::DataPtr tree,
+        const AST::DataPtr source,
         QByteArray & out,
         QString & mimeType,
         QString & fileSuffix
@@ -91,6 +104,15 @@ void KumirCodeGeneratorPlugin::generateExecutable(
 {
     Data data;
 
+    int passes = AST::Optimizer::AllPasses;
+    if (debugLevel_ != NoDebug) {
+        // Hidden variables would appear on margin and in debugger
+        passes &= ~AST::Optimizer::HoistLoopInvariants;
+    }
+    const AST::DataPtr tree = optimize_
+            ? AST::Optimizer::optimize(source, passes)
+            : source;
+
     QList<AST::ModulePtr> & modules = tree->modules;
 
     d->reset(tree, &data);
@@ -48,6 +48,8 @@ protected:
 private:
     class Generator * d;
     bool textMode_;
+    bool optimize_;
+    DebugLevel debugLevel_;
 
 
 
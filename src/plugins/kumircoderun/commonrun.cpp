@@ -40,8 +40,28 @@ ExternalModuleCallFunctor::~ExternalModuleCallFunctor()
     delete finishedMutex_;
 }
 
+ExternalModuleCallFunctor::ModuleHandle ExternalModuleCallFunctor::resolveModule
+(
+    const std::string & asciiModuleName
+)
+{
+    return Util::findActor(asciiModuleName);
+}
+
+AnyValue ExternalModuleCallFunctor::operator ()
+(
+    const std::string & asciiModuleName,
+    const String & moduleName,
+    const uint16_t algKey,
+    VariableReferencesList alist, Kumir::String * error
+)
+{
+    return (*this)(nullptr, asciiModuleName, moduleName, algKey, alist, error);
+}
+
 AnyValue ExternalModuleCallFunctor::operator ()
 (
+    ModuleHandle module,
     const std::string & asciiModuleName,
     const String & moduleName,
     const uint16_t algKey,
@@ -52,18 +72,21 @@ AnyValue ExternalModuleCallFunctor::operator ()
     finishedFlag_ = false;
 
     // Convert STL+Kumir into Qt value types
-    const QString qModuleName = QString::fromStdWString(moduleName);
     const quint16 qAlgKey = quint16(algKey);
     QVariantList arguments;
+    arguments.reserve(int(alist.size()));
     for (std::deque<Variable>::const_iterator it=alist.begin(); it!=alist.end(); ++it) {
         const QVariant qVal = Util::VariableToQVariant(*it);
         arguments.push_back(qVal);
     }
 
-    // Find an actor (or throw)
-    Shared::ActorInterface * actor = Util::findActor(asciiModuleName);
+    // Find an actor (or throw) unless resolved by VM before
+    Shared::ActorInterface * actor = module
+            ? static_cast<Shared::ActorInterface*>(module)
+            : Util::findActor(asciiModuleName);
 
     if (! actor) {
+        const QString qModuleName = QString::fromStdWString(moduleName);
         const String errorMessage = QString::fromUtf8(
                     "Нельзя вызвать алгоритм из %1: исполнитель не загружен"
                     ).arg(qModuleName).toStdWString();
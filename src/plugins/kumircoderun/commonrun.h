@@ -41,6 +41,14 @@ class ExternalModuleCallFunctor:
     Q_OBJECT
 public:
     explicit ExternalModuleCallFunctor(QObject * parent = 0);
+    ModuleHandle resolveModule(const std::string & asciiModuleName) _override;
+    AnyValue operator()(
+            ModuleHandle module,
+            const std::string & asciiModuleName,
+            const String & moduleName,
+            const uint16_t algKey,
+            VariableReferencesList alist, Kumir::String * error
+            )  _override;
     AnyValue operator()(
             const std::string & asciiModuleName,
             const String & moduleName,
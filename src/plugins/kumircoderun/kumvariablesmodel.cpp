@@ -16,6 +16,12 @@ namespace KumirCodeRun {
 
 static const int MAXIMUM_SHOWN_TABLE_ITEMS_COUNT = 255;
 
+// Dimensions of arrays longer than this are shown by pages
+static const int ARRAY_PAGE_SIZE = 100;
+
+// Views are updated not more often than 25 times per second
+static const int FLUSH_INTERVAL_MSEC = 40;
+
 KumVariablesModel::KumVariablesModel(
         std::shared_ptr<VM::KumirVM> vm,
         std::shared_ptr<VM::CriticalSectionLocker> mutex,
@@ -24,15 +30,28 @@ KumVariablesModel::KumVariablesModel(
         : QAbstractItemModel(parent)
         , _vm(vm)
         , mutex_(mutex)
+        , flushScheduled_(false)
+        , flushTimer_(new QTimer(this))
 {
+    flushTimer_->setSingleShot(true);
+    flushTimer_->setInterval(FLUSH_INTERVAL_MSEC);
+    connect(flushTimer_, SIGNAL(timeout()), this, SLOT(flushChanges()));
 }
 
 void KumVariablesModel::clear()
 {
     beginResetModel();
-    parents_.clear();
-    cache_.clear();
+    qDeleteAll(tableItems_);
+    qDeleteAll(variableItems_);
+    qDeleteAll(arrayItems_);
+    tableItems_.clear();
+    variableItems_.clear();
+    arrayItems_.clear();
+    arrayItemsByVariable_.clear();
     endResetModel();
+    QMutexLocker locker(&dirtyMutex_);
+    changedVariables_.clear();
+    initializedArrays_.clear();
 }
 
 QModelIndex KumVariablesModel::index(int row, int column, const QModelIndex &parent) const
@@ -50,13 +69,12 @@ QModelIndex KumVariablesModel::index(int row, int column, const QModelIndex &par
         if (parentItem->itemType() == KumVariableItem::GlobalsTable ||
                 parentItem->itemType() == KumVariableItem::LocalsTable)
         {
-            result = valueIndex(row, column, parentItem->table());
+            result = valueIndex(row, column, parentItem);
         }        
-        else if (parentItem->itemType() == KumVariableItem::Variable ||
-                 parentItem->itemType() == KumVariableItem::ArrayItem)
-        {
-            if (parentItem->variable()->dimension() > 0) {
-                result = arrayIndex(row, column, parentItem->variable(), parentItem->arrayIndeces());
+        else {
+            KumVariableItem * item = childItem(row, parentItem);
+            if (item) {
+                result = createIndex(row, column, item);
             }
         }
     }
@@ -72,8 +90,8 @@ QModelIndex KumVariablesModel::topLevelIndex(int row) const
     size_t globalsOffset = hasGlobals? 1u : 0u;
     KumVariableItem * result = nullptr;
     if (hasGlobals && row == 0) {
-        for (int i=0; i<cache_.size(); i++) {
-            KumVariableItem * item = cache_[i];
+        for (int i=0; i<tableItems_.size(); i++) {
+            KumVariableItem * item = tableItems_[i];
             if (item->itemType() == KumVariableItem::GlobalsTable) {
                 result = item;
                 break;
@@ -83,7 +101,7 @@ QModelIndex KumVariablesModel::topLevelIndex(int row) const
             mutex_->lock();
             result = new KumVariableItem(_vm->getMainModuleGlobals(), row);
             mutex_->unlock();
-            cache_.push_back(result);
+            tableItems_.push_back(result);
         }
     }
     else {
@@ -124,8 +142,8 @@ QModelIndex KumVariablesModel::topLevelIndex(int row) const
             }
         }
         mutex_->unlock();
-        for (int i=0; i<cache_.size(); i++) {
-            KumVariableItem * item = cache_[i];
+        for (int i=0; i<tableItems_.size(); i++) {
+            KumVariableItem * item = tableItems_[i];
             if (KumVariableItem::LocalsTable==item->itemType() &&
                     item->framePointer()==framePointer &&
                     item->name()==algorithmName)
@@ -137,14 +155,15 @@ QModelIndex KumVariablesModel::topLevelIndex(int row) const
         if (result == nullptr) {
             result = new KumVariableItem(locals, row, algorithmName);
             result->setFramePointer(framePointer);
-            cache_.push_back(result);
+            tableItems_.push_back(result);
         }
     }
     return createIndex(row, 0, result);
 }
 
-QModelIndex KumVariablesModel::valueIndex(int row, int column, TableOfVariables *table) const
+QModelIndex KumVariablesModel::valueIndex(int row, int column, KumVariableItem *tableItem) const
 {
+    TableOfVariables * table = tableItem->table();
     size_t indexInTable = size_t(row);
     mutex_->lock();
     size_t tableSize = table->size();
@@ -155,70 +174,91 @@ QModelIndex KumVariablesModel::valueIndex(int row, int column, TableOfVariables
     mutex_->lock();
     const VM::Variable * var = & table->at(indexInTable);
     mutex_->unlock();
-    KumVariableItem * result = nullptr;
-    for (int i=0; i<cache_.size(); i++) {
-        KumVariableItem * item = cache_[i];
-        if (item->itemType() == KumVariableItem::Variable &&
-                item->variable() == var)
-        {
-            result = item;
-            break;
-        }
-
-    }
+    // Items of finished algorithm calls are dropped when their rows
+    // are removed, so the item found belongs to this table
+    KumVariableItem * result = variableItems_.value(var, nullptr);
     if (result == nullptr) {
         result = new KumVariableItem(var, row, table);
-        cache_.push_back(result);
+        variableItems_[var] = result;
+    }
+    result->_parent = tableItem;
+    return createIndex(row, column, result);
+}
+
+KumVariableItem * KumVariablesModel::childItem(int row, KumVariableItem *parentItem) const
+{
+    const VM::Variable * variable = parentItem->variable();
+    if (variable == nullptr || row < 0) {
+        return nullptr;
     }
-    QModelIndex resultIndex;
-    if (modelIndeces_.contains(result)) {
-        resultIndex = modelIndeces_[result];
+    const QPair<KumVariableItem*,int> key(parentItem, row);
+    KumVariableItem * result = arrayItems_.value(key, nullptr);
+    if (result) {
+        return result;
+    }
+    if (parentItem->itemType() == KumVariableItem::ArrayPage) {
+        if (row > parentItem->_pageLast - parentItem->_pageFirst) {
+            return nullptr;
+        }
+        QVector<int> indeces = parentItem->arrayIndeces();
+        indeces.push_back(parentItem->_pageFirst + row);
+        result = new KumVariableItem(variable, row, indeces);
     }
     else {
-        resultIndex = createIndex(row, column, result);
-        modelIndeces_[result] = resultIndex;
+        const int level = parentItem->arrayIndeces().size();
+        if (int(variable->dimension()) <= level) {
+            return nullptr;
+        }
+        int bounds[7];
+        mutex_->lock();
+        variable->getEffectiveBounds(bounds);
+        mutex_->unlock();
+        const int first = bounds[2 * level];
+        const int last = bounds[2 * level + 1];
+        if (last - first + 1 > ARRAY_PAGE_SIZE) {
+            const int pageFirst = first + row * ARRAY_PAGE_SIZE;
+            if (pageFirst > last) {
+                return nullptr;
+            }
+            const int pageLast = qMin(pageFirst + ARRAY_PAGE_SIZE - 1, last);
+            result = new KumVariableItem(variable, row, parentItem->arrayIndeces(),
+                                         pageFirst, pageLast);
+        }
+        else {
+            if (first + row > last) {
+                return nullptr;
+            }
+            QVector<int> indeces = parentItem->arrayIndeces();
+            indeces.push_back(first + row);
+            result = new KumVariableItem(variable, row, indeces);
+        }
     }
-    return resultIndex;
+    result->_parent = parentItem;
+    arrayItems_.insert(key, result);
+    arrayItemsByVariable_.insert(variable, result);
+    return result;
 }
 
-QModelIndex KumVariablesModel::arrayIndex(
-        int row, int column,
-        const VM::Variable * variable,
-        const QVector<int> &prevIndeces
-        ) const
+int KumVariablesModel::childrenCount(const KumVariableItem *item) const
 {
-    QVector<int> newIndeces(prevIndeces.size() + 1);
-    ::memcpy(newIndeces.data(), prevIndeces.constData(), prevIndeces.size() * sizeof(int));
-    int bounds[7];
-    mutex_->lock();
-    variable->getEffectiveBounds(bounds);
-    mutex_->unlock();
-    int newIndex = row + bounds[2 * prevIndeces.size()];
-    newIndeces.last() = newIndex;
-    KumVariableItem * result = nullptr;
-    for (int i=0; i<cache_.size(); i++) {
-        KumVariableItem * item = cache_[i];
-        if (item->itemType() == KumVariableItem::ArrayItem &&
-                item->variable() == variable &&
-                item->arrayIndeces() == newIndeces)
-        {
-            result = item;
-            break;
-        }
+    if (item->itemType() == KumVariableItem::ArrayPage) {
+        return item->_pageLast - item->_pageFirst + 1;
     }
-    if (result == nullptr) {
-        result = new KumVariableItem(variable, row, newIndeces);
-        cache_.push_back(result);
+    const VM::Variable * variable = item->variable();
+    const int level = item->arrayIndeces().size();
+    if (variable == nullptr || int(variable->dimension()) <= level) {
+        return 0;
     }
-    QModelIndex resultIndex;
-    if (modelIndeces_.contains(result)) {
-        resultIndex = modelIndeces_[result];
+    if (item->itemType() == KumVariableItem::Variable && !variable->hasValue()) {
+        return 0;
     }
-    else {
-        resultIndex = createIndex(row, column, result);
-        modelIndeces_[result] = resultIndex;
+    int bounds[7];
+    variable->getEffectiveBounds(bounds);
+    const int count = bounds[2 * level + 1] - bounds[2 * level] + 1;
+    if (count > ARRAY_PAGE_SIZE) {
+        return (count + ARRAY_PAGE_SIZE - 1) / ARRAY_PAGE_SIZE;
     }
-    return resultIndex;
+    return qMax(0, count);
 }
 
 QModelIndex KumVariablesModel::parent(const QModelIndex &child) const
@@ -229,58 +269,10 @@ QModelIndex KumVariablesModel::parent(const QModelIndex &child) const
     KumVariableItem * item =
             static_cast<KumVariableItem*>(child.internalPointer());
 
-    if (item == nullptr) {
+    if (item == nullptr || item->parentItem() == nullptr) {
         return QModelIndex();
     }
-
-    if (item->itemType() == KumVariableItem::GlobalsTable ||
-            item->itemType() == KumVariableItem::LocalsTable)
-    {
-        return QModelIndex();
-    }
-    KumVariableItem * result = nullptr;
-    if (item->itemType() == KumVariableItem::Variable) {
-        for (int i=0; i<cache_.size(); i++) {
-            KumVariableItem * it = cache_[i];
-            if (it->itemType() == KumVariableItem::GlobalsTable ||
-                    it->itemType() == KumVariableItem::LocalsTable)
-            {
-                if (it->table() == item->table()) {
-                    result = it;
-                    break;
-                }
-            }
-        }
-    }
-    else if (item->itemType() == KumVariableItem::ArrayItem) {
-        QVector<int> indeces = item->arrayIndeces();
-        indeces.pop_back();
-        if (indeces.isEmpty()) {
-            for (int i=0; i<cache_.size(); i++) {
-                KumVariableItem * it = cache_[i];
-                if (it->itemType() == KumVariableItem::Variable
-                        && it->variable() == item->variable())
-                {
-                    result = it;
-                    break;
-                }
-            }
-        }
-        else {
-            for (int i=0; i<cache_.size(); i++) {
-                KumVariableItem * it = cache_[i];
-                if (it->itemType() == KumVariableItem::ArrayItem
-                        && it->variable() == item->variable()
-                        && it->arrayIndeces() == indeces
-                        )
-                {
-                    result = it;
-                    break;
-                }
-            }
-        }
-    }
-    return createIndex(result->numberInTable(), 0, result);
+    return itemIndex(item->parentItem());
 }
 
 int KumVariablesModel::rowCount(const QModelIndex &parent) const
@@ -324,28 +316,14 @@ int KumVariablesModel::rowCount(const QModelIndex &parent) const
         mutex_->unlock();
         return size;
     }
-    else if (item->itemType() == KumVariableItem::Variable && item->hasValue()) {
-        quint8 dim = item->variable()->dimension();
-        if (dim > 0) {
-            mutex_->lock();
-            int bounds[7];
-            item->variable()->getEffectiveBounds(bounds);
-            mutex_->unlock();
-            return bounds[1] - bounds[0] + 1;
-        }
-    }
-    else if (item->itemType() == KumVariableItem::ArrayItem) {
-        int dim = item->variable()->dimension();
-        int parentDim = item->arrayIndeces().size();
-        if (dim - parentDim > 0) {
-            mutex_->lock();
-            int bounds[7];
-            item->variable()->getEffectiveBounds(bounds);
-            mutex_->unlock();
-            return bounds[parentDim * 2 + 1] - bounds[parentDim * 2] + 1;
-        }
+    if (item->_rows < 0) {
+        // Count is remembered, so it changes in views only
+        // by row insertions and removals made on flush
+        mutex_->lock();
+        item->_rows = childrenCount(item);
+        mutex_->unlock();
     }
-    return 0;
+    return item->_rows;
 }
 
 int KumVariablesModel::columnCount(const QModelIndex &parent) const
@@ -434,6 +412,18 @@ QVariant KumVariablesModel::data(const QModelIndex &index, int role) const
                 return fnt;
             }
         }
+        else if (item->itemType() == KumVariableItem::ArrayPage) {
+            if (role == Qt::DisplayRole) {
+                mutex_->lock();
+                const QString text = item->name();
+                mutex_->unlock();
+                return text;
+            }
+            else if (role == Qt::FontRole) {
+                QFont fnt = mainEditorFont();
+                return fnt;
+            }
+        }
     }
     return QVariant();
 }
@@ -469,47 +459,142 @@ Qt::ItemFlags KumVariablesModel::flags(const QModelIndex & index) const
     return result;
 }
 
-void KumVariablesModel::emitValueChanged(
-        const VM::Variable &variable,
-        const QVector<int> &indeces
-        )
+void KumVariablesModel::noticeValueChanged(const VM::Variable &variable)
 {
-    QModelIndex modelIndex;
-    KumVariableItem * item = nullptr;
-    if (indeces.size() == 0) {
-        for (int i=0; i<cache_.size(); i++) {
-            KumVariableItem * it = cache_[i];
-            if (it->itemType() == KumVariableItem::Variable
-                    && it->variable() == &variable)
-            {
-                item = it;
-                break;
-            }
+    QMutexLocker locker(&dirtyMutex_);
+    changedVariables_.insert(&variable);
+    scheduleFlush();
+}
+
+void KumVariablesModel::noticeArrayInitialized(const VM::Variable &variable)
+{
+    QMutexLocker locker(&dirtyMutex_);
+    initializedArrays_.insert(&variable);
+    scheduleFlush();
+}
+
+static void removeVariablesInRange(QSet<const VM::Variable*> & variables,
+                                   const VM::Variable * first,
+                                   const VM::Variable * last)
+{
+    QSet<const VM::Variable*>::iterator it = variables.begin();
+    while (it != variables.end()) {
+        if (*it >= first && *it <= last)
+            it = variables.erase(it);
+        else
+            ++it;
+    }
+}
+
+void KumVariablesModel::forgetVariables(TableOfVariables *table)
+{
+    if (table == nullptr || table->empty()) {
+        return;
+    }
+    QMutexLocker locker(&dirtyMutex_);
+    removeVariablesInRange(changedVariables_, &table->front(), &table->back());
+    removeVariablesInRange(initializedArrays_, &table->front(), &table->back());
+}
+
+void KumVariablesModel::scheduleFlush()
+{
+    // dirtyMutex_ is locked by caller
+    if (!flushScheduled_) {
+        flushScheduled_ = true;
+        QMetaObject::invokeMethod(this, "startFlushTimer", Qt::QueuedConnection);
+    }
+}
+
+void KumVariablesModel::startFlushTimer()
+{
+    if (!flushTimer_->isActive()) {
+        flushTimer_->start();
+    }
+}
+
+void KumVariablesModel::flushChanges()
+{
+    QSet<const VM::Variable*> changed;
+    QSet<const VM::Variable*> initialized;
+    dirtyMutex_.lock();
+    changed.swap(changedVariables_);
+    initialized.swap(initializedArrays_);
+    flushScheduled_ = false;
+    dirtyMutex_.unlock();
+
+    foreach (const VM::Variable * variable, initialized) {
+        KumVariableItem * item = variableItems_.value(variable, nullptr);
+        if (item) {
+            updateArrayRows(item);
         }
+        changed.insert(variable);
     }
-    else {
-        for (int i=0; i<cache_.size(); i++) {
-            KumVariableItem * it = cache_[i];
-            if (it->itemType() == KumVariableItem::ArrayItem
-                    && it->variable() == &variable
-                    && it->arrayIndeces() == indeces
-                    )
-            {
-                item = it;
-                break;
-            }
+    foreach (const VM::Variable * variable, changed) {
+        KumVariableItem * item = variableItems_.value(variable, nullptr);
+        if (item) {
+            const QModelIndex index = itemIndex(item);
+            emit dataChanged(index, index);
+        }
+        const QList<KumVariableItem*> elements = arrayItemsByVariable_.values(variable);
+        foreach (KumVariableItem * element, elements) {
+            const QModelIndex index = itemIndex(element);
+            emit dataChanged(index, index);
         }
     }
-    if (item && modelIndeces_.contains(item)) {
-        modelIndex = modelIndeces_[item];
+}
+
+void KumVariablesModel::updateArrayRows(KumVariableItem *item)
+{
+    const int shownRows = item->_rows;
+    const QModelIndex index = itemIndex(item);
+    if (shownRows > 0) {
+        beginRemoveRows(index, 0, shownRows - 1);
+        item->_rows = 0;
+        endRemoveRows();
+    }
+    dropArrayItems(item->variable());
+    if (shownRows < 0) {
+        return;  // views never asked for children
+    }
+    mutex_->lock();
+    const int rows = childrenCount(item);
+    mutex_->unlock();
+    if (rows > 0) {
+        beginInsertRows(index, 0, rows - 1);
+        item->_rows = rows;
+        endInsertRows();
+    }
+}
+
+void KumVariablesModel::dropTableItems(TableOfVariables *table)
+{
+    // Called between begin and end of removal of table rows,
+    // so views do not refer to these items any more
+    QHash<const VM::Variable*, KumVariableItem*>::iterator it = variableItems_.begin();
+    while (it != variableItems_.end()) {
+        if (it.value()->table() == table) {
+            dropArrayItems(it.key());
+            delete it.value();
+            it = variableItems_.erase(it);
+        }
+        else {
+            ++it;
+        }
     }
-    if (modelIndex.isValid()) {
-        emit dataChanged(modelIndex, modelIndex);
+    for (int i=tableItems_.size()-1; i>=0; i--) {
+        if (tableItems_[i]->table() == table) {
+            delete tableItems_.takeAt(i);
+        }
     }
-    if (indeces.size() > 0) {
-        QVector<int> lessIndeces(indeces.size() - 1);
-        ::memcpy(lessIndeces.data(), indeces.constData(), (indeces.size()-1) * sizeof(int));
-        emitValueChanged(variable, lessIndeces);
+}
+
+void KumVariablesModel::dropArrayItems(const VM::Variable *variable) const
+{
+    const QList<KumVariableItem*> items = arrayItemsByVariable_.values(variable);
+    arrayItemsByVariable_.remove(variable);
+    foreach (KumVariableItem * item, items) {
+        arrayItems_.remove(qMakePair(item->parentItem(), item->numberInTable()));
+        delete item;
     }
 }
 
@@ -567,6 +652,15 @@ QString KumVariableItem::name() const
         }
         result += "]";
     }
+    else if (_type == ArrayPage) {
+        result = QString::fromStdWString(_variable->myName());
+        result += "[";
+        for (int i=0; i<_indeces.size(); i++) {
+            result += QString::number(_indeces[i]) + ",";
+        }
+        result += QString::number(_pageFirst) + ":" + QString::number(_pageLast);
+        result += "]";
+    }
     else if (_type == LocalsTable) {
         result = _algorithmName;
     }
@@ -798,6 +892,10 @@ KumVariableItem::KumVariableItem(TableOfVariables *table, int row)
     , _table(table)
     , _tableNumber(row)
     , _framePointer(0)
+    , _parent(nullptr)
+    , _rows(-1)
+    , _pageFirst(0)
+    , _pageLast(0)
 {
 }
 
@@ -808,6 +906,10 @@ KumVariableItem::KumVariableItem(TableOfVariables *table, int row, const QString
     , _tableNumber(row)
     , _algorithmName(name)
     , _framePointer(0)
+    , _parent(nullptr)
+    , _rows(-1)
+    , _pageFirst(0)
+    , _pageLast(0)
 {
 }
 
@@ -818,6 +920,10 @@ KumVariableItem::KumVariableItem(const VM::Variable *variable, int row,
     , _table(table)
     , _tableNumber(row)
     , _framePointer(0)
+    , _parent(nullptr)
+    , _rows(-1)
+    , _pageFirst(0)
+    , _pageLast(0)
 {
 }
 
@@ -829,6 +935,26 @@ KumVariableItem::KumVariableItem(const VM::Variable *variable, int row,
     , _tableNumber(row)
     , _indeces(indeces)
     , _framePointer(0)
+    , _parent(nullptr)
+    , _rows(-1)
+    , _pageFirst(0)
+    , _pageLast(0)
+{
+}
+
+KumVariableItem::KumVariableItem(const VM::Variable *variable, int row,
+                                 const QVector<int> &indeces,
+                                 int pageFirst, int pageLast)
+    : _type(ArrayPage)
+    , _variable(variable)
+    , _table(nullptr)
+    , _tableNumber(row)
+    , _indeces(indeces)
+    , _framePointer(0)
+    , _parent(nullptr)
+    , _rows(-1)
+    , _pageFirst(pageFirst)
+    , _pageLast(pageLast)
 {
 }
 
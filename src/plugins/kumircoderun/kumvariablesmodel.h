@@ -10,6 +10,9 @@
 #include <QString>
 #include <QVariant>
 #include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QTimer>
 
 namespace KumirCodeRun {
 
@@ -19,7 +22,7 @@ class KumVariableItem {
     friend class KumVariablesModel;
 public:
     enum Type {
-        GlobalsTable, LocalsTable, Variable, ArrayItem
+        GlobalsTable, LocalsTable, Variable, ArrayItem, ArrayPage
     };
     inline Type itemType() const { return _type; }
     inline int numberInTable() const { return _tableNumber; }
@@ -34,6 +37,7 @@ public:
     bool isReference() const;
     inline quint64 framePointer() const { return _framePointer; }
     inline void setFramePointer(quint64 p) { _framePointer = p; }
+    inline KumVariableItem * parentItem() const { return _parent; }
 private:
     explicit KumVariableItem(TableOfVariables * table, int row);
     explicit KumVariableItem(TableOfVariables * table, int row,
@@ -42,6 +46,9 @@ private:
                              TableOfVariables * table);
     explicit KumVariableItem(const VM::Variable * variable, int row,
                              const QVector<int> & indeces);
+    explicit KumVariableItem(const VM::Variable * variable, int row,
+                             const QVector<int> & indeces,
+                             int pageFirst, int pageLast);
 
     QString array1Representation(const QVector<int> & indeces, int maxItems, int & readItems) const;
     QString array2Representation(const QVector<int> & indeces, int maxItems, int & readItems) const;
@@ -54,6 +61,10 @@ private:
     QVector<int> _indeces;
     QString _algorithmName;
     quint64 _framePointer;
+    KumVariableItem * _parent;
+    int _rows;  // count of children known to views or -1
+    int _pageFirst;
+    int _pageLast;
 };
 
 class KumVariablesModel : public QAbstractItemModel
@@ -76,21 +87,47 @@ protected:
                                std::shared_ptr<VM::CriticalSectionLocker> mutex,
                                QObject *parent = 0);
 
-    QModelIndex valueIndex(int row, int column, TableOfVariables * table) const;
-    QModelIndex arrayIndex(int row, int column, const VM::Variable * variable, const QVector<int> & prevIndeces) const;
+    QModelIndex valueIndex(int row, int column, KumVariableItem * tableItem) const;
     QModelIndex topLevelIndex(int row) const;
 
     void clear();
-    void emitValueChanged(const VM::Variable & variable, const QVector<int> & indeces);
+
+    // Called from VM thread. Changes are collected and shown
+    // in views not more often than once per flush interval
+    void noticeValueChanged(const VM::Variable & variable);
+    void noticeArrayInitialized(const VM::Variable & variable);
+    void forgetVariables(TableOfVariables * table);
+    void dropTableItems(TableOfVariables * table);
+
+private slots:
+    void startFlushTimer();
+    void flushChanges();
 
 private:
     QFont mainEditorFont() const;
+    void scheduleFlush();
+    void updateArrayRows(KumVariableItem * item);
+    void dropArrayItems(const VM::Variable * variable) const;
+    int childrenCount(const KumVariableItem * item) const;
+    KumVariableItem * childItem(int row, KumVariableItem * parentItem) const;
+    inline QModelIndex itemIndex(KumVariableItem * item) const {
+        return createIndex(item->numberInTable(), 0, item);
+    }
 
     std::shared_ptr<VM::KumirVM> _vm;
     std::shared_ptr<VM::CriticalSectionLocker> mutex_;
-    QHash<QModelIndex, QModelIndex> parents_;
-    mutable QList<KumVariableItem*> cache_;
-    mutable QHash<KumVariableItem*, QModelIndex> modelIndeces_;
+    mutable QList<KumVariableItem*> tableItems_;
+    mutable QHash<const VM::Variable*, KumVariableItem*> variableItems_;
+    // Array elements and pages are created on demand, only for rows
+    // requested by views, and looked up by parent item and row
+    mutable QHash<QPair<KumVariableItem*,int>, KumVariableItem*> arrayItems_;
+    mutable QMultiHash<const VM::Variable*, KumVariableItem*> arrayItemsByVariable_;
+
+    QMutex dirtyMutex_;
+    QSet<const VM::Variable*> changedVariables_;
+    QSet<const VM::Variable*> initializedArrays_;
+    bool flushScheduled_;
+    QTimer * flushTimer_;
 };
 
 
@@ -141,8 +141,14 @@ void Run::debuggerReset()
 
 void Run::debuggerNoticeBeforePopContext()
 {
+    const VM::Context & context = vm->callStack().top();
+    _variablesModel->forgetVariables(&context.locals);
     int index = _variablesModel->rowCount(QModelIndex()) - 1;
     _variablesModel->beginRemoveRows(QModelIndex(), index, index);
+    // Locals of next call may get the same addresses
+    if (context.type == Bytecode::EL_FUNCTION) {
+        _variablesModel->dropTableItems(&context.locals);
+    }
 }
 
 void Run::debuggerNoticeAfterPopContext()
@@ -164,40 +170,19 @@ void Run::debuggerNoticeAfterPushContext()
 void Run::debuggerNoticeBeforeArrayInitialize(const Variable & variable,
                                               const int bounds[7])
 {
-    int firstStart = bounds[0];
-    int firstEnd = bounds[1];
-    int count = firstEnd - firstStart + 1;
-    QModelIndex variableIndex;
-    KumVariableItem * item = nullptr;
-    for (int i=0; i<_variablesModel->cache_.size(); i++) {
-        KumVariableItem * it = _variablesModel->cache_[i];
-        if (it->itemType() == KumVariableItem::Variable) {
-            if (it->variable() == &variable) {
-                item = it;
-                break;
-            }
-        }
-    }
-    if (item && _variablesModel->modelIndeces_.contains(item)) {
-        variableIndex = _variablesModel->modelIndeces_[item];
-    }
-    _variablesModel->beginInsertRows(variableIndex, 0, count - 1);
+    // Rows of array are replaced by variables model on next flush
+    Q_UNUSED(variable);
+    Q_UNUSED(bounds);
 }
 
 void Run::debuggerNoticeAfterArrayInitialize(const Variable & variable)
 {
-    _variablesModel->endInsertRows();
-    _variablesModel->emitValueChanged(variable, QVector<int>());
+    _variablesModel->noticeArrayInitialized(variable);
 }
 
 void Run::debuggerNoticeOnValueChanged(const Variable & variable, const int * indeces)
 {
-    QVector<int> ind = indeces==nullptr
-            ? QVector<int>()
-            : QVector<int>(indeces[3]);
-    if (ind.size() > 0)
-        ::memcpy(ind.data(), indeces, indeces[3] * sizeof(int));
-    _variablesModel->emitValueChanged(variable, ind);
+    _variablesModel->noticeValueChanged(variable);
 }
 
 void Run::debuggerNoticeOnBreakpointHit(const String &filename, const quint32 lineNo)
@@ -317,11 +302,10 @@ void Run::removeAllBreakpoints()
     vm->removeAllBreakpoints();
 }
 
-void Run::insertOrChangeBreakpoint(bool enabled, const QString &fileName, quint32 lineNo, quint32 ignoreCount, const QString &condition)
+void Run::insertOrChangeBreakpoint(bool enabled, const QString &fileName, quint32 lineNo, quint32 ignoreCount, const Bytecode::Data &condition)
 {
     const String wFileName = fileName.toStdWString();
-    const String wCondition = condition.toStdWString();
-    vm->insertOrChangeBreakpoint(enabled, wFileName, lineNo, ignoreCount, wCondition);
+    vm->insertOrChangeBreakpoint(enabled, wFileName, lineNo, ignoreCount, condition);
 }
 
 void Run::insertSingleHitBreakpoint(const QString &fileName, quint32 lineNo)
@@ -378,12 +362,12 @@ int Run::effectiveLineNo() const
     return vm->effectiveLineNo();
 }
 
-bool Run::loadProgramFromBinaryBuffer(std::list<char> &stream, const String & filename)
+bool Run::loadProgramFromImage(const std::shared_ptr<const Bytecode::Image> & image, const String & filename)
 {
     breakpoints_.clear();
     Kumir::EncodingError encodingError;
     String errorMessage;
-    bool ok = vm->loadProgramFromBinaryBuffer(stream, true, filename, errorMessage);
+    bool ok = vm->loadProgramFromImage(image, true, filename, errorMessage);
     if (!ok) {
         std::string msg;
 #if defined(WIN32) || defined(_WIN32)
@@ -63,7 +63,7 @@ public:
 
     // VM Access methods
     int effectiveLineNo() const;
-    bool loadProgramFromBinaryBuffer(std::list<char> & stream, const String & filename);
+    bool loadProgramFromImage(const std::shared_ptr<const Bytecode::Image> & image, const String & filename);
     inline void setProgramDirectory(const QString & dirName) { vm->setProgramDirectory(dirName.toStdWString()); }
     QString error() const;
     bool hasTestingAlgorithm() const;
@@ -115,7 +115,7 @@ public slots:
     void handlePauseRequest();
 
     void removeAllBreakpoints();
-    void insertOrChangeBreakpoint(bool enabled, const QString &fileName, quint32 lineNo, quint32 ignoreCount, const QString &condition);
+    void insertOrChangeBreakpoint(bool enabled, const QString &fileName, quint32 lineNo, quint32 ignoreCount, const Bytecode::Data &condition);
     void insertSingleHitBreakpoint(const QString &fileName, quint32 lineNo);
     void removeBreakpoint(const QString &fileName, quint32 lineNo);
 
@@ -17,6 +17,10 @@
 #include <QtGui>
 #endif
 
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
 namespace KumirCodeRun {
 
 struct CommonFunctors {
@@ -96,10 +100,9 @@ bool KumirRunPlugin::loadProgram(const RunnableProgram &program)
     const QString programFileName = program.sourceFileName.isEmpty()
             ? program.executableFileName : program.sourceFileName;
     bool ok = false;
-    std::list<char> buffer;
-    for (int i=0; i<program.executableData.size(); i++)
-        buffer.push_back(program.executableData[i]);
-    ok = pRun_->loadProgramFromBinaryBuffer(buffer, programFileName.toStdWString());
+    const std::shared_ptr<const Bytecode::Image> image = Bytecode::Image::fromBuffer(
+                program.executableData.constData(), program.executableData.size());
+    ok = pRun_->loadProgramFromImage(image, programFileName.toStdWString());
     if (!ok) {
         return ok;
     }    
@@ -107,6 +110,8 @@ bool KumirRunPlugin::loadProgram(const RunnableProgram &program)
             ? "" : QFileInfo(programFileName).absoluteDir().absolutePath();
     pRun_->setProgramDirectory(programDirName);
     pRun_->programLoaded = ok;
+    programSource_ = program.sourceData;
+    programDirName_ = programDirName;
     return ok;
 }
 
@@ -452,7 +457,26 @@ void KumirRunPlugin::removeAllBreakpoints()
 
 void KumirRunPlugin::insertOrChangeBreakpoint(bool enabled, const QString &fileName, quint32 lineNo, quint32 ignoreCount, const QString &condition)
 {
-    pRun_->insertOrChangeBreakpoint(enabled, fileName, lineNo, ignoreCount, condition);
+    Bytecode::Data compiledCondition;
+    if (!condition.trimmed().isEmpty()) {
+        // Condition is compiled against program source, which is given
+        // only by hosts setting RunnableProgram::sourceData
+        if (programSource_.isEmpty()) {
+            emit errorOutputRequest(
+                        tr("Condition of breakpoint at line %1 is ignored, breakpoint always stops: program source is not available")
+                        .arg(lineNo + 1));
+        }
+        else {
+            compiledCondition = Util::compileBreakpointCondition(
+                        programSource_, programDirName_, lineNo, condition.trimmed());
+            if (compiledCondition.d.empty()) {
+                emit errorOutputRequest(
+                            tr("Condition of breakpoint at line %1 is not correct, breakpoint always stops: %2")
+                            .arg(lineNo + 1).arg(condition.trimmed()));
+            }
+        }
+    }
+    pRun_->insertOrChangeBreakpoint(enabled, fileName, lineNo, ignoreCount, compiledCondition);
 }
 
 void KumirRunPlugin::insertSingleHitBreakpoint(const QString &fileName, quint32 lineNo)
@@ -583,6 +607,15 @@ void KumirRunPlugin::prepareConsoleRun()
 
     console_->getMainArgument.init(arguments);
 
+    // Show output line by line in terminal, otherwise write it in blocks
+#ifdef Q_OS_UNIX
+    const bool lineBuffered = isatty(STDOUT_FILENO);
+#else
+    const bool lineBuffered = false;
+#endif
+    Kumir::Files::getStdOutBuffer(localeEncoding)->setBuffering(
+                lineBuffered, Kumir::FileOutputBuffer::DefaultCapacity, 500);
+
     console_->reset.setCallFunctor(&common_->call);
 
     pRun_->vm->setFunctor(&console_->reset);
@@ -666,8 +699,12 @@ void KumirRunPlugin::runProgramInCurrentThread(bool useTestingEntryPoint)
     }
     pRun_->vm->setConsoleInputBuffer(simulatedInputBuffer_? simulatedInputBuffer_ : defaultInputBuffer_);
     pRun_->vm->setConsoleOutputBuffer(simulatedOutputBuffer_? simulatedOutputBuffer_ : defaultOutputBuffer_);
+    // Same program is usually run many times here (checking by tests),
+    // so evaluate modules initialization only once
+    pRun_->vm->setInitSnapshotEnabled(true);
     pRun_->reset();
     pRun_->runInCurrentThread();
+    pRun_->vm->setInitSnapshotEnabled(false);
     checkForErrorInConsole();
 }
 
@@ -809,6 +846,7 @@ void KumirRunPlugin::timerEvent(QTimerEvent *event) {
 
 void KumirRunPlugin::checkForErrorInConsole()
 {
+    Kumir::Files::flushOutputBuffers();
     if (pRun_->error().length() > 0) {
         const QString message = pRun_->effectiveLineNo() != -1
                 ?
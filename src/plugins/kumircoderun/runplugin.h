@@ -133,6 +133,9 @@ private:
     Gui::SimulatedOutputBuffer * simulatedOutputBuffer_;
     Kumir::AbstractOutputBuffer * defaultOutputBuffer_;
 
+    QString programSource_; // breakpoint conditions are compiled against
+    QString programDirName_;
+
 
 };
 
@@ -2,6 +2,8 @@
 #include "util.h"
 
 #include <kumir2-libs/extensionsystem/pluginmanager.h>
+#include <kumir2/analizerinterface.h>
+#include <kumir2/generatorinterface.h>
 
 namespace KumirCodeRun {
 namespace Util {
@@ -131,6 +133,120 @@ ActorInterface* findActor(const QByteArray & qModuleName, bool allowLoad)
     return actor;
 }
 
+Bytecode::Data compileBreakpointCondition(const QString & programSource,
+                                          const QString & sourceDirName,
+                                          quint32 lineNo,
+                                          const QString & condition)
+{
+    using namespace ExtensionSystem;
+    using namespace Bytecode;
+
+    Data result;
+    AnalizerInterface * analizer =
+            PluginManager::instance()->findPlugin<AnalizerInterface>("KumirAnalizer");
+    GeneratorInterface * generator =
+            PluginManager::instance()->findPlugin<GeneratorInterface>("KumirCodeGenerator");
+    if (!analizer || !generator || programSource.isEmpty()) {
+        return result;
+    }
+
+    // Condition is compiled as assertion inserted before breakpoint line,
+    // so its names mean the same as in the line, and generated code
+    // refers to variables and algorithms by the same ids as the program
+    const Analizer::SourceFileInterface::Data source =
+            analizer->sourceFileHandler()->fromString(programSource);
+    QStringList lines = source.visibleText.split("\n", QString::KeepEmptyParts);
+    if (source.hasHiddenText) {
+        lines += source.hiddenText.split("\n", QString::KeepEmptyParts);
+    }
+    if (int(lineNo) > lines.size()) {
+        return result;
+    }
+    lines.insert(int(lineNo), QString::fromUtf8("утв (%1)").arg(condition));
+
+    Analizer::InstanceInterface * instance = analizer->createInstance();
+    instance->setSourceDirName(sourceDirName);
+    instance->setSourceText(lines.join("\n"));
+    bool correct = instance->compiler() != nullptr;
+    const QList<Analizer::Error> errors = instance->errors();
+    for (int i=0; i<errors.size(); i++) {
+        if (errors[i].line == int(lineNo)) {
+            correct = false;
+        }
+    }
+    QByteArray bytes;
+    if (correct) {
+        QString mimeType, fileSuffix;
+        generator->setOutputToText(false);
+        generator->setDebugLevel(GeneratorInterface::LinesOnly);
+        generator->generateExecutable(instance->compiler()->abstractSyntaxTree(),
+                                      bytes, mimeType, fileSuffix);
+    }
+    delete instance;
+    if (bytes.isEmpty()) {
+        return result;
+    }
+    Data program;
+    std::list<char> stream(bytes.constData(), bytes.constData()+bytes.size());
+    bytecodeFromDataStream(stream, program);
+
+    // Assertion is generated as: LINE, column LINE, condition calculation,
+    // POP, SHOWREG, JNZ and ERRORR; calculation is taken from there
+    for (size_t i=0; i<program.d.size(); i++) {
+        const TableElem & e = program.d[i];
+        if (e.type==EL_CONST) {
+            result.d.push_back(e);
+        }
+    }
+    for (size_t i=0; i<program.d.size(); i++) {
+        const TableElem & e = program.d[i];
+        if (e.type!=EL_FUNCTION && e.type!=EL_MAIN && e.type!=EL_TESTING && e.type!=EL_INIT) {
+            continue;
+        }
+        const std::vector<Instruction> & instrs = e.instructions;
+        size_t start = 0;
+        while (start<instrs.size() && !(instrs[start].type==LINE
+                                         && (instrs[start].scope & COLUMN_START_AND_END)==0
+                                         && instrs[start].arg==lineNo))
+        {
+            start ++;
+        }
+        if (start==instrs.size()) {
+            continue;
+        }
+        start ++;
+        if (start<instrs.size() && instrs[start].type==LINE) {
+            start ++;
+        }
+        size_t end = start;
+        while (end<instrs.size() && instrs[end].type!=ERRORR) {
+            end ++;
+        }
+        if (end==instrs.size() || end<start+4
+                || instrs[end-3].type!=POP || instrs[end-2].type!=SHOWREG
+                || instrs[end-1].type!=JNZ)
+        {
+            break;
+        }
+        TableElem function = e;
+        function.instructions.assign(instrs.begin()+start, instrs.begin()+(end-3));
+        const size_t length = function.instructions.size();
+        for (size_t j=0; j<length; j++) {
+            Instruction & instr = function.instructions[j];
+            // Jumps of short circuit calculations are relative to function
+            if (instr.type==JUMP || instr.type==JZ || instr.type==JNZ) {
+                if (instr.arg<start || instr.arg>start+length) {
+                    return Data();
+                }
+                instr.arg -= start;
+            }
+        }
+        result.d.push_back(function);
+        return result;
+    }
+    return Data();
+}
+
 
 }} // namespaces
 
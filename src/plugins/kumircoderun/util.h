@@ -3,6 +3,7 @@
 
 #define DO_NOT_DECLARE_STATIC
 #include <kumir2-libs/vm/variant.hpp>
+#include <kumir2-libs/vm/vm_bytecode.hpp>
 #include <kumir2/actorinterface.h>
 #include <QVariant>
 
@@ -20,6 +21,15 @@ AnyValue QVariantToValue(const QVariant & var, int dim);
 ActorInterface* findActor(const std::string & moduleAsciiName, bool allowLoad = true);
 ActorInterface* findActor(const QByteArray & moduleAsciiName, bool allowLoad = true);
 
+/** Compiles condition of breakpoint at line lineNo of program source
+ *  by Kumir analizer and generator into data accepted by
+ *  KumirVM::insertOrChangeBreakpoint. Returns empty data if condition
+ *  is not correct in context of the line, so breakpoint stops always */
+Bytecode::Data compileBreakpointCondition(const QString & programSource,
+                                          const QString & sourceDirName,
+                                          quint32 lineNo,
+                                          const QString & condition);
+
 class SleepFunctions: private QThread
 {
 public:
@@ -6,6 +6,8 @@
 #include "plugins/kumiranalizer/kumiranalizerplugin.h"
 #include <kumir2/generatorinterface.h>
 #include <kumir2-libs/dataformats/kumfile.h>
+#include <kumir2-libs/dataformats/bytecodecache.h>
+#include <kumir2/actorinterface.h>
 #include <kumir2-libs/stdlib/kumirstdlib.hpp>
 #include <kumir2-libs/vm/variant.hpp>
 #include <kumir2-libs/vm/vm_bytecode.hpp>
@@ -17,6 +19,8 @@ using namespace KumirAnalizer;
 
 typedef Shared::GeneratorInterface::DebugLevel DebugLevel;
 
+static const QString MIME_BYTECODE_BINARY = QString::fromLatin1("executable/kumir2-bytecode");
+
 KumirCompilerToolPlugin::KumirCompilerToolPlugin()
     : KPlugin()
     , analizer_(nullptr)
@@ -92,6 +96,20 @@ QString KumirCompilerToolPlugin::initialize(
 
 #include <iostream>
 
+QByteArray KumirCompilerToolPlugin::compilerOptions()
+{
+    // Options of all the plugins are passed by command line,
+    // options of output only do not affect executable
+    QStringList options;
+    const QStringList arguments = qApp->arguments();
+    for (int i=1; i<arguments.size(); i++) {
+        const QString & arg = arguments[i];
+        if (arg.startsWith("-") && !arg.startsWith("-o=") && !arg.startsWith("--out=")) {
+            options << arg;
+        }
+    }
+    return options.join("\n").toUtf8();
+}
 
 void KumirCompilerToolPlugin::start()
 {
@@ -108,25 +126,49 @@ void KumirCompilerToolPlugin::start()
         Shared::Analizer::SourceFileInterface::Data kumFile;
         kumFile = analizer_->sourceFileHandler()->fromBytes(fileData, sourceFileEncoding_);
         kumFile.sourceUrl = QUrl::fromLocalFile(sourceFileName_);
+        const QString sourceText = kumFile.visibleText + "\n" + kumFile.hiddenText;
 
-        Shared::Analizer::InstanceInterface * analizer =
-                analizer_->createInstance();
-
-        QString dirname = QFileInfo(filename).absoluteDir().absolutePath();
-        analizer->setSourceDirName(dirname);
-        analizer->setSourceText(kumFile.visibleText + "\n" + kumFile.hiddenText);
-        QList<Shared::Analizer::Error> errors = analizer->errors();
-        AST::DataPtr ast = analizer->compiler()->abstractSyntaxTree();
-        foreach (AST::ModulePtr mod, ast->modules) {
-            if (mod->header.type != AST::ModTypeCached &&
-                    mod->header.type != AST::ModTypeExternal)
-            {
-                mod->header.sourceFileName = QFileInfo(sourceFileName_).fileName();
+        const QString baseName = QFileInfo(filename).completeBaseName();
+
+        QString suffix;
+        QString mimeType;
+        QByteArray outData;
+        QList<Shared::Analizer::Error> errors;
+
+        // Unchanged programs without errors are taken from cache
+        // as is, without analysis and code generation
+        const BytecodeCache cache;
+        const QByteArray cacheKey = cache.isEnabled()
+                ? BytecodeCache::sourceKey(sourceText, filename, compilerOptions())
+                : QByteArray();
+        const QList<Shared::ActorInterface*> actors =
+                ExtensionSystem::PluginManager::instance()->findPlugins<Shared::ActorInterface>();
+        if (cache.find(cacheKey, actors, outData)) {
+            mimeType = MIME_BYTECODE_BINARY;
+            suffix = ".kod";
+        }
+        else {
+            Shared::Analizer::InstanceInterface * analizer =
+                    analizer_->createInstance();
+
+            QString dirname = QFileInfo(filename).absoluteDir().absolutePath();
+            analizer->setSourceDirName(dirname);
+            analizer->setSourceText(sourceText);
+            errors = analizer->errors();
+            AST::DataPtr ast = analizer->compiler()->abstractSyntaxTree();
+            foreach (AST::ModulePtr mod, ast->modules) {
+                if (mod->header.type != AST::ModTypeCached &&
+                        mod->header.type != AST::ModTypeExternal)
+                {
+                    mod->header.sourceFileName = QFileInfo(sourceFileName_).fileName();
+                }
+            }
+            generator_->generateExecutable(ast, outData, mimeType, suffix);
+            if (errors.isEmpty() && MIME_BYTECODE_BINARY == mimeType) {
+                cache.store(cacheKey, ast, analizer->compiler()->includedFiles(), outData);
             }
         }
 
-        const QString baseName = QFileInfo(filename).completeBaseName();
-
         for (int i=0; i<errors.size(); i++) {
             Shared::Analizer::Error e = errors[i];
             QString errorMessage = tr("Error: ") +
@@ -143,15 +185,16 @@ void KumirCompilerToolPlugin::start()
             std::cerr << std::endl;
         }
 
-        QString suffix;
-        QString mimeType;
-        QByteArray outData;
-        generator_->generateExecutable(ast, outData, mimeType, suffix);
-
         if (qApp->property("returnCode").toInt() != 0) {
             return;
         }
 
+        if (mimeType.isEmpty()) {
+            // Generator has already run the program itself
+            // and set its exit status as return code
+            return;
+        }
+
         QString outFileName = QFileInfo(filename).dir().absoluteFilePath(baseName+suffix);
 
         if (outFileName_.length() > 0)
@@ -161,16 +204,22 @@ void KumirCompilerToolPlugin::start()
         if (!outFileName.endsWith(suffix))
             outFileName += suffix;
 
-        QFile binOut(outFileName);
+        // File is replaced by rename, not rewritten in place: running
+        // programs keep their mapped copy of previous module version
+        const QString tempFileName = outFileName + "." +
+                QString::number(QCoreApplication::applicationPid()) + ".tmp";
+        QFile binOut(tempFileName);
 
         binOut.open(QIODevice::WriteOnly);
         binOut.write(outData);
         binOut.close();
-        if (mimeType.startsWith("executable") && QFile::exists(outFileName)) {
+        if (mimeType.startsWith("executable") && QFile::exists(tempFileName)) {
             QFile::Permissions ps = binOut.permissions();
             ps |= QFile::ExeGroup | QFile::ExeOwner | QFile::ExeOther;
-            QFile::setPermissions(outFileName, ps);
+            QFile::setPermissions(tempFileName, ps);
         }
+        QFile::remove(outFileName);
+        QFile::rename(tempFileName, outFileName);
         qApp->setProperty("returnCode", errors.isEmpty()? 0 : 1);
     }
     else {
@@ -29,6 +29,7 @@ public:
 protected:
     void createPluginSpec();
 private:
+    static QByteArray compilerOptions();
 
     Shared::AnalizerInterface * analizer_;
     Shared::GeneratorInterface * generator_;
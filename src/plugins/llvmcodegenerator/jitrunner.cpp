@@ -0,0 +1,272 @@
+#include "jitrunner.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include <llvm/Config/llvm-config.h>
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/ObjectCache.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+
+#include <llvm/Support/DynamicLibrary.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/TargetSelect.h>
+
+#include <list>
+#include <vector>
+#include <memory>
+#include <string>
+
+#if LLVM_VERSION_MAJOR == 3 && LLVM_VERSION_MINOR < 6
+#define KUMIR_LLVM_RAW_POINTERS_API
+#endif
+
+namespace LLVMCodeGenerator {
+
+/* Stores object produced by MCJIT into a file named by hash
+ * of module bitcode and gives it back on the next run */
+class JitObjectCache
+        : public llvm::ObjectCache
+{
+public:
+    explicit JitObjectCache(const QString & fileName)
+        : fileName_(fileName)
+        , hit_(false)
+    {}
+
+    inline bool hit() const { return hit_; }
+
+#ifdef KUMIR_LLVM_RAW_POINTERS_API
+    void notifyObjectCompiled(const llvm::Module *, const llvm::MemoryBuffer * obj)
+    {
+        store(obj->getBufferStart(), obj->getBufferSize());
+    }
+
+    llvm::MemoryBuffer* getObject(const llvm::Module *)
+    {
+        const QByteArray data = load();
+        if (data.isEmpty())
+            return 0;
+        hit_ = true;
+        return llvm::MemoryBuffer::getMemBufferCopy(
+                    llvm::StringRef(data.constData(), data.size()));
+    }
+#else
+    void notifyObjectCompiled(const llvm::Module *, llvm::MemoryBufferRef obj)
+    {
+        store(obj.getBufferStart(), obj.getBufferSize());
+    }
+
+    std::unique_ptr<llvm::MemoryBuffer> getObject(const llvm::Module *)
+    {
+        const QByteArray data = load();
+        if (data.isEmpty())
+            return std::unique_ptr<llvm::MemoryBuffer>();
+        hit_ = true;
+        return llvm::MemoryBuffer::getMemBufferCopy(
+                    llvm::StringRef(data.constData(), data.size()));
+    }
+#endif
+
+private:
+    QByteArray load() const
+    {
+        if (fileName_.isEmpty())
+            return QByteArray();
+        QFile f(fileName_);
+        if (!f.open(QIODevice::ReadOnly))
+            return QByteArray();
+        return f.readAll();
+    }
+
+    void store(const char * data, size_t size) const
+    {
+        if (fileName_.isEmpty() || hit_)
+            return;
+        QDir().mkpath(QFileInfo(fileName_).absolutePath());
+        // Write to temporary file first, so concurrent runs never
+        // see partially written object
+        const QString tmpName = fileName_ + "." +
+                QString::number(QCoreApplication::applicationPid());
+        QFile f(tmpName);
+        if (!f.open(QIODevice::WriteOnly))
+            return;
+        const bool written = f.write(data, size) == qint64(size);
+        f.close();
+        QFile::remove(fileName_);
+        if (!written || !QFile::rename(tmpName, fileName_))
+            QFile::remove(tmpName);
+    }
+
+    QString fileName_;
+    bool hit_;
+};
+
+
+JitRunner::JitRunner(const QString &cacheDir)
+    : cacheDir_(cacheDir)
+    , lastRunFromCache_(false)
+{
+}
+
+void JitRunner::initializeTarget()
+{
+    static bool initialized = false;
+    if (!initialized) {
+        llvm::InitializeNativeTarget();
+        llvm::InitializeNativeTargetAsmPrinter();
+        llvm::InitializeNativeTargetAsmParser();
+        // Make C/C++ runtime symbols of this process visible to JIT code
+        llvm::sys::DynamicLibrary::LoadLibraryPermanently(0);
+        initialized = true;
+    }
+}
+
+QString JitRunner::cacheFileName(const QByteArray &key) const
+{
+    if (cacheDir_.isEmpty())
+        return QString();
+    return cacheDir_ + "/" + QString::fromLatin1(key.toHex()) + ".o";
+}
+
+void JitRunner::defineDsoHandle(llvm::Module *module)
+{
+    // Clang references external __dso_handle from static destructors
+    // registration, which is provided by crtbegin.o in regular executables
+    llvm::GlobalVariable * dsoHandle = module->getGlobalVariable("__dso_handle");
+    if (dsoHandle && dsoHandle->isDeclaration()) {
+        llvm::Type * type = dsoHandle->getType()->getElementType();
+        dsoHandle->setInitializer(llvm::Constant::getNullValue(type));
+        dsoHandle->setLinkage(llvm::GlobalValue::PrivateLinkage);
+        dsoHandle->setVisibility(llvm::GlobalValue::DefaultVisibility);
+    }
+}
+
+void JitRunner::optimizeModule(llvm::Module *module)
+{
+    llvm::PassManagerBuilder builder;
+    builder.OptLevel = 3;
+    builder.Inliner = llvm::createFunctionInliningPass(3, 0);
+
+    llvm::legacy::FunctionPassManager functionPasses(module);
+    llvm::legacy::PassManager modulePasses;
+    builder.populateFunctionPassManager(functionPasses);
+    builder.populateModulePassManager(modulePasses);
+
+    functionPasses.doInitialization();
+    for (llvm::Module::iterator it=module->begin(); it!=module->end(); ++it) {
+        functionPasses.run(*it);
+    }
+    functionPasses.doFinalization();
+    modulePasses.run(*module);
+}
+
+bool JitRunner::run(LLVM::ModuleRef &module,
+                    const QStringList &arguments,
+                    int &exitCode)
+{
+    errorString_.clear();
+    lastRunFromCache_ = false;
+    exitCode = 0;
+
+    initializeTarget();
+
+    llvm::Module * lmodule = module.rawPtr();
+    if (!lmodule) {
+        errorString_ = "No module to run";
+        return false;
+    }
+    if (lmodule->getTargetTriple().empty()) {
+        lmodule->setTargetTriple(llvm::sys::getProcessTriple());
+    }
+    defineDsoHandle(lmodule);
+
+    // Module bitcode is completely defined by program source, used units,
+    // stdlib and generator options, so its hash identifies the program
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(module.binaryRepresentation());
+    hash.addData(LLVM_VERSION_STRING);
+    hash.addData(llvm::sys::getProcessTriple().c_str());
+    hash.addData(llvm::sys::getHostCPUName().data(),
+                 llvm::sys::getHostCPUName().size());
+    const QByteArray key = hash.result();
+
+    const QString objectFileName = cacheFileName(key);
+    if (objectFileName.isEmpty() || !QFile::exists(objectFileName)) {
+        // Optimization is required only when object is not cached yet
+        optimizeModule(lmodule);
+    }
+
+    JitObjectCache * objectCache = new JitObjectCache(objectFileName);
+    std::string error;
+
+#ifdef KUMIR_LLVM_RAW_POINTERS_API
+    llvm::EngineBuilder builder(module.release().release());
+    builder.setUseMCJIT(true);
+    builder.setMCJITMemoryManager(new llvm::SectionMemoryManager);
+#else
+    llvm::EngineBuilder builder(module.release());
+    builder.setMCJITMemoryManager(
+                std::unique_ptr<llvm::SectionMemoryManager>(
+                    new llvm::SectionMemoryManager));
+#endif
+    builder.setEngineKind(llvm::EngineKind::JIT);
+    builder.setOptLevel(llvm::CodeGenOpt::Aggressive);
+    builder.setErrorStr(&error);
+
+    llvm::ExecutionEngine * engine = builder.create();
+    if (!engine) {
+        errorString_ = QString::fromStdString(error);
+        delete objectCache;
+        return false;
+    }
+
+    // Program might register atexit handlers pointing into JIT-compiled
+    // code, so engine and its memory must live until process exit
+    static std::list<llvm::ExecutionEngine*> engines;
+    static std::list<JitObjectCache*> objectCaches;
+    engines.push_back(engine);
+    objectCaches.push_back(objectCache);
+
+    engine->setObjectCache(objectCache);
+    engine->finalizeObject();
+    lastRunFromCache_ = objectCache->hit();
+
+    typedef int (*MainFunction)(int, char**);
+    MainFunction mainFunction = reinterpret_cast<MainFunction>(
+                engine->getFunctionAddress("main"));
+    if (!mainFunction) {
+        errorString_ = "Entry point 'main' not found";
+        return false;
+    }
+
+    engine->runStaticConstructorsDestructors(false);
+
+    std::list<QByteArray> argsData;
+    std::vector<char*> argv;
+    Q_FOREACH(const QString & argument, arguments) {
+        argsData.push_back(argument.toLocal8Bit());
+        argv.push_back(argsData.back().data());
+    }
+    argv.push_back(0);
+
+    exitCode = mainFunction(int(argv.size()) - 1, &argv[0]);
+
+    engine->runStaticConstructorsDestructors(true);
+    return true;
+}
+
+}
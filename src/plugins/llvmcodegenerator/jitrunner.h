@@ -0,0 +1,45 @@
+#ifndef JITRUNNER_H
+#define JITRUNNER_H
+
+#include "llvm_module.h"
+
+#include <QString>
+#include <QStringList>
+
+namespace LLVMCodeGenerator {
+
+/** Runs generated module in the same process using LLVM MCJIT.
+ *
+ * Module must be already linked with stdlib and all used units and
+ * must contain 'main' entry point. Native code is stored in cache
+ * directory (if specified), keyed by hash of module bitcode, so the
+ * next run of the same program skips optimization and code generation.
+ */
+class JitRunner
+{
+public:
+    explicit JitRunner(const QString & cacheDir = QString());
+
+    /** Takes ownership of module contents and runs its 'main' function.
+     *  Returns true on success and stores 'main' return value into exitCode */
+    bool run(LLVM::ModuleRef & module,
+             const QStringList & arguments,
+             int & exitCode);
+
+    inline QString errorString() const { return errorString_; }
+    inline bool lastRunFromCache() const { return lastRunFromCache_; }
+
+private:
+    static void initializeTarget();
+    static void optimizeModule(llvm::Module * module);
+    static void defineDsoHandle(llvm::Module * module);
+    QString cacheFileName(const QByteArray & key) const;
+
+    QString cacheDir_;
+    QString errorString_;
+    bool lastRunFromCache_;
+};
+
+}
+
+#endif // JITRUNNER_H
@@ -42,6 +42,10 @@ public:
     QByteArray textRepresentation() const;
     QByteArray binaryRepresentation() const;
 
+    // Passes ownership of underlying module to caller,
+    // so this reference becomes empty
+    std::unique_ptr<llvm::Module> release();
+
     operator bool() const;
     bool operator == (const ModuleRef other) const;
 
@@ -84,6 +84,11 @@ ModuleRef::~ModuleRef()
 
 
 
+std::unique_ptr<llvm::Module> ModuleRef::release()
+{
+    return std::move(d);
+}
+
 llvm::Module * ModuleRef::rawPtr() const
 {
     if (d) {
@@ -1,10 +1,15 @@
 #include "llvmcodegeneratorplugin.h"
 #include "llvmgenerator.h"
+#include "jitrunner.h"
+
+#include "dataformats/ast_optimizer.h"
 
 #include <QtPlugin>
 #include <QProcess>
+#include <QTime>
 #if QT_VERSION >= 0x050000
 #include <QProcessEnvironment>
+#include <QStandardPaths>
 #endif
 
 #include <llvm/Config/llvm-config.h>
@@ -40,6 +45,9 @@ LLVMCodeGeneratorPlugin::LLVMCodeGeneratorPlugin()
     , linkAllUnits_(false)
     , textForm_(false)
     , runToolChain_(false)
+    , runJit_(false)
+    , useJitCache_(true)
+    , optimize_(true)
     , debugLevel_(LinesOnly)
 {
 }
@@ -98,6 +106,22 @@ LLVMCodeGeneratorPlugin::acceptableCommandLineParameters() const
                   'k', "keep",
                   tr("Keep generated temporary files")
                   );
+    result << CommandLineParameter(
+                  false,
+                  'j', "jit",
+                  tr("Run program immediately using in-process JIT compiler instead of creating executable")
+                  );
+    result << CommandLineParameter(
+                  false,
+                  'n', "nocache",
+                  tr("Do not use cache of JIT-compiled programs (in conjuntion with -j flag)")
+                  );
+    result << CommandLineParameter(
+                  false,
+                  'O', "optimize",
+                  tr("Optimization level: 0 (none) or 1 (constant folding and dead code elimination, default)"),
+                  QVariant::Int, false
+                  );
     return result;
 }
 
@@ -107,7 +131,7 @@ void LLVMCodeGeneratorPlugin::setDebugLevel(DebugLevel debugLevel)
 }
 
 void LLVMCodeGeneratorPlugin::generateExecutable(
-            const AST::DataPtr tree,
+            const AST::DataPtr source,
             QByteArray & out,
             QString & mimeType,
             QString & fileSuffix
@@ -115,6 +139,15 @@ void LLVMCodeGeneratorPlugin::generateExecutable(
 {
     d->reset(createMain_, debugLevel_);
 
+    int passes = AST::Optimizer::AllPasses;
+    if (debugLevel_ != NoDebug) {
+        // Hidden variables would appear in debug information
+        passes &= ~AST::Optimizer::HoistLoopInvariants;
+    }
+    const AST::DataPtr tree = optimize_
+            ? AST::Optimizer::optimize(source, passes)
+            : source;
+
     const QList<AST::ModulePtr> & modules = tree->modules;
     QList<AST::ModulePtr> kmodules;
     std::deque<LLVM::ModuleRef> usedUnits;
@@ -228,6 +261,14 @@ void LLVMCodeGeneratorPlugin::generateExecutable(
         return;
     }
 
+    if (runJit_) {
+        runModuleInProcess(reparsedModule, userModule->header.sourceFileName);
+        out.clear();
+        mimeType.clear();
+        fileSuffix.clear();
+        return;
+    }
+
     const QByteArray binBufData = reparsedModule.binaryRepresentation();
 
     if (!runToolChain_) {
@@ -247,6 +288,52 @@ void LLVMCodeGeneratorPlugin::generateExecutable(
 
 }
 
+QString LLVMCodeGeneratorPlugin::jitCacheDir()
+{
+#if QT_VERSION >= 0x050000
+    const QString cacheLocation =
+            QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+#else
+    const QString cacheLocation = QDir::homePath() + "/.cache/kumir2";
+#endif
+    if (cacheLocation.isEmpty()) {
+        return QString();
+    }
+    return cacheLocation + "/llvmjit";
+}
+
+void LLVMCodeGeneratorPlugin::runModuleInProcess(LLVM::ModuleRef &module,
+                                                 const QString &sourceFileName)
+{
+    // Program expects executable path as argv[0] to find files
+    // relative to it, so pretend it located near source file
+    QString programPath = QFileInfo(sourceFileName).absoluteFilePath();
+    if (programPath.endsWith(".kum")) {
+        programPath = programPath.left(programPath.length()-4);
+    }
+
+    JitRunner jit(useJitCache_ ? jitCacheDir() : QString());
+    int exitCode = 0;
+    QTime timer;
+    timer.start();
+    if (!jit.run(module, QStringList() << programPath, exitCode)) {
+        const QString errorMessage = QString("== ERROR == JIT failed: %1")
+                .arg(jit.errorString());
+        std::cerr << errorMessage.toStdString() << std::endl;
+        qApp->setProperty("returnCode", 5);
+        qApp->quit();
+        return;
+    }
+    if (verboseOutput_) {
+        const QString verboseMessage = QString::fromLatin1(
+                    "JIT: program finished in %1 ms (%2)\n")
+                .arg(timer.elapsed())
+                .arg(jit.lastRunFromCache() ? "cached code" : "compiled code");
+        std::cout << verboseMessage.toStdString();
+    }
+    qApp->setProperty("returnCode", exitCode);
+}
+
 bool LLVMCodeGeneratorPlugin::compileExternalUnit(const QString &fileName)
 {
     const QString kumFileName = fileName.endsWith(".kum")
@@ -554,13 +641,15 @@ QString LLVMCodeGeneratorPlugin::initialize(
 {
     if (runtimeArguments.hasFlag('c')) {
         runToolChain_ = false;
+        runJit_ = false;
         createMain_ = runtimeArguments.hasFlag('m');
         textForm_ = runtimeArguments.hasFlag('S');
         linkStdLib_ = runtimeArguments.hasFlag('t');
         linkAllUnits_ = runtimeArguments.hasFlag('l');
     }
     else {
-        runToolChain_ = true;
+        runJit_ = runtimeArguments.hasFlag('j');
+        runToolChain_ = !runJit_;
         createMain_ = true;
         textForm_ = false;
         linkStdLib_ = true;
@@ -569,6 +658,7 @@ QString LLVMCodeGeneratorPlugin::initialize(
 
     setVerbose(runtimeArguments.hasFlag('v'));
     keepTemporaryFiles_ = runtimeArguments.hasFlag('k');
+    useJitCache_ = !runtimeArguments.hasFlag('n');
 
     DebugLevel debugLevel = LinesOnly;
     if (runtimeArguments.value('g').isValid()) {
@@ -578,6 +668,9 @@ QString LLVMCodeGeneratorPlugin::initialize(
         debugLevel = DebugLevel(level);
     }
     setDebugLevel(debugLevel);
+    if (runtimeArguments.value('O').isValid()) {
+        optimize_ = runtimeArguments.value('O').toInt() > 0;
+    }
 
     d->initialize(myResourcesDir());
 
@@ -9,6 +9,10 @@
 
 #include <llvm/ADT/Triple.h>
 
+namespace LLVM {
+class ModuleRef;
+}
+
 namespace LLVMCodeGenerator {
 
 class LLVMCodeGeneratorPlugin
@@ -49,6 +53,8 @@ protected:
 
     static QByteArray runExternalToolsToGenerateExecutable(const QByteArray & bitcode);
     static bool compileExternalUnit(const QString & fileName);
+    void runModuleInProcess(LLVM::ModuleRef & module, const QString & sourceFileName);
+    static QString jitCacheDir();
 #if defined(Q_OS_UNIX) && !defined(Q_OS_MACX)
     static QString findLibraryByName(const QString & baseName);
 #endif
@@ -61,6 +67,9 @@ private:
     bool linkAllUnits_;
     bool textForm_;
     bool runToolChain_;
+    bool runJit_;
+    bool useJitCache_;
+    bool optimize_;
     DebugLevel debugLevel_;
     static bool verboseOutput_;
     static bool keepTemporaryFiles_;
@@ -18,6 +18,7 @@
 #include <llvm/IR/ValueSymbolTable.h>
 #include <llvm/IR/Value.h>
 #include <llvm/IR/Attributes.h>
+#include <llvm/IR/Intrinsics.h>
 
 
 #include <llvm/Bitcode/ReaderWriter.h>
@@ -74,6 +75,7 @@ void LLVMGenerator::reset(bool addMainEntryPoint,
     externs_.clear();
     readStdLibFunctions();
     calculateCache_.clear();
+    runtimeErrorMessages_.clear();
     lastLineNumber_ = 0;
 }
 
@@ -893,6 +895,12 @@ void LLVMGenerator::createAssign(llvm::IRBuilder<> &builder, const AST::Statemen
 {
     const AST::ExpressionPtr rvalue = st->expressions.at(0);
     llvm::Value * llvm_rvalue = calculate(builder, rvalue);
+    if (st->expressions.size() > 1 &&
+            createNativeAssign(builder, st->expressions.at(1), rvalue, llvm_rvalue))
+    {
+        createFreeTempScalars(builder);
+        return;
+    }
     if (st->expressions.size() > 1) {
         const AST::ExpressionPtr lvalue = st->expressions.at(1);        
         llvm::Value * llvm_lvalue = calculate(builder, lvalue, true);
@@ -1677,7 +1685,24 @@ llvm::Value * LLVMGenerator::createArrayElementGet(llvm::IRBuilder<> &builder, c
     args.reserve(20);
     llvm::Value * elemPtr = CreateAlloca(builder, getScalarType().pointerTo(), "", allocaPlace);
     Q_ASSERT(elemPtr);
-    if (ex->variable->dimension > 0u) {
+    // Array passed by reference is not a plain structure pointer
+    bool nativeIndices = ex->variable->dimension > 0u && isScalarPointer(var);
+    for (int i=0; nativeIndices && i<ex->variable->dimension; i++) {
+        nativeIndices = AST::TypeInteger == ex->operands[i]->baseType.kind &&
+                0 == ex->operands[i]->dimension;
+    }
+    if (nativeIndices) {
+        // Inline bounds check and element address calculation
+        QVector<llvm::Value*> indices;
+        for (int i=0; i<ex->variable->dimension; i++) {
+            llvm::Value * index = calculate(builder, ex->operands[i]);
+            Q_ASSERT(index);
+            indices.push_back(createNativeLoad(builder, index, AST::TypeInteger));
+        }
+        llvm::Value * elem = createInlineArrayElementPtr(builder, var, indices, !isLvalue);
+        builder.CreateStore(elem, elemPtr);
+    }
+    else if (ex->variable->dimension > 0u) {
         args.push_back(elemPtr);
         if (!isLvalue) {
             args.push_back(llvm::ConstantInt::getTrue(*context_));
@@ -2119,6 +2144,11 @@ llvm::Value * LLVMGenerator::createSubExpession(llvm::IRBuilder<> &builder, cons
     }
 
     llvm::Value * result = CreateAlloca(builder, getScalarType(), "", ex->keepInCache? FunctionBegin : BeforeTerminator);
+    if (canCreateNativeOperation(ex, operands)) {
+        llvm::Value * value = createNativeOperation(builder, ex, operands);
+        createNativeStore(builder, result, value, ex->baseType.kind);
+        return result;
+    }
     LLVM::FunctionRef opFunc;
     size_t operandsCount = operands.size();
     switch (ex->operatorr) {
@@ -2204,6 +2234,329 @@ llvm::Value * LLVMGenerator::createShortCircuitOperation(llvm::IRBuilder<> &buil
 }
 
 
+bool LLVMGenerator::isNativeScalar(const AST::ExpressionPtr &ex)
+{
+    if (!ex || 0 != ex->dimension) {
+        return false;
+    }
+    const AST::VariableBaseType kind = ex->baseType.kind;
+    return AST::TypeInteger == kind || AST::TypeReal == kind || AST::TypeBoolean == kind;
+}
+
+bool LLVMGenerator::isScalarPointer(const llvm::Value *value)
+{
+    if (!value || !value->getType()->isPointerTy()) {
+        return false;
+    }
+    const llvm::PointerType * ptrType = llvm::cast<llvm::PointerType>(value->getType());
+    return ptrType->getElementType()->isStructTy();
+}
+
+bool LLVMGenerator::canCreateNativeOperation(const AST::ExpressionPtr &ex,
+                                             const QVector<llvm::Value *> &operands) const
+{
+    if (!isNativeScalar(ex) || operands.isEmpty() || operands.size() > 2) {
+        return false;
+    }
+    for (int i=0; i<operands.size(); i++) {
+        if (!isNativeScalar(ex->operands[i]) || !isScalarPointer(operands[i])) {
+            return false;
+        }
+    }
+    const AST::VariableBaseType left = ex->operands.first()->baseType.kind;
+    const AST::VariableBaseType right = ex->operands.last()->baseType.kind;
+    const bool numeric = AST::TypeBoolean != left && AST::TypeBoolean != right;
+    const bool logical = AST::TypeBoolean == left && AST::TypeBoolean == right;
+    if (1 == operands.size()) {
+        return (AST::OpNot == ex->operatorr && logical) ||
+                (AST::OpSubstract == ex->operatorr && numeric);
+    }
+    switch (ex->operatorr) {
+    case AST::OpEqual:
+    case AST::OpNotEqual:
+        return numeric || logical;
+    case AST::OpLess:
+    case AST::OpGreater:
+    case AST::OpLessOrEqual:
+    case AST::OpGreaterOrEqual:
+    case AST::OpSumm:
+    case AST::OpSubstract:
+    case AST::OpMultiply:
+    case AST::OpDivision:
+        return numeric;
+    default:
+        // Power has integer-specific semantics implemented in stdlib
+        return false;
+    }
+}
+
+llvm::Value * LLVMGenerator::createNativeOperation(Builder &builder,
+                                                   const AST::ExpressionPtr &ex,
+                                                   const QVector<llvm::Value *> &operands)
+{
+    llvm::Type * realType = llvm::Type::getDoubleTy(*context_);
+    const AST::VariableBaseType leftType = ex->operands.first()->baseType.kind;
+    const AST::VariableBaseType rightType = ex->operands.last()->baseType.kind;
+    llvm::Value * left = createNativeLoad(builder, operands.first(), leftType);
+
+    if (1 == operands.size()) {
+        if (AST::OpNot == ex->operatorr) {
+            return builder.CreateNot(left);
+        }
+        else if (AST::TypeInteger == leftType) {
+            return createCheckedIntegerOperation(builder, llvm::Intrinsic::ssub_with_overflow,
+                                                 llvm::ConstantInt::get(left->getType(), 0), left);
+        }
+        else {
+            return builder.CreateFSub(llvm::ConstantFP::get(realType, 0.0), left);
+        }
+    }
+
+    llvm::Value * right = createNativeLoad(builder, operands.last(), rightType);
+    const bool integerOperation =
+            AST::TypeInteger == leftType && AST::TypeInteger == rightType &&
+            AST::OpDivision != ex->operatorr;
+
+    if (AST::TypeBoolean == leftType) {
+        return AST::OpEqual == ex->operatorr
+                ? builder.CreateICmpEQ(left, right)
+                : builder.CreateICmpNE(left, right);
+    }
+
+    if (AST::OpDivision == ex->operatorr) {
+        llvm::Value * nonZero = AST::TypeInteger == rightType
+                ? builder.CreateICmpNE(right, llvm::ConstantInt::get(right->getType(), 0))
+                : builder.CreateFCmpUNE(right, llvm::ConstantFP::get(realType, 0.0));
+        createRuntimeCheck(builder, nonZero, QString::fromUtf8("Деление на ноль"));
+    }
+
+    if (!integerOperation) {
+        if (AST::TypeInteger == leftType) {
+            left = builder.CreateSIToFP(left, realType);
+        }
+        if (AST::TypeInteger == rightType) {
+            right = builder.CreateSIToFP(right, realType);
+        }
+    }
+
+    llvm::Intrinsic::ID overflowIntrinsic = llvm::Intrinsic::not_intrinsic;
+    llvm::Value * result = 0;
+    switch (ex->operatorr) {
+    case AST::OpEqual:
+        return integerOperation ? builder.CreateICmpEQ(left, right) : builder.CreateFCmpOEQ(left, right);
+    case AST::OpNotEqual:
+        return integerOperation ? builder.CreateICmpNE(left, right) : builder.CreateFCmpONE(left, right);
+    case AST::OpLess:
+        return integerOperation ? builder.CreateICmpSLT(left, right) : builder.CreateFCmpOLT(left, right);
+    case AST::OpGreater:
+        return integerOperation ? builder.CreateICmpSGT(left, right) : builder.CreateFCmpOGT(left, right);
+    case AST::OpLessOrEqual:
+        return integerOperation ? builder.CreateICmpSLE(left, right) : builder.CreateFCmpOLE(left, right);
+    case AST::OpGreaterOrEqual:
+        return integerOperation ? builder.CreateICmpSGE(left, right) : builder.CreateFCmpOGE(left, right);
+    case AST::OpSumm:
+        overflowIntrinsic = llvm::Intrinsic::sadd_with_overflow;
+        if (!integerOperation) result = builder.CreateFAdd(left, right);
+        break;
+    case AST::OpSubstract:
+        overflowIntrinsic = llvm::Intrinsic::ssub_with_overflow;
+        if (!integerOperation) result = builder.CreateFSub(left, right);
+        break;
+    case AST::OpMultiply:
+        overflowIntrinsic = llvm::Intrinsic::smul_with_overflow;
+        if (!integerOperation) result = builder.CreateFMul(left, right);
+        break;
+    case AST::OpDivision:
+        result = builder.CreateFDiv(left, right);
+        break;
+    default:
+        break;
+    }
+
+    if (integerOperation) {
+        result = createCheckedIntegerOperation(builder, overflowIntrinsic, left, right);
+    }
+    else {
+        // Finite value minus itself is zero, while infinity or NaN gives NaN
+        llvm::Value * finite = builder.CreateFCmpOEQ(
+                    builder.CreateFSub(result, result),
+                    llvm::ConstantFP::get(realType, 0.0));
+        createRuntimeCheck(builder, finite,
+                           QString::fromUtf8("Вещественное переполнение"));
+    }
+    Q_ASSERT(result);
+    return result;
+}
+
+llvm::Value * LLVMGenerator::createCheckedIntegerOperation(Builder &builder,
+                                                           llvm::Intrinsic::ID overflowIntrinsic,
+                                                           llvm::Value *left, llvm::Value *right)
+{
+    llvm::Type * intType = left->getType();
+    llvm::Function * intrinsic = llvm::Intrinsic::getDeclaration(
+                currentModule_.rawPtr(), overflowIntrinsic, intType);
+    llvm::Value * withOverflow = builder.CreateCall(intrinsic, std::vector<llvm::Value*>({left, right}));
+    llvm::Value * overflow = builder.CreateExtractValue(withOverflow, 1);
+    createRuntimeCheck(builder, builder.CreateNot(overflow),
+                       QString::fromUtf8("Целочисленное переполнение"));
+    return builder.CreateExtractValue(withOverflow, 0);
+}
+
+llvm::Value * LLVMGenerator::createStructFieldPtr(Builder &builder, llvm::Value *ptr, int field, int element)
+{
+    llvm::Type * indexType = llvm::Type::getInt32Ty(*context_);
+    std::vector<llvm::Value*> indices;
+    indices.push_back(llvm::ConstantInt::get(indexType, 0));
+    indices.push_back(llvm::ConstantInt::get(indexType, field));
+    if (element >= 0) {
+        indices.push_back(llvm::ConstantInt::get(indexType, element));
+    }
+    return builder.CreateInBoundsGEP(ptr, indices);
+}
+
+llvm::Value * LLVMGenerator::createNativeLoad(Builder &builder, llvm::Value *scalar, const AST::VariableBaseType type)
+{
+    // __kumir_scalar fields: defined, type, data
+    llvm::Value * defined = builder.CreateLoad(createStructFieldPtr(builder, scalar, 0));
+    createRuntimeCheck(builder,
+                       builder.CreateICmpNE(defined, llvm::Constant::getNullValue(defined->getType())),
+                       QString::fromUtf8("Нет значения у величины"));
+    llvm::Value * data = createStructFieldPtr(builder, scalar, 2);
+    llvm::Type * intType = llvm::Type::getInt32Ty(*context_);
+    llvm::Type * realType = llvm::Type::getDoubleTy(*context_);
+    llvm::Type * byteType = llvm::Type::getInt8Ty(*context_);
+    if (AST::TypeInteger == type) {
+        return builder.CreateLoad(builder.CreateBitCast(data, intType->getPointerTo()));
+    }
+    else if (AST::TypeBoolean == type) {
+        llvm::Value * b = builder.CreateLoad(builder.CreateBitCast(data, byteType->getPointerTo()));
+        return builder.CreateICmpNE(b, llvm::ConstantInt::get(byteType, 0));
+    }
+    else {
+        // Real variable might hold integer value copied without conversion
+        llvm::Value * tag = builder.CreateLoad(createStructFieldPtr(builder, scalar, 1));
+        llvm::Value * isInt = builder.CreateICmpEQ(tag, llvm::ConstantInt::get(tag->getType(), __KUMIR_INT));
+        llvm::Value * i = builder.CreateLoad(builder.CreateBitCast(data, intType->getPointerTo()));
+        llvm::Value * r = builder.CreateLoad(builder.CreateBitCast(data, realType->getPointerTo()));
+        return builder.CreateSelect(isInt, builder.CreateSIToFP(i, realType), r);
+    }
+}
+
+void LLVMGenerator::createNativeStore(Builder &builder, llvm::Value *scalar, llvm::Value *value, const AST::VariableBaseType type)
+{
+    llvm::Value * definedPtr = createStructFieldPtr(builder, scalar, 0);
+    llvm::Value * tagPtr = createStructFieldPtr(builder, scalar, 1);
+    llvm::Value * data = createStructFieldPtr(builder, scalar, 2);
+    llvm::Type * definedType = llvm::cast<llvm::PointerType>(definedPtr->getType())->getElementType();
+    llvm::Type * tagType = llvm::cast<llvm::PointerType>(tagPtr->getType())->getElementType();
+    __kumir_scalar_type tag = __KUMIR_REAL;
+    if (AST::TypeInteger == type) {
+        tag = __KUMIR_INT;
+    }
+    else if (AST::TypeBoolean == type) {
+        tag = __KUMIR_BOOL;
+        value = builder.CreateZExt(value, llvm::Type::getInt8Ty(*context_));
+    }
+    builder.CreateStore(llvm::ConstantInt::get(definedType, 1), definedPtr);
+    builder.CreateStore(llvm::ConstantInt::get(tagType, tag), tagPtr);
+    builder.CreateStore(value, builder.CreateBitCast(data, value->getType()->getPointerTo()));
+}
+
+bool LLVMGenerator::createNativeAssign(Builder &builder, const AST::ExpressionPtr &lvalue,
+                                       const AST::ExpressionPtr &rvalue, llvm::Value *llvm_rvalue)
+{
+    if (!isNativeScalar(lvalue) || !isNativeScalar(rvalue)) {
+        return false;
+    }
+    const AST::VariableBaseType ltype = lvalue->baseType.kind;
+    const AST::VariableBaseType rtype = rvalue->baseType.kind;
+    if (ltype != rtype && !(AST::TypeReal == ltype && AST::TypeInteger == rtype)) {
+        return false;
+    }
+    const bool toVariable = AST::ExprVariable == lvalue->kind &&
+            0u == lvalue->variable->dimension;
+    const bool toArrayElement = AST::ExprArrayElement == lvalue->kind &&
+            lvalue->variable->dimension == lvalue->operands.size();
+    if (!toVariable && !toArrayElement) {
+        return false;
+    }
+    if (!isScalarPointer(llvm_rvalue)) {
+        return false;
+    }
+    llvm::Value * value = createNativeLoad(builder, llvm_rvalue, rtype);
+    if (ltype != rtype) {
+        value = builder.CreateSIToFP(value, llvm::Type::getDoubleTy(*context_));
+    }
+    llvm::Value * target = calculate(builder, lvalue, true);
+    if (toArrayElement) {
+        target = builder.CreateLoad(target);
+    }
+    Q_ASSERT(isScalarPointer(target));
+    createNativeStore(builder, target, value, ltype);
+    return true;
+}
+
+llvm::Value * LLVMGenerator::createInlineArrayElementPtr(Builder &builder,
+                                                         llvm::Value *array,
+                                                         const QVector<llvm::Value *> &indices,
+                                                         bool valueExpected)
+{
+    // __kumir_array fields: dim, size_left, size_right, shape_left, shape_right, data
+    llvm::Type * offsetType = llvm::Type::getInt64Ty(*context_);
+    llvm::Value * offset = 0;
+    for (int i=0; i<indices.size(); i++) {
+        llvm::Value * index = indices[i];
+        llvm::Value * shapeLeft = builder.CreateLoad(createStructFieldPtr(builder, array, 3, i));
+        llvm::Value * shapeRight = builder.CreateLoad(createStructFieldPtr(builder, array, 4, i));
+        llvm::Value * inBounds = builder.CreateAnd(
+                    builder.CreateICmpSGE(index, shapeLeft),
+                    builder.CreateICmpSLE(index, shapeRight));
+        createRuntimeCheck(builder, inBounds, QString::fromUtf8("Выход за границу таблицы"));
+        llvm::Value * sizeLeft = builder.CreateLoad(createStructFieldPtr(builder, array, 1, i));
+        llvm::Value * position = builder.CreateSExt(builder.CreateSub(index, sizeLeft), offsetType);
+        if (!offset) {
+            offset = position;
+        }
+        else {
+            llvm::Value * sizeRight = builder.CreateLoad(createStructFieldPtr(builder, array, 2, i));
+            llvm::Value * extent = builder.CreateSExt(
+                        builder.CreateAdd(builder.CreateSub(sizeRight, sizeLeft),
+                                          llvm::ConstantInt::get(sizeRight->getType(), 1)),
+                        offsetType);
+            offset = builder.CreateAdd(builder.CreateMul(offset, extent), position);
+        }
+    }
+    llvm::Value * data = builder.CreateLoad(createStructFieldPtr(builder, array, 5));
+    llvm::Value * elem = builder.CreateInBoundsGEP(data, offset);
+    if (valueExpected) {
+        llvm::Value * defined = builder.CreateLoad(createStructFieldPtr(builder, elem, 0));
+        createRuntimeCheck(builder,
+                           builder.CreateICmpNE(defined, llvm::Constant::getNullValue(defined->getType())),
+                           QString::fromUtf8("Значение элемента таблицы не определено"));
+    }
+    return elem;
+}
+
+void LLVMGenerator::createRuntimeCheck(Builder &builder, llvm::Value *condition, const QString &errorMessage)
+{
+    llvm::Function * func = currentFunction_.rawPtr();
+    llvm::BasicBlock * failed = llvm::BasicBlock::Create(*context_, "runtime_error", func);
+    llvm::BasicBlock * passed = llvm::BasicBlock::Create(*context_, "runtime_ok", func);
+    builder.CreateCondBr(condition, passed, failed);
+
+    builder.SetInsertPoint(failed);
+    if (!runtimeErrorMessages_.contains(errorMessage)) {
+        runtimeErrorMessages_[errorMessage] = builder.CreateGlobalStringPtr(
+                    std::string(errorMessage.toUtf8().constData()));
+    }
+    kumirAbortOnError_.createCallInstruction(&builder, runtimeErrorMessages_[errorMessage]);
+    builder.CreateUnreachable(); // abort handler terminates program
+
+    currentBlock_ = passed;
+    builder.SetInsertPoint(passed);
+}
+
+
 void LLVMGenerator::createExternsTable(const LLVM::ModuleRef & source,
                                        const QByteArray & prefix)
 {
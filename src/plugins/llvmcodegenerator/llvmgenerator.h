@@ -16,6 +16,7 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/LLVMContext.h>
 #include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Intrinsics.h>
 #include <llvm/Support/MemoryBuffer.h>
 
 #include <cstdint>
@@ -100,6 +101,22 @@ public:
     void createOutputValue(Builder & builder, const QString & name, llvm::Value * value, const AST::VariableBaseType type, const bool isArray);
     void createInputValue(Builder & builder, const QString & name, llvm::Value * value, const AST::VariableBaseType type, const bool isArray);
 
+    /* Inline lowering of integer, real and boolean values.
+     * Values are still kept in __kumir_scalar structures, but all field
+     * accesses are plain IR, so LLVM can promote non-escaping locals
+     * to registers and drop redundant definedness checks */
+    static bool isNativeScalar(const AST::ExpressionPtr & ex);
+    static bool isScalarPointer(const llvm::Value * value);
+    bool canCreateNativeOperation(const AST::ExpressionPtr & ex, const QVector<llvm::Value*> & operands) const;
+    llvm::Value* createNativeOperation(Builder & builder, const AST::ExpressionPtr & ex, const QVector<llvm::Value*> & operands);
+    llvm::Value* createNativeLoad(Builder & builder, llvm::Value * scalar, const AST::VariableBaseType type);
+    void createNativeStore(Builder & builder, llvm::Value * scalar, llvm::Value * value, const AST::VariableBaseType type);
+    llvm::Value* createCheckedIntegerOperation(Builder & builder, llvm::Intrinsic::ID overflowIntrinsic, llvm::Value * left, llvm::Value * right);
+    bool createNativeAssign(Builder & builder, const AST::ExpressionPtr & lvalue, const AST::ExpressionPtr & rvalue, llvm::Value * llvm_rvalue);
+    llvm::Value* createInlineArrayElementPtr(Builder & builder, llvm::Value * array, const QVector<llvm::Value*> & indices, bool valueExpected);
+    llvm::Value* createStructFieldPtr(Builder & builder, llvm::Value * ptr, int field, int element = -1);
+    void createRuntimeCheck(Builder & builder, llvm::Value * condition, const QString & errorMessage);
+
 
 
     llvm::AllocaInst * CreateAlloca(Builder & builder, LLVM::TypeRef ty, const QByteArray & name, AllocaPlace allocaPlace);
@@ -232,6 +249,7 @@ public:
 
     QList<LLVM::FunctionRef> externs_;
     QMap<AST::ExpressionWPtr, llvm::Value*> calculateCache_;
+    QMap<QString, llvm::Value*> runtimeErrorMessages_;
     int lastLineNumber_;
 
 
@@ -233,6 +233,7 @@ EXTERN void __kumir_halt()
 #endif
     Kumir::EncodingError encodingError;
     const std::string loc_message = Kumir::Coder::encode(enc, message, encodingError);
+    Kumir::Files::flushOutputBuffers();
     std::cout << loc_message;
     exit(0);
 }
@@ -253,6 +254,11 @@ EXTERN void __kumir_pop_call_stack_counter()
     __kumir_call_stack_size --;
 }
 
+static void __kumir_flush_output()
+{
+    Kumir::Files::flushOutputBuffers();
+}
+
 static void __kumir_handle_abort()
 {
     const std::wstring message = __kumir_current_line_number == -1
@@ -267,6 +273,7 @@ static void __kumir_handle_abort()
 #endif
     Kumir::EncodingError encodingError;
     const std::string loc_message = Kumir::Coder::encode(enc, message, encodingError);
+    Kumir::Files::flushOutputBuffers();
     std::cerr << loc_message << std::endl;
     exit(1);
 }
@@ -765,7 +772,7 @@ static __kumir_scalar __kumir_file_type_to_scalar(const Kumir::FileType &f)
     __kumir_scalar result;
     result.defined = true;
     result.type = __KUMIR_RECORD;
-    result.data.u.nfields = 4u;
+    result.data.u.nfields = 5u;
     __kumir_scalar_type * types = reinterpret_cast<__kumir_scalar_type*>(
                 calloc(result.data.u.nfields, sizeof(__kumir_scalar_type))
                 );
@@ -780,6 +787,7 @@ static __kumir_scalar __kumir_file_type_to_scalar(const Kumir::FileType &f)
     types[1] = __KUMIR_INT;
     types[2] = __KUMIR_INT;
     types[3] = __KUMIR_BOOL;
+    types[4] = __KUMIR_INT;
 
     fields[0].s = reinterpret_cast<wchar_t*>(calloc(f.fullPath.length() + 1u, sizeof(wchar_t)));
     wcsncpy(fields[0].s, f.fullPath.c_str(), f.fullPath.length());
@@ -788,7 +796,7 @@ static __kumir_scalar __kumir_file_type_to_scalar(const Kumir::FileType &f)
     fields[1].i = f.mode;
     fields[2].i = f.type;
     fields[3].b = f.valid;
-
+    fields[4].i = f.key;
 
     return result;
 }
@@ -801,6 +809,8 @@ static Kumir::FileType __kumir_scalar_to_file_type(const __kumir_scalar & scalar
     f.mode = fields[1].i;
     f.type = fields[2].i;
     f.valid = fields[3].b;
+    if (scalar.data.u.nfields > 4u)
+        f.key = fields[4].i;
     return f;
 }
 
@@ -1717,6 +1727,8 @@ EXTERN void __kumir_init_stdlib()
 #endif
     // Init Standard library
     Kumir::initStandardLibrary();
+    // Program output is buffered, so write it out when main returns
+    atexit(__kumir_flush_output);
 
     // Set abort and print message on error handler
     Kumir::Core::AbortHandler = &__kumir_handle_abort;
@@ -0,0 +1,194 @@
+#include "interpreterpool.h"
+#include "interpreterstate.h"
+#include "actorshandler.h"
+#include "pyutils.h"
+
+namespace Python3Language {
+
+InterpreterPool::InterpreterPool(const QString &extraPythonPath,
+                                 ActorsHandler *actorsHandler,
+                                 int capacity)
+    : pythonPath_(extraPythonPath)
+    , actorsHandler_(actorsHandler)
+    , capacity_(qMax(1, capacity))
+{
+}
+
+InterpreterPool::~InterpreterPool()
+{
+    clear();
+}
+
+InterpreterPool::Entry* InterpreterPool::createEntry()
+{
+    Entry * entry = new Entry;
+
+    // Create interpreter and import common modules
+    PyGILState_STATE gilState = PyGILState_Ensure();
+    PyThreadState * previous = PyThreadState_Get();
+    entry->py = Py_NewInterpreter();
+    if (!entry->py) {
+        PyThreadState_Swap(previous);
+        PyGILState_Release(gilState);
+        delete entry;
+        return 0;
+    }
+#ifdef Q_OS_WIN32
+    prepareBundledSysPath();
+#else
+    appendToSysPath(pythonPath_);
+#endif
+    createSysArgv(QStringList() << "");
+    PyObject * py_run_wrapper = PyImport_ImportModule("run_wrapper");
+    if (!py_run_wrapper) {
+        printPythonTraceback();
+        Py_EndInterpreter(entry->py);
+        PyThreadState_Swap(previous);
+        PyGILState_Release(gilState);
+        delete entry;
+        return 0;
+    }
+    Py_DECREF(py_run_wrapper);
+    PyThreadState_Swap(previous);
+    PyGILState_Release(gilState);
+
+    // Create actor 'modules'
+    clearCreatedModules();
+    for (int i=0; i<actorsHandler_->size(); i++) {
+        const QString source = actorsHandler_->moduleWrapper(i);
+        const QString name = actorsHandler_->moduleName(i);
+        PyObject * module = createModuleFromSource(entry->py, name, source);
+        Py_XINCREF(module);
+        entry->actorModules[name] = module;
+    }
+
+    // Remember clean state to restore it on release
+    gilState = PyGILState_Ensure();
+    previous = PyThreadState_Swap(entry->py);
+    std::vector<PyObject*> modules;
+    modules.push_back(PyImport_AddModule("run_wrapper"));
+    Q_FOREACH(PyObject * module, entry->actorModules.values()) {
+        modules.push_back(module);
+    }
+    entry->state = new InterpreterState(modules);
+    PyThreadState_Swap(previous);
+    PyGILState_Release(gilState);
+
+    return entry;
+}
+
+void InterpreterPool::bindToCurrentThread(Entry *entry)
+{
+    // Thread state is valid only for a thread it was created in,
+    // so replace it by a new one for the same interpreter
+    if (entry->py->thread_id == PyThread_get_thread_ident())
+        return;
+    PyThreadState * old = entry->py;
+    PyThreadState * py = PyThreadState_New(old->interp);
+    PyEval_AcquireThread(py);
+    PyThreadState_Clear(old);
+    PyThreadState_Delete(old);
+    PyEval_ReleaseThread(py);
+    entry->py = py;
+}
+
+bool InterpreterPool::resetEntry(Entry *entry)
+{
+    PyEval_AcquireThread(entry->py);
+    PyEval_SetTrace(0, 0);
+    PyEval_SetProfile(0, 0);
+    PyErr_Clear();
+
+    const bool success = entry->state->restore();
+    PyGC_Collect();
+    PyErr_Clear();
+    PyEval_ReleaseThread(entry->py);
+    return success;
+}
+
+void InterpreterPool::destroyEntry(Entry *entry)
+{
+    PyEval_AcquireThread(entry->py);
+    Q_FOREACH(PyObject * module, entry->actorModules.values()) {
+        Py_XDECREF(module);
+    }
+    delete entry->state;
+    Py_EndInterpreter(entry->py);
+    PyEval_ReleaseLock();
+    delete entry;
+}
+
+PyThreadState* InterpreterPool::acquire()
+{
+    mutex_.lock();
+    Entry * entry = idle_.isEmpty() ? 0 : idle_.takeFirst();
+    mutex_.unlock();
+
+    if (!entry) {
+        entry = createEntry();
+        if (!entry)
+            return 0;
+    }
+    bindToCurrentThread(entry);
+
+    // Make actor modules of this interpreter visible to value converters
+    clearCreatedModules();
+    Q_FOREACH(const QString & name, entry->actorModules.keys()) {
+        registerCreatedModule(name, entry->actorModules[name]);
+    }
+
+    mutex_.lock();
+    busy_[entry->py] = entry;
+    mutex_.unlock();
+    return entry->py;
+}
+
+void InterpreterPool::release(PyThreadState *py)
+{
+    mutex_.lock();
+    Entry * entry = busy_.take(py);
+    mutex_.unlock();
+    if (!entry)
+        return;
+
+    const bool reusable = resetEntry(entry);
+
+    mutex_.lock();
+    const bool hasRoom = idle_.size() < capacity_;
+    if (reusable && hasRoom)
+        idle_.append(entry);
+    mutex_.unlock();
+
+    if (!reusable || !hasRoom)
+        destroyEntry(entry);
+}
+
+void InterpreterPool::warmUp()
+{
+    forever {
+        mutex_.lock();
+        const bool full = idle_.size() + busy_.size() >= capacity_;
+        mutex_.unlock();
+        if (full)
+            break;
+        Entry * entry = createEntry();
+        if (!entry)
+            break;
+        QMutexLocker l(&mutex_);
+        idle_.append(entry);
+    }
+}
+
+void InterpreterPool::clear()
+{
+    mutex_.lock();
+    QList<Entry*> entries = idle_;
+    idle_.clear();
+    mutex_.unlock();
+    Q_FOREACH(Entry * entry, entries) {
+        bindToCurrentThread(entry);
+        destroyEntry(entry);
+    }
+}
+
+} // namespace Python3Language
@@ -0,0 +1,75 @@
+#ifndef PYTHON3LANGUAGE_INTERPRETERPOOL_H
+#define PYTHON3LANGUAGE_INTERPRETERPOOL_H
+
+#include <QtCore>
+extern "C" {
+#include <Python.h>
+}
+
+namespace Python3Language {
+
+class ActorsHandler;
+class InterpreterState;
+
+/** Keeps a small set of pre-initialized Python sub-interpreters.
+ *
+ * Each pooled interpreter has sys.path prepared, run_wrapper imported and
+ * all actor wrapper modules already created, so a program run just takes
+ * one from the pool. On release the interpreter is reset to its post-warm-up
+ * state (see InterpreterState): namespaces of __main__, sys, builtins,
+ * run_wrapper and actor modules are restored, lists of sys and recursion
+ * limit are restored, and modules imported by the program are dropped.
+ *
+ * All methods must be called without holding the GIL.
+ */
+class InterpreterPool
+{
+public:
+    explicit InterpreterPool(const QString & extraPythonPath,
+                             ActorsHandler * actorsHandler,
+                             int capacity = 1);
+    ~InterpreterPool();
+
+    /** Returns ready to use interpreter bound to the calling thread,
+     *  creating a new one if pool is empty. GIL is released on return.
+     *  Returns 0 on initialization failure */
+    PyThreadState * acquire();
+
+    /** Resets interpreter and returns it to pool, or finalizes it
+     *  if pool is full or reset failed */
+    void release(PyThreadState * py);
+
+    /** Fills pool up to its capacity */
+    void warmUp();
+
+    /** Finalizes all idle interpreters */
+    void clear();
+
+    inline int capacity() const { return capacity_; }
+
+private /*types*/:
+    struct Entry {
+        PyThreadState * py;
+        InterpreterState * state;
+        QMap<QString,PyObject*> actorModules;
+        inline explicit Entry(): py(0), state(0) {}
+    };
+
+private /*methods*/:
+    Entry * createEntry();
+    void bindToCurrentThread(Entry * entry);
+    bool resetEntry(Entry * entry);
+    void destroyEntry(Entry * entry);
+
+private /*fields*/:
+    QString pythonPath_;
+    ActorsHandler * actorsHandler_;
+    int capacity_;
+    QMutex mutex_;
+    QList<Entry*> idle_;
+    QHash<PyThreadState*,Entry*> busy_;
+};
+
+} // namespace Python3Language
+
+#endif // PYTHON3LANGUAGE_INTERPRETERPOOL_H
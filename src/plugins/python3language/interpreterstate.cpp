@@ -0,0 +1,93 @@
+#include "interpreterstate.h"
+
+namespace Python3Language {
+
+// Lists of sys changed in place by programs like sys.path.append(...)
+static const char * const SysLists[] = {
+    "path", "argv", "meta_path", "path_hooks", 0
+};
+
+InterpreterState::InterpreterState(const std::vector<PyObject*> &modules)
+    : recursionLimit_(Py_GetRecursionLimit())
+{
+    // Namespace of sys goes first to have sys.modules object
+    // and friends in place before they are restored
+    addDict(PyModule_GetDict(PyImport_AddModule("sys")));
+    addDict(PySys_GetObject("modules"));
+    addDict(PySys_GetObject("path_importer_cache"));
+    addDict(PyModule_GetDict(PyImport_AddModule("builtins")));
+    addDict(PyModule_GetDict(PyImport_AddModule("__main__")));
+    for (size_t i=0; i<modules.size(); i++) {
+        if (modules[i] && PyModule_Check(modules[i])) {
+            addDict(PyModule_GetDict(modules[i]));
+        }
+    }
+    for (int i=0; SysLists[i]; i++) {
+        addList(PySys_GetObject(SysLists[i]));
+    }
+    PyErr_Clear();
+}
+
+InterpreterState::~InterpreterState()
+{
+    for (size_t i=0; i<dicts_.size(); i++) {
+        Py_DECREF(dicts_[i].object);
+        Py_DECREF(dicts_[i].copy);
+    }
+    for (size_t i=0; i<lists_.size(); i++) {
+        Py_DECREF(lists_[i].object);
+        Py_DECREF(lists_[i].copy);
+    }
+}
+
+void InterpreterState::addDict(PyObject *dict)
+{
+    if (!dict || !PyDict_Check(dict))
+        return;
+    Copy c;
+    c.object = dict;
+    c.copy = PyDict_Copy(dict);
+    if (!c.copy)
+        return;
+    Py_INCREF(dict);
+    dicts_.push_back(c);
+}
+
+void InterpreterState::addList(PyObject *list)
+{
+    if (!list || !PyList_Check(list))
+        return;
+    Copy c;
+    c.object = list;
+    c.copy = PyList_GetSlice(list, 0, PyList_GET_SIZE(list));
+    if (!c.copy)
+        return;
+    Py_INCREF(list);
+    lists_.push_back(c);
+}
+
+bool InterpreterState::restore() const
+{
+    for (size_t i=0; i<dicts_.size(); i++) {
+        // Remove added names one by one instead of clearing dictionary,
+        // so destructors of removed objects still have sys and builtins
+        PyObject * keys = PyDict_Keys(dicts_[i].object);
+        for (Py_ssize_t j=0; keys && j<PyList_GET_SIZE(keys); j++) {
+            PyObject * key = PyList_GET_ITEM(keys, j);
+            if (0 == PyDict_Contains(dicts_[i].copy, key)) {
+                PyDict_DelItem(dicts_[i].object, key);
+            }
+        }
+        Py_XDECREF(keys);
+        PyDict_Update(dicts_[i].object, dicts_[i].copy);
+    }
+    for (size_t i=0; i<lists_.size(); i++) {
+        PyList_SetSlice(lists_[i].object,
+                        0, PyList_GET_SIZE(lists_[i].object),
+                        lists_[i].copy);
+    }
+    Py_SetRecursionLimit(recursionLimit_);
+    return 0 == PyErr_Occurred();
+}
+
+} // namespace Python3Language
@@ -0,0 +1,53 @@
+#ifndef PYTHON3LANGUAGE_INTERPRETERSTATE_H
+#define PYTHON3LANGUAGE_INTERPRETERSTATE_H
+
+#include <vector>
+extern "C" {
+#include <Python.h>
+}
+
+namespace Python3Language {
+
+/** Copy of interpreter-wide state which a program might change.
+ *
+ * Includes namespaces of sys, builtins, __main__ and given modules,
+ * sys.modules, lists kept by sys (path, argv, meta_path, path_hooks) and
+ * recursion limit. Restoring the copy drops all names added by program,
+ * returns replaced objects back and removes imported modules.
+ *
+ * Must be created, restored and destroyed holding the GIL of interpreter
+ * it was created in.
+ */
+class InterpreterState
+{
+public:
+    /** Remembers state of the current interpreter; modules are
+     *  pre-imported modules to be restored too */
+    explicit InterpreterState(const std::vector<PyObject*> & modules);
+    ~InterpreterState();
+
+    /** Returns interpreter to remembered state, or returns false
+     *  if Python error occured */
+    bool restore() const;
+
+private /*types*/:
+    struct Copy {
+        PyObject * object;
+        PyObject * copy;
+    };
+
+private /*methods*/:
+    InterpreterState(const InterpreterState &);
+    InterpreterState & operator=(const InterpreterState &);
+    void addDict(PyObject * dict);
+    void addList(PyObject * list);
+
+private /*fields*/:
+    std::vector<Copy> dicts_;
+    std::vector<Copy> lists_;
+    int recursionLimit_;
+};
+
+} // namespace Python3Language
+
+#endif // PYTHON3LANGUAGE_INTERPRETERSTATE_H
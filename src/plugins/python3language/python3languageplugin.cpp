@@ -79,6 +79,8 @@ QString Python3LanguagePlugin::initialize(const QStringList &, const ExtensionSy
     runner_ = PythonRunThread::instance(this, myResourcesDir().absolutePath());
     qDebug() << "Connecting signals/slots";
     connectRunThreadSignals();
+    qDebug() << "Preparing interpreters for runs";
+    runner_->warmUpInterpreters();
     qDebug() << "Initialization done";
 
     sandboxWidget_ = SandboxWidget::instance(myResourcesDir().absolutePath(), 0);
@@ -108,6 +110,8 @@ void Python3LanguagePlugin::stop()
 {
     Q_FOREACH ( PythonAnalizerInstance* instance, analizerInstances_ )
         instance->stopPythonInterpreter();
+    if (runner_)
+        runner_->releaseInterpreters();
     QCoreApplication::instance()->processEvents();
     PyEval_AcquireThread(pyMain_);
     //    Py_Finalize();
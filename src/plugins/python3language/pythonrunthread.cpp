@@ -1,6 +1,7 @@
 #include "pythonrunthread.h"
 #include "interpretercallback.h"
 #include "actorshandler.h"
+#include "interpreterpool.h"
 #include "pyutils.h"
 #include "interfaces/runinterface.h"
 #include "variablesmodel.h"
@@ -27,6 +28,7 @@ PythonRunThread::PythonRunThread(QObject *parent, const QString & extraPythonPat
     : QThread(parent)
     , callback_(InterpreterCallback::instance(this))
     , actorsHandler_(ActorsHandler::instance(this))
+    , interpreterPool_(new InterpreterPool(extraPythonPath, actorsHandler_))
     , pythonPath_(extraPythonPath)
     , mutex_(new QMutex)
     , testingMode_(false)
@@ -52,6 +54,14 @@ PythonRunThread::PythonRunThread(QObject *parent, const QString & extraPythonPat
     qDebug() << "Run thread: created";
 }
 
+PythonRunThread::~PythonRunThread()
+{
+    delete interpreterPool_;
+    if (self == this) {
+        self = 0;
+    }
+}
+
 void PythonRunThread::reset()
 {
     QMutexLocker l(mutex_);
@@ -105,6 +115,16 @@ RunInterface::RunMode PythonRunThread::currentRunMode() const
     return runMode_.isEmpty() ? RunInterface::RM_Idle : runMode_.top();
 }
 
+void PythonRunThread::warmUpInterpreters()
+{
+    interpreterPool_->warmUp();
+}
+
+void PythonRunThread::releaseInterpreters()
+{
+    interpreterPool_->clear();
+}
+
 void PythonRunThread::setStdInStream(QTextStream *stream)
 {
     callback_->setStdInStream(stream);
@@ -138,27 +158,20 @@ void PythonRunThread::run()
         actorsHandler_->reset();
         variablesModel_->resetModel();
 
-        // Initialize interpreter in current thread
-        PyGILState_Ensure();
-        PyThreadState * py = Py_NewInterpreter();
-    #ifdef Q_OS_WIN32
-        prepareBundledSysPath();
-    #else
-        appendToSysPath(pythonPath_);
-    #endif        
+        // Take pre-initialized interpreter with actor modules created
+        PyThreadState * py = interpreterPool_->acquire();
+        if (!py) {
+            const QString error = tr("Can't initialize Python interpreter");
+            mutex_->lock();
+            errorText_ = error;
+            mutex_->unlock();
+            Q_EMIT errorOutputRequest(error);
+            break;
+        }
+        PyEval_AcquireThread(py);
         createSysArgv(QStringList() << QDir::current().relativeFilePath(sourceProgramPath_));
-        PyObject* py_run_wrapper = PyImport_ImportModule("run_wrapper");
-        if (!py_run_wrapper) { printPythonTraceback(); return; }
         PyEval_ReleaseThread(py);
 
-        // Create actor 'modules'
-        clearCreatedModules();
-        for (int i=0; i<actorsHandler_->size(); i++) {
-            const QString source = actorsHandler_->moduleWrapper(i);
-            const QString name = actorsHandler_->moduleName(i);
-            createModuleFromSource(py, name, source);
-        }
-
         // Prepare pre-run and post-run program code
         mutex_->lock();
         PyEval_AcquireThread(py);
@@ -292,11 +305,9 @@ void PythonRunThread::run()
             PyEval_ReleaseThread(py);
         }
 
-        // Finalize interpreter
-        PyEval_AcquireThread(py);
-        Py_EndInterpreter(py);
+        // Reset interpreter and return it back for next run
+        interpreterPool_->release(py);
         py = 0;
-        PyEval_ReleaseLock();
 
         firstRun = false;
         testRunCount_ --;
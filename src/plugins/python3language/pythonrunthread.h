@@ -13,6 +13,7 @@ namespace Python3Language {
 
 class InterpreterCallback;
 class ActorsHandler;
+class InterpreterPool;
 class VariablesModel;
 
 using Shared::RunInterface;
@@ -30,6 +31,7 @@ class PythonRunThread : public QThread
     Q_OBJECT
 public /*methods*/:
     static PythonRunThread * instance(QObject *parent = 0, const QString & extraPythonPath = QString());
+    ~PythonRunThread();
     inline QString errorText() const { QMutexLocker l(mutex_); return errorText_; }
     inline QVariant testingResult() const { QMutexLocker l(mutex_); return testingResult_; }
     inline int currentLineNumber() const { QMutexLocker l(mutex_); return lineNumber_; }
@@ -54,6 +56,9 @@ public /*methods*/:
 
     RunInterface::RunMode currentRunMode() const;
 
+    void warmUpInterpreters();
+    void releaseInterpreters();
+
 Q_SIGNALS:
     void errorOutputRequest(const QString &);
     void outputRequest(const QString & output);
@@ -103,8 +108,8 @@ private /*fields*/:
     QStack<RunInterface::RunMode> runMode_;
     InterpreterCallback * callback_;
     ActorsHandler* actorsHandler_;
+    InterpreterPool* interpreterPool_;
     QString pythonPath_;
-    PyObject * py_run_wrapper;
     QString sourceProgramPath_;
     QString sourceProgram_;    
     QMutex * mutex_;
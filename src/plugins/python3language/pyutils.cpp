@@ -481,6 +481,12 @@ extern PyObject* createModuleFromSource(
     return module;
 }
 
+extern void registerCreatedModule(const QString &name, PyObject *module)
+{
+    Py_XINCREF(module);
+    CreatedModules[name] = module;
+}
+
 extern PyObject* findCreatedModule(const QString &name)
 {
     if (CreatedModules.contains(name)) {
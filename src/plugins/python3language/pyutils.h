@@ -78,6 +78,8 @@ extern PyObject* createModuleFromSource(
 
 extern void clearCreatedModules();
 
+extern void registerCreatedModule(const QString & name, PyObject * module);
+
 extern PyObject* findCreatedModule(const QString & name);
 
 extern void appendToSysPath(const QString & path);
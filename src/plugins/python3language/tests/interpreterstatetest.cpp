@@ -0,0 +1,104 @@
+/*
+ * Checks that a pooled interpreter does not keep changes made by a program
+ * to sys, builtins and pre-imported modules for the next program run.
+ */
+
+#include "../interpreterstate.h"
+
+#include <cstdio>
+
+using namespace Python3Language;
+
+static const char * const FirstRun =
+        "import sys, builtins, io, json\n"
+        "import run_wrapper, actor\n"
+        "sys.path.append('/first/run')\n"
+        "sys.argv[:] = ['first']\n"
+        "sys.setrecursionlimit(123)\n"
+        "sys.stdout = io.StringIO()\n"
+        "sys.first_run = True\n"
+        "builtins.len = lambda x: -1\n"
+        "builtins.first_run = True\n"
+        "run_wrapper.value = 'first'\n"
+        "del actor.function\n"
+        "first_run = True\n";
+
+static const char * const SecondRun =
+        "import sys, builtins\n"
+        "import run_wrapper, actor\n"
+        "assert '/first/run' not in sys.path\n"
+        "assert sys.argv == ['']\n"
+        "assert sys.getrecursionlimit() == limit\n"
+        "assert sys.stdout is sys.__stdout__\n"
+        "assert not hasattr(sys, 'first_run')\n"
+        "assert len([1, 2]) == 2\n"
+        "assert not hasattr(builtins, 'first_run')\n"
+        "assert run_wrapper.value == 'initial'\n"
+        "assert actor.function() == 1\n"
+        "assert 'json' not in sys.modules\n"
+        "assert 'first_run' not in globals()\n";
+
+static PyObject * createModule(const char * name, const char * source)
+{
+    PyObject * code = Py_CompileString(source, name, Py_file_input);
+    if (!code)
+        return 0;
+    PyObject * module = PyImport_ExecCodeModule(const_cast<char*>(name), code);
+    Py_DECREF(code);
+    return module;
+}
+
+static bool run(const char * source)
+{
+    PyObject * globals = PyModule_GetDict(PyImport_AddModule("__main__"));
+    PyObject * result = PyRun_String(source, Py_file_input, globals, globals);
+    if (!result) {
+        PyErr_Print();
+        return false;
+    }
+    Py_DECREF(result);
+    return true;
+}
+
+int main()
+{
+    Py_InitializeEx(0);
+    PyThreadState * mainThread = PyThreadState_Get();
+    PyThreadState * py = Py_NewInterpreter();
+    if (!py) {
+        fprintf(stderr, "Can't create interpreter\n");
+        return 1;
+    }
+    PyObject * argv = Py_BuildValue("[s]", "");
+    PySys_SetObject("argv", argv);
+    Py_DECREF(argv);
+
+    std::vector<PyObject*> modules;
+    modules.push_back(createModule("run_wrapper", "value = 'initial'\n"));
+    modules.push_back(createModule("actor", "def function():\n    return 1\n"));
+    if (!modules[0] || !modules[1]) {
+        PyErr_Print();
+        return 1;
+    }
+    PyObject * globals = PyModule_GetDict(PyImport_AddModule("__main__"));
+    PyObject * limit = PyLong_FromLong(Py_GetRecursionLimit());
+    PyDict_SetItemString(globals, "limit", limit);
+    Py_DECREF(limit);
+
+    InterpreterState * state = new InterpreterState(modules);
+    bool ok = run(FirstRun);
+    ok = state->restore() && ok;
+    ok = run(SecondRun) && ok;
+    // State is restored repeatedly for each next run
+    ok = run(FirstRun) && state->restore() && run(SecondRun) && ok;
+
+    delete state;
+    Py_DECREF(modules[0]);
+    Py_DECREF(modules[1]);
+    Py_EndInterpreter(py);
+    PyThreadState_Swap(mainThread);
+    Py_Finalize();
+
+    fprintf(stderr, "%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -6,8 +6,13 @@
 #include <kumir2-libs/vm/variant.hpp>
 #include <kumir2-libs/vm/vm_bytecode.hpp>
 #include <kumir2-libs/vm/vm.hpp>
+#include <kumir2-libs/vm/vm_scheduler.hpp>
 
 #include <algorithm>
+#include <iterator>
+#include <climits>
+#include <cstdint>
+#include <cerrno>
 
 #if defined(WIN32) || defined(_WIN32)
 #include <Windows.h>
@@ -23,9 +28,7 @@ static Encoding LOCALE;
 
 static void do_output(const String &s)
 {
-    Kumir::EncodingError encodingError;
-    const std::string localstring = Coder::encode(LOCALE, s, encodingError);
-    std::cout << localstring;
+    Files::getStdOutBuffer(LOCALE)->write(s);
 }
 
 static void do_output(const std::string & s)
@@ -55,11 +58,27 @@ int usage(const char * programName)
         message  = Core::fromUtf8("Вызов:");
         message.push_back(_n);
         message += Core::fromUtf8("\t")+Core::fromUtf8(std::string(programName));
-        message += Core::fromUtf8(" [-ansi] ИМЯФАЙЛА.kod [ПАРАМ1 [ПАРАМ2 ... [ПАРАМn]]]");
+        message += Core::fromUtf8(" [-ansi] [-l] [--profile[=ФАЙЛ]] [--recursion-limit=N] [--max-instructions=N] [--time-limit=МС] [--memory-limit=МБ] [--sessions=N [--workers=N]] ИМЯФАЙЛА.kod [ПАРАМ1 [ПАРАМ2 ... [ПАРАМn]]]");
         message.push_back(_n);
         message.push_back(_n);
         message += Core::fromUtf8("\t-ansi\t\tИспользовть кодировку 1251 вместо 866 в терминале (только для Windows)");
         message.push_back(_n);
+        message += Core::fromUtf8("\t-l, --line-buffered\tВыводить каждую строку сразу (по умолчанию, если вывод в терминал)");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--profile[=ФАЙЛ]\tВывести профиль выполнения по строкам и алгоритмам, и сохранить его в ФАЙЛ в формате Callgrind");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--recursion-limit=N\tНаибольшая глубина вложенных вызовов алгоритмов, 0 - без ограничения");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--max-instructions=N\tПрервать выполнение после N команд (код возврата 123)");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--time-limit=МС\tПрервать выполнение через МС миллисекунд (код возврата 124)");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--memory-limit=МБ\tПрервать выполнение, если строки и таблицы занимают больше МБ мегабайт (код возврата 122)");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--sessions=N\tВыполнить N копий программы попеременно, каждой передать весь ввод; вывод копий выводится по очереди");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--workers=N\tЧисло потоков для копий программы, 0 - по числу процессоров");
+        message.push_back(_n);
         message += Core::fromUtf8("\tИМЯФАЙЛА.kod\tИмя выполнеяемой программы");
         message.push_back(_n);
         message += Core::fromUtf8("\tПАРАМ1...ПАРАМn\tАргументы главного алгоритма Кумир-программы");
@@ -69,11 +88,27 @@ int usage(const char * programName)
         message  = Core::fromUtf8("Usage:");
         message.push_back(_n);
         message += Core::fromUtf8("\t")+Core::fromUtf8(std::string(programName));
-        message += Core::fromUtf8(" [-ansi] FILENAME.kod [ARG1 [ARG2 ... [ARGn]]]");
+        message += Core::fromUtf8(" [-ansi] [-l] [--profile[=FILE]] [--recursion-limit=N] [--max-instructions=N] [--time-limit=MSECS] [--memory-limit=MB] [--sessions=N [--workers=N]] FILENAME.kod [ARG1 [ARG2 ... [ARGn]]]");
         message.push_back(_n);
         message.push_back(_n);
         message += Core::fromUtf8("\t-ansi\t\tUse codepage 1251 instead of 866 in console (Windows only)");
         message.push_back(_n);
+        message += Core::fromUtf8("\t-l, --line-buffered\tWrite output line by line (default if output is a terminal)");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--profile[=FILE]\tPrint lines and algorithms execution profile, and save it to FILE in Callgrind format");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--recursion-limit=N\tMaximum depth of nested algorithm calls, 0 means no limit");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--max-instructions=N\tStop after N instructions (exit code 123)");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--time-limit=MSECS\tStop after MSECS milliseconds (exit code 124)");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--memory-limit=MB\tStop if strings and tables take more than MB megabytes (exit code 122)");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--sessions=N\tRun N copies of program in turns, each of them reads the whole input; outputs of copies are written one after another");
+        message.push_back(_n);
+        message += Core::fromUtf8("\t--workers=N\tNumber of threads running copies of program, 0 means one per processor");
+        message.push_back(_n);
         message += Core::fromUtf8("\tFILENAME.kod\tKumir runtime file name");
         message.push_back(_n);
         message += Core::fromUtf8("\tARG1...ARGn\tKumir program main algorithm arguments");
@@ -86,6 +121,7 @@ int usage(const char * programName)
 
 int showErrorMessage(const String & message, int code) {
     Kumir::EncodingError encodingError;
+    Files::flushOutputBuffers();
     bool toHttp = false;
 #if !defined(WIN32) && !defined(_WIN32)
     char * REQUEST_METHOD = getenv("REQUEST_METHOD");
@@ -109,6 +145,143 @@ int showErrorMessage(const String & message, int code) {
     }
 }
 
+void showProfile(VM::Profiler & profiler, const std::string & fileName)
+{
+    Kumir::EncodingError encodingError;
+    profiler.finish();
+    std::cerr << Coder::encode(LOCALE, profiler.textReport(), encodingError);
+    if (!fileName.empty()) {
+        std::ofstream callgrindFile(fileName.c_str(), std::ios::out|std::ios::binary);
+        if (callgrindFile.is_open())
+            profiler.writeCallgrindReport(callgrindFile);
+        else
+            std::cerr << "Can't write profile file: " << fileName << std::endl;
+    }
+}
+
+/* Shows runtime error of program and returns exit code for it */
+int showRuntimeError(const VM::KumirVM & vm)
+{
+    static const String RUNTIME_ERROR = Core::fromUtf8("ОШИБКА ВЫПОЛНЕНИЯ: ");
+    static const String RUNTIME_ERROR_AT = Core::fromUtf8("ОШИБКА ВЫПОЛНЕНИЯ В СТРОКЕ ");
+    static const String COLON = Core::fromAscii(": ");
+    String message;
+    if (vm.effectiveLineNo()!=-1) {
+        message = RUNTIME_ERROR_AT+
+                Converter::sprintfInt(vm.effectiveLineNo()+1,10,0,0)+
+                COLON+
+                vm.error();
+    }
+    else {
+        message = RUNTIME_ERROR + vm.error();
+    }
+    int code = 120;
+    if (vm.exceededLimit()==VM::KumirVM::RL_Memory)
+        code = 122;
+    else if (vm.exceededLimit()==VM::KumirVM::RL_Instructions)
+        code = 123;
+    else if (vm.exceededLimit()==VM::KumirVM::RL_Time)
+        code = 124;
+    return showErrorMessage(message, code);
+}
+
+/* Parses value of numeric command line option, returns false
+   if it is not a decimal number in range 0..maximum */
+bool parseOptionValue(const std::string & text, unsigned long long maximum, unsigned long long & value)
+{
+    if (text.empty() || text.find_first_not_of("0123456789")!=std::string::npos)
+        return false;
+    errno = 0;
+    value = strtoull(text.c_str(), 0, 10);
+    return errno!=ERANGE && value<=maximum;
+}
+
+/* Console output of a session kept until all sessions are finished */
+class SessionOutputBuffer: public AbstractOutputBuffer {
+public:
+    inline void writeRawString(const String & s) _override { text.append(s); }
+    String text;
+};
+
+/* Runs copies of program as sessions evaluated by VM::Scheduler in turns.
+   Each copy reads the whole standard input, which is typed line by line
+   after all copies started, so copies waiting for it are parked. Outputs
+   of copies are written one after another when all of them finished,
+   and work done by each copy is written to standard error */
+int runSessions(const Bytecode::Data & programData,
+                const String & programName,
+                const String & programDir,
+                size_t sessionsCount,
+                unsigned workersCount,
+                int recursionLimit,
+                unsigned long long instructionsLimit,
+                uint32_t timeLimit,
+                unsigned long long memoryLimit)
+{
+    Kumir::EncodingError encodingError;
+    const std::string input((std::istreambuf_iterator<char>(std::cin)),
+                            std::istreambuf_iterator<char>());
+    const String text = Coder::decode(LOCALE, input, encodingError);
+
+    std::vector< std::shared_ptr<VM::Session> > sessions(sessionsCount);
+    std::vector<SessionOutputBuffer> outputs(sessionsCount);
+    std::vector<VM::Console::OutputFunctor> outputFunctors(sessionsCount);
+    {
+        VM::Scheduler scheduler(workersCount);
+        for (size_t i=0; i<sessionsCount; i++) {
+            sessions[i] = std::make_shared<VM::Session>();
+            VM::Session & session = *sessions[i];
+            String setProgramError;
+            session.setProgram(programData, programName, &setProgramError);
+            if (setProgramError.length() > 0) {
+                static const String LOAD_ERROR = Core::fromUtf8("ОШИБКА ЗАГРУЗКИ ПРОГРАММЫ: ");
+                return showErrorMessage(LOAD_ERROR + setProgramError, 126);
+            }
+            outputFunctors[i].setLocale(LOCALE);
+            outputFunctors[i].setOutputBuffer(&outputs[i]);
+            session.vm().setFunctor(&outputFunctors[i]);
+            session.setConsoleOutputBuffer(&outputs[i]);
+            session.vm().setProgramDirectory(programDir);
+            session.vm().setRecursionLimit(recursionLimit);
+            session.vm().setInstructionsLimit(instructionsLimit);
+            session.vm().setTimeLimit(timeLimit);
+            session.vm().setMemoryLimit(memoryLimit);
+            session.reset();
+            session.vm().setDebugOff(true);
+            scheduler.start(sessions[i]);
+        }
+        size_t lineStart = 0;
+        while (lineStart < text.length()) {
+            size_t lineEnd = text.find(Char('\n'), lineStart);
+            lineEnd = lineEnd==String::npos ? text.length() : lineEnd+1;
+            const String line = text.substr(lineStart, lineEnd-lineStart);
+            for (size_t i=0; i<sessionsCount; i++)
+                sessions[i]->provideInput(line);
+            lineStart = lineEnd;
+        }
+        for (size_t i=0; i<sessionsCount; i++)
+            sessions[i]->closeInput();
+        for (size_t i=0; i<sessionsCount; i++)
+            sessions[i]->waitForFinished();
+    }
+
+    int result = 0;
+    for (size_t i=0; i<sessionsCount; i++) {
+        do_output(outputs[i].text);
+        const VM::KumirVM & vm = sessions[i]->vm();
+        if (vm.error().length() > 0)
+            result = std::max(result, showRuntimeError(vm));
+        const VM::SessionStatistics statistics = sessions[i]->statistics();
+        std::cerr << "Session " << i+1 << ": "
+                  << statistics.instructions << " instructions, "
+                  << statistics.quanta << " quanta, "
+                  << statistics.migrations << " migrations, "
+                  << statistics.cpuTime / 1000u << " us" << std::endl;
+    }
+    Files::flushOutputBuffers();
+    return result;
+}
+
 bool IsPluginExtern(const Bytecode::TableElem & e) {
     bool isExtern = e.type==Bytecode::EL_EXTERN;
     bool isKumirModule = e.fileName.length()>4 &&
@@ -185,6 +358,19 @@ int main(int argc, char *argv[])
     std::deque<std::string> args;
     bool testingMode = false;
     bool quietMode = false;
+    bool profiling = false;
+    std::string profileFileName;
+    int recursionLimit = MAX_RECURSION_SIZE;
+    unsigned long long instructionsLimit = 0u;
+    uint32_t timeLimit = 0u;
+    unsigned long long memoryLimit = 0u;
+    unsigned long long sessionsCount = 0u;
+    unsigned long long workersCount = 0u;
+#if defined(WIN32) || defined(_WIN32)
+    bool lineBuffered = false;
+#else
+    bool lineBuffered = isatty(STDOUT_FILENO);
+#endif
     for (int i=1; i<argc; i++) {
         std::string  arg(argv[i]);
         if (arg.length()==0)
@@ -194,6 +380,15 @@ int main(int argc, char *argv[])
         static const std::string minus_minus_testing("--test");
         static const std::string minus_p("-p");
         static const std::string minus_minus_pipe("--pipe");
+        static const std::string minus_l("-l");
+        static const std::string minus_minus_line_buffered("--line-buffered");
+        static const std::string minus_minus_profile("--profile");
+        static const std::string minus_minus_recursion_limit("--recursion-limit=");
+        static const std::string minus_minus_max_instructions("--max-instructions=");
+        static const std::string minus_minus_time_limit("--time-limit=");
+        static const std::string minus_minus_memory_limit("--memory-limit=");
+        static const std::string minus_minus_sessions("--sessions=");
+        static const std::string minus_minus_workers("--workers=");
         if (programName.empty()) {
             if (arg==minus_t || arg==minus_minus_testing) {
                 testingMode = true;
@@ -201,6 +396,55 @@ int main(int argc, char *argv[])
             else if (arg==minus_p || arg==minus_minus_pipe) {
                 quietMode = true;
             }
+            else if (arg==minus_l || arg==minus_minus_line_buffered) {
+                lineBuffered = true;
+            }
+            else if (arg.compare(0, minus_minus_profile.length(), minus_minus_profile)==0) {
+                profiling = true;
+                if (arg.length()>minus_minus_profile.length()+1 && arg[minus_minus_profile.length()]=='=')
+                    profileFileName = arg.substr(minus_minus_profile.length()+1);
+            }
+            else if (arg.compare(0, minus_minus_recursion_limit.length(), minus_minus_recursion_limit)==0) {
+                unsigned long long value = 0u;
+                if (!parseOptionValue(arg.substr(minus_minus_recursion_limit.length()), INT_MAX, value)) {
+                    std::cerr << "Invalid option value: " << arg << std::endl;
+                    return usage(argv[0]);
+                }
+                recursionLimit = int(value);
+            }
+            else if (arg.compare(0, minus_minus_max_instructions.length(), minus_minus_max_instructions)==0) {
+                if (!parseOptionValue(arg.substr(minus_minus_max_instructions.length()), ULLONG_MAX, instructionsLimit)) {
+                    std::cerr << "Invalid option value: " << arg << std::endl;
+                    return usage(argv[0]);
+                }
+            }
+            else if (arg.compare(0, minus_minus_time_limit.length(), minus_minus_time_limit)==0) {
+                unsigned long long value = 0u;
+                if (!parseOptionValue(arg.substr(minus_minus_time_limit.length()), UINT32_MAX, value)) {
+                    std::cerr << "Invalid option value: " << arg << std::endl;
+                    return usage(argv[0]);
+                }
+                timeLimit = static_cast<uint32_t>(value);
+            }
+            else if (arg.compare(0, minus_minus_memory_limit.length(), minus_minus_memory_limit)==0) {
+                if (!parseOptionValue(arg.substr(minus_minus_memory_limit.length()), ULLONG_MAX >> 20, memoryLimit)) {
+                    std::cerr << "Invalid option value: " << arg << std::endl;
+                    return usage(argv[0]);
+                }
+                memoryLimit *= 1024u * 1024u;
+            }
+            else if (arg.compare(0, minus_minus_sessions.length(), minus_minus_sessions)==0) {
+                if (!parseOptionValue(arg.substr(minus_minus_sessions.length()), 100000u, sessionsCount)) {
+                    std::cerr << "Invalid option value: " << arg << std::endl;
+                    return usage(argv[0]);
+                }
+            }
+            else if (arg.compare(0, minus_minus_workers.length(), minus_minus_workers)==0) {
+                if (!parseOptionValue(arg.substr(minus_minus_workers.length()), 1024u, workersCount)) {
+                    std::cerr << "Invalid option value: " << arg << std::endl;
+                    return usage(argv[0]);
+                }
+            }
             else if (arg==minus_ansi) {
                 IO::LOCALE_ENCODING = LOCALE = CP1251;
             }
@@ -215,18 +459,18 @@ int main(int argc, char *argv[])
     if (programName.empty())
         return usage(argv[0]);
 
-    // Load a program
-    std::ifstream programFile(programName.c_str(), std::ios::in|std::ios::binary);
-    if (!programFile.is_open()) {
+    // Load a program: file is mapped and algorithms are decoded
+    // on first call, so large programs start without delay
+    const std::shared_ptr<const Bytecode::Image> programImage =
+            Bytecode::Image::fromFile(programName);
+    if (!programImage) {
         std::cerr << "Can't open program file: " << programName << std::endl;
         return 1;
     }
     const std::string suffix = programName.substr(programName.length()-2);
     Bytecode::Data programData;
 
-    Bytecode::bytecodeFromDataStream(programFile, programData);
-
-    programFile.close();
+    Bytecode::bytecodeFromImage(programImage, programData);
 
     // Check if it's possible to run using regular runtime
     bool hasPluginDependency =
@@ -236,8 +480,22 @@ int main(int argc, char *argv[])
         return runKumirXRun(argc, argv);
     }
 
+    // Output is written in large blocks unless user needs to see each line;
+    // it is also flushed before every input request
+    static const int OutputFlushInterval = 500; // msecs
+    Files::getStdOutBuffer(LOCALE)->setBuffering(lineBuffered,
+                                                 FileOutputBuffer::DefaultCapacity,
+                                                 OutputFlushInterval);
+
     // Prepare runner
     VM::KumirVM vm;
+    VM::Profiler profiler;
+    if (profiling)
+        vm.setProfiler(&profiler);
+    vm.setRecursionLimit(recursionLimit);
+    vm.setInstructionsLimit(instructionsLimit);
+    vm.setTimeLimit(timeLimit);
+    vm.setMemoryLimit(memoryLimit);
 
     VM::Console::InputFunctor inputFunctor;
     VM::Console::OutputFunctor outputFunctor;
@@ -267,6 +525,12 @@ int main(int argc, char *argv[])
         programDir = programPath.substr(0, slashPos);
     }
 
+    if (sessionsCount > 0u) {
+        return runSessions(programData, Coder::decode(LOCALE, programName, encodingError), programDir,
+                           size_t(sessionsCount), unsigned(workersCount),
+                           recursionLimit, instructionsLimit, timeLimit, memoryLimit);
+    }
+
     vm.setProgramDirectory(programDir);
 
     static const String LOAD_ERROR = Core::fromUtf8("ОШИБКА ЗАГРУЗКИ ПРОГРАММЫ: ");
@@ -295,24 +559,18 @@ int main(int argc, char *argv[])
     while (vm.hasMoreInstructions()) {
         vm.evaluateNextInstruction();
         if (vm.error().length()>0) {
-            static const String RUNTIME_ERROR = Core::fromUtf8("ОШИБКА ВЫПОЛНЕНИЯ: ");
-            static const String RUNTIME_ERROR_AT = Core::fromUtf8("ОШИБКА ВЫПОЛНЕНИЯ В СТРОКЕ ");
-            static const String COLON = Core::fromAscii(": ");
-            String message;
-            if (vm.effectiveLineNo()!=-1) {
-                message = RUNTIME_ERROR_AT+
-                        Converter::sprintfInt(vm.effectiveLineNo()+1,10,0,0)+
-                        COLON+
-                        vm.error();
-            }
-            else {
-                message = RUNTIME_ERROR + vm.error();
-            }
-            return showErrorMessage(message, 120);
-            return 120;
+            const int code = showRuntimeError(vm);
+            if (profiling)
+                showProfile(profiler, profileFileName);
+            return code;
         }
     }
 
+    Files::flushOutputBuffers();
+
+    if (profiling)
+        showProfile(profiler, profileFileName);
+
     if (testingMode)
         return vm.returnCode();
     else
@@ -0,0 +1,95 @@
+# coding=UTF-8
+
+# Checks cache of compiled programs used by kumir2-bc: repeated compilation
+# of unchanged program must give the same executable taken from cache,
+# change of program or of included file must compile it again.
+# Prints times of compilation and cache statistics.
+# Usage:
+#    bccachetest.py [--kumirdir=KUMIR_DIR] [SIZE]
+
+import sys
+import os
+import os.path
+import shutil
+import subprocess
+import tempfile
+import time
+import kumirutils
+
+SIZE = 5000
+sizes = [int(arg) for arg in sys.argv[1:] if arg.isdigit()]
+if len(sizes)>0:
+    SIZE = sizes[0]
+
+
+def program(size):
+    lines = [u"ВКЛЮЧИТЬ \"included.kum\"", u"алг", u"нач", u"цел x, y", u"x := 0"]
+    for i in range(size):
+        lines += [u"x := x + %d" % i]
+        lines += [u"если x > %d то y := x иначе y := 0 все" % i]
+    lines += [u"вывод x, нс", u"вывод функция(x), нс", u"кон"]
+    return lines
+
+
+def included(value):
+    return [u"алг цел функция(цел a)", u"нач", u"знач := a + %d" % value, u"кон"]
+
+
+def statistics(cache_dir):
+    result = {"hits": 0, "misses": 0, "stores": 0}
+    file_name = cache_dir+os.path.sep+"statistics.ini"
+    if os.path.exists(file_name):
+        for line in open(file_name).read().split("\n"):
+            if "=" in line:
+                key, value = line.split("=", 1)
+                result[key.strip()] = int(value)
+    return result
+
+
+def compile_program(kumfile):
+    start = time.time()
+    status = subprocess.call([kumirutils.bc_path(), kumfile],
+                             stdout=open(os.devnull, "w"),
+                             stderr=open(os.devnull, "w"))
+    elapsed = time.time()-start
+    kodfile = kumfile[0:-4]+".kod"
+    data = open(kodfile, "rb").read() if os.path.exists(kodfile) else None
+    return status, elapsed, data
+
+
+if __name__=="__main__":
+    work_dir = tempfile.mkdtemp()
+    cache_dir = work_dir+os.path.sep+"cache"
+    os.environ["KUMIR2_BYTECODE_CACHE_DIR"] = cache_dir
+    kumfile = work_dir+os.path.sep+"program.kum"
+    incfile = work_dir+os.path.sep+"included.kum"
+    failed = False
+    try:
+        kumirutils.write_lines(kumfile, program(SIZE))
+        kumirutils.write_lines(incfile, included(1))
+        steps = [
+            ("first compilation", None, "misses"),
+            ("unchanged", None, "hits"),
+            ("included file changed", lambda: kumirutils.write_lines(incfile, included(2)), "misses"),
+            ("unchanged again", None, "hits"),
+            ("program changed", lambda: kumirutils.write_lines(kumfile, program(SIZE+1)), "misses"),
+        ]
+        previous = statistics(cache_dir)
+        previous_data = None
+        sys.stdout.write("%-24s %8s %10s %8s\n" % ("step", "status", "time, s", "result"))
+        for name, change, expected in steps:
+            if change:
+                change()
+            status, elapsed, data = compile_program(kumfile)
+            current = statistics(cache_dir)
+            ok = status==0 and data is not None and current[expected]==previous[expected]+1
+            if expected=="hits":
+                ok = ok and data==previous_data
+            sys.stdout.write("%-24s %8d %10.3f %8s\n" % (name, status, elapsed, "OK" if ok else "FAIL"))
+            failed = failed or not ok
+            previous = current
+            previous_data = data
+        sys.stdout.write("cache: %(hits)d hits, %(misses)d misses, %(stores)d stores\n" % previous)
+    finally:
+        shutil.rmtree(work_dir)
+    sys.exit(1 if failed else 0)
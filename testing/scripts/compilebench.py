@@ -0,0 +1,97 @@
+# coding=UTF-8
+
+# Measures time of kumir2-bc on generated large programs.
+# Usage:
+#    compilebench.py [--kumirdir=KUMIR_DIR] [--repeat=N] [SIZE ...]
+
+import sys
+import os
+import os.path
+import subprocess
+import tempfile
+import time
+import kumirutils
+
+REPEAT = 3
+for arg in sys.argv:
+    if arg.startswith("--repeat="):
+        REPEAT = int(arg[len("--repeat="):])
+
+SIZES = [1000, 5000, 20000]
+sizes = [int(arg) for arg in sys.argv[1:] if arg.isdigit()]
+if len(sizes)>0:
+    SIZES = sizes
+
+
+def flat_program(size):
+    "Many simple statements with distinct constants"
+    lines = [u"алг", u"нач", u"цел x, y", u"x := 0"]
+    for i in range(size):
+        lines += [u"x := x + %d" % i]
+        lines += [u"если x > %d и x < %d то y := x иначе y := 0 все" % (i, i*2)]
+    lines += [u"вывод x, нс", u"кон"]
+    return lines
+
+
+def nested_program(size):
+    "Deeply nested loops with exits on every level"
+    depth = max(1, size//100)
+    lines = [u"алг", u"нач", u"цел x", u"x := 0"]
+    for i in range(depth):
+        lines += [u"цел i%d" % i]
+    for i in range(depth):
+        lines += [u"нц для i%d от 1 до 2" % i]
+        lines += [u"если x > %d то выход все" % (size+i)]
+    lines += [u"x := x + 1"]
+    for i in range(depth):
+        lines += [u"кц"]
+    lines += [u"вывод x, нс", u"кон"]
+    return lines
+
+
+def many_algorithms_program(size):
+    "Many small algorithms calling each other"
+    count = max(1, size//20)
+    lines = [u"алг", u"нач", u"вывод ф0(1), нс", u"кон"]
+    for i in range(count):
+        lines += [u"алг цел ф%d(цел a)" % i, u"нач"]
+        if i<count-1:
+            lines += [u"знач := ф%d(a + %d)" % (i+1, i)]
+        else:
+            lines += [u"знач := a"]
+        lines += [u"кон"]
+    return lines
+
+
+def measure(lines):
+    fd, kumfile = tempfile.mkstemp(suffix=".kum")
+    os.write(fd, (u"\n".join(lines)+u"\n").encode("utf-8"))
+    os.close(fd)
+    best = None
+    try:
+        for i in range(REPEAT):
+            start = time.time()
+            subprocess.call([kumirutils.bc_path(), kumfile],
+                            stdout=open(os.devnull, "w"),
+                            stderr=open(os.devnull, "w"))
+            elapsed = time.time()-start
+            if best is None or elapsed<best:
+                best = elapsed
+    finally:
+        os.remove(kumfile)
+        kodfile = kumfile[0:-4]+".kod"
+        if os.path.exists(kodfile):
+            os.remove(kodfile)
+    return best
+
+
+if __name__=="__main__":
+    generators = [("flat", flat_program),
+                  ("nested", nested_program),
+                  ("algorithms", many_algorithms_program)]
+    sys.stdout.write("%-12s %8s %8s %10s\n" % ("program", "size", "lines", "time, s"))
+    for name, generator in generators:
+        for size in SIZES:
+            lines = generator(size)
+            elapsed = measure(lines)
+            sys.stdout.write("%-12s %8d %8d %10.3f\n" % (name, size, len(lines), elapsed))
@@ -0,0 +1,132 @@
+# coding=UTF-8
+
+# Measures input/output throughput of kumir2-run: reading and writing
+# COUNT integers (10^6 by default) from/to files and standard streams.
+# Usage:
+#    iobench.py [--kumirdir=KUMIR_DIR] [--repeat=N] [--count=N]
+
+import sys
+import os
+import os.path
+import random
+import shutil
+import subprocess
+import tempfile
+import time
+import kumirutils
+
+REPEAT = 3
+COUNT = 1000000
+for arg in sys.argv:
+    if arg.startswith("--repeat="):
+        REPEAT = int(arg[len("--repeat="):])
+    if arg.startswith("--count="):
+        COUNT = int(arg[len("--count="):])
+
+
+def read_file_program(datafile):
+    "Reads all integers from file using Files module"
+    return [u"использовать Файлы",
+            u"алг",
+            u"нач",
+            u"файл f",
+            u"цел x, s",
+            u"s := 0",
+            u"f := открыть на чтение(\"%s\")" % datafile.replace("\\", "/"),
+            u"нц пока не конец файла(f)",
+            u"ввод f, x",
+            u"s := mod(s + mod(x, 1000), 1000)",
+            u"кц",
+            u"закрыть(f)",
+            u"вывод s, нс",
+            u"кон"]
+
+
+def read_stdin_program():
+    "Reads count of integers and then integers from standard input"
+    return [u"алг",
+            u"нач",
+            u"цел n, i, x, s",
+            u"s := 0",
+            u"ввод n",
+            u"нц для i от 1 до n",
+            u"ввод x",
+            u"s := mod(s + mod(x, 1000), 1000)",
+            u"кц",
+            u"вывод s, нс",
+            u"кон"]
+
+
+def write_stdout_program():
+    "Prints integers to standard output"
+    return [u"алг",
+            u"нач",
+            u"цел i",
+            u"нц для i от 1 до %d" % COUNT,
+            u"вывод i, нс",
+            u"кц",
+            u"кон"]
+
+
+def write_file_program(outfile):
+    "Writes integers to file using Files module"
+    return [u"использовать Файлы",
+            u"алг",
+            u"нач",
+            u"файл f",
+            u"цел i",
+            u"f := открыть на запись(\"%s\")" % outfile.replace("\\", "/"),
+            u"нц для i от 1 до %d" % COUNT,
+            u"вывод f, i, нс",
+            u"кц",
+            u"закрыть(f)",
+            u"кон"]
+
+
+def make_data(dirname):
+    rnd = random.Random(2015)
+    values = [str(rnd.randint(-1000000000, 1000000000)) for i in range(COUNT)]
+    datafile = os.path.join(dirname, "data.txt")
+    with open(datafile, "w") as f:
+        f.write(str(COUNT)+"\n")
+        f.write("\n".join(values)+"\n")
+    return datafile
+
+
+def measure(dirname, lines, stdinfile):
+    kumfile = os.path.join(dirname, "program.kum")
+    with open(kumfile, "wb") as f:
+        f.write((u"\n".join(lines)+u"\n").encode("utf-8"))
+    subprocess.call([kumirutils.binary_path("kumir2-bc"), kumfile],
+                    stdout=open(os.devnull, "w"),
+                    stderr=open(os.devnull, "w"))
+    kodfile = kumfile[0:-4]+".kod"
+    best = None
+    for i in range(REPEAT):
+        stdin = open(stdinfile, "r") if stdinfile else None
+        start = time.time()
+        subprocess.call([kumirutils.binary_path("kumir2-run"), kodfile],
+                        stdin=stdin,
+                        stdout=open(os.devnull, "w"))
+        elapsed = time.time()-start
+        if stdin:
+            stdin.close()
+        if best is None or elapsed<best:
+            best = elapsed
+    return best
+
+
+if __name__=="__main__":
+    dirname = tempfile.mkdtemp()
+    try:
+        datafile = make_data(dirname)
+        benchmarks = [("read file", read_file_program(datafile), None),
+                      ("read stdin", read_stdin_program(), datafile),
+                      ("write stdout", write_stdout_program(), None),
+                      ("write file", write_file_program(os.path.join(dirname, "out.txt")), None)]
+        sys.stdout.write("%-12s %10s %10s\n" % ("benchmark", "count", "time, s"))
+        for name, lines, stdinfile in benchmarks:
+            elapsed = measure(dirname, lines, stdinfile)
+            sys.stdout.write("%-12s %10d %10.3f\n" % (name, COUNT, elapsed))
+    finally:
+        shutil.rmtree(dirname)
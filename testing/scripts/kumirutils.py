@@ -65,13 +65,23 @@ class CompileError:
         s += "T: "+self.text
         return s
     
-def __binary_path(util):
+def binary_path(util):
     "Returns absolute file path to execuable"
     res = KUMIR_DIR+os.path.sep+"bin"+os.path.sep+util
     if os.name=="nt":
         res += ".exe"
     return res
 
+def bc_path():
+    "Returns absolute file path to bytecode compiler"
+    return binary_path("kumir2-bc")
+
+def write_lines(file_name, lines):
+    "Writes unicode lines to file in UTF-8"
+    f = open(file_name, "wb")
+    f.write((u"\n".join(lines)+u"\n").encode("utf-8"))
+    f.close()
+
 def __run_util(args):
     "Starts a process and returns what process returns"
     sys.stderr.write("Starting "+str(args)+"\n")
@@ -125,7 +135,7 @@ def __run_program(args, indata):
 
 def compile_to_bytecode(kumfile):
     "Compiles a kumir program file into kumir bytecode file"
-    out, errors = __run_util([__binary_path("kumir2-bc"), kumfile])
+    out, errors = __run_util([binary_path("kumir2-bc"), kumfile])
     #print "out=", out
     #print "errors.text=", str(errors)
     errors = filter(lambda x: x.startswith("Error: "), errors)
@@ -133,13 +143,13 @@ def compile_to_bytecode(kumfile):
 
 def compile_to_native(kumfile):
     "Compiles a kumir program file into native execuable file"
-    out, errors = __run_util([__binary_path("kumir2-cc"), kumfile])
+    out, errors = __run_util([binary_path("kumir2-cc"), kumfile])
     errors = filter(lambda x: x.startswith("Error: "), errors)
     return map(lambda x: CompileError(x), errors)
 
 def run_bytecode(kodfile, indata):
     "Evaluates kumir bytecode and returns output, then input"
-    return __run_program([__binary_path("kumir2-run"), "-p", kodfile], indata)
+    return __run_program([binary_path("kumir2-run"), "-p", kodfile], indata)
 
 def print_usage_and_exit(errcode):
     sys.stderr.write("""Usage:
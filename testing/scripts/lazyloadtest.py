@@ -0,0 +1,76 @@
+# coding=UTF-8
+
+# Checks loading of large Kumir module by kumir2-run: program uses two
+# of many module algorithms, which must give right results while the rest
+# of module is never decoded. Prints times of compilation and execution.
+# Usage:
+#    lazyloadtest.py [--kumirdir=KUMIR_DIR] [SIZE]
+
+import sys
+import os
+import os.path
+import shutil
+import subprocess
+import tempfile
+import time
+import kumirutils
+
+SIZE = 2000
+sizes = [int(arg) for arg in sys.argv[1:] if arg.isdigit()]
+if len(sizes)>0:
+    SIZE = sizes[0]
+
+
+def library(size):
+    lines = [u"алг", u"нач", u"кон"]
+    for i in range(1, size+1):
+        lines += [u"алг цел ф%d(цел a)" % i,
+                  u"нач",
+                  u"цел b; b := a",
+                  u"нц 3 раз b := b + 1 кц",
+                  u"знач := b - 3 + %d" % i,
+                  u"кон"]
+    return lines
+
+
+def program(size):
+    return [u"использовать \"library.kum\"",
+            u"алг",
+            u"нач",
+            u"вывод ф1(1), \" \", ф%d(2), нс" % size,
+            u"кон"]
+
+
+def timed_call(args):
+    start = time.time()
+    proc = subprocess.Popen(args, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    out, err = proc.communicate()
+    return proc.returncode, out, time.time()-start
+
+
+if __name__=="__main__":
+    work_dir = tempfile.mkdtemp()
+    os.environ["KUMIR2_BYTECODE_CACHE_DIR"] = ""
+    failed = False
+    try:
+        libfile = work_dir+os.path.sep+"library.kum"
+        kumfile = work_dir+os.path.sep+"program.kum"
+        kumirutils.write_lines(libfile, library(SIZE))
+        kumirutils.write_lines(kumfile, program(SIZE))
+        expected = ("2 %d" % (2+SIZE)).encode("ascii")
+        steps = [
+            ("compile library", [kumirutils.binary_path("kumir2-bc"), libfile]),
+            ("compile program", [kumirutils.binary_path("kumir2-bc"), kumfile]),
+            ("run program", [kumirutils.binary_path("kumir2-run"), kumfile[0:-4]+".kod"]),
+        ]
+        sys.stdout.write("%-20s %8s %10s %8s\n" % ("step", "status", "time, s", "result"))
+        for name, args in steps:
+            status, out, elapsed = timed_call(args)
+            ok = status==0
+            if name=="run program":
+                ok = ok and out.strip()==expected
+            sys.stdout.write("%-20s %8d %10.3f %8s\n" % (name, status, elapsed, "OK" if ok else "FAIL"))
+            failed = failed or not ok
+    finally:
+        shutil.rmtree(work_dir)
+    sys.exit(1 if failed else 0)
@@ -0,0 +1,101 @@
+# coding=UTF-8
+
+# Measures lexer throughput of kumir2-bc on generated programs with long
+# lines. Each program is compiled twice: as is and with the same lines
+# turned into comments (each comment is a single lexem), so the difference
+# is time of processing these lines, which is dominated by splitting long
+# lines into lexems. Lines of "words" program are not valid statements,
+# they are still lexed completely.
+# Usage:
+#    lexbench.py [--kumirdir=KUMIR_DIR] [--repeat=N] [SIZE ...]
+
+import sys
+import os
+import os.path
+import subprocess
+import tempfile
+import time
+import kumirutils
+
+REPEAT = 3
+for arg in sys.argv:
+    if arg.startswith("--repeat="):
+        REPEAT = int(arg[len("--repeat="):])
+
+SIZES = [1000, 5000]
+sizes = [int(arg) for arg in sys.argv[1:] if arg.isdigit()]
+if len(sizes)>0:
+    SIZES = sizes
+
+
+def expressions_lines(size):
+    "Long expressions full of operators and keywords"
+    lines = []
+    for i in range(size):
+        terms = [u"(x%d + %d) * y - z ** 2 / 3" % (i % 10, j) for j in range(6)]
+        lines += [u"если " + u" + ".join(terms) + u" >= %d и не (x0 <> y) или z <= 1 то y := x0 иначе y := 0 все" % i]
+    return lines
+
+
+def literals_lines(size):
+    "Outputs of string literals containing operator characters"
+    lines = []
+    for i in range(size):
+        lines += [u"вывод \"строка %d: a+b*(c-d) := если то иначе\", 'x', \"нц кц\", нс" % i]
+    return lines
+
+
+def words_lines(size):
+    "Long identifiers that look like keywords"
+    lines = []
+    for i in range(size):
+        lines += [u"y := длинное имя переменной если%d + целое имя нцкц%d + знач иначе%d" % (i, i, i)]
+    return lines
+
+
+def program(lines, commented):
+    prefix = u"| " if commented else u""
+    result = [u"алг", u"нач", u"цел x0, x1, x2, x3, x4, x5, x6, x7, x8, x9, y, z"]
+    result += [prefix + line for line in lines]
+    result += [u"кон"]
+    return result
+
+
+def measure(lines):
+    fd, kumfile = tempfile.mkstemp(suffix=".kum")
+    os.write(fd, (u"\n".join(lines)+u"\n").encode("utf-8"))
+    os.close(fd)
+    best = None
+    try:
+        for i in range(REPEAT):
+            start = time.time()
+            subprocess.call([kumirutils.bc_path(), kumfile],
+                            stdout=open(os.devnull, "w"),
+                            stderr=open(os.devnull, "w"))
+            elapsed = time.time()-start
+            if best is None or elapsed<best:
+                best = elapsed
+    finally:
+        os.remove(kumfile)
+        kodfile = kumfile[0:-4]+".kod"
+        if os.path.exists(kodfile):
+            os.remove(kodfile)
+    return best
+
+
+if __name__=="__main__":
+    generators = [("expressions", expressions_lines),
+                  ("literals", literals_lines),
+                  ("words", words_lines)]
+    sys.stdout.write("%-12s %8s %10s %10s %10s %12s\n" %
+                     ("program", "lines", "chars", "time, s", "base, s", "lexing, KB/s"))
+    for name, generator in generators:
+        for size in SIZES:
+            lines = generator(size)
+            chars = sum([len(line) for line in lines])
+            elapsed = measure(program(lines, False))
+            base = measure(program(lines, True))
+            lexing = elapsed - base
+            speed = chars / 1024.0 / lexing if lexing>0 else float("inf")
+            sys.stdout.write("%-12s %8d %10d %10.3f %10.3f %12.1f\n" %
+                             (name, size, chars, elapsed, base, speed))
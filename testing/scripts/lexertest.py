@@ -0,0 +1,62 @@
+# coding=UTF-8
+
+# Checks splitting of lines into lexems by kumir2-bc for whitespace inside
+# compound keywords: any whitespace, including tabs, separates parts of
+# keywords like 'кц при'. Each program is compiled and run, output must
+# be the expected one.
+# Usage:
+#    lexertest.py [--kumirdir=KUMIR_DIR]
+
+import sys
+import os
+import os.path
+import shutil
+import subprocess
+import tempfile
+import kumirutils
+
+
+def program(loop_end):
+    return [u"алг",
+            u"нач",
+            u"цел i",
+            u"i := 0",
+            u"нц",
+            u"i := i + 1",
+            loop_end + u" i >= 3",
+            u"вывод i, нс",
+            u"кон"]
+
+
+CASES = [("space", u"кц при"),
+         ("tab", u"кц\tпри"),
+         ("spaces and tab", u"кц \t  при"),
+         ("underscore", u"кц_при")]
+
+
+if __name__=="__main__":
+    work_dir = tempfile.mkdtemp()
+    os.environ["KUMIR2_BYTECODE_CACHE_DIR"] = ""
+    failed = False
+    try:
+        for name, loop_end in CASES:
+            kumfile = work_dir+os.path.sep+"program.kum"
+            kumirutils.write_lines(kumfile, program(loop_end))
+            proc = subprocess.Popen([kumirutils.bc_path(), kumfile],
+                                    stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+            out, err = proc.communicate()
+            errors = [line for line in err.decode(kumirutils.SYSTEMENCODING, "replace").split("\n")
+                      if line.startswith("Error: ")]
+            out = b""
+            if not errors:
+                proc = subprocess.Popen([kumirutils.binary_path("kumir2-run"), "-p", kumfile[0:-4]+".kod"],
+                                        stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+                out, err = proc.communicate()
+            ok = not errors and out.replace(b"\r\n", b"\n")==b"3\n"
+            sys.stdout.write("%-16s %s\n" % (name, "OK" if ok else "FAIL"))
+            for error in errors:
+                sys.stdout.write("    %s\n" % error)
+            failed = failed or not ok
+    finally:
+        shutil.rmtree(work_dir)
+    sys.exit(1 if failed else 0)
@@ -0,0 +1,104 @@
+# coding=UTF-8
+
+# Checks optimization of programs made by kumir2-bc: program compiled
+# without optimization (-O=0) and with all optimizations (-O=1 -g=0)
+# must give the same output and exit status, including runtime errors.
+# Prints times of execution.
+# Usage:
+#    optimizetest.py [--kumirdir=KUMIR_DIR] [SIZE]
+
+import sys
+import os
+import os.path
+import shutil
+import subprocess
+import tempfile
+import time
+import kumirutils
+
+SIZE = 200000
+sizes = [int(arg) for arg in sys.argv[1:] if arg.isdigit()]
+if len(sizes)>0:
+    SIZE = sizes[0]
+
+
+def constants_program():
+    "Folded constants, dead branches and code after exit"
+    return [u"алг",
+            u"нач",
+            u"цел x; вещ r; лит s",
+            u"x := 2 + 3 * 4 - 10",
+            u"r := 1 / 4 + 0.5",
+            u"s := \"аб\" + 'в' + \"где\"",
+            u"если 2 > 1 и да то вывод \"да\", нс иначе вывод \"нет\", нс все",
+            u"если 2 < 1 то вывод \"нет\", нс все",
+            u"нц пока нет",
+            u"вывод \"никогда\", нс",
+            u"кц",
+            u"вывод x, \" \", r, \" \", s, нс",
+            u"выход",
+            u"вывод \"после выхода\", нс",
+            u"кон"]
+
+
+def overflow_program():
+    "Overflow in constant expression must be a runtime error"
+    return [u"алг",
+            u"нач",
+            u"вывод \"начало\", нс",
+            u"вывод 2147483647 + 1, нс",
+            u"кон"]
+
+
+def loop_program(size):
+    "Loop condition uses length of unchanged string"
+    return [u"алг",
+            u"нач",
+            u"лит s; цел i, n",
+            u"s := \"\"",
+            u"нц для i от 1 до %d" % size,
+            u"s := s + \"a\"",
+            u"кц",
+            u"i := 0; n := 0",
+            u"нц пока i < длин(s)",
+            u"i := i + 1",
+            u"если mod(i, 7) = 0 то n := n + 1 все",
+            u"кц",
+            u"вывод n, нс",
+            u"кон"]
+
+
+def run(dirname, name, lines, options):
+    kumfile = os.path.join(dirname, name+".kum")
+    kumirutils.write_lines(kumfile, lines)
+    subprocess.call([kumirutils.binary_path("kumir2-bc")] + options + [kumfile],
+                    stdout=open(os.devnull, "w"),
+                    stderr=open(os.devnull, "w"))
+    kodfile = kumfile[0:-4]+".kod"
+    start = time.time()
+    proc = subprocess.Popen([kumirutils.binary_path("kumir2-run"), kodfile],
+                            stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    out, err = proc.communicate()
+    elapsed = time.time()-start
+    os.remove(kodfile)
+    return proc.returncode, out, elapsed
+
+
+if __name__=="__main__":
+    dirname = tempfile.mkdtemp()
+    os.environ["KUMIR2_BYTECODE_CACHE_DIR"] = ""
+    failed = False
+    try:
+        programs = [("constants", constants_program()),
+                    ("overflow", overflow_program()),
+                    ("loop", loop_program(SIZE))]
+        sys.stdout.write("%-12s %10s %10s %8s\n" % ("program", "-O=0, s", "-O=1, s", "result"))
+        for name, lines in programs:
+            status0, out0, time0 = run(dirname, name, lines, ["-O=0"])
+            status1, out1, time1 = run(dirname, name, lines, ["-O=1", "-g=0"])
+            ok = status0==status1 and out0==out1
+            sys.stdout.write("%-12s %10.3f %10.3f %8s\n" % (name, time0, time1, "OK" if ok else "FAIL"))
+            failed = failed or not ok
+    finally:
+        shutil.rmtree(dirname)
+    sys.exit(1 if failed else 0)
@@ -3,10 +3,14 @@
 import sys
 import os
 import os.path
+import subprocess
 import kumirutils
 
 DIRS = ["tErrors"]
 
+# Standalone test scripts, each exits with non-zero status on failure
+SCRIPTS = ["bccachetest.py", "optimizetest.py", "lazyloadtest.py", "sessionstest.py", "lexertest.py"]
+
 def find_differences_in_compile_errors(fullname, old, new):
     for oe in old:
         line = oe.line
@@ -87,7 +91,22 @@ def process_dir(name):
         fullname = name + os.path.sep + fn
         process_file(fullname, fn)
 
+def run_script(name):
+    "Runs test script from this directory and returns True if it passed"
+    script = os.path.dirname(os.path.abspath(__file__))+os.path.sep+name
+    sys.stdout.write("Script: "+name+"\n")
+    status = subprocess.call([sys.executable, script, "--kumirdir="+kumirutils.KUMIR_DIR])
+    if status!=0:
+        sys.stdout.write("FAILED: "+name+"\n")
+        sys.stdout.write("===========\n")
+    return status==0
+
 if __name__=="__main__":
     for d in DIRS:
         process_dir(d)
+    failed = False
+    for s in SCRIPTS:
+        if not run_script(s):
+            failed = True
+    sys.exit(1 if failed else 0)
 
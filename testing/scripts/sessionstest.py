@@ -0,0 +1,73 @@
+# coding=UTF-8
+
+# Checks running of many copies of program by kumir2-run --sessions: copies
+# wait for input and in 'ждать' without taking worker threads, and each copy
+# has its own memory limit. Prints time of execution.
+# Usage:
+#    sessionstest.py [--kumirdir=KUMIR_DIR] [SESSIONS]
+
+import sys
+import os
+import os.path
+import shutil
+import subprocess
+import tempfile
+import time
+import kumirutils
+
+SESSIONS = 8
+WORKERS = 2
+DELAY = 500 # msec
+sizes = [int(arg) for arg in sys.argv[1:] if arg.isdigit()]
+if len(sizes)>0:
+    SESSIONS = sizes[0]
+
+
+def program():
+    # String of 128K characters is less than 1 MB limit of each copy,
+    # but all copies hold their strings together while waiting
+    return [u"алг",
+            u"нач",
+            u"цел n",
+            u"лит s",
+            u"ввод n",
+            u"s := \"ab\"",
+            u"нц 16 раз s := s + s кц",
+            u"ждать(%d)" % DELAY,
+            u"вывод n*2, \" \", длин(s), нс",
+            u"кон"]
+
+
+if __name__=="__main__":
+    work_dir = tempfile.mkdtemp()
+    os.environ["KUMIR2_BYTECODE_CACHE_DIR"] = ""
+    failed = False
+    try:
+        kumfile = work_dir+os.path.sep+"program.kum"
+        kumirutils.write_lines(kumfile, program())
+        subprocess.call([kumirutils.bc_path(), kumfile],
+                        stdout=open(os.devnull, "w"),
+                        stderr=open(os.devnull, "w"))
+        start = time.time()
+        proc = subprocess.Popen([kumirutils.binary_path("kumir2-run"),
+                                 "--sessions=%d" % SESSIONS,
+                                 "--workers=%d" % WORKERS,
+                                 "--memory-limit=1",
+                                 kumfile[0:-4]+".kod"],
+                                stdin=subprocess.PIPE, stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        out, err = proc.communicate(b"7\n")
+        elapsed = time.time()-start
+        # Copies taking workers while waiting would need
+        # SESSIONS/WORKERS delays one after another
+        serial = SESSIONS*DELAY/1000.0/WORKERS
+        expected = b"14 131072\n"*SESSIONS
+        ok = proc.returncode==0 and out.replace(b"\r\n", b"\n")==expected
+        sys.stdout.write("%-10s %8s %10s %10s %8s\n" % ("sessions", "status", "time, s", "serial, s", "result"))
+        sys.stdout.write("%-10d %8d %10.3f %10.3f %8s\n" % (SESSIONS, proc.returncode, elapsed, serial,
+                                                          "OK" if ok and elapsed<serial*0.75 else "FAIL"))
+        failed = not ok or elapsed>=serial*0.75
+        if proc.returncode!=0:
+            sys.stdout.write(err.decode(kumirutils.SYSTEMENCODING, "replace"))
+    finally:
+        shutil.rmtree(work_dir)
+    sys.exit(1 if failed else 0)
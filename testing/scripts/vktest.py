@@ -0,0 +1,241 @@
+# coding=UTF-8
+
+# Tests VK actor against local mock of VK API and long poll servers.
+# The program authorizes, sends a message, starts listening and waits
+# for a message, which the mock delivers by long poll. The mock checks
+# sent parameters and counts TCP connections, so the test also fails
+# when requests do not reuse keep-alive connections.
+# Then the mock answers as for user token with replies of unexpected shape
+# (failed calls of batch, mistyped events) and, finally, with long poll
+# reply which is not an object: the actor must skip broken parts or report
+# an error to the program instead of crashing.
+# Usage:
+#    vktest.py [--kumirdir=KUMIR_DIR]
+#    vktest.py --serve[=PORT]     only run mock server
+
+import sys
+import os
+import os.path
+import json
+import shutil
+import subprocess
+import tempfile
+import threading
+import time
+import kumirutils
+
+try:
+    from http.server import BaseHTTPRequestHandler, HTTPServer
+    from socketserver import ThreadingMixIn
+    from urllib.parse import urlparse, parse_qs
+except ImportError:
+    from BaseHTTPServer import BaseHTTPRequestHandler, HTTPServer
+    from SocketServer import ThreadingMixIn
+    from urlparse import urlparse, parse_qs
+
+GROUP_ID = 1001
+PEER_ID = 42
+INCOMING_TEXT = u"входящее сообщение"
+OUTGOING_TEXT = u"привет"
+
+
+class MockState:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.connections = 0
+        self.sent = []
+        self.errors = []
+        self.delivered = False
+        self.mode = "group"
+
+
+class MockHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def setup(self):
+        BaseHTTPRequestHandler.setup(self)
+        with self.server.state.lock:
+            self.server.state.connections += 1
+
+    def log_message(self, format, *args):
+        pass
+
+    def reply(self, value):
+        body = json.dumps(value).encode("utf-8")
+        self.send_response(200)
+        self.send_header("Content-Type", "application/json; charset=utf-8")
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def params(self):
+        url = urlparse(self.path)
+        query = url.query
+        if self.command == "POST":
+            length = int(self.headers.get("Content-Length", "0"))
+            query = self.rfile.read(length).decode("utf-8")
+        return url.path, dict((k, v[0]) for k, v in parse_qs(query).items())
+
+    def do_GET(self):
+        self.handle_request()
+
+    def do_POST(self):
+        self.handle_request()
+
+    def handle_request(self):
+        path, params = self.params()
+        state = self.server.state
+        if path == "/lp":
+            self.reply(self.long_poll(params))
+            return
+        method = path[len("/method/"):]
+        if params.get("access_token") != "token" or params.get("v") is None:
+            self.reply({"error": {"error_code": 5, "error_msg": "User authorization failed"}})
+        elif method == "execute":
+            code = params.get("code", "")
+            results = []
+            if state.mode == "group" and "API.groups.getById" in code:
+                results += [[{"id": GROUP_ID, "name": "test"}]]
+            elif "API.groups.getById" in code:
+                # Failed call of batch is false in place of its result
+                results += [False]
+            if state.mode == "group" and "API.users.get" in code:
+                results += [[]]
+            elif "API.users.get" in code:
+                results += [[{"id": PEER_ID+1, "first_name": "test"}]]
+            results += [False] * code.count("API.messages.getById")
+            self.reply({"response": results})
+        elif method == "groups.getLongPollServer":
+            if params.get("group_id") != str(GROUP_ID):
+                state.errors += ["wrong group_id: %s" % params.get("group_id")]
+            self.reply({"response": {"server": "http://%s:%d/lp" % self.server.server_address,
+                                     "key": "lpkey", "ts": "1"}})
+        elif method == "messages.getLongPollServer":
+            self.reply({"response": {"server": "http://%s:%d/lp" % self.server.server_address,
+                                     "key": "lpkey", "ts": 1}})
+        elif method == "messages.send":
+            with state.lock:
+                state.sent += [params]
+            self.reply({"response": len(state.sent)})
+        else:
+            self.reply({"error": {"error_code": 3, "error_msg": "Unknown method passed"}})
+
+    def long_poll(self, params):
+        state = self.server.state
+        if params.get("act") != "a_check" or params.get("key") != "lpkey":
+            return {"failed": 2}
+        with state.lock:
+            delivered = state.delivered
+            state.delivered = True
+        if delivered:
+            # Like the real server, hold request until timeout,
+            # so stopping the actor must abort it
+            time.sleep(int(params.get("wait", "0")))
+            return {"ts": params.get("ts"), "updates": []}
+        if state.mode == "broken":
+            return [1, 2]
+        if state.mode == "malformed":
+            # More than 100 new messages are requested by execute batch
+            events = [[4, 100+i, 0, PEER_ID, 1, INCOMING_TEXT, {}] for i in range(101)]
+            return {"ts": 2, "updates": ["x", 5, [], [4, "id", "flags"], {"type": 1}] + events}
+        message = {"id": 7, "date": 1, "peer_id": PEER_ID, "from_id": PEER_ID, "text": INCOMING_TEXT}
+        return {"ts": str(int(params.get("ts", "1")) + 1),
+                "updates": [{"type": "message_new", "object": {"message": message}, "group_id": GROUP_ID}]}
+
+
+class MockServer(ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+    def __init__(self, port=0):
+        HTTPServer.__init__(self, ("127.0.0.1", port), MockHandler)
+        self.state = MockState()
+
+
+def test_program():
+    return [u"использовать ВК",
+            u"использовать _Сообщение",
+            u"алг",
+            u"нач",
+            u"сообщениетаб полученные[0:0]",
+            u"авторизация(\"token\")",
+            u"Отправить сообщение(Создать сообщение(\"%s\", %d))" % (OUTGOING_TEXT, PEER_ID),
+            u"Запустить прослушивание",
+            u"нц пока не Есть сообщения",
+            u"кц",
+            u"Получить сообщения(полученные)",
+            u"Остановить прослушивание",
+            u"вывод \"получено\", нс",
+            u"кон"]
+
+
+def run_program(server):
+    dirname = tempfile.mkdtemp()
+    try:
+        kumfile = os.path.join(dirname, "program.kum")
+        kumirutils.write_lines(kumfile, test_program())
+        subprocess.call([kumirutils.bc_path(), kumfile])
+        proc = subprocess.Popen([kumirutils.binary_path("kumir2-run"),
+                                 "--vkapi=http://%s:%d" % server.server_address,
+                                 kumfile[0:-4]+".kod"],
+                                stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+        out, err = proc.communicate()
+    finally:
+        shutil.rmtree(dirname)
+    return proc.returncode, out.decode("utf-8"), err.decode("utf-8")
+
+
+def run_malformed_test(server):
+    errors = []
+    server.state.mode = "malformed"
+    server.state.delivered = False
+    code, out, err = run_program(server)
+    if u"получено" not in out:
+        errors += ["message is not received from malformed reply (%d): %s" % (code, err)]
+    server.state.mode = "broken"
+    server.state.delivered = False
+    code, out, err = run_program(server)
+    # Negative code means the process is killed by signal
+    if code <= 0 or u"Ошибка получения сообщений" not in out+err:
+        errors += ["broken long poll reply is not reported (%d): %s" % (code, err)]
+    return errors
+
+
+def run_test(server):
+    code, out, err = run_program(server)
+    state = server.state
+    errors = list(state.errors)
+    if u"получено" not in out:
+        errors += ["message is not received: " + err]
+    if len(state.sent) != 1:
+        errors += ["expected 1 sent message, got %d" % len(state.sent)]
+    else:
+        sent = state.sent[0]
+        if sent.get("peer_id") != str(PEER_ID) or sent.get("message") != OUTGOING_TEXT:
+            errors += ["wrong message sent: %s" % sent]
+        if not sent.get("random_id"):
+            errors += ["message sent without random_id"]
+    # One connection for API calls and one for long polling,
+    # which waits in parallel with the program
+    if state.connections > 2:
+        errors += ["connections are not reused: %d connections" % state.connections]
+    return errors
+
+
+if __name__=="__main__":
+    serve = [arg for arg in sys.argv if arg.startswith("--serve")]
+    if serve:
+        port = int(serve[0][len("--serve="):]) if "=" in serve[0] else 8080
+        server = MockServer(port)
+        sys.stderr.write("Serving VK mock at http://%s:%d\n" % server.server_address)
+        server.serve_forever()
+    server = MockServer()
+    thread = threading.Thread(target=server.serve_forever)
+    thread.daemon = True
+    thread.start()
+    errors = run_test(server)
+    errors += run_malformed_test(server)
+    server.shutdown()
+    for error in errors:
+        sys.stderr.write(error+"\n")
+    sys.stdout.write("FAILED\n" if errors else "PASSED\n")
+    sys.exit(1 if errors else 0)